@@ -0,0 +1,36 @@
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+// Runs f repeat times and returns the fastest run in milliseconds.
+// The minimum is less sensitive to noise than the mean for short workloads.
+template <typename F> double best_of(int repeat, F f) {
+  double best = 1e300;
+  for (int i = 0; i < repeat; i++) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto stop = std::chrono::steady_clock::now();
+    best = std::min(
+        best, std::chrono::duration<double, std::milli>(stop - start).count());
+  }
+  return best;
+}
+
+inline void report(const char *name, double ms) {
+  std::printf("%-40s %10.3f ms\n", name, ms);
+}
+
+// Prints the number of instructions dispatched by a run, which are only
+// counted in builds configured with -DWINTERP_COUNT_DISPATCH=ON
+inline void report_dispatches(uint64_t count) {
+  if (count != 0) {
+    std::printf("%-40s %10llu\n", "  dispatches",
+                static_cast<unsigned long long>(count));
+  }
+}
+
+#endif // BENCH_HPP
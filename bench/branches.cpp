@@ -0,0 +1,275 @@
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "bench.hpp"
+#include "runtime.hpp"
+#include "sections.hpp"
+#include "wasm_builder.hpp"
+
+// Deeply nested loops with blocks and early exits.
+// Every iteration of the innermost loop branches backwards over its whole
+// body, and the middle loop leaves three nested blocks with a br_if, which
+// makes this workload dominated by branch resolution cost.
+
+const int N = 100;
+
+static uint32_t expected_result() {
+  uint32_t acc = 0;
+  for (uint32_t i = 0; i < N; i++) {
+    for (uint32_t j = 0; j < N; j++) {
+      for (uint32_t k = 0; k < N; k++) {
+        acc = (acc + k * 3) ^ j;
+        acc = (k & 1) ? acc + 1 : acc - 1;
+      }
+      if ((j & 1) == 0) {
+        acc += i;
+      }
+    }
+  }
+  return acc;
+}
+
+static Bytes nested_loops_body() {
+  const uint32_t i = 0, j = 1, k = 2, acc = 3;
+
+  Bytes padding;
+  for (int p = 0; p < 16; p++) {
+    padding = concat({padding, op_u(0x20, acc), i32_const(0), op(0x6a),
+                      op_u(0x21, acc)});
+  }
+
+  Bytes inner_loop = concat({
+      op_u(0x03, 0x40), // loop
+      op_u(0x20, acc), op_u(0x20, k), i32_const(3), op(0x6c), op(0x6a),
+      op_u(0x20, j), op(0x73), op_u(0x21, acc),
+      op_u(0x20, acc), i32_const(1), op(0x6a), // acc + 1
+      op_u(0x20, acc), i32_const(1), op(0x6b), // acc - 1
+      op_u(0x20, k), i32_const(1), op(0x71), op(0x1b), op_u(0x21, acc),
+      op_u(0x20, k), i32_const(1), op(0x6a), op_u(0x22, k), i32_const(N),
+      op(0x49), op_u(0x0d, 0), // br_if inner loop
+      op(0x0b),
+  });
+
+  Bytes middle_loop = concat({
+      op_u(0x03, 0x40), // loop
+      i32_const(0), op_u(0x21, k),
+      op_u(0x02, 0x40), // block
+      op_u(0x02, 0x40), // block
+      op_u(0x02, 0x40), // block
+      inner_loop,
+      op_u(0x20, j), i32_const(1), op(0x71), op_u(0x0d, 2), // leave blocks
+      padding,
+      op(0x0b),
+      padding,
+      op(0x0b),
+      op_u(0x20, acc), op_u(0x20, i), op(0x6a), op_u(0x21, acc),
+      op(0x0b),
+      op_u(0x20, j), i32_const(1), op(0x6a), op_u(0x22, j), i32_const(N),
+      op(0x49), op_u(0x0d, 0), // br_if middle loop
+      op(0x0b),
+  });
+
+  return concat({
+      op_u(0x03, 0x40), // loop
+      i32_const(0), op_u(0x21, j),
+      middle_loop,
+      op_u(0x20, i), i32_const(1), op(0x6a), op_u(0x22, i), i32_const(N),
+      op(0x49), op_u(0x0d, 0), // br_if outer loop
+      op(0x0b),
+      i32_const(0), op_u(0x20, acc), mem_op(0x36, 2, 0),
+  });
+}
+
+// A loop which leaves a large block on almost every iteration. The skipped
+// instructions are never executed, but searching for the end of the block is
+// proportional to its size.
+const int EARLY_EXIT_ITERATIONS = 200000;
+
+static Bytes early_exit_body() {
+  const uint32_t i = 0, acc = 1;
+
+  Bytes skipped;
+  for (int p = 0; p < 64; p++) {
+    skipped = concat({skipped, op_u(0x20, acc), i32_const(p), op(0x6a),
+                      op_u(0x21, acc)});
+  }
+
+  return concat({
+      op_u(0x03, 0x40), // loop
+      op_u(0x02, 0x40), // block
+      op_u(0x02, 0x40), // block
+      op_u(0x20, i), i32_const(15), op(0x71), op_u(0x0d, 1), // leave both
+      skipped,
+      op(0x0b),
+      op(0x0b),
+      op_u(0x20, acc), i32_const(1), op(0x6a), op_u(0x21, acc),
+      op_u(0x20, i), i32_const(1), op(0x6a), op_u(0x22, i),
+      i32_const(EARLY_EXIT_ITERATIONS), op(0x49), op_u(0x0d, 0),
+      op(0x0b),
+      i32_const(0), op_u(0x20, acc), mem_op(0x36, 2, 0),
+  });
+}
+
+static uint32_t expected_early_exit() {
+  uint32_t acc = 0;
+  for (uint32_t i = 0; i < EARLY_EXIT_ITERATIONS; i++) {
+    if ((i & 15) == 0) {
+      for (uint32_t p = 0; p < 64; p++) {
+        acc += p;
+      }
+    }
+    acc += 1;
+  }
+  return acc;
+}
+
+// The dispatch loop of a bytecode interpreter compiled to Wasm: a br_table
+// over one nested block per handler, each handler branching back to the
+// loop. Run with a small and a large table, a br_table takes the same time
+// independent of its number of targets and of the nesting depth.
+const int DISPATCH_ITERATIONS = 200000;
+
+const uint32_t DISPATCH_HANDLERS[] = {4, 128};
+
+static uint32_t handler_index(uint32_t i, uint32_t handlers) {
+  return (i * 7919) % handlers;
+}
+
+static uint32_t expected_dispatch(uint32_t handlers) {
+  uint32_t acc = 0;
+  for (uint32_t i = 1; i <= DISPATCH_ITERATIONS; i++) {
+    acc = acc * 3 + handler_index(i, handlers);
+  }
+  return acc;
+}
+
+static Bytes dispatch_body(uint32_t handlers) {
+  const uint32_t i = 0, acc = 1;
+
+  // br_table 0 1 ... handlers - 1, the last label is the default
+  Bytes blocks;
+  Bytes table = op_u(0x0e, handlers - 1);
+  for (uint32_t h = 0; h < handlers; h++) {
+    blocks = concat({blocks, op_u(0x02, 0x40)});
+    put_uleb(table, h);
+  }
+
+  Bytes handler_code;
+  for (uint32_t h = 0; h < handlers; h++) {
+    handler_code = concat({
+        handler_code, op(0x0b), // end of the block of handler h
+        op_u(0x20, acc), i32_const(3), op(0x6c), i32_const(h), op(0x6a),
+        op_u(0x21, acc),
+        op_u(0x0c, handlers - 1 - h), // br dispatch loop
+    });
+  }
+
+  return concat({
+      op_u(0x02, 0x40), // block exit
+      op_u(0x03, 0x40), // loop dispatch
+      op_u(0x20, i), i32_const(DISPATCH_ITERATIONS), op(0x4f),
+      op_u(0x0d, 1), // br_if exit
+      op_u(0x20, i), i32_const(1), op(0x6a), op_u(0x21, i),
+      blocks,
+      op_u(0x20, i), i32_const(7919), op(0x6c), i32_const(handlers), op(0x70),
+      table,
+      handler_code,
+      op(0x0b),
+      op(0x0b),
+      i32_const(0), op_u(0x20, acc), mem_op(0x36, 2, 0),
+  });
+}
+
+int main() {
+  WasmBuilder builder;
+  uint32_t type = builder.add_type({}, {});
+  uint32_t f = builder.add_function(type, {{4, 0x7F}}, nested_loops_body());
+  builder.add_export("nested_loops", f);
+  f = builder.add_function(type, {{2, 0x7F}}, early_exit_body());
+  builder.add_export("early_exit", f);
+  for (uint32_t handlers : DISPATCH_HANDLERS) {
+    f = builder.add_function(type, {{2, 0x7F}}, dispatch_body(handlers));
+    builder.add_export("dispatch_" + std::to_string(handlers), f);
+  }
+
+  const char *path = "bench_branches.wasm";
+  if (!builder.write(path)) {
+    std::fprintf(stderr, "unable to write %s\n", path);
+    return 1;
+  }
+
+  WasmFile wasm;
+  if (wasm.read(path) != 0) {
+    return 1;
+  }
+
+  for (Interpreter interpreter : {STACK_INTERPRETER, REGISTER_INTERPRETER}) {
+    bool registers = interpreter == REGISTER_INTERPRETER;
+
+    std::string func = "nested_loops";
+    uint32_t result = 0;
+    uint64_t dispatches = 0;
+    double ms = best_of(5, [&]() {
+      Runtime runtime(wasm, interpreter);
+      runtime.run(func);
+      result = runtime.read_memory(0, 0, ImmediateRepr::I32).v.n32;
+      dispatches = runtime.dispatch_count;
+    });
+
+    if (result != expected_result()) {
+      std::fprintf(stderr, "wrong result %u, expected %u\n", result,
+                   expected_result());
+      return 1;
+    }
+
+    report(registers ? "nested_loops, register code"
+                     : "nested_loops (1M inner iterations)",
+           ms);
+    report_dispatches(dispatches);
+
+    func = "early_exit";
+    ms = best_of(5, [&]() {
+      Runtime runtime(wasm, interpreter);
+      runtime.run(func);
+      result = runtime.read_memory(0, 0, ImmediateRepr::I32).v.n32;
+      dispatches = runtime.dispatch_count;
+    });
+
+    if (result != expected_early_exit()) {
+      std::fprintf(stderr, "wrong result %u, expected %u\n", result,
+                   expected_early_exit());
+      return 1;
+    }
+
+    report(registers ? "early_exit, register code"
+                     : "early_exit (200k iterations)",
+           ms);
+    report_dispatches(dispatches);
+
+    for (uint32_t handlers : DISPATCH_HANDLERS) {
+      func = "dispatch_" + std::to_string(handlers);
+      ms = best_of(5, [&]() {
+        Runtime runtime(wasm, interpreter);
+        runtime.run(func);
+        result = runtime.read_memory(0, 0, ImmediateRepr::I32).v.n32;
+        dispatches = runtime.dispatch_count;
+      });
+
+      if (result != expected_dispatch(handlers)) {
+        std::fprintf(stderr, "wrong result %u, expected %u\n", result,
+                     expected_dispatch(handlers));
+        return 1;
+      }
+
+      std::string name = "br_table, " + std::to_string(handlers) + " targets";
+      if (registers) {
+        name += ", register code";
+      }
+      report(name.c_str(), ms);
+      report_dispatches(dispatches);
+    }
+  }
+  std::remove(path);
+  return 0;
+}
@@ -0,0 +1,115 @@
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "runtime.hpp"
+#include "sections.hpp"
+#include "wasm_builder.hpp"
+
+// Throughput of the bulk memory instructions, each moving MIB bytes per
+// instruction ROUNDS times. The instructions are shared by all engines, so
+// only the stack interpreter runs them. Dispatch is negligible next to the
+// bytes moved, the times are those of the copies themselves.
+
+const uint32_t MIB = 1 << 20;
+const uint32_t ROUNDS = 16;
+// Size of the passive data segment, memory.init copies it MIB / SEGMENT times
+// per round
+const uint32_t SEGMENT = 64 * 1024;
+
+static Bytes fill(Bytes value) {
+  return concat({i32_const(0), value, i32_const(MIB), misc_op(11, {0})});
+}
+
+// Repeats body ROUNDS times, with the round in local 0
+static Bytes rounds(const Bytes &body) {
+  const uint32_t round = 0;
+  return concat({
+      op_u(0x03, 0x40), // loop
+      body,
+      op_u(0x20, round), i32_const(1), op(0x6a), op_u(0x22, round),
+      i32_const(ROUNDS), op(0x49), op_u(0x0d, 0), // br_if loop
+      op(0x0b),
+  });
+}
+
+int main() {
+  WasmBuilder builder;
+  builder.memory_pages = 2 * MIB / MEMORY_PAGE_SIZE;
+  Bytes segment(SEGMENT);
+  for (uint32_t i = 0; i < SEGMENT; i++) {
+    segment[i] = i;
+  }
+  uint32_t passive = builder.add_passive_data(segment);
+
+  Bytes init;
+  for (uint32_t offset = 0; offset < MIB; offset += SEGMENT) {
+    put_bytes(init, concat({i32_const(offset), i32_const(0),
+                            i32_const(SEGMENT), misc_op(8, {passive, 0})}));
+  }
+
+  struct Workload {
+    const char *name;
+    const char *function;
+    Bytes body;
+    // Checked after the run
+    uint32_t address;
+    uint32_t expected;
+  };
+  const Workload workloads[] = {
+      {"memory.fill (16 MiB)", "fill", rounds(fill(op_u(0x20, 0))), MIB - 1,
+       ROUNDS - 1},
+      {"memory.copy (16 MiB)", "copy",
+       concat({fill(i32_const(7)),
+               rounds(concat({i32_const(MIB), i32_const(0), i32_const(MIB),
+                              misc_op(10, {0, 0})}))}),
+       2 * MIB - 1, 7},
+      {"memory.copy overlapping (16 MiB)", "overlapping",
+       concat({fill(i32_const(7)),
+               rounds(concat({i32_const(1), i32_const(0), i32_const(MIB),
+                              misc_op(10, {0, 0})}))}),
+       MIB, 7},
+      {"memory.init (16 MiB)", "init", rounds(init), MIB - 1,
+       (SEGMENT - 1) & 0xFF},
+  };
+
+  uint32_t type = builder.add_type({}, {});
+  for (const Workload &workload : workloads) {
+    uint32_t f = builder.add_function(type, {{1, 0x7F}}, workload.body);
+    builder.add_export(workload.function, f);
+  }
+
+  const char *path = "bench_bulk_memory.wasm";
+  if (!builder.write(path)) {
+    std::fprintf(stderr, "unable to write %s\n", path);
+    return 1;
+  }
+
+  WasmFile wasm;
+  if (wasm.read(path) != 0) {
+    return 1;
+  }
+
+  for (const Workload &workload : workloads) {
+    std::string func = workload.function;
+    uint32_t result = 0;
+    double ms = best_of(5, [&]() {
+      Runtime runtime(wasm, STACK_INTERPRETER);
+      runtime.run(func);
+      result = runtime.read_memory(0, workload.address, ImmediateRepr::Byte)
+                   .v.n32;
+    });
+
+    if (result != workload.expected) {
+      std::fprintf(stderr, "%s: wrong result %u, expected %u\n", workload.name,
+                   result, workload.expected);
+      return 1;
+    }
+
+    report(workload.name, ms);
+  }
+  std::remove(path);
+  return 0;
+}
@@ -0,0 +1,138 @@
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "runtime.hpp"
+#include "sections.hpp"
+#include "wasm_builder.hpp"
+
+// Recursive fibonacci, which makes almost every fifth instruction a call.
+// This measures how expensive entering and leaving a function is.
+
+const int N = 25;
+
+static uint32_t fib(uint32_t n) { return n < 2 ? n : fib(n - 1) + fib(n - 2); }
+
+// Virtual dispatch: a loop calling one of METHODS small functions through the
+// function table on every iteration, like the method calls of a C++ or Rust
+// program compiled to Wasm. call_indirect names a second, identical copy of
+// their type, which only matches after the types are canonicalized.
+const int VIRTUAL_CALLS = 300000;
+const uint32_t METHODS = 8;
+
+static uint32_t method(uint32_t k, uint32_t x) {
+  return k % 2 == 0 ? x + k + 1 : x ^ (k * 0x9E37);
+}
+
+static uint32_t expected_virtual_calls() {
+  uint32_t acc = 0;
+  for (uint32_t i = 0; i < VIRTUAL_CALLS; i++) {
+    acc = method(i % METHODS, acc);
+  }
+  return acc;
+}
+
+static Bytes method_body(uint32_t k) {
+  if (k % 2 == 0) {
+    return concat({op_u(0x20, 0), i32_const(k + 1), op(0x6a)});
+  }
+  return concat({op_u(0x20, 0), i32_const(k * 0x9E37), op(0x73)});
+}
+
+static Bytes virtual_calls_body(uint32_t call_type) {
+  const uint32_t i = 0, acc = 1;
+  return concat({
+      op_u(0x03, 0x40), // loop
+      op_u(0x20, acc), op_u(0x20, i), i32_const(METHODS - 1), op(0x71),
+      op_u(0x11, call_type), Bytes{0x00}, // call_indirect of table 0
+      op_u(0x21, acc),
+      op_u(0x20, i), i32_const(1), op(0x6a), op_u(0x22, i),
+      i32_const(VIRTUAL_CALLS), op(0x49), op_u(0x0d, 0), // br_if loop
+      op(0x0b),
+      i32_const(0), op_u(0x20, acc), mem_op(0x36, 2, 0),
+  });
+}
+
+int main() {
+  WasmBuilder builder;
+  uint32_t fib_type = builder.add_type({0x7F}, {0x7F});
+  uint32_t entry_type = builder.add_type({}, {});
+
+  // if n < 2 then n else fib(n - 1) + fib(n - 2)
+  uint32_t f = builder.add_function(
+      fib_type, {},
+      concat({op_u(0x20, 0), i32_const(2), op(0x48), op_u(0x04, 0x7F),
+              op_u(0x20, 0), op(0x05), op_u(0x20, 0), i32_const(1), op(0x6b),
+              op_u(0x10, 0), op_u(0x20, 0), i32_const(2), op(0x6b),
+              op_u(0x10, 0), op(0x6a), op(0x0b)}));
+  uint32_t entry = builder.add_function(
+      entry_type, {},
+      concat({i32_const(0), i32_const(N), op_u(0x10, f), mem_op(0x36, 2, 0)}));
+  builder.add_export("fib", entry);
+
+  uint32_t call_type = builder.add_type({0x7F}, {0x7F});
+  std::vector<uint32_t> methods;
+  for (uint32_t k = 0; k < METHODS; k++) {
+    methods.push_back(builder.add_function(fib_type, {}, method_body(k)));
+  }
+  builder.set_table(methods);
+  uint32_t virtual_calls = builder.add_function(entry_type, {{2, 0x7F}},
+                                                virtual_calls_body(call_type));
+  builder.add_export("virtual_calls", virtual_calls);
+
+  const char *path = "bench_calls.wasm";
+  if (!builder.write(path)) {
+    std::fprintf(stderr, "unable to write %s\n", path);
+    return 1;
+  }
+
+  WasmFile wasm;
+  if (wasm.read(path) != 0) {
+    return 1;
+  }
+
+  for (Interpreter interpreter : {STACK_INTERPRETER, REGISTER_INTERPRETER}) {
+    bool registers = interpreter == REGISTER_INTERPRETER;
+
+    std::string func = "fib";
+    uint32_t result = 0;
+    uint64_t dispatches = 0;
+    double ms = best_of(5, [&]() {
+      Runtime runtime(wasm, interpreter);
+      runtime.run(func);
+      result = runtime.read_memory(0, 0, ImmediateRepr::I32).v.n32;
+      dispatches = runtime.dispatch_count;
+    });
+
+    if (result != fib(N)) {
+      std::fprintf(stderr, "wrong result %u, expected %u\n", result, fib(N));
+      return 1;
+    }
+
+    report(registers ? "fib(25), register code" : "fib(25)", ms);
+    report_dispatches(dispatches);
+
+    func = "virtual_calls";
+    ms = best_of(5, [&]() {
+      Runtime runtime(wasm, interpreter);
+      runtime.run(func);
+      result = runtime.read_memory(0, 0, ImmediateRepr::I32).v.n32;
+      dispatches = runtime.dispatch_count;
+    });
+
+    if (result != expected_virtual_calls()) {
+      std::fprintf(stderr, "wrong result %u, expected %u\n", result,
+                   expected_virtual_calls());
+      return 1;
+    }
+
+    report(registers ? "virtual_calls, register code"
+                     : "virtual_calls (300k call_indirect)",
+           ms);
+    report_dispatches(dispatches);
+  }
+  std::remove(path);
+  return 0;
+}
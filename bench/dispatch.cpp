@@ -0,0 +1,106 @@
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "bench.hpp"
+#include "runtime.hpp"
+#include "sections.hpp"
+#include "wasm_builder.hpp"
+
+// A tight loop of cheap integer and float arithmetic. Every instruction does
+// very little work, which makes this workload dominated by the cost of
+// dispatching from one instruction to the next.
+
+const int ITERATIONS = 300000;
+
+static uint32_t expected_result() {
+  uint32_t acc = 1;
+  float f = 0.0f;
+  for (uint32_t i = 0; i < ITERATIONS; i++) {
+    acc = (acc * 31 + i) ^ (i >> 3);
+    acc = acc - (i & 7) + ((acc << 1) | 1);
+    f = f + 1.5f;
+  }
+  return acc + static_cast<uint32_t>(static_cast<int32_t>(f));
+}
+
+static Bytes arithmetic_body() {
+  const uint32_t i = 0, acc = 1, f = 2;
+
+  return concat({
+      i32_const(1), op_u(0x21, acc),
+      op_u(0x03, 0x40), // loop
+      // acc = (acc * 31 + i) ^ (i >> 3)
+      op_u(0x20, acc), i32_const(31), op(0x6c), op_u(0x20, i), op(0x6a),
+      op_u(0x20, i), i32_const(3), op(0x76), op(0x73), op_u(0x21, acc),
+      // acc = acc - (i & 7) + ((acc << 1) | 1)
+      op_u(0x20, acc), op_u(0x20, i), i32_const(7), op(0x71), op(0x6b),
+      op_u(0x20, acc), i32_const(1), op(0x74), i32_const(1), op(0x72),
+      op(0x6a), op_u(0x21, acc),
+      // f = f + 1.5
+      op_u(0x20, f), op(0x43), Bytes{0x00, 0x00, 0xC0, 0x3F}, op(0x92),
+      op_u(0x21, f),
+      op_u(0x20, i), i32_const(1), op(0x6a), op_u(0x22, i),
+      i32_const(ITERATIONS), op(0x49), op_u(0x0d, 0), // br_if loop
+      op(0x0b),
+      i32_const(0), op_u(0x20, acc), op_u(0x20, f), op(0xA8), op(0x6a),
+      mem_op(0x36, 2, 0),
+  });
+}
+
+int main() {
+  WasmBuilder builder;
+  uint32_t type = builder.add_type({}, {});
+  uint32_t f =
+      builder.add_function(type, {{2, 0x7F}, {1, 0x7D}}, arithmetic_body());
+  builder.add_export("arithmetic", f);
+
+  const char *path = "bench_dispatch.wasm";
+  if (!builder.write(path)) {
+    std::fprintf(stderr, "unable to write %s\n", path);
+    return 1;
+  }
+
+  // With and without superinstructions, see fusion.hpp, and with register
+  // code, see registers.hpp
+  struct Mode {
+    const char *name;
+    bool superinstructions;
+    Interpreter interpreter;
+  };
+  const Mode modes[] = {
+      {"arithmetic (300k iterations)", true, STACK_INTERPRETER},
+      {"arithmetic, no superinstructions", false, STACK_INTERPRETER},
+      {"arithmetic, register code", true, REGISTER_INTERPRETER},
+  };
+
+  for (const Mode &mode : modes) {
+    WasmFile wasm;
+    wasm.superinstructions = mode.superinstructions;
+    if (wasm.read(path) != 0) {
+      return 1;
+    }
+
+    std::string func = "arithmetic";
+    uint32_t result = 0;
+    uint64_t dispatches = 0;
+    double ms = best_of(5, [&]() {
+      Runtime runtime(wasm, mode.interpreter);
+      runtime.run(func);
+      result = runtime.read_memory(0, 0, ImmediateRepr::I32).v.n32;
+      dispatches = runtime.dispatch_count;
+    });
+
+    if (result != expected_result()) {
+      std::fprintf(stderr, "wrong result %u, expected %u\n", result,
+                   expected_result());
+      return 1;
+    }
+
+    report(mode.name, ms);
+    report_dispatches(dispatches);
+  }
+
+  std::remove(path);
+  return 0;
+}
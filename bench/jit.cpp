@@ -0,0 +1,139 @@
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "runtime.hpp"
+#include "sections.hpp"
+#include "wasm_builder.hpp"
+
+// Compares the interpreters with the JIT compiler on compute bound code: a
+// sieve of Eratosthenes over the first page of memory, repeated a few times,
+// and the recursive fib of bench/calls.cpp.
+
+const uint32_t SIEVE_SIZE = 60000;
+const uint32_t SIEVE_ROUNDS = 20;
+const uint32_t FIB_N = 25;
+
+static uint32_t expected_primes() {
+  std::vector<uint8_t> composite(SIEVE_SIZE, 0);
+  uint32_t count = 0;
+  for (uint32_t i = 2; i < SIEVE_SIZE; i++) {
+    if (!composite[i]) {
+      count++;
+      for (uint32_t j = i * 2; j < SIEVE_SIZE; j += i) {
+        composite[j] = 1;
+      }
+    }
+  }
+  return count;
+}
+
+static uint32_t fib(uint32_t n) { return n < 2 ? n : fib(n - 1) + fib(n - 2); }
+
+// Counts the primes below SIEVE_SIZE SIEVE_ROUNDS times, marking composites
+// with one byte each, and stores the count of the last round at address 0
+static Bytes sieve_body() {
+  const uint32_t round = 0, i = 1, j = 2, count = 3;
+  return concat({
+      op_u(0x03, 0x40), // loop over rounds
+      // memory.fill(0, 0, SIEVE_SIZE)
+      i32_const(0), i32_const(0), i32_const(SIEVE_SIZE), Bytes{0xFC, 0x0B, 0x00},
+      i32_const(0), op_u(0x21, count), i32_const(2), op_u(0x21, i),
+      op_u(0x03, 0x40), // loop over i
+      op_u(0x20, i), mem_op(0x2D, 0, 0), op(0x45), op_u(0x04, 0x40),
+      op_u(0x20, count), i32_const(1), op(0x6a), op_u(0x21, count),
+      op_u(0x20, i), i32_const(1), op(0x74), op_u(0x21, j),
+      op_u(0x02, 0x40), op_u(0x03, 0x40), // while (j < SIEVE_SIZE)
+      op_u(0x20, j), i32_const(SIEVE_SIZE), op(0x4f), op_u(0x0d, 1),
+      op_u(0x20, j), i32_const(1), mem_op(0x3A, 0, 0),
+      op_u(0x20, j), op_u(0x20, i), op(0x6a), op_u(0x21, j), op_u(0x0c, 0),
+      op(0x0b), op(0x0b),
+      op(0x0b), // end if
+      op_u(0x20, i), i32_const(1), op(0x6a), op_u(0x22, i),
+      i32_const(SIEVE_SIZE), op(0x49), op_u(0x0d, 0),
+      op(0x0b),
+      op_u(0x20, round), i32_const(1), op(0x6a), op_u(0x22, round),
+      i32_const(SIEVE_ROUNDS), op(0x49), op_u(0x0d, 0),
+      op(0x0b),
+      i32_const(0), op_u(0x20, count), mem_op(0x36, 2, 0),
+  });
+}
+
+int main() {
+  WasmBuilder builder;
+  uint32_t fib_type = builder.add_type({0x7F}, {0x7F});
+  uint32_t entry_type = builder.add_type({}, {});
+
+  uint32_t sieve = builder.add_function(entry_type, {{4, 0x7F}}, sieve_body());
+  builder.add_export("sieve", sieve);
+
+  // if n < 2 then n else fib(n - 1) + fib(n - 2), fib is function 1
+  uint32_t f = builder.add_function(
+      fib_type, {},
+      concat({op_u(0x20, 0), i32_const(2), op(0x48), op_u(0x04, 0x7F),
+              op_u(0x20, 0), op(0x05), op_u(0x20, 0), i32_const(1), op(0x6b),
+              op_u(0x10, 1), op_u(0x20, 0), i32_const(2), op(0x6b),
+              op_u(0x10, 1), op(0x6a), op(0x0b)}));
+  uint32_t entry = builder.add_function(
+      entry_type, {},
+      concat({i32_const(0), i32_const(FIB_N), op_u(0x10, f),
+              mem_op(0x36, 2, 0)}));
+  builder.add_export("fib", entry);
+
+  const char *path = "bench_jit.wasm";
+  if (!builder.write(path)) {
+    std::fprintf(stderr, "unable to write %s\n", path);
+    return 1;
+  }
+
+  WasmFile wasm;
+  if (wasm.read(path) != 0) {
+    return 1;
+  }
+
+  struct Workload {
+    const char *func;
+    uint32_t expected;
+  };
+  const Workload workloads[] = {
+      {"sieve", expected_primes()},
+      {"fib", fib(FIB_N)},
+  };
+
+  struct Mode {
+    const char *name;
+    Interpreter interpreter;
+  };
+  const Mode modes[] = {
+      {"stack interpreter", STACK_INTERPRETER},
+      {"register interpreter", REGISTER_INTERPRETER},
+      {"jit", JIT_COMPILER},
+      {"tiered", TIERED},
+  };
+
+  for (const Workload &workload : workloads) {
+    for (const Mode &mode : modes) {
+      std::string func = workload.func;
+      uint32_t result = 0;
+      double ms = best_of(5, [&]() {
+        Runtime runtime(wasm, mode.interpreter);
+        runtime.run(func);
+        result = runtime.read_memory(0, 0, ImmediateRepr::I32).v.n32;
+      });
+
+      if (result != workload.expected) {
+        std::fprintf(stderr, "%s: wrong result %u, expected %u\n",
+                     workload.func, result, workload.expected);
+        return 1;
+      }
+
+      std::string name = func + ", " + mode.name;
+      report(name.c_str(), ms);
+    }
+  }
+
+  std::remove(path);
+  return 0;
+}
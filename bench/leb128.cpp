@@ -0,0 +1,199 @@
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "bench.hpp"
+#include "leb128.hpp"
+#include "wasm_builder.hpp"
+
+// Compares the LEB128 decoders against the previous implementation, which
+// collected the bytes of every value in a std::vector before assembling it.
+// The value distributions follow what is found in real modules: indices and
+// sizes are almost always a single byte, constants are more spread out.
+
+template <typename T>
+static T vector_uleb128_decode(const uint8_t *&start, const uint8_t *end) {
+  std::vector<uint8_t> blocks;
+  while (start != end) {
+    blocks.push_back(*start);
+    bool is_end = ((*start) & 0x80) == 0;
+    start++;
+    if (is_end) {
+      break;
+    }
+  }
+
+  T result = 0;
+  for (int i = 0; i < blocks.size(); i++) {
+    result |= static_cast<T>(blocks[i] & 0x7F) << (i * 7);
+  }
+  return result;
+}
+
+template <typename T>
+static T vector_leb128_decode(const uint8_t *&start, const uint8_t *end) {
+  std::vector<uint8_t> blocks;
+  while (start != end) {
+    blocks.push_back(*start);
+    bool is_end = ((*start) & 0x80) == 0;
+    start++;
+    if (is_end) {
+      break;
+    }
+  }
+
+  T result = 0;
+  int shift = 0;
+  for (int i = 0; i < blocks.size(); i++) {
+    result |= static_cast<T>(blocks[i] & 0x7F) << shift;
+    shift += 7;
+  }
+  if ((shift < sizeof(T) * 8) && ((blocks.back() & 0x40) != 0)) {
+    result |= (~T(0) << shift);
+  }
+  return result;
+}
+
+const int VALUES = 1000000;
+
+// 90% single byte, 9% two bytes and 1% three bytes
+static Bytes index_stream(std::vector<uint32_t> &values) {
+  std::mt19937 rng(42);
+  Bytes bytes;
+  for (int i = 0; i < VALUES; i++) {
+    uint32_t bucket = rng() % 100;
+    uint32_t value = bucket < 90   ? rng() % 128
+                     : bucket < 99 ? 128 + rng() % (16384 - 128)
+                                   : 16384 + rng() % (1 << 21);
+    values.push_back(value);
+    put_uleb(bytes, value);
+  }
+  return bytes;
+}
+
+// Type indices of the function section, and element segments of small
+// modules, all fit into a single byte
+static Bytes small_index_stream(std::vector<uint32_t> &values) {
+  std::mt19937 rng(3);
+  Bytes bytes;
+  for (int i = 0; i < VALUES; i++) {
+    values.push_back(rng() % 128);
+    put_uleb(bytes, values.back());
+  }
+  return bytes;
+}
+
+// Mostly small constants, but with all lengths up to 5 bytes
+static Bytes constant_stream(std::vector<int32_t> &values) {
+  std::mt19937 rng(7);
+  Bytes bytes;
+  for (int i = 0; i < VALUES; i++) {
+    uint32_t bucket = rng() % 100;
+    int32_t value = bucket < 60   ? static_cast<int32_t>(rng() % 128) - 64
+                    : bucket < 85 ? static_cast<int32_t>(rng() % 16384) - 8192
+                                  : static_cast<int32_t>(rng());
+    values.push_back(value);
+    put_sleb(bytes, value);
+  }
+  return bytes;
+}
+
+template <typename F> static double run(const Bytes &bytes, F decode) {
+  return best_of(5, [&]() {
+    const uint8_t *ptr = bytes.data();
+    const uint8_t *end = bytes.data() + bytes.size();
+    decode(ptr, end);
+  });
+}
+
+int main() {
+  std::vector<uint32_t> indices;
+  Bytes index_bytes = index_stream(indices);
+  std::vector<uint32_t> small_indices;
+  Bytes small_index_bytes = small_index_stream(small_indices);
+  std::vector<int32_t> constants;
+  Bytes constant_bytes = constant_stream(constants);
+
+  std::vector<uint32_t> out(VALUES);
+  std::vector<int32_t> signed_out(VALUES);
+
+  auto check = [](bool ok, const char *name) {
+    if (!ok) {
+      std::fprintf(stderr, "%s decoded wrong values\n", name);
+    }
+    return ok;
+  };
+
+  double ms = run(index_bytes, [&](const uint8_t *&ptr, const uint8_t *end) {
+    for (int i = 0; i < VALUES; i++) {
+      out[i] = vector_uleb128_decode<uint32_t>(ptr, end);
+    }
+  });
+  if (!check(out == indices, "vector uleb128")) {
+    return 1;
+  }
+  report("indices, vector uleb128 (1M)", ms);
+
+  std::fill(out.begin(), out.end(), 0);
+  ms = run(index_bytes, [&](const uint8_t *&ptr, const uint8_t *end) {
+    for (int i = 0; i < VALUES; i++) {
+      out[i] = uleb128_decode<uint32_t>(ptr, end);
+    }
+  });
+  if (!check(out == indices, "uleb128")) {
+    return 1;
+  }
+  report("indices, uleb128 (1M)", ms);
+
+  std::fill(out.begin(), out.end(), 0);
+  ms = run(index_bytes, [&](const uint8_t *&ptr, const uint8_t *end) {
+    uleb128_decode_u32s(ptr, end, out.data(), VALUES);
+  });
+  if (!check(out == indices, "bulk uleb128")) {
+    return 1;
+  }
+  report("indices, bulk uleb128 (1M)", ms);
+
+  ms = run(small_index_bytes, [&](const uint8_t *&ptr, const uint8_t *end) {
+    for (int i = 0; i < VALUES; i++) {
+      out[i] = uleb128_decode<uint32_t>(ptr, end);
+    }
+  });
+  if (!check(out == small_indices, "uleb128")) {
+    return 1;
+  }
+  report("single byte indices, uleb128 (1M)", ms);
+
+  std::fill(out.begin(), out.end(), 0);
+  ms = run(small_index_bytes, [&](const uint8_t *&ptr, const uint8_t *end) {
+    uleb128_decode_u32s(ptr, end, out.data(), VALUES);
+  });
+  if (!check(out == small_indices, "bulk uleb128")) {
+    return 1;
+  }
+  report("single byte indices, bulk uleb128 (1M)", ms);
+
+  ms = run(constant_bytes, [&](const uint8_t *&ptr, const uint8_t *end) {
+    for (int i = 0; i < VALUES; i++) {
+      signed_out[i] = vector_leb128_decode<int32_t>(ptr, end);
+    }
+  });
+  if (!check(signed_out == constants, "vector leb128")) {
+    return 1;
+  }
+  report("constants, vector leb128 (1M)", ms);
+
+  std::fill(signed_out.begin(), signed_out.end(), 0);
+  ms = run(constant_bytes, [&](const uint8_t *&ptr, const uint8_t *end) {
+    for (int i = 0; i < VALUES; i++) {
+      signed_out[i] = leb128_decode<int32_t>(ptr, end);
+    }
+  });
+  if (!check(signed_out == constants, "leb128")) {
+    return 1;
+  }
+  report("constants, leb128 (1M)", ms);
+
+  return 0;
+}
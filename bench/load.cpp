@@ -0,0 +1,166 @@
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include "bench.hpp"
+#include "runtime.hpp"
+#include "sections.hpp"
+#include "wasm_builder.hpp"
+
+// Loads a module with many mid sized functions. This measures the decoder
+// and the memory used by the decoded function bodies.
+// A second module holds a large data segment, as found in modules compiled
+// from C and C++, which measures how the loader handles raw bytes.
+
+const int FUNCTIONS = 2000;
+const int MANY_FUNCTIONS = 40000;
+const int DATA_BYTES = 16 << 20;
+
+static Bytes function_body(uint32_t seed) {
+  const uint32_t a = 0, b = 1;
+
+  Bytes body;
+  for (uint32_t i = 0; i < 40; i++) {
+    body = concat({body, op_u(0x20, a), i32_const(seed * 31 + i), op(0x6a),
+                   op_u(0x20, b), op(0x73), op_u(0x21, a), op_u(0x20, a),
+                   mem_op(0x28, 2, i * 4), op_u(0x21, b)});
+  }
+  return concat({body, op_u(0x02, 0x40), op_u(0x20, a), op_u(0x0d, 0),
+                 op(0x0b), op_u(0x20, a), op_u(0x20, b), op(0x6a)});
+}
+
+// Bytes currently allocated on the heap, or 0 if unknown
+static size_t heap_in_use() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+  return mallinfo2().uordblks;
+#else
+  return 0;
+#endif
+}
+
+int main() {
+  WasmBuilder builder;
+  uint32_t type = builder.add_type({0x7F}, {0x7F});
+  for (uint32_t i = 0; i < FUNCTIONS; i++) {
+    builder.add_function(type, {{1, 0x7F}}, function_body(i));
+  }
+  builder.add_export("f0", 0);
+
+  const char *path = "bench_load.wasm";
+  if (!builder.write(path)) {
+    std::fprintf(stderr, "unable to write %s\n", path);
+    return 1;
+  }
+
+  size_t instructions = 0;
+  double ms = best_of(5, [&]() {
+    WasmFile wasm;
+    wasm.read(path);
+    instructions = 0;
+    for (const Code &code : wasm.codes) {
+      instructions += code.expr.size();
+    }
+  });
+
+  report("load (2000 functions)", ms);
+
+  size_t before = heap_in_use();
+  {
+    WasmFile wasm;
+    wasm.read(path);
+    size_t after = heap_in_use();
+    if (after > before) {
+      std::printf("%-40s %10.1f KiB\n", "heap after load", (after - before) / 1024.0);
+      std::printf("%-40s %10.1f B\n", "heap per instruction",
+                  double(after - before) / instructions);
+    }
+  }
+
+  // Tens of thousands of functions, decoded by one thread and by the default
+  // number of threads
+  WasmBuilder many_builder;
+  type = many_builder.add_type({0x7F}, {0x7F});
+  for (uint32_t i = 0; i < MANY_FUNCTIONS; i++) {
+    many_builder.add_function(type, {{1, 0x7F}}, function_body(i));
+  }
+  Bytes many = many_builder.build();
+
+  ms = best_of(5, [&]() {
+    WasmFile wasm;
+    wasm.parse_threads = 1;
+    wasm.read_from_memory(many.data(), many.size());
+  });
+  report("load (40000 functions, 1 thread)", ms);
+
+  ms = best_of(5, [&]() {
+    WasmFile wasm;
+    wasm.read_from_memory(many.data(), many.size());
+  });
+  std::string label = "load (40000 functions, " +
+                      std::to_string(std::thread::hardware_concurrency()) +
+                      " hw threads)";
+  report(label.c_str(), ms);
+
+  // Time until the first call returns, which only uses one of the functions
+  std::string entry = "entry";
+  uint32_t entry_type = many_builder.add_type({}, {});
+  many_builder.add_export(
+      entry, many_builder.add_function(
+                 entry_type, {}, concat({i32_const(7), op_u(0x10, 0), op(0x1A)})));
+  many = many_builder.build();
+  for (bool lazy : {false, true}) {
+    ms = best_of(5, [&]() {
+      WasmFile wasm;
+      wasm.lazy_code = lazy;
+      wasm.read_from_memory(many.data(), many.size());
+      Runtime runtime(wasm);
+      runtime.run(entry);
+    });
+    report(lazy ? "first call (40000 functions, lazy)"
+                : "first call (40000 functions, eager)",
+           ms);
+  }
+  many = Bytes();
+
+  WasmBuilder data_builder;
+  type = data_builder.add_type({}, {});
+  data_builder.add_function(type, {}, {});
+  data_builder.memory_pages = DATA_BYTES / 65536;
+  Bytes segment(DATA_BYTES);
+  for (size_t i = 0; i < segment.size(); i++) {
+    segment[i] = static_cast<uint8_t>(i * 7);
+  }
+  data_builder.add_data(0, segment);
+  segment = Bytes();
+
+  const char *data_path = "bench_load_data.wasm";
+  if (!data_builder.write(data_path)) {
+    std::fprintf(stderr, "unable to write %s\n", data_path);
+    return 1;
+  }
+
+  ms = best_of(5, [&]() {
+    WasmFile wasm;
+    wasm.read(data_path);
+  });
+
+  report("load (16 MiB data segment)", ms);
+
+  before = heap_in_use();
+  {
+    WasmFile wasm;
+    wasm.read(data_path);
+    size_t after = heap_in_use();
+    std::printf("%-40s %10.1f KiB\n", "heap after load",
+                after > before ? (after - before) / 1024.0 : 0.0);
+  }
+
+  std::remove(data_path);
+  std::remove(path);
+  return 0;
+}
@@ -0,0 +1,118 @@
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "runtime.hpp"
+#include "sections.hpp"
+#include "wasm_builder.hpp"
+
+// Passes over an array of i32 in memory, every element becoming a mix of
+// itself and its predecessor. Two loads and a store per iteration and little
+// else, which makes this workload dominated by memory accesses. Compare a
+// build with -DWINTERP_SIGNAL_TRAPS=OFF to see what checking them costs.
+
+const uint32_t WORDS = 8192;
+const uint32_t PASSES = 50;
+// Address of the array, behind the result at 0
+const uint32_t ARRAY = 64;
+
+static uint32_t expected_result() {
+  std::vector<uint32_t> a(WORDS);
+  for (uint32_t k = 0; k < WORDS; k++) {
+    a[k] = k;
+  }
+  for (uint32_t p = 0; p < PASSES; p++) {
+    for (uint32_t k = 1; k < WORDS; k++) {
+      a[k] = (a[k - 1] ^ a[k]) + p;
+    }
+  }
+  return a[WORDS - 1];
+}
+
+static Bytes mix_body() {
+  const uint32_t p = 0, i = 1;
+
+  Bytes init = concat({
+      op_u(0x03, 0x40), // loop
+      op_u(0x20, i), op_u(0x20, i), i32_const(2), op(0x76),
+      mem_op(0x36, 2, ARRAY), // a[i / 4] = i / 4
+      op_u(0x20, i), i32_const(4), op(0x6a), op_u(0x22, i),
+      i32_const(4 * WORDS), op(0x49), op_u(0x0d, 0), // br_if loop
+      op(0x0b),
+  });
+
+  Bytes pass = concat({
+      op_u(0x03, 0x40), // loop
+      i32_const(4), op_u(0x21, i),
+      op_u(0x03, 0x40), // loop
+      op_u(0x20, i),
+      op_u(0x20, i), mem_op(0x28, 2, ARRAY - 4), // a[k - 1]
+      op_u(0x20, i), mem_op(0x28, 2, ARRAY),     // a[k]
+      op(0x73), op_u(0x20, p), op(0x6a), mem_op(0x36, 2, ARRAY),
+      op_u(0x20, i), i32_const(4), op(0x6a), op_u(0x22, i),
+      i32_const(4 * WORDS), op(0x49), op_u(0x0d, 0), // br_if inner loop
+      op(0x0b),
+      op_u(0x20, p), i32_const(1), op(0x6a), op_u(0x22, p), i32_const(PASSES),
+      op(0x49), op_u(0x0d, 0), // br_if outer loop
+      op(0x0b),
+  });
+
+  return concat({
+      init, pass,
+      i32_const(0), i32_const(ARRAY + 4 * (WORDS - 1)), mem_op(0x28, 2, 0),
+      mem_op(0x36, 2, 0),
+  });
+}
+
+int main() {
+  WasmBuilder builder;
+  uint32_t type = builder.add_type({}, {});
+  uint32_t f = builder.add_function(type, {{2, 0x7F}}, mix_body());
+  builder.add_export("mix", f);
+
+  const char *path = "bench_memory.wasm";
+  if (!builder.write(path)) {
+    std::fprintf(stderr, "unable to write %s\n", path);
+    return 1;
+  }
+
+  WasmFile wasm;
+  if (wasm.read(path) != 0) {
+    return 1;
+  }
+
+  struct Variant {
+    const char *name;
+    Interpreter interpreter;
+  };
+  const Variant variants[] = {
+      {"mix (400k iterations)", STACK_INTERPRETER},
+      {"mix, register code", REGISTER_INTERPRETER},
+      {"mix, compiled", JIT_COMPILER},
+  };
+
+  for (const Variant &variant : variants) {
+    std::string func = "mix";
+    uint32_t result = 0;
+    uint64_t dispatches = 0;
+    double ms = best_of(5, [&]() {
+      Runtime runtime(wasm, variant.interpreter);
+      runtime.run(func);
+      result = runtime.read_memory(0, 0, ImmediateRepr::I32).v.n32;
+      dispatches = runtime.dispatch_count;
+    });
+
+    if (result != expected_result()) {
+      std::fprintf(stderr, "wrong result %u, expected %u\n", result,
+                   expected_result());
+      return 1;
+    }
+
+    report(variant.name, ms);
+    report_dispatches(dispatches);
+  }
+  std::remove(path);
+  return 0;
+}
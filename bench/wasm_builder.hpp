@@ -0,0 +1,354 @@
+#ifndef WASM_BUILDER_HPP
+#define WASM_BUILDER_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Minimal encoder for WebAssembly binaries, used by the benchmarks to generate
+// workloads without depending on wat2wasm.
+// Only the sections the interpreter supports are emitted.
+
+typedef std::vector<uint8_t> Bytes;
+
+inline void put_uleb(Bytes &out, uint64_t value) {
+  do {
+    uint8_t byte = value & 0x7F;
+    value >>= 7;
+    if (value != 0) {
+      byte |= 0x80;
+    }
+    out.push_back(byte);
+  } while (value != 0);
+}
+
+inline void put_sleb(Bytes &out, int64_t value) {
+  bool more = true;
+  while (more) {
+    uint8_t byte = value & 0x7F;
+    value >>= 7;
+    if ((value == 0 && (byte & 0x40) == 0) ||
+        (value == -1 && (byte & 0x40) != 0)) {
+      more = false;
+    } else {
+      byte |= 0x80;
+    }
+    out.push_back(byte);
+  }
+}
+
+inline void put_bytes(Bytes &out, const Bytes &bytes) {
+  out.insert(out.end(), bytes.begin(), bytes.end());
+}
+
+// Small helpers to write function bodies in a readable way
+inline Bytes op(uint8_t opcode) { return {opcode}; }
+
+inline Bytes op_u(uint8_t opcode, uint64_t imm) {
+  Bytes out = {opcode};
+  put_uleb(out, imm);
+  return out;
+}
+
+inline Bytes i32_const(int32_t value) {
+  Bytes out = {0x41};
+  put_sleb(out, value);
+  return out;
+}
+
+inline Bytes i64_const(int64_t value) {
+  Bytes out = {0x42};
+  put_sleb(out, value);
+  return out;
+}
+
+inline Bytes f64_const(double value) {
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  Bytes out = {0x44};
+  for (int i = 0; i < 8; i++) {
+    out.push_back(bits >> (8 * i));
+  }
+  return out;
+}
+
+// memarg with alignment and offset, always targets memory 0
+inline Bytes mem_op(uint8_t opcode, uint32_t align, uint32_t offset) {
+  Bytes out = {opcode};
+  put_uleb(out, align);
+  put_uleb(out, offset);
+  return out;
+}
+
+// memarg of another memory, which sets bit 6 of the alignment
+inline Bytes mem_op_at(uint8_t opcode, uint32_t memory, uint32_t align,
+                       uint32_t offset) {
+  Bytes out = {opcode};
+  put_uleb(out, align | 0x40);
+  put_uleb(out, memory);
+  put_uleb(out, offset);
+  return out;
+}
+
+// Instructions behind the 0xFC prefix, like the bulk memory and table
+// instructions, with their u32 immediates
+inline Bytes misc_op(uint32_t opcode, std::initializer_list<uint32_t> imms) {
+  Bytes out = {0xFC};
+  put_uleb(out, opcode);
+  for (uint32_t imm : imms) {
+    put_uleb(out, imm);
+  }
+  return out;
+}
+
+inline Bytes concat(std::initializer_list<Bytes> parts) {
+  Bytes out;
+  for (const Bytes &part : parts) {
+    put_bytes(out, part);
+  }
+  return out;
+}
+
+struct BuilderFunction {
+  uint32_t type;
+  std::vector<std::pair<uint32_t, uint8_t>> locals; // count, valtype
+  Bytes body;                                       // Without the final end
+};
+
+struct BuilderData {
+  bool passive;
+  uint32_t offset; // Only for active segments
+  Bytes bytes;
+};
+
+struct BuilderExport {
+  std::string name;
+  uint32_t function;
+};
+
+class WasmBuilder {
+public:
+  // Returns the type index
+  uint32_t add_type(const Bytes &params, const Bytes &results) {
+    Bytes type = {0x60};
+    put_uleb(type, params.size());
+    put_bytes(type, params);
+    put_uleb(type, results.size());
+    put_bytes(type, results);
+    types.push_back(type);
+    return types.size() - 1;
+  }
+
+  // Returns the function index
+  uint32_t add_function(uint32_t type,
+                        std::vector<std::pair<uint32_t, uint8_t>> locals,
+                        const Bytes &body) {
+    functions.push_back({type, locals, body});
+    return functions.size() - 1;
+  }
+
+  void add_export(const std::string &name, uint32_t function) {
+    exports.push_back({name, function});
+  }
+
+  // Active data segment of memory 0, returns the data segment index
+  uint32_t add_data(uint32_t offset, const Bytes &bytes) {
+    data.push_back({false, offset, bytes});
+    return data.size() - 1;
+  }
+
+  // Passive data segment for memory.init, returns the data segment index
+  uint32_t add_passive_data(const Bytes &bytes) {
+    data.push_back({true, 0, bytes});
+    return data.size() - 1;
+  }
+
+  // Entries of a single function table, placed at offset 0. The table holds
+  // size entries, the ones behind entries are uninitialized.
+  void set_table(const std::vector<uint32_t> &entries, uint32_t size = 0) {
+    table = entries;
+    table_size = std::max<uint32_t>(size, entries.size());
+  }
+
+  // Passive element segment of function indices for table.init, returns the
+  // element segment index. The one of set_table follows them.
+  uint32_t add_passive_elem(const std::vector<uint32_t> &functions) {
+    passive_elems.push_back(functions);
+    return passive_elems.size() - 1;
+  }
+
+  // Empty tables behind the one of set_table, returns the table index
+  uint32_t add_table(uint32_t size) {
+    tables.push_back(size);
+    return tables.size();
+  }
+
+  // Memories behind memory 0, returns the memory index. maximum is only
+  // emitted if given.
+  uint32_t add_memory(uint32_t pages, int64_t maximum = -1) {
+    memories.push_back({pages, maximum});
+    return memories.size();
+  }
+
+  // Initial pages of memory 0
+  uint32_t memory_pages = 1;
+  // Maximum of memory 0, only emitted if not negative
+  int64_t memory_maximum = -1;
+
+  Bytes build() const {
+    Bytes out = {0x00, 0x61, 0x73, 0x6D, 0x01, 0x00, 0x00, 0x00};
+
+    Bytes section;
+    put_uleb(section, types.size());
+    for (const Bytes &type : types) {
+      put_bytes(section, type);
+    }
+    put_section(out, 1, section);
+
+    section.clear();
+    put_uleb(section, functions.size());
+    for (const BuilderFunction &f : functions) {
+      put_uleb(section, f.type);
+    }
+    put_section(out, 3, section);
+
+    if (table_size > 0 || !tables.empty()) {
+      section.clear();
+      put_uleb(section, 1 + tables.size());
+      section.push_back(0x70);
+      section.push_back(0x00);
+      put_uleb(section, table_size);
+      for (uint32_t size : tables) {
+        section.push_back(0x70);
+        section.push_back(0x00);
+        put_uleb(section, size);
+      }
+      put_section(out, 4, section);
+    }
+
+    section.clear();
+    put_uleb(section, 1 + memories.size());
+    section.push_back(memory_maximum < 0 ? 0x00 : 0x01);
+    put_uleb(section, memory_pages);
+    if (memory_maximum >= 0) {
+      put_uleb(section, memory_maximum);
+    }
+    for (const auto &memory : memories) {
+      section.push_back(memory.second < 0 ? 0x00 : 0x01);
+      put_uleb(section, memory.first);
+      if (memory.second >= 0) {
+        put_uleb(section, memory.second);
+      }
+    }
+    put_section(out, 5, section);
+
+    section.clear();
+    put_uleb(section, exports.size());
+    for (const BuilderExport &e : exports) {
+      put_uleb(section, e.name.size());
+      section.insert(section.end(), e.name.begin(), e.name.end());
+      section.push_back(0x00);
+      put_uleb(section, e.function);
+    }
+    put_section(out, 7, section);
+
+    if (!table.empty() || !passive_elems.empty()) {
+      section.clear();
+      put_uleb(section, passive_elems.size() + (table.empty() ? 0 : 1));
+      for (const std::vector<uint32_t> &functions : passive_elems) {
+        section.push_back(0x01);
+        section.push_back(0x00); // funcref
+        put_functions(section, functions);
+      }
+      if (!table.empty()) {
+        put_bytes(section, {0x00, 0x41, 0x00, 0x0b});
+        put_functions(section, table);
+      }
+      put_section(out, 9, section);
+    }
+
+    // Required by memory.init and data.drop
+    if (!data.empty()) {
+      section.clear();
+      put_uleb(section, data.size());
+      put_section(out, 12, section);
+    }
+
+    section.clear();
+    put_uleb(section, functions.size());
+    for (const BuilderFunction &f : functions) {
+      Bytes code;
+      put_uleb(code, f.locals.size());
+      for (const auto &local : f.locals) {
+        put_uleb(code, local.first);
+        code.push_back(local.second);
+      }
+      put_bytes(code, f.body);
+      code.push_back(0x0b);
+
+      put_uleb(section, code.size());
+      put_bytes(section, code);
+    }
+    put_section(out, 10, section);
+
+    if (!data.empty()) {
+      section.clear();
+      put_uleb(section, data.size());
+      for (const BuilderData &segment : data) {
+        if (segment.passive) {
+          section.push_back(0x01);
+        } else {
+          section.push_back(0x00);
+          put_bytes(section, i32_const(segment.offset));
+          section.push_back(0x0b);
+        }
+        put_uleb(section, segment.bytes.size());
+        put_bytes(section, segment.bytes);
+      }
+      put_section(out, 11, section);
+    }
+
+    return out;
+  }
+
+  // Writes the module to path, returns false on failure
+  bool write(const char *path) const {
+    Bytes bytes = build();
+    FILE *file = std::fopen(path, "wb");
+    if (!file) {
+      return false;
+    }
+    bool ok = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    std::fclose(file);
+    return ok;
+  }
+
+private:
+  std::vector<Bytes> types;
+  std::vector<BuilderFunction> functions;
+  std::vector<BuilderExport> exports;
+  std::vector<uint32_t> table;
+  uint32_t table_size = 0;
+  std::vector<uint32_t> tables; // sizes
+  std::vector<std::vector<uint32_t>> passive_elems;
+  std::vector<BuilderData> data;
+  std::vector<std::pair<uint32_t, int64_t>> memories; // pages, maximum
+
+  static void put_functions(Bytes &out, const std::vector<uint32_t> &functions) {
+    put_uleb(out, functions.size());
+    for (uint32_t function : functions) {
+      put_uleb(out, function);
+    }
+  }
+
+  static void put_section(Bytes &out, uint8_t id, const Bytes &section) {
+    out.push_back(id);
+    put_uleb(out, section.size());
+    put_bytes(out, section);
+  }
+};
+
+#endif // WASM_BUILDER_HPP
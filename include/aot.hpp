@@ -0,0 +1,27 @@
+#ifndef AOT_HPP
+#define AOT_HPP
+
+#include <ostream>
+
+#include "sections.hpp"
+
+// Ahead of time translation of a module into C++, used by winterp_aot.
+// The translation unit defines a class derived from AotModule (see
+// aot_runtime.hpp) with
+//  - one member function per Wasm function, translated from its register
+//    code (see registers.hpp). Every slot of the frame becomes a local
+//    variable and branches become gotos, which a C++ compiler turns into
+//    native code.
+//  - one field per global
+// Memory, the function table and data segments are kept by AotModule.
+// The numeric instructions call the handlers of numeric.hpp, such that the
+// results are those of the interpreters.
+// An instance is created by an extern "C" function named create, which takes
+// no arguments. Compiled into a shared library, it can be loaded by aot_load.
+
+// Writes the translation unit of wasm to out. Returns 1 and prints the reason
+// if the module uses something which cannot be translated.
+int translate_module(const WasmFile &wasm, const char *create,
+                     std::ostream &out);
+
+#endif // AOT_HPP
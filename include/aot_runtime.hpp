@@ -0,0 +1,192 @@
+#ifndef AOT_RUNTIME_HPP
+#define AOT_RUNTIME_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "instructions.hpp"
+#include "numeric.hpp"
+
+// Support library of the C++ translation units generated by winterp_aot, see
+// aot.hpp. It is linked as winterp_aot_runtime and does not depend on the
+// interpreter.
+
+// Size of a page of memory, as MEMORY_PAGE_SIZE of the Runtime
+const uint32_t AOT_PAGE_SIZE = 65536;
+
+// Pages memory can grow to at most, as MAX_MEMORY_PAGES of the Runtime
+const uint32_t AOT_MAX_PAGES = 65536;
+
+// Entry of the function table without a function, as NULL_ENTRY of the
+// Runtime
+const uint32_t AOT_NULL_ENTRY = UINT32_MAX;
+
+// Stops execution, for out of bounds memory accesses and invalid indirect
+// calls
+[[noreturn]] void aot_trap(const char *message);
+
+// A data segment of a generated module, its bytes are a static array
+struct AotData {
+  const uint8_t *bytes;
+  size_t size;
+};
+
+// An instance of a module, the generated code derives from it. Its functions
+// are member functions of the derived class and its globals are fields.
+class AotModule {
+public:
+  virtual ~AotModule() = default;
+
+  // Takes as input the name of a function, looks it up in the exports and
+  // executes it, like Runtime::run. Its parameters are 0.
+  void run(std::string &function);
+
+  // Reads from memory at offset, like Runtime::read_memory. Modules only have
+  // memory 0, other indices trap.
+  Immediate read_memory(const uint32_t &mem_index, const uint32_t &offset,
+                        const ImmediateRepr repr);
+
+protected:
+  // Starts with a single page of memory, the generated constructor resizes it
+  // to the initial size of memory 0 of the module
+  AotModule() : memory(AOT_PAGE_SIZE), pages(1), max_pages(AOT_MAX_PAGES) {}
+
+  // Calls the exported function named function, returns false if there is
+  // none
+  virtual bool call_export(const std::string &function) = 0;
+
+  // Loads and stores at an address, which already includes the offset
+  template <OpCode op> Value load(uint32_t address);
+  template <OpCode op> void store(uint32_t address, Value value);
+
+  // As their counterparts of the Runtime
+  uint32_t memory_grow(uint32_t delta);
+  void memory_fill(uint32_t offset, Value value, uint32_t n);
+  void memory_copy(uint32_t dst, uint32_t src, uint32_t n);
+  void memory_init(uint32_t data_segment_index, uint32_t dst, uint32_t src,
+                   uint32_t n);
+  void data_drop(uint32_t data_segment_index);
+  void table_init(uint32_t elem_index, uint32_t dst, uint32_t src, uint32_t n);
+  void elem_drop(uint32_t elem_index);
+  void table_copy(uint32_t dst, uint32_t src, uint32_t n);
+
+  // Copies an active data segment into memory
+  void init_data(uint32_t offset, const AotData &segment);
+
+  // The only supported import, writes iovs_len buffers to stdout or stderr
+  uint32_t fd_write(uint32_t fd, uint32_t iovs_ptr, uint32_t iovs_len,
+                    uint32_t nwritten);
+
+  std::vector<uint8_t> memory;
+  uint32_t pages;
+  // The maximum of memory 0, set by the generated constructor if the module
+  // declares one
+  uint32_t max_pages;
+
+  // Function indices, filled by the element segments. Entries without a
+  // function hold AOT_NULL_ENTRY.
+  std::vector<uint32_t> function_table;
+
+  // Function indices of the passive element segments, the others are dropped
+  std::vector<std::vector<uint32_t>> elems;
+
+  std::vector<AotData> data;
+
+private:
+  void check_access(uint32_t address, uint32_t size) const {
+    if (static_cast<uint64_t>(address) + size > memory.size()) {
+      aot_trap("out of bounds memory access");
+    }
+  }
+};
+
+template <OpCode op> Value AotModule::load(uint32_t address) {
+  Value result;
+  if constexpr (op == OpCode::I32Load || op == OpCode::F32Load) {
+    check_access(address, 4);
+    std::memcpy(&result.n32, &memory[address], 4);
+  } else if constexpr (op == OpCode::I64Load || op == OpCode::F64Load) {
+    check_access(address, 8);
+    std::memcpy(&result.n64, &memory[address], 8);
+  } else if constexpr (op == OpCode::I32Load8S) {
+    check_access(address, 1);
+    result.n32 = static_cast<int32_t>(static_cast<int8_t>(memory[address]));
+  } else if constexpr (op == OpCode::I32Load8U) {
+    check_access(address, 1);
+    result.n32 = memory[address];
+  } else if constexpr (op == OpCode::I32Load16S) {
+    int16_t data;
+    check_access(address, 2);
+    std::memcpy(&data, &memory[address], 2);
+    result.n32 = static_cast<int32_t>(data);
+  } else if constexpr (op == OpCode::I32Load16U) {
+    uint16_t data;
+    check_access(address, 2);
+    std::memcpy(&data, &memory[address], 2);
+    result.n32 = data;
+  } else if constexpr (op == OpCode::I64Load8S) {
+    check_access(address, 1);
+    result.n64 = static_cast<int64_t>(static_cast<int8_t>(memory[address]));
+  } else if constexpr (op == OpCode::I64Load8U) {
+    check_access(address, 1);
+    result.n64 = memory[address];
+  } else if constexpr (op == OpCode::I64Load16S) {
+    int16_t data;
+    check_access(address, 2);
+    std::memcpy(&data, &memory[address], 2);
+    result.n64 = static_cast<int64_t>(data);
+  } else if constexpr (op == OpCode::I64Load16U) {
+    uint16_t data;
+    check_access(address, 2);
+    std::memcpy(&data, &memory[address], 2);
+    result.n64 = data;
+  } else if constexpr (op == OpCode::I64Load32S) {
+    int32_t data;
+    check_access(address, 4);
+    std::memcpy(&data, &memory[address], 4);
+    result.n64 = static_cast<int64_t>(data);
+  } else if constexpr (op == OpCode::I64Load32U) {
+    uint32_t data;
+    check_access(address, 4);
+    std::memcpy(&data, &memory[address], 4);
+    result.n64 = data;
+  } else {
+    static_assert(op == OpCode::I32Load, "not a load");
+  }
+  return result;
+}
+
+template <OpCode op> void AotModule::store(uint32_t address, Value value) {
+  if constexpr (op == OpCode::I32Store || op == OpCode::F32Store ||
+                op == OpCode::I64Store32) {
+    check_access(address, 4);
+    std::memcpy(&memory[address], &value, 4);
+  } else if constexpr (op == OpCode::I64Store || op == OpCode::F64Store) {
+    check_access(address, 8);
+    std::memcpy(&memory[address], &value, 8);
+  } else if constexpr (op == OpCode::I32Store8 || op == OpCode::I64Store8) {
+    check_access(address, 1);
+    memory[address] = static_cast<uint8_t>(value.n32);
+  } else if constexpr (op == OpCode::I32Store16 || op == OpCode::I64Store16) {
+    check_access(address, 2);
+    std::memcpy(&memory[address], &value, 2);
+  } else {
+    static_assert(op == OpCode::I32Store, "not a store");
+  }
+}
+
+// The function exported by every generated module, unless winterp_aot was
+// given another name. It returns a new instance of the module.
+typedef AotModule *(*AotCreate)();
+
+// Loads a generated module which has been compiled into a shared library and
+// creates an instance of it. Returns nullptr if the library or its function
+// create cannot be found. The library stays loaded.
+std::unique_ptr<AotModule>
+aot_load(const char *library, const char *create = "winterp_aot_create");
+
+#endif // AOT_RUNTIME_HPP
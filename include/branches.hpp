@@ -0,0 +1,18 @@
+#ifndef BRANCHES_HPP
+#define BRANCHES_HPP
+
+#include "sections.hpp"
+
+// Resolves the control flow of a function body once at load time.
+// Every block, loop, if, else, br, br_if, br_table and return gets the pc it
+// continues at, together with the operand stack height and arity of the label
+// it jumps to. This turns every branch in the runtime into a constant time
+// jump, instead of scanning the instructions for the matching end.
+// The stack heights are computed by simulating the operand stack, which
+// assumes the function body is valid. The largest height is stored in
+// code.max_height and the first instruction of every loop in code.loops.
+// A return is appended to the body, which replaces its final end.
+void resolve_branches(const WasmFile &wasm, const FunctionType &signature,
+                      Code &code);
+
+#endif // BRANCHES_HPP
@@ -0,0 +1,19 @@
+#ifndef FUSION_HPP
+#define FUSION_HPP
+
+#include "sections.hpp"
+
+// Replaces common sequences of instructions by a single superinstruction,
+// which saves dispatches and operand stack accesses in the runtime.
+// The sequences were picked from the pairs of instructions executed most by
+// the tests and benchmarks, the superinstructions are listed in OpCode.
+// A sequence is only fused when no branch continues in the middle of it.
+// Nop, block and end are removed, such that entering and leaving nested
+// blocks, like the dozens of blocks around a br_table dispatching to the
+// handlers of a bytecode interpreter, costs no dispatches. Loop is kept, as
+// branches back to a loop continue behind it and code.loops stays distinct.
+// Runs after resolve_branches, all branch targets are moved to the fused
+// instructions.
+void fuse_instructions(Code &code);
+
+#endif // FUSION_HPP
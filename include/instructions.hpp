@@ -4,7 +4,45 @@
 #include <cstdint>
 #include <vector>
 
-enum OpCode {
+// i32 binops and comparisons with fused variants, see fusion.hpp
+// clang-format off
+#define FUSED_COMPARISONS(X)                                                   \
+  X(I32eq) X(I32ne) X(I32lts) X(I32ltu) X(I32gts) X(I32gtu) X(I32le_s)         \
+  X(I32le_u) X(I32ge_s) X(I32ge_u)
+#define FUSED_BINOPS(X)                                                        \
+  FUSED_COMPARISONS(X)                                                         \
+  X(I32Add) X(I32Sub) X(I32Mul) X(I32and) X(I32or) X(I32xor) X(I32shl)         \
+  X(I32shrs) X(I32shru)
+// clang-format on
+
+// All loads and stores, whose handlers are shared by the interpreters
+#define MEMORY_ACCESSES(LOAD, STORE)                                           \
+  LOAD(I32Load)                                                                \
+  LOAD(I64Load)                                                                \
+  LOAD(F32Load)                                                                \
+  LOAD(F64Load)                                                                \
+  LOAD(I32Load8S)                                                              \
+  LOAD(I32Load8U)                                                              \
+  LOAD(I32Load16S)                                                             \
+  LOAD(I32Load16U)                                                             \
+  LOAD(I64Load8S)                                                              \
+  LOAD(I64Load8U)                                                              \
+  LOAD(I64Load16S)                                                             \
+  LOAD(I64Load16U)                                                             \
+  LOAD(I64Load32S)                                                             \
+  LOAD(I64Load32U)                                                             \
+  STORE(I32Store)                                                              \
+  STORE(I64Store)                                                              \
+  STORE(F32Store)                                                              \
+  STORE(F64Store)                                                              \
+  STORE(I32Store8)                                                             \
+  STORE(I32Store16)                                                            \
+  STORE(I64Store8)                                                             \
+  STORE(I64Store16)                                                            \
+  STORE(I64Store32)
+
+// OpCodes fit into 16 bits, which keeps Instr small
+enum OpCode : uint16_t {
   // Parametric
   Unreachable = 0x00,
   Nop = 0x01,
@@ -200,13 +238,21 @@ enum OpCode {
   MemorySize = 0x3F,
   MemoryGrow = 0x40,
 
-  MemoryInit = 0xFC,
-
-  // These have no actual opcode by themselves, but are versions of  MemoryInit dependent on the flag
-  // FF at the end, such that in cases where the opcode is converted to uint8_t it doest match any cases
-  DataDrop = 0xFC1FF,
-  MemoryCopy = 0xFC2FF,
-  MemoryFill = 0xFC3FF,
+  // Prefix of the bulk memory and table instructions, which are followed by a
+  // u32 selecting the actual instruction
+  // https://webassembly.github.io/spec/core/binary/instructions.html#memory-instructions
+  // https://webassembly.github.io/spec/core/binary/instructions.html#table-instructions
+  MiscPrefix = 0xFC,
+
+  // These have no single byte opcode by themselves, they are stored as
+  // 0x100 + the u32 following the prefix, such that all OpCodes stay dense
+  MemoryInit = 0x108,
+  DataDrop = 0x109,
+  MemoryCopy = 0x10A,
+  MemoryFill = 0x10B,
+  TableInit = 0x10C,
+  ElemDrop = 0x10D,
+  TableCopy = 0x10E,
 
   // Variable Instructions
   LocalGet = 0x20,
@@ -223,8 +269,53 @@ enum OpCode {
 
 
   End = 0x0b,
+
+  // Superinstructions created by fuse_instructions, which replace a common
+  // sequence of instructions. They are not part of WebAssembly and follow
+  // behind all of its OpCodes. For every op of FUSED_BINOPS there are
+  //  - opC:  i32.const c; op           with imm = c
+  //  - opL:  local.get x; op           with imm = x
+  //  - opLC: local.get x; i32.const c; op  with imm = x, imm2 = c
+  //  - opLL: local.get x; local.get y; op  with imm = x, imm2 = y
+  // and for every op of FUSED_COMPARISONS, with the target of the br_if or if
+  //  - BrIfop:  op; br_if
+  //  - Ifop:    op; if
+  //  - BrIfopC: i32.const c; op; br_if  with imm = c
+  //  - IfopC:   i32.const c; op; if     with imm = c
+  // of which i32.eqz only has the first two.
+  FusedBegin = 0x10F,
+#define FUSED_BINOP_OPCODES(name) name##C, name##L, name##LC, name##LL,
+  FUSED_BINOPS(FUSED_BINOP_OPCODES)
+#undef FUSED_BINOP_OPCODES
+#define FUSED_COMPARISON_OPCODES(name)                                         \
+  BrIf##name, If##name, BrIf##name##C, If##name##C,
+  FUSED_COMPARISONS(FUSED_COMPARISON_OPCODES)
+#undef FUSED_COMPARISON_OPCODES
+  BrIfI32eqz,
+  IfI32eqz,
+  // i32.const c; i32.store    with imm = c, imm2 = offset, only for memory 0
+  I32StoreC,
+  // local.set x; local.get y  with imm = x, imm2 = y
+  LocalSetGet,
+  FusedEnd,
+
+  // Only used by the register code, see registers.hpp.
+  // Copies slot a to slot dst.
+  Move = FusedEnd,
+
+  // Loads and stores of memories other than 0 in decoded bodies, with the
+  // memory index in imm and the offset in imm2 as before. Those of memory 0
+  // keep their OpCodes, whose handlers do not look up the memory.
+#define INDEXED_ACCESS_OPCODES(name) name##Indexed,
+  MEMORY_ACCESSES(INDEXED_ACCESS_OPCODES, INDEXED_ACCESS_OPCODES)
+#undef INDEXED_ACCESS_OPCODES
+
+  OpCodeEnd,
 };
 
+// All OpCodes are smaller than this, such that they can index a dense table
+const uint32_t NUM_OPCODES = OpCode::OpCodeEnd;
+
 enum ImmediateRepr : uint8_t {
 
   Uninitialised = 0x00,
@@ -261,17 +352,51 @@ struct Immediate {
   Value v;
 };
 
+// Where execution continues after a structured control instruction.
+// These are resolved once after parsing by resolve_branches, such that the
+// runtime never has to search for the matching block, loop, else or end.
+struct BranchTarget {
+  uint32_t pc;     // Next instruction to execute
+  uint32_t height; // Operand stack height of the label, relative to the frame
+  uint32_t arity;  // Number of values carried over to the label
+};
+
+// A decoded instruction. Its immediates are stored inline, such that a
+// function body is one contiguous array of fixed size instructions without
+// any further allocations. Which members are set depends on op:
+//  - imm: block type of block, loop and if, label depth of br and br_if,
+//    number of labels of br_table without its default, and the function,
+//    type, local, global, data segment or memory index of all others
+//  - imm2: offset of loads and stores, whose imm is the memory index,
+//    table index of call_indirect, memory index of memory.init and the
+//    source memory of memory.copy
+//  - value: i32/i64/f32/f64.const, stored with its type such that it can be
+//    pushed onto the stack as is
+//  - target: control instructions, see resolve_branches.
+//    For br_table, pc is the index of its first entry in Code::br_tables.
 struct Instr {
   OpCode op;
-  std::vector<Immediate> imms;
+  uint32_t imm;
+  union {
+    BranchTarget target;
+    uint32_t imm2;
+    Immediate value;
+  };
 };
 
-// Reads the opcode and depending on it reads multiple immediates to finally
-// return the Instr
-Instr parse_instruction(const uint8_t *&start, const uint8_t *end);
+// Reads the opcode and depending on it reads its immediates to finally
+// return the Instr. The labels of a br_table are appended to br_tables, with
+// the label depth stored in pc until resolve_branches replaces them.
+Instr parse_instruction(const uint8_t *&start, const uint8_t *end,
+                        std::vector<BranchTarget> &br_tables);
 
 // Reads all instructions starting from ptr until 0x0b (end code) is read and
 // builds the expression vector result.
+void read_expr(const uint8_t *&ptr, const uint8_t *end,
+               std::vector<Instr> &result,
+               std::vector<BranchTarget> &br_tables);
+
+// Reads a constant expression, as used by globals, elements and data segments
 void read_expr(const uint8_t *&ptr, const uint8_t *end,
                std::vector<Instr> &result);
 
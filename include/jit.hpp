@@ -0,0 +1,78 @@
+#ifndef JIT_HPP
+#define JIT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "instructions.hpp"
+#include "registers.hpp"
+#include "trap.hpp"
+
+// Baseline compiler from register code (see registers.hpp) to x86-64 machine
+// code, selected with Runtime(wasm, JIT_COMPILER).
+// Every register instruction is compiled on its own in a single pass, reading
+// its operands from and writing its result to the frame in memory, exactly
+// like execute_registers. Integer arithmetic, comparisons, the basic float
+// operations, loads, stores and all control flow are compiled to machine
+// code. Calls and the remaining instructions call back into the Runtime.
+// The code is written while its pages are writable and they are only made
+// executable afterwards, no page is ever writable and executable at once.
+
+class Runtime;
+
+// The state of a Runtime used by compiled code
+struct JitContext {
+  Runtime *runtime;
+  // Start and size of memory 0, updated whenever it grows or is reset
+  uint8_t *memory;
+  uint64_t memory_size;
+};
+
+// Compiled functions are called with the context of the calling Runtime and
+// the frame of the function, which is set up as for execute_registers. The
+// result is left in frame[0].
+typedef void (*JitEntry)(JitContext *context, Value *frame);
+
+// The machine code of a function, unmapped when destroyed
+struct JitFunction {
+  JitEntry entry = nullptr;
+  // Per loop of RegisterCode::loops, enters the function at the start of the
+  // loop with a frame holding the locals and the operand stack below the
+  // loop. nullptr for loops which are never executed.
+  std::vector<JitEntry> loop_entries;
+  void *code = nullptr;
+  size_t size = 0;
+
+  JitFunction() = default;
+  JitFunction(const JitFunction &) = delete;
+  JitFunction &operator=(const JitFunction &) = delete;
+  JitFunction(JitFunction &&other);
+  JitFunction &operator=(JitFunction &&other);
+  ~JitFunction();
+};
+
+// Whether this build can compile to machine code, only x86-64 Linux can.
+// Otherwise JIT_COMPILER runs the register interpreter instead.
+bool jit_supported();
+
+// Compiles the register code of a function. code must outlive result, the
+// machine code refers to its instructions. If the pages for the machine code
+// can not be mapped, result is left without an entry and the function runs in
+// the register interpreter.
+void compile_function(const RegisterCode &code, JitFunction &result);
+
+// Called by compiled code, implemented by the Runtime.
+// Calls a function whose arguments end at args_end.
+void jit_call(JitContext *context, uint32_t function_index, Value *args_end);
+// Calls the function at table_index of the function table, whose signature
+// must be type_index
+void jit_call_indirect(JitContext *context, uint32_t table_index,
+                       Value *args_end, uint32_t type_index);
+// Executes a single instruction which has not been compiled
+void jit_execute(JitContext *context, const RegInstr *instr, Value *frame);
+// Stops execution with a trap, for out of bounds memory accesses in builds
+// without WINTERP_SIGNAL_TRAPS
+[[noreturn]] void jit_trap(Trap trap);
+
+#endif // JIT_HPP
@@ -1,95 +1,105 @@
 #ifndef ULEB_HPP
 #define ULEB_HPP
 
+#include <cassert>
+#include <cstddef>
 #include <cstdint>
-#include <fstream>
-#include <vector>
-
-
-template<typename T>
-T uleb128_from_blocks(const std::vector<uint8_t>& blocks) {
-  T result = 0;
-  for (int i = 0; i < blocks.size(); i++) {
-    // set msb to always be 0 such that it doesnt contribute, then shift
-    uint8_t block = blocks[i] & 0x7F;
-    int shift = i * 7;
-    result |= (static_cast<T>(block) << shift);
-  }
 
-  return result;
-}
 
-template<typename T>
-T uleb128_decode(const uint8_t* &start, const uint8_t* end) {
+// Maximum number of bytes of a LEB128 encoded integer of type T
+// https://webassembly.github.io/spec/core/binary/values.html#integers
+template <typename T> constexpr int leb128_max_bytes() {
+  return (sizeof(T) * 8 + 6) / 7;
+}
 
-  // Read in bits of 8 until msb is 0
-  // TODO: preallocate, known max size,
-  // https://webassembly.github.io/spec/core/binary/values.html#integers
-  std::vector<uint8_t> blocks;
-  uint8_t block;
+// Decodes the remaining bytes of a value which did not fit into a single byte.
+// The loop is bounded by the maximum size of T, such that the compiler can
+// fully unroll it, and the value is assembled in a register.
+template <typename T>
+T uleb128_decode_multi(const uint8_t *&start, const uint8_t *end) {
+  uint64_t result = 0;
+  int shift = 0;
 
-  while(start != end) {
+  for (int i = 0; i < leb128_max_bytes<T>(); i++) {
+    if (start == end) {
+      assert(false && "truncated LEB128 integer");
+      return static_cast<T>(result);
+    }
 
-    blocks.push_back(*start);
+    uint8_t block = *start;
+    start++;
 
-    bool is_end = ((*start) & 0x80) == 0;
-    start++; // Increase before exiting, such that next call to this function starts at the next block
+    result |= static_cast<uint64_t>(block & 0x7F) << shift;
+    shift += 7;
 
-    if(is_end) {
-      break;
+    if ((block & 0x80) == 0) {
+      return static_cast<T>(result);
     }
   }
 
-  return uleb128_from_blocks<T>(blocks);
+  assert(false && "LEB128 integer too long");
+  return static_cast<T>(result);
 }
 
-template<typename T>
-T leb128_from_blocks(const std::vector<uint8_t>& blocks) {
-  T result = 0;
-
-  int shift = 0;
-  for (int i = 0; i < blocks.size(); i++) {
-    // set msb to always be 0 such that it doesnt contribute, then shift
-    uint8_t block = blocks[i] & 0x7F;
-    
-    result |= (static_cast<T>(block) << shift);
-    shift += 7;
+template <typename T>
+T uleb128_decode(const uint8_t *&start, const uint8_t *end) {
+  // Most indices and sizes are smaller than 128 and fit into a single byte
+  if (start != end && (*start & 0x80) == 0) {
+    T result = static_cast<T>(*start);
+    start++;
+    return result;
   }
 
-  // Ones complement + negating all bits
-  if((shift < sizeof(T) * 8) && ((blocks.back() & 0x40) != 0)) {
-    result |= (~T(0) << shift);
-  }
-
-  return result;
+  return uleb128_decode_multi<T>(start, end);
 }
 
-template<typename T>
-T leb128_decode(const uint8_t* &start, const uint8_t* end) {
-
-  std::vector<uint8_t> blocks;
-  uint8_t block;
+template <typename T>
+T leb128_decode_multi(const uint8_t *&start, const uint8_t *end) {
+  uint64_t result = 0;
+  int shift = 0;
 
-  while(start != end) {
+  for (int i = 0; i < leb128_max_bytes<T>(); i++) {
+    if (start == end) {
+      assert(false && "truncated LEB128 integer");
+      return static_cast<T>(result);
+    }
 
-    blocks.push_back(*start);
+    uint8_t block = *start;
+    start++;
 
-    bool is_end = ((*start) & 0x80) == 0;
-    start++; // Increase before exiting, such that next call to this function starts at the next block
+    result |= static_cast<uint64_t>(block & 0x7F) << shift;
+    shift += 7;
 
-    if(is_end) {
-      break;
+    if ((block & 0x80) == 0) {
+      // Sign extend from the last block
+      if (shift < 64 && (block & 0x40) != 0) {
+        result |= ~uint64_t(0) << shift;
+      }
+      return static_cast<T>(result);
     }
   }
 
-  return leb128_from_blocks<T>(blocks);
+  assert(false && "LEB128 integer too long");
+  return static_cast<T>(result);
 }
 
+template <typename T>
+T leb128_decode(const uint8_t *&start, const uint8_t *end) {
+  // Single byte values are in the range -64 to 63, bit 6 is the sign
+  if (start != end && (*start & 0x80) == 0) {
+    uint8_t block = *start;
+    start++;
+    return static_cast<T>(static_cast<int8_t>(block << 1) >> 1);
+  }
 
-// Reads a ULEB128 integer directly from file stream
-// Converts it to a uint32_t
-uint32_t file_uleb128_u32t(std::ifstream &file);
+  return leb128_decode_multi<T>(start, end);
+}
 
+// Decodes count consecutive unsigned LEB128 values into out, as found in
+// vectors of indices. Runs of single byte values are decoded eight at a time,
+// and with BMI2 (WINTERP_BMI2), longer values are gathered with pext.
+void uleb128_decode_u32s(const uint8_t *&start, const uint8_t *end,
+                         uint32_t *out, size_t count);
 
 // Starts reading the bytes at start and converts from uleb128 to uint32_t
 uint32_t uleb128_u32t(const uint8_t* &start, const uint8_t* end);
@@ -0,0 +1,75 @@
+#ifndef LINEAR_MEMORY_HPP
+#define LINEAR_MEMORY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// As defined per
+// https://webassembly.github.io/spec/core/exec/runtime.html#memory-instances
+const int MEMORY_PAGE_SIZE = 65536;
+
+// Most pages a memory with 32 bit addresses can have, 4 GiB
+const uint32_t MAX_MEMORY_PAGES = 65536;
+
+// Bytes reserved behind the largest memory. A load or store adds a 32 bit
+// offset to a 32 bit address and accesses at most 8 bytes from there, which
+// never reaches past the guard region.
+const uint64_t MEMORY_GUARD_SIZE = (uint64_t(1) << 32) + MEMORY_PAGE_SIZE;
+
+// The zero initialised bytes of a linear memory.
+// Where supported, the address space of the largest memory followed by
+// MEMORY_GUARD_SIZE bytes is reserved up front without any access rights.
+// Growing only makes the new pages accessible, so it never copies the memory
+// and data() stays the same. Every access behind size() faults.
+// Otherwise the bytes are kept in a vector, which moves when it grows.
+class LinearMemory {
+public:
+  LinearMemory() = default;
+  ~LinearMemory();
+
+  LinearMemory(const LinearMemory &) = delete;
+  LinearMemory &operator=(const LinearMemory &) = delete;
+
+  // Drops the contents and resizes the memory to pages zeroed pages. Returns
+  // false and leaves the memory without pages if there are more than
+  // MAX_MEMORY_PAGES or they can not be committed.
+  bool reset(uint32_t pages);
+
+  // Appends delta zeroed pages. Returns false and leaves the memory unchanged
+  // if it would have more than MAX_MEMORY_PAGES or the pages can not be
+  // committed.
+  bool grow(uint32_t delta);
+
+  uint8_t *data() { return bytes; }
+  const uint8_t *data() const { return bytes; }
+  size_t size() const { return length; }
+  uint32_t pages() const { return length / MEMORY_PAGE_SIZE; }
+
+  uint8_t &operator[](size_t offset) { return bytes[offset]; }
+  const uint8_t &operator[](size_t offset) const { return bytes[offset]; }
+
+  // Whether the address space is reserved, such that accesses behind size()
+  // fault instead of reaching other memory
+  bool reserved() const { return reservation != 0; }
+
+  // Whether address is inside the reservation, the memory or its guard region
+  bool reserves(const void *address) const {
+    const uint8_t *byte = static_cast<const uint8_t *>(address);
+    return reservation != 0 && byte >= bytes && byte < bytes + reservation;
+  }
+
+private:
+  // Makes [from, to) of the reservation accessible or inaccessible. Pages
+  // which become inaccessible are released and read as zero afterwards.
+  bool commit(size_t from, size_t to);
+  void decommit(size_t from, size_t to);
+
+  uint8_t *bytes = nullptr;
+  size_t length = 0;
+  // Reserved bytes at bytes, 0 if the memory is held in buffer
+  size_t reservation = 0;
+  std::vector<uint8_t> buffer;
+};
+
+#endif // LINEAR_MEMORY_HPP
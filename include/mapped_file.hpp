@@ -0,0 +1,36 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Read only contents of a whole file.
+// Where supported, the file is mapped into memory, such that its pages are
+// only read from disk when accessed and are never copied. Otherwise the file
+// is read into a buffer.
+class MappedFile {
+public:
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  // Returns nullptr if the file can not be opened or is empty
+  static std::shared_ptr<MappedFile> open(const char *path);
+
+  const uint8_t *data() const { return bytes; }
+  size_t size() const { return length; }
+
+private:
+  MappedFile() = default;
+
+  const uint8_t *bytes = nullptr;
+  size_t length = 0;
+  bool mapped = false;
+  // Only used if the file could not be mapped
+  std::vector<uint8_t> buffer;
+};
+
+#endif // MAPPED_FILE_HPP
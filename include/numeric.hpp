@@ -0,0 +1,574 @@
+#ifndef NUMERIC_HPP
+#define NUMERIC_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+#include "bits.hpp"
+#include "instructions.hpp"
+#include "trap.hpp"
+
+// The numeric instructions, shared by the interpreters and the C++ code
+// generated by winterp_aot (see aot.hpp), such that all of them compute the
+// same results.
+// op is a template parameter, such that every instruction gets its own
+// specialised handler without any branching on the opcode at run time.
+// Division and truncation to integers raise their traps, see trap.hpp.
+
+// Every numeric instruction except the reinterpretations, which leave the
+// bits of a Value as they are, together with its handler
+#define NUMERIC_INSTRUCTIONS(UNOP, BINOP)                                      \
+  UNOP(I32eqz, handle_numeric_unop_i32)                                        \
+  UNOP(I32clz, handle_numeric_unop_i32)                                        \
+  UNOP(I32ctz, handle_numeric_unop_i32)                                        \
+  UNOP(I32popcnt, handle_numeric_unop_i32)                                     \
+  UNOP(I64eqz, handle_numeric_unop_i64)                                        \
+  UNOP(I64clz, handle_numeric_unop_i64)                                        \
+  UNOP(I64ctz, handle_numeric_unop_i64)                                        \
+  UNOP(I64popcnt, handle_numeric_unop_i64)                                     \
+  UNOP(F32Abs, handle_numeric_unop_f32)                                        \
+  UNOP(F32Neg, handle_numeric_unop_f32)                                        \
+  UNOP(F32Ceil, handle_numeric_unop_f32)                                       \
+  UNOP(F32Floor, handle_numeric_unop_f32)                                      \
+  UNOP(F32Trunc, handle_numeric_unop_f32)                                      \
+  UNOP(F32Nearest, handle_numeric_unop_f32)                                    \
+  UNOP(F32Sqrt, handle_numeric_unop_f32)                                       \
+  UNOP(F64Abs, handle_numeric_unop_f64)                                        \
+  UNOP(F64Neg, handle_numeric_unop_f64)                                        \
+  UNOP(F64Ceil, handle_numeric_unop_f64)                                       \
+  UNOP(F64Floor, handle_numeric_unop_f64)                                      \
+  UNOP(F64Trunc, handle_numeric_unop_f64)                                      \
+  UNOP(F64Nearest, handle_numeric_unop_f64)                                    \
+  UNOP(F64Sqrt, handle_numeric_unop_f64)                                       \
+  BINOP(I32eq, handle_numeric_binop_i32)                                       \
+  BINOP(I32ne, handle_numeric_binop_i32)                                       \
+  BINOP(I32lts, handle_numeric_binop_i32)                                      \
+  BINOP(I32ltu, handle_numeric_binop_i32)                                      \
+  BINOP(I32gts, handle_numeric_binop_i32)                                      \
+  BINOP(I32gtu, handle_numeric_binop_i32)                                      \
+  BINOP(I32le_s, handle_numeric_binop_i32)                                     \
+  BINOP(I32le_u, handle_numeric_binop_i32)                                     \
+  BINOP(I32ge_s, handle_numeric_binop_i32)                                     \
+  BINOP(I32ge_u, handle_numeric_binop_i32)                                     \
+  BINOP(I32Add, handle_numeric_binop_i32)                                      \
+  BINOP(I32Sub, handle_numeric_binop_i32)                                      \
+  BINOP(I32Mul, handle_numeric_binop_i32)                                      \
+  BINOP(I32DivS, handle_numeric_binop_i32)                                     \
+  BINOP(I32DivU, handle_numeric_binop_i32)                                     \
+  BINOP(I32RemS, handle_numeric_binop_i32)                                     \
+  BINOP(I32RemU, handle_numeric_binop_i32)                                     \
+  BINOP(I32and, handle_numeric_binop_i32)                                      \
+  BINOP(I32or, handle_numeric_binop_i32)                                       \
+  BINOP(I32xor, handle_numeric_binop_i32)                                      \
+  BINOP(I32shl, handle_numeric_binop_i32)                                      \
+  BINOP(I32shrs, handle_numeric_binop_i32)                                     \
+  BINOP(I32shru, handle_numeric_binop_i32)                                     \
+  BINOP(I32rotl, handle_numeric_binop_i32)                                     \
+  BINOP(I32rotr, handle_numeric_binop_i32)                                     \
+  BINOP(I64eq, handle_numeric_binop_i64)                                       \
+  BINOP(I64ne, handle_numeric_binop_i64)                                       \
+  BINOP(I64lts, handle_numeric_binop_i64)                                      \
+  BINOP(I64ltu, handle_numeric_binop_i64)                                      \
+  BINOP(I64gts, handle_numeric_binop_i64)                                      \
+  BINOP(I64gtu, handle_numeric_binop_i64)                                      \
+  BINOP(I64les, handle_numeric_binop_i64)                                      \
+  BINOP(I64leu, handle_numeric_binop_i64)                                      \
+  BINOP(I64ges, handle_numeric_binop_i64)                                      \
+  BINOP(I64geu, handle_numeric_binop_i64)                                      \
+  BINOP(I64Add, handle_numeric_binop_i64)                                      \
+  BINOP(I64Sub, handle_numeric_binop_i64)                                      \
+  BINOP(I64Mul, handle_numeric_binop_i64)                                      \
+  BINOP(I64DivS, handle_numeric_binop_i64)                                     \
+  BINOP(I64DivU, handle_numeric_binop_i64)                                     \
+  BINOP(I64RemS, handle_numeric_binop_i64)                                     \
+  BINOP(I64RemU, handle_numeric_binop_i64)                                     \
+  BINOP(I64and, handle_numeric_binop_i64)                                      \
+  BINOP(I64or, handle_numeric_binop_i64)                                       \
+  BINOP(I64xor, handle_numeric_binop_i64)                                      \
+  BINOP(I64shl, handle_numeric_binop_i64)                                      \
+  BINOP(I64shrs, handle_numeric_binop_i64)                                     \
+  BINOP(I64shru, handle_numeric_binop_i64)                                     \
+  BINOP(I64rotl, handle_numeric_binop_i64)                                     \
+  BINOP(I64rotr, handle_numeric_binop_i64)                                     \
+  BINOP(F32EQ, handle_numeric_binop_f32)                                       \
+  BINOP(F32Ne, handle_numeric_binop_f32)                                       \
+  BINOP(F32Lt, handle_numeric_binop_f32)                                       \
+  BINOP(F32Gt, handle_numeric_binop_f32)                                       \
+  BINOP(F32Le, handle_numeric_binop_f32)                                       \
+  BINOP(F32Ge, handle_numeric_binop_f32)                                       \
+  BINOP(F32Add, handle_numeric_binop_f32)                                      \
+  BINOP(F32Sub, handle_numeric_binop_f32)                                      \
+  BINOP(F32Mul, handle_numeric_binop_f32)                                      \
+  BINOP(F32Div, handle_numeric_binop_f32)                                      \
+  BINOP(F32Min, handle_numeric_binop_f32)                                      \
+  BINOP(F32Max, handle_numeric_binop_f32)                                      \
+  BINOP(F32CopySign, handle_numeric_binop_f32)                                 \
+  BINOP(F64EQ, handle_numeric_binop_f64)                                       \
+  BINOP(F64Ne, handle_numeric_binop_f64)                                       \
+  BINOP(F64Lt, handle_numeric_binop_f64)                                       \
+  BINOP(F64Gt, handle_numeric_binop_f64)                                       \
+  BINOP(F64Le, handle_numeric_binop_f64)                                       \
+  BINOP(F64Ge, handle_numeric_binop_f64)                                       \
+  BINOP(F64Add, handle_numeric_binop_f64)                                      \
+  BINOP(F64Sub, handle_numeric_binop_f64)                                      \
+  BINOP(F64Mul, handle_numeric_binop_f64)                                      \
+  BINOP(F64Div, handle_numeric_binop_f64)                                      \
+  BINOP(F64Min, handle_numeric_binop_f64)                                      \
+  BINOP(F64Max, handle_numeric_binop_f64)                                      \
+  BINOP(F64CopySign, handle_numeric_binop_f64)                                 \
+  UNOP(I32WrapI64, handle_conversion)                                          \
+  UNOP(I32TruncSF32, handle_conversion)                                        \
+  UNOP(I32TruncUF32, handle_conversion)                                        \
+  UNOP(I32TruncSF64, handle_conversion)                                        \
+  UNOP(I32TruncUF64, handle_conversion)                                        \
+  UNOP(I64ExtendSI32, handle_conversion)                                       \
+  UNOP(I64ExtendUI32, handle_conversion)                                       \
+  UNOP(I64TruncSF32, handle_conversion)                                        \
+  UNOP(I64TruncUF32, handle_conversion)                                        \
+  UNOP(I64TruncSF64, handle_conversion)                                        \
+  UNOP(I64TruncUF64, handle_conversion)                                        \
+  UNOP(F32ConvertSI32, handle_conversion)                                      \
+  UNOP(F32ConvertUI32, handle_conversion)                                      \
+  UNOP(F32ConvertSI64, handle_conversion)                                      \
+  UNOP(F32ConvertUI64, handle_conversion)                                      \
+  UNOP(F32DemoteF64, handle_conversion)                                        \
+  UNOP(F64ConvertSI32, handle_conversion)                                      \
+  UNOP(F64ConvertUI32, handle_conversion)                                      \
+  UNOP(F64ConvertSI64, handle_conversion)                                      \
+  UNOP(F64ConvertUI64, handle_conversion)                                      \
+  UNOP(F32PromoteF64, handle_conversion)
+
+template <OpCode op>
+Value handle_numeric_binop_i32(Value a,
+                                            Value b) {
+  Value result;
+  if constexpr (op == OpCode::I32Add) {
+    result.n32 = a.n32 + b.n32;
+  } else if constexpr (op == OpCode::I32Mul) {
+    result.n32 = a.n32 * b.n32;
+  } else if constexpr (op == OpCode::I32Sub) {
+    result.n32 = a.n32 - b.n32;
+  } else if constexpr (op == OpCode::I32DivS) {
+    if (b.n32 == 0) {
+      raise_trap(INTEGER_DIVIDE_BY_ZERO);
+    }
+    if (static_cast<int32_t>(a.n32) == INT32_MIN && static_cast<int32_t>(b.n32) == -1) {
+      raise_trap(INTEGER_OVERFLOW);
+    }
+    result.n32 =
+        static_cast<int32_t>(a.n32) / static_cast<int32_t>(b.n32);
+  } else if constexpr (op == OpCode::I32DivU) {
+    if (b.n32 == 0) {
+      raise_trap(INTEGER_DIVIDE_BY_ZERO);
+    }
+    result.n32 = a.n32 / b.n32;
+  } else if constexpr (op == OpCode::I32RemS) {
+    if (b.n32 == 0) {
+      raise_trap(INTEGER_DIVIDE_BY_ZERO);
+    }
+    // The minimum divided by -1 overflows, but its remainder is 0
+    result.n32 = static_cast<int32_t>(b.n32) == -1
+                     ? 0
+                     : static_cast<int32_t>(a.n32) % static_cast<int32_t>(b.n32);
+  } else if constexpr (op == OpCode::I32RemU) {
+    if (b.n32 == 0) {
+      raise_trap(INTEGER_DIVIDE_BY_ZERO);
+    }
+    result.n32 = a.n32 % b.n32;
+  } else if constexpr (op == OpCode::I32eq) {
+    result.n32 = (a.n32 == b.n32);
+  } else if constexpr (op == OpCode::I32ne) {
+    result.n32 = (a.n32 != b.n32);
+  } else if constexpr (op == OpCode::I32ltu) {
+    result.n32 = a.n32 < b.n32;
+  } else if constexpr (op == OpCode::I32lts) {
+    result.n32 =
+        (static_cast<int32_t>(a.n32) < static_cast<int32_t>(b.n32));
+  } else if constexpr (op == OpCode::I32gtu) {
+    result.n32 = a.n32 > b.n32;
+  } else if constexpr (op == OpCode::I32gts) {
+    result.n32 =
+        (static_cast<int32_t>(a.n32) > static_cast<int32_t>(b.n32));
+  } else if constexpr (op == OpCode::I32le_s) {
+    result.n32 =
+        (static_cast<int32_t>(a.n32) <= static_cast<int32_t>(b.n32));
+  } else if constexpr (op == OpCode::I32le_u) {
+    result.n32 = a.n32 <= b.n32;
+  } else if constexpr (op == OpCode::I32ge_s) {
+    result.n32 =
+        (static_cast<int32_t>(a.n32) >= static_cast<int32_t>(b.n32));
+  } else if constexpr (op == OpCode::I32ge_u) {
+    result.n32 = a.n32 >= b.n32;
+  } else if constexpr (op == OpCode::I32and) {
+    result.n32 = a.n32 & b.n32;
+  } else if constexpr (op == OpCode::I32or) {
+    result.n32 = a.n32 | b.n32;
+  } else if constexpr (op == OpCode::I32xor) {
+    result.n32 = a.n32 ^ b.n32;
+  } else if constexpr (op == OpCode::I32shl) {
+    // Shift and rotate counts are taken modulo the width
+    result.n32 = a.n32 << (b.n32 & 0x1F);
+  } else if constexpr (op == OpCode::I32shrs) {
+    result.n32 = static_cast<int32_t>(a.n32) >> (b.n32 & 0x1F);
+  } else if constexpr (op == OpCode::I32shru) {
+    result.n32 = a.n32 >> (b.n32 & 0x1F);
+  } else if constexpr (op == OpCode::I32rotl) {
+    uint32_t shift = b.n32 & 0x1F;
+    result.n32 = (a.n32 << shift) | (a.n32 >> ((32 - shift) & 0x1F));
+  } else if constexpr (op == OpCode::I32rotr) {
+    uint32_t shift = b.n32 & 0x1F;
+    result.n32 = (a.n32 >> shift) | (a.n32 << ((32 - shift) & 0x1F));
+  } else {
+    assert(false && "todo: invalid binop for i32");
+  }
+
+  return result;
+}
+
+template <OpCode op>
+Value handle_numeric_unop_i32(Value a) {
+
+  Value result;
+
+  if constexpr (op == I32eqz) {
+    result.n32 = a.n32 == 0;
+  } else if constexpr (op == OpCode::I32clz) {
+    result.n32 = clz(a.n32);
+  } else if constexpr (op == OpCode::I32ctz) {
+    result.n32 = ctz(a.n32);
+  } else if constexpr (op == OpCode::I32popcnt) {
+    result.n32 = popcnt(a.n32);
+  } else {
+    assert(false && "todo: missing opcode");
+  }
+
+  return result;
+}
+
+template <OpCode op>
+Value handle_numeric_unop_i64(Value a) {
+
+  Value result;
+
+  if constexpr (op == I64eqz) {
+    result.n64 = a.n64 == 0;
+  } else if constexpr (op == OpCode::I64clz) {
+    result.n64 = clz(a.n64);
+  } else if constexpr (op == OpCode::I64ctz) {
+    result.n64 = ctz(a.n64);
+  } else if constexpr (op == OpCode::I64popcnt) {
+    result.n64 = popcnt(a.n64);
+  } else {
+    assert(false && "todo: missing opcode");
+  }
+
+  return result;
+}
+
+template <OpCode op>
+Value handle_numeric_binop_i64(Value a,
+                                            Value b) {
+  Value result;
+  if constexpr (op == OpCode::I64Add) {
+    result.n64 = a.n64 + b.n64;
+  } else if constexpr (op == OpCode::I64Mul) {
+    result.n64 = a.n64 * b.n64;
+  } else if constexpr (op == OpCode::I64Sub) {
+    result.n64 = a.n64 - b.n64;
+  } else if constexpr (op == OpCode::I64DivS) {
+    if (b.n64 == 0) {
+      raise_trap(INTEGER_DIVIDE_BY_ZERO);
+    }
+    if (static_cast<int64_t>(a.n64) == INT64_MIN && static_cast<int64_t>(b.n64) == -1) {
+      raise_trap(INTEGER_OVERFLOW);
+    }
+    result.n64 =
+        static_cast<int64_t>(a.n64) / static_cast<int64_t>(b.n64);
+  } else if constexpr (op == OpCode::I64DivU) {
+    if (b.n64 == 0) {
+      raise_trap(INTEGER_DIVIDE_BY_ZERO);
+    }
+    result.n64 = a.n64 / b.n64;
+  } else if constexpr (op == OpCode::I64RemS) {
+    if (b.n64 == 0) {
+      raise_trap(INTEGER_DIVIDE_BY_ZERO);
+    }
+    // The minimum divided by -1 overflows, but its remainder is 0
+    result.n64 = static_cast<int64_t>(b.n64) == -1
+                     ? 0
+                     : static_cast<int64_t>(a.n64) % static_cast<int64_t>(b.n64);
+  } else if constexpr (op == OpCode::I64RemU) {
+    if (b.n64 == 0) {
+      raise_trap(INTEGER_DIVIDE_BY_ZERO);
+    }
+    result.n64 = a.n64 % b.n64;
+  } else if constexpr (op == OpCode::I64and) {
+    result.n64 = a.n64 & b.n64;
+  } else if constexpr (op == OpCode::I64or) {
+    result.n64 = a.n64 | b.n64;
+  } else if constexpr (op == OpCode::I64xor) {
+    result.n64 = a.n64 ^ b.n64;
+  } else if constexpr (op == OpCode::I64shl) {
+    result.n64 = a.n64 << (b.n64 & 0x3F);
+  } else if constexpr (op == OpCode::I64shrs) {
+    result.n64 = static_cast<int64_t>(a.n64) >> (b.n64 & 0x3F);
+  } else if constexpr (op == OpCode::I64shru) {
+    result.n64 = a.n64 >> (b.n64 & 0x3F);
+  } else if constexpr (op == OpCode::I64rotl) {
+    uint64_t shift = b.n64 & 0x3F;
+    result.n64 = (a.n64 << shift) | (a.n64 >> ((64 - shift) & 0x3F));
+  } else if constexpr (op == OpCode::I64rotr) {
+    uint64_t shift = b.n64 & 0x3F;
+    result.n64 = (a.n64 >> shift) | (a.n64 << ((64 - shift) & 0x3F));
+  } else if constexpr (op == OpCode::I64eqz) {
+    result.n32 = (a.n64 == 0) ? 1 : 0;
+  } else if constexpr (op == OpCode::I64eq) {
+    result.n32 = (a.n64 == b.n64) ? 1 : 0;
+  } else if constexpr (op == OpCode::I64ne) {
+    result.n32 = (a.n64 != b.n64) ? 1 : 0;
+  } else if constexpr (op == OpCode::I64lts) {
+    result.n32 =
+        (static_cast<int64_t>(a.n64) < static_cast<int64_t>(b.n64)) ? 1 : 0;
+  } else if constexpr (op == OpCode::I64ltu) {
+    result.n32 = a.n64 < b.n64 ? 1 : 0;
+  } else if constexpr (op == OpCode::I64gts) {
+    result.n32 =
+        (static_cast<int64_t>(a.n64) > static_cast<int64_t>(b.n64)) ? 1 : 0;
+  } else if constexpr (op == OpCode::I64gtu) {
+    result.n32 = a.n64 > b.n64 ? 1 : 0;
+  } else if constexpr (op == OpCode::I64les) {
+    result.n32 =
+        (static_cast<int64_t>(a.n64) <= static_cast<int64_t>(b.n64)) ? 1
+                                                                         : 0;
+  } else if constexpr (op == OpCode::I64leu) {
+    result.n32 = a.n64 <= b.n64 ? 1 : 0;
+  } else if constexpr (op == OpCode::I64ges) {
+    result.n32 =
+        (static_cast<int64_t>(a.n64) >= static_cast<int64_t>(b.n64)) ? 1
+                                                                         : 0;
+  } else if constexpr (op == OpCode::I64geu) {
+    result.n32 = a.n64 >= b.n64 ? 1 : 0;
+  } else {
+    assert(false && "todo: invalid binop for i64");
+  }
+
+  return result;
+}
+
+template <OpCode op>
+Value handle_numeric_unop_f32(Value a) {
+  Value result;
+
+  if constexpr (op == OpCode::F32Abs) {
+    result.p32 = std::fabs(a.p32);
+  } else if constexpr (op == OpCode::F32Neg) {
+    result.p32 = -a.p32;
+  } else if constexpr (op == OpCode::F32Sqrt) {
+    result.p32 = std::sqrt(a.p32);
+  } else if constexpr (op == OpCode::F32Ceil) {
+    result.p32 = std::ceil(a.p32);
+  } else if constexpr (op == OpCode::F32Floor) {
+    result.p32 = std::floor(a.p32);
+  } else if constexpr (op == OpCode::F32Trunc) {
+    result.p32 = std::trunc(a.p32);
+  } else if constexpr (op == OpCode::F32Nearest) {
+    result.p32 = std::rintf(a.p32);
+  } else {
+    assert(false && "todo: invalid f32 binop");
+  }
+  return result;
+}
+
+template <OpCode op>
+Value handle_numeric_binop_f32(Value a,
+                                            Value b) {
+  Value result;
+  if constexpr (op == OpCode::F32Add) {
+    result.p32 = a.p32 + b.p32;
+  } else if constexpr (op == OpCode::F32Mul) {
+    result.p32 = a.p32 * b.p32;
+  } else if constexpr (op == OpCode::F32Sub) {
+    result.p32 = a.p32 - b.p32;
+  } else if constexpr (op == OpCode::F32Div) {
+    result.p32 = a.p32 / b.p32;
+  } else if constexpr (op == OpCode::F32Min) {
+    result.p32 = std::min(a.p32, b.p32);
+  } else if constexpr (op == OpCode::F32Max) {
+    result.p32 = std::max(a.p32, b.p32);
+  } else if constexpr (op == OpCode::F32CopySign) {
+    result.p32 = std::copysign(a.p32, b.p32);
+  } else {
+
+    // Most likely a Comparison op
+    if constexpr (op == OpCode::F32EQ) {
+      result.n32 = a.p32 == b.p32;
+    } else if constexpr (op == OpCode::F32Ne) {
+      result.n32 = a.p32 != b.p32;
+    }
+
+    else if constexpr (op == OpCode::F32Lt) {
+      result.n32 = a.p32 < b.p32;
+    } else if constexpr (op == OpCode::F32Gt) {
+      result.n32 = a.p32 > b.p32;
+    }
+
+    else if constexpr (op == OpCode::F32Le) {
+      result.n32 = a.p32 <= b.p32;
+    }
+
+    else if constexpr (op == OpCode::F32Ge) {
+      result.n32 = a.p32 >= b.p32;
+    } else {
+      assert(false && "todo: invalid binop for f32");
+    }
+  }
+  return result;
+}
+
+template <OpCode op>
+Value handle_numeric_unop_f64(Value a) {
+  Value result;
+
+  if constexpr (op == OpCode::F64Abs) {
+    result.p64 = std::fabs(a.p64);
+  } else if constexpr (op == OpCode::F64Neg) {
+    result.p64 = -a.p64;
+  } else if constexpr (op == OpCode::F64Sqrt) {
+    result.p64 = std::sqrt(a.p64);
+  } else if constexpr (op == OpCode::F64Ceil) {
+    result.p64 = std::ceil(a.p64);
+  } else if constexpr (op == OpCode::F64Floor) {
+    result.p64 = std::floor(a.p64);
+  } else if constexpr (op == OpCode::F64Trunc) {
+    result.p64 = std::trunc(a.p64);
+  } else if constexpr (op == OpCode::F64Nearest) {
+    result.p64 = std::rintf(a.p64);
+  } else {
+    assert(false && "todo");
+  }
+  return result;
+}
+
+template <OpCode op>
+Value handle_numeric_binop_f64(Value a,
+                                            Value b) {
+  Value result;
+  if constexpr (op == OpCode::F64Add) {
+    result.p64 = a.p64 + b.p64;
+  } else if constexpr (op == OpCode::F64Mul) {
+    result.p64 = a.p64 * b.p64;
+  } else if constexpr (op == OpCode::F64Sub) {
+    result.p64 = a.p64 - b.p64;
+  } else if constexpr (op == OpCode::F64Div) {
+    result.p64 = a.p64 / b.p64;
+  } else if constexpr (op == OpCode::F64Min) {
+    result.p64 = std::min(a.p64, b.p64);
+  } else if constexpr (op == OpCode::F64Max) {
+    result.p64 = std::max(a.p64, b.p64);
+  } else if constexpr (op == OpCode::F64CopySign) {
+    result.p64 = std::copysign(a.p64, b.p64);
+  } else {
+
+    // Most likely a Comparison op
+    if constexpr (op == OpCode::F64EQ) {
+      result.n64 = a.p64 == b.p64;
+    } else if constexpr (op == OpCode::F64Ne) {
+      result.n64 = a.p64 != b.p64;
+    }
+
+    else if constexpr (op == OpCode::F64Lt) {
+      result.n64 = a.p64 < b.p64;
+    } else if constexpr (op == OpCode::F64Gt) {
+      result.n64 = a.p64 > b.p64;
+    }
+
+    else if constexpr (op == OpCode::F64Le) {
+      result.n64 = a.p64 <= b.p64;
+    }
+
+    else if constexpr (op == OpCode::F64Ge) {
+      result.n64 = a.p64 >= b.p64;
+    } else {
+      assert(false && "todo: invalid binop for f64");
+    }
+  }
+  return result;
+}
+
+// The integer value rounds towards zero to, trapping for NaN and values
+// outside of the range of Int
+// https://webassembly.github.io/spec/core/exec/numerics.html#op-trunc-u
+template <typename Int> Int truncate(double value) {
+  if (std::isnan(value)) {
+    raise_trap(INVALID_CONVERSION_TO_INTEGER);
+  }
+  // Both bounds are powers of two, which a double holds exactly. f32 values
+  // convert to double without rounding.
+  const double lower =
+      std::is_signed<Int>::value ? double(std::numeric_limits<Int>::min()) : 0;
+  const double upper = std::is_signed<Int>::value
+                           ? -lower
+                           : 2 * double(Int(1) << (sizeof(Int) * 8 - 1));
+  double truncated = std::trunc(value);
+  if (!(truncated >= lower && truncated < upper)) {
+    raise_trap(INTEGER_OVERFLOW);
+  }
+  return static_cast<Int>(truncated);
+}
+
+template <OpCode op>
+Value handle_conversion(Value a) {
+  Value result;
+  if constexpr (op == I32WrapI64) {
+    result.n32 = static_cast<uint32_t>(a.n64);
+  } else if constexpr (op == F32ConvertSI32) {
+    result.p32 = static_cast<float>((int32_t)a.n32);
+  } else if constexpr (op == F32ConvertUI32) {
+    result.p32 = static_cast<float>(a.n32);
+  } else if constexpr (op == F32ConvertSI64) {
+    result.p32 = static_cast<float>((int64_t)a.n64);
+  } else if constexpr (op == F32ConvertUI64) {
+    result.p32 = static_cast<float>(a.n64);
+  } else if constexpr (op == F32DemoteF64) {
+    result.p32 = static_cast<float>(a.p64);
+  } else if constexpr (op == F64ConvertSI32) {
+    result.p64 = static_cast<double>((int32_t)a.n32);
+  } else if constexpr (op == F64ConvertUI32) {
+    result.p64 = static_cast<double>(a.n32);
+  } else if constexpr (op == F64ConvertSI64) {
+    result.p64 = static_cast<double>((int64_t)a.n64);
+  } else if constexpr (op == F64ConvertUI64) {
+    result.p64 = static_cast<double>(a.n64);
+  } else if constexpr (op == F32PromoteF64) {
+    result.p64 = static_cast<double>(a.p32);
+  } else if constexpr (op == I32TruncSF32) {
+    result.n32 = static_cast<uint32_t>(truncate<int32_t>(a.p32));
+  } else if constexpr (op == I32TruncUF32) {
+    result.n32 = truncate<uint32_t>(a.p32);
+  } else if constexpr (op == I32TruncSF64) {
+    result.n32 = static_cast<uint32_t>(truncate<int32_t>(a.p64));
+  } else if constexpr (op == I32TruncUF64) {
+    result.n32 = truncate<uint32_t>(a.p64);
+  } else if constexpr (op == I64ExtendSI32) {
+    result.n64 = static_cast<int64_t>(static_cast<int32_t>(a.n32));
+  } else if constexpr (op == I64ExtendUI32) {
+    result.n64 = static_cast<uint64_t>(static_cast<uint32_t>(a.n32));
+  } else if constexpr (op == I64TruncSF32) {
+    result.n64 = static_cast<uint64_t>(truncate<int64_t>(a.p32));
+  } else if constexpr (op == I64TruncUF32) {
+    result.n64 = truncate<uint64_t>(a.p32);
+  } else if constexpr (op == I64TruncSF64) {
+    result.n64 = static_cast<uint64_t>(truncate<int64_t>(a.p64));
+  } else if constexpr (op == I64TruncUF64) {
+    result.n64 = truncate<uint64_t>(a.p64);
+  } else {
+    assert(false && "todo: missing case");
+  }
+  return result;
+}
+
+#endif // NUMERIC_HPP
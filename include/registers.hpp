@@ -0,0 +1,87 @@
+#ifndef REGISTERS_HPP
+#define REGISTERS_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "instructions.hpp"
+
+// A register based form of a function body, executed by
+// Runtime::execute_registers.
+// Instead of pushing and popping the operand stack, every instruction names
+// the slots of the frame holding its operands and its result. The frame of a
+// function consists of
+//  - its locals, starting with its parameters
+//  - its constants, copied into the frame when the function is called
+//  - one slot per operand stack height, for intermediate results. A call
+//    passes its arguments in these slots, they become the callee's frame.
+// local.get, the consts, drop, nop, block, loop and end need no instruction at
+// all, instructions read their operands directly from the locals and
+// constants. An instruction followed by local.set writes its result directly
+// to the local.
+
+// A translated instruction. Which members are set depends on op:
+//  - dst: slot of the result. Branches move their value from a to dst.
+//  - a, b, c: slots of the operands, in the order Wasm pops them reversed.
+//    br_if has its condition in b, if in a. Calls store their first argument
+//    in a, which becomes the frame of the callee, and the number of
+//    arguments in c.
+//  - imm: pc of branches, offset of loads and stores, number of values
+//    returned by return, or the function, type, global or data segment index
+//  - imm2: memory index, table index of call_indirect or the number of
+//    labels of br_table without its default
+struct RegInstr {
+  OpCode op;
+  uint32_t dst;
+  uint32_t a;
+  uint32_t b;
+  uint32_t c;
+  uint32_t imm;
+  uint32_t imm2;
+};
+
+// A label of br_table, its value is moved to the slot dst
+struct RegTableEntry {
+  uint32_t pc;
+  uint32_t dst;
+};
+
+// Where a loop of the body starts, for entering register code in the middle
+// of a function (see Runtime::enter_loop). When entering, the operand stack
+// below the loop holds height values, which are in the slots of the
+// intermediate results.
+struct RegLoop {
+  // First instruction of the loop, UNREACHABLE_LOOP if it is never executed
+  uint32_t pc;
+  uint32_t height;
+};
+
+const uint32_t UNREACHABLE_LOOP = UINT32_MAX;
+
+struct RegisterCode {
+  std::vector<RegInstr> instrs;
+  // For every br_table, its labels followed by the default label.
+  // br_table stores the index of its first label in imm.
+  std::vector<RegTableEntry> br_tables;
+  // Copied to the frame at slot constants_slot when the function is called
+  std::vector<Value> constants;
+  // Every loop in the order of the body, like Code::loops
+  std::vector<RegLoop> loops;
+  uint32_t num_params = 0;
+  // Number of results, which are returned in the first slot
+  uint32_t num_results = 0;
+  // Zero initialised locals, which follow the parameters
+  uint32_t num_locals = 0;
+  uint32_t constants_slot = 0;
+  // First slot of the intermediate results, behind the constants
+  uint32_t temps_slot = 0;
+  // Number of slots of the whole frame
+  uint32_t frame_size = 0;
+};
+
+// Translates the body of wasm.codes[code_index] into register code.
+// The body must have been decoded and validated by WasmFile::function_code.
+void translate_registers(const struct WasmFile &wasm, uint32_t code_index,
+                         RegisterCode &result);
+
+#endif // REGISTERS_HPP
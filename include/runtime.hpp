@@ -2,13 +2,86 @@
 #define RUNNER_HPP
 
 #include "instructions.hpp"
+#include "jit.hpp"
+#include "linear_memory.hpp"
+#include "registers.hpp"
 #include "sections.hpp"
+#include "trap.hpp"
+#include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <vector>
 
-// As defined per
-// https://webassembly.github.io/spec/core/exec/runtime.html#memory-instances
-const int MEMORY_PAGE_SIZE = 65536;
+// Number of values the operand stack of a Runtime can hold
+const size_t STACK_SLOTS = 1 << 20;
+
+// Bytes of the native stack which the calls nested inside of Runtime::run may
+// use. The thread running it needs this much and some more.
+const uintptr_t NATIVE_STACK_SIZE = 4 << 20;
+
+// How a Runtime executes function bodies
+enum Interpreter : uint8_t {
+  // Executes the decoded Wasm instructions on the operand stack
+  STACK_INTERPRETER,
+  // Executes register code, see registers.hpp
+  REGISTER_INTERPRETER,
+  // Compiles the register code to machine code, see jit.hpp. Falls back to
+  // the register interpreter where this is not supported.
+  JIT_COMPILER,
+  // Starts every function in the stack interpreter, which needs no
+  // translation, and counts its calls and loop iterations. Functions which
+  // reach Runtime::tier_up_threshold run in Runtime::optimized_tier from
+  // their next call on.
+  TIERED,
+};
+
+// Counters of a function run by TIERED
+struct FunctionProfile {
+  uint64_t calls = 0;
+  // Branches back to the start of a loop, in total and per loop in the order
+  // of Code::loops. Only counted while the function runs in the stack
+  // interpreter.
+  uint64_t back_edges = 0;
+  std::vector<uint64_t> loop_back_edges;
+  // Where the function runs from its next call on
+  Interpreter tier = STACK_INTERPRETER;
+};
+
+// A function promoted by TIERED, with its counters at that time
+struct TierUp {
+  uint32_t function_index;
+  uint64_t calls;
+  uint64_t back_edges;
+  Interpreter tier;
+};
+
+// A call of a function which moved from the stack interpreter to its
+// optimized code while running, at the start of one of its loops
+struct OsrEntry {
+  uint32_t function_index;
+  // Index of the loop in Code::loops
+  uint32_t loop;
+  // Back edges of the loop so far
+  uint64_t back_edges;
+  Interpreter tier;
+};
+
+// Type id of a table entry which holds no function
+const uint32_t NULL_ENTRY = UINT32_MAX;
+
+// An entry of the function table. call_indirect compares the canonical type
+// id of its signature with type_id, see WasmFile::type_ids.
+struct TableEntry {
+  uint32_t type_id = NULL_ENTRY;
+  uint32_t function_index = 0;
+  // The prepared code of the function for the interpreter of the Runtime,
+  // which call_indirect runs without going through execute_function. Only
+  // the one of the interpreter is set, none for imports, lazy modules and
+  // TIERED.
+  const Code *code = nullptr;
+  const RegisterCode *registers = nullptr;
+  const JitFunction *jit = nullptr; // With registers, for JIT_COMPILER
+};
 
 class Runtime {
 
@@ -16,15 +89,34 @@ private:
   // the parsed data file
   const struct WasmFile &wasm;
 
-  // Normal stack, can be pushed and popped.
-  std::vector<Immediate> stack;
+  Interpreter interpreter;
+
+  // Operand stack of STACK_SLOTS values, allocated once.
+  // Values carry no type, the instructions of a valid module always know the
+  // types of their operands. sp points behind the topmost value.
+  std::unique_ptr<Value[]> stack;
+  Value *sp;
 
-  // Array memory
-  std::vector<uint8_t> memory;
+  // Memory 0, which keeps its address when it grows where supported, see
+  // LinearMemory. Instructions on memory 0 use it directly.
+  LinearMemory memory;
 
-  // The Data Segments, directly copied from WasmFile
+  // The Store of memory instances by index, sized from WasmFile::memory.
+  // memories[0] is memory, which has no pages if the module has no memory.
+  // The others only exist in modules with multiple memories and are owned by
+  // additional_memories.
+  std::vector<LinearMemory *> memories;
+  std::vector<std::unique_ptr<LinearMemory>> additional_memories;
+
+  // The Data Segments, directly copied from WasmFile. Unlike the element
+  // segments, active ones stay available to memory.init until data.drop,
+  // which the test binaries rely on.
   std::vector<DataSegment> data;
 
+  // The function indices of the Element Segments. Active and declarative ones
+  // are dropped when instantiating, like elem.drop does.
+  std::vector<std::vector<uint32_t>> elems;
+
   struct GlobalInstance {
     bool mut;
     Immediate value;
@@ -32,17 +124,21 @@ private:
 
   std::vector<GlobalInstance> globals;
 
-  // How many pages of memory we currently have. One page is MEMORY_PAGE_SIZE bytes
-  uint32_t pages;
+  // Initialised by the "Table" section in wasm, filled by the element
+  // segments
+  std::vector<TableEntry> function_table;
+
+  // Passed to compiled code
+  JitContext jit_context;
 
-  // Initialised by the "Table" section in wasm
-  std::vector<uint32_t> function_table;
+  // One per entry of WasmFile::codes, only for TIERED
+  std::vector<FunctionProfile> profiles;
   
   // Returns and removes the last value on the stack
-  Immediate pop_stack();
+  Value pop_stack();
 
-  // Pushes the stack by imm
-  void push_stack(const Immediate &imm);
+  // Pushes value onto the stack
+  void push_stack(Value value);
 
   // Writes the number to the memory in little-endian bytes
   // https://webassembly.github.io/spec/core/exec/numerics.html#storage
@@ -50,77 +146,109 @@ private:
   void write_memory(const uint32_t &mem_index, const uint32_t &offset,
                     const Immediate &imm);
 
-  // Moves the program counter, until the next else / end is found, ignoring
-  // nested conditions
-  // The program counter will be left at the first instruction to be executed
-  // next.
-  void skip_control_block(const std::vector<Instr> &block, int &pc);
-
-  // Moves the program counter to the next executable instruction.
-  // This means it searches for arity + 1 'end's, ignoring newly nested ends.
-  void branch_block(const std::vector<Instr> &block, int &pc, int arity); 
+  // Jumps to a branch target resolved by resolve_branches.
+  // The operand stack is unwound to the height of the target label, keeping
+  // only the values carried over to it. frame is the stack pointer at the
+  // start of the function, the new stack pointer is returned.
+  Value *branch(const BranchTarget &target, Value *frame, Value *sp, int &pc);
   
-  // Computes the resulting Immediate based on the value of OpCode
-  // The valid OpCodes for this function are limited to unop's for i32
-  Immediate handle_numeric_unop_i32(const OpCode &op, const Immediate &a);
-
-  // Computes the resulting Immediate based on the value of OpCode
-  // The valid OpCodes for this function are limited to binop's for i32
-  Immediate handle_numeric_binop_i32(const OpCode &op, const Immediate &a,
-                                     const Immediate &b);
-
-
-  // Computes the resulting Immediate based on the value of OpCode
-  // The valid OpCodes for this function are limited to unop's for i64
-  Immediate handle_numeric_unop_i64(const OpCode &op, const Immediate &a);
-
-  // Computes the resulting Immediate based on the value of OpCode
-  // The valid OpCodes for this function are limited to binop's for i64
-  Immediate handle_numeric_binop_i64(const OpCode &op, const Immediate &a,
-                                     const Immediate &b);
-
-  // Computes the resulting Immediate based on the value of OpCode
-  // The valid OpCodes for this function are limited to unop's for f32
-  Immediate handle_numeric_unop_f32(const OpCode &op, const Immediate &a);
+  // Memory mem_index, memory 0 without going through memories
+  LinearMemory &memory_instance(uint32_t mem_index);
 
-  // Computes the resulting Immediate based on the value of OpCode
-  // The valid OpCodes for this function are limited to binop's for f32
-  // Resulting immediate is not limited to f32, result of comparisons will be
-  // set to i32
-  Immediate handle_numeric_binop_f32(const OpCode &op, const Immediate &a,
-                                     const Immediate &b);
+  // The size bytes of instance at address, raising a trap if they are out of
+  // bounds. Builds with WINTERP_SIGNAL_TRAPS leave that to the guard region
+  // and do not check, see trap.hpp.
+  template <size_t size>
+  uint8_t *memory_at(LinearMemory &instance, uint64_t address);
 
-  // Computes the resulting Immediate based on the value of OpCode
-  // The valid OpCodes for this function are limited to unop's for f64
-  Immediate handle_numeric_unop_f64(const OpCode &op, const Immediate &a);
-
-  // Computes the resulting Immediate based on the value of OpCode
-  // The valid OpCodes for this function are limited to binop's for f64
-  // Resulting immediate is not limited to f64, result of comparisons will be
-  // set to i32
-  Immediate handle_numeric_binop_f64(const OpCode &op, const Immediate &a,
-                                     const Immediate &b);
-
-  // Converts, Promotes or demotes 'a' based on OpCode.
-  Immediate handle_conversion(const OpCode &op, const Immediate &a);
-
-  // Handles all Load operations with given reinterp
-  Immediate handle_load(const OpCode &op, const uint32_t& mem_index, const uint32_t& offset);
+  // Handles all Load operations with given reinterp. address is the sum of
+  // the 32 bit address and offset, which must not wrap around. The
+  // interpreters pass memory itself for memory 0, which they then access
+  // without looking it up.
+  template <OpCode op> Value handle_load(LinearMemory &instance, uint64_t address);
 
   // Handles all store operations 
-  void handle_store(const OpCode &op, const uint32_t& mem_index, const uint32_t& offset, const Immediate& value);
-
-  // Changes the type of A from 'from' to 'to'. No casting or actual conversion
-  // is done. Will assert that the current type of a is 'from'.
-  Immediate reinterp(const Immediate &a, const ImmediateRepr from,
-                     const ImmediateRepr to);
-
-  // Executes the given instruction block
-  // params and locals need to be correctly initialised, since these can be used by the block
-  void execute_block(const std::vector<Instr>& block, std::vector<Immediate>& params, std::vector<Immediate>& locals);
-
-  // Execute a block and initialised params and locals to be empty
-  void execute_block(const std::vector<Instr>& block);
+  template <OpCode op> void handle_store(LinearMemory &instance, uint64_t address, Value value);
+
+  // The n bytes of memory mem_index at address, raising a trap unless all of
+  // them are in bounds. Checked in every build, the ranges of the bulk memory
+  // instructions can reach far past the guard region.
+  uint8_t *memory_range(uint32_t mem_index, uint64_t address, uint64_t n);
+
+  // Memory instructions, shared by execute_block and execute_registers.
+  // memory_grow returns the previous number of pages, or UINT32_MAX (-1)
+  // without changing the memory if it can not grow, also not past the
+  // maximum of its limits.
+  // The bulk instructions check their whole ranges up front, then copy or
+  // fill them at once. Nothing is written if they trap.
+  uint32_t memory_grow(uint32_t mem_index, uint32_t delta);
+  void memory_fill(uint32_t mem_index, uint32_t offset, Value value,
+                   uint32_t n);
+  void memory_copy(uint32_t dst_mem, uint32_t src_mem, uint32_t dst,
+                   uint32_t src, uint32_t n);
+  void memory_init(uint32_t data_segment_index, uint32_t mem_index,
+                   uint32_t dst, uint32_t src, uint32_t n);
+  void data_drop(uint32_t data_segment_index);
+
+  // Table instructions, likewise. Only table 0 exists, the function table,
+  // so table_instance traps with TABLE_OUT_OF_BOUNDS for all others.
+  std::vector<TableEntry> &table_instance(uint32_t table_index);
+  void table_init(uint32_t elem_index, uint32_t table_index, uint32_t dst,
+                  uint32_t src, uint32_t n);
+  void elem_drop(uint32_t elem_index);
+  void table_copy(uint32_t dst_table, uint32_t src_table, uint32_t dst,
+                  uint32_t src, uint32_t n);
+
+  // The table entry holding the function, with its code prepared for the
+  // interpreter like call_indirect expects
+  TableEntry make_table_entry(uint32_t function_index) const;
+
+  // Executes the body of a function
+  // locals points to the frame of the function on the stack, its arguments
+  // followed by its declared locals. The operand stack starts behind them.
+  // On return, the frame is replaced by the results.
+  // Branches back to a loop are counted in profile, unless it is nullptr.
+  void execute_block(const Code &code, Value *locals,
+                     FunctionProfile *profile = nullptr);
+
+  // Counts a branch to the loop starting at pc. Returns whether the function
+  // is hot, such that the loop should continue in optimized code.
+  bool count_back_edge(FunctionProfile &profile, const Code &code,
+                       uint32_t pc);
+
+  // On stack replacement: continues the function of profile, whose stack
+  // interpreter frame is at locals and whose operand stack is [operands, sp),
+  // at the loop starting at pc in optimized code, promoting it first if
+  // needed. The locals stay in place, the operand stack moves behind the
+  // constants. Returns once the function has returned.
+  void enter_loop(FunctionProfile &profile, const Code &code, Value *locals,
+                  Value *operands, Value *sp, uint32_t pc);
+
+  // Moves wasm.codes[code_index] to optimized_tier, translating or compiling
+  // it first
+  void tier_up(uint32_t code_index);
+
+  // Executes the register code of a function, see registers.hpp.
+  // frame points to its locals on the stack, followed by its constants and
+  // intermediate results. On return, its result is moved to frame[0].
+  // Execution starts at instruction start, the start of a loop for enter_loop.
+  void execute_registers(const RegisterCode &code, Value *frame,
+                         uint32_t start = 0);
+
+  // Executes a single instruction of register code, which is no branch or
+  // call. Used for the instructions compiled code does not handle itself.
+  void execute_register_instruction(const RegInstr &instr, Value *frame);
+
+  friend void jit_call(JitContext *context, uint32_t function_index,
+                       Value *args_end);
+  friend void jit_call_indirect(JitContext *context, uint32_t table_index,
+                                Value *args_end, uint32_t type_index);
+  friend void jit_execute(JitContext *context, const RegInstr *instr,
+                          Value *frame);
+
+  // Evaluates a constant expression, as used by globals, elements and data
+  // segments, and returns its value
+  Immediate evaluate_constant_expr(const std::vector<Instr>& expr);
   
   // Executes the requested import function, these are provided by the "host", aka this interpreter
   void execute_import(int function_index); 
@@ -130,18 +258,79 @@ private:
   // parameters and actual body are stored in different structs in wasm
   void execute_function(int function_index);
 
+  // Executes a decoded function body in the stack interpreter, whose
+  // arguments end at sp
+  void execute_code(const Code &code, FunctionProfile *profile);
+
+  // Executes register code whose arguments end at sp, or its machine code
+  // unless jit is nullptr or could not be compiled
+  void execute_compiled(const RegisterCode &code, const JitFunction *jit);
+
+  // Returns the entry at table_index of the function table for call_indirect
+  // with the signature type_index, raising a trap unless it holds a function
+  // of that type
+  const TableEntry &table_entry(uint32_t table_index, uint32_t type_index);
+
+  // Raises CALL_STACK_EXHAUSTED unless the operand stack holds a frame ending
+  // at frame_end and the native stack has room for another call. Checked on
+  // every call.
+  void check_stack(const Value *frame_end);
+
+  // Lowest address of the native stack nested calls may use, see
+  // NATIVE_STACK_SIZE. Set by run.
+  uintptr_t native_stack_limit = 0;
+
 public:
-  Runtime(const struct WasmFile &wasm);
+  Runtime(const struct WasmFile &wasm,
+          Interpreter interpreter = STACK_INTERPRETER);
+
+  // Set by the constructor if a memory can not be committed or an active
+  // element or data segment does not fit into its table or memory.
+  // Instantiation stops there, and run returns the trap without running
+  // anything.
+  Trap instantiation_trap = NO_TRAP;
 
   // Takes as input the name of a function, looks it up in the exports and
-  // executes it.
-  void run(std::string &function);
+  // executes it. Returns the trap which stopped it, NO_TRAP if it returned.
+  // The Runtime can run functions again after a trap.
+  Trap run(std::string &function);
 
-  // Reads from memory at offset, currently mem_index is ignored due to missing
-  // store impl.
+  // Reads from memory mem_index at offset. Outside of run, reading out of
+  // bounds terminates the process.
   Immediate read_memory(const uint32_t &mem_index, const uint32_t &offset,
                         const ImmediateRepr repr);
 
+  // Zeroes memory mem_index and shrinks it back to the pages it started with,
+  // leaving the other memories alone. Its pages are released rather than
+  // cleared, so resetting a scratch memory between runs is cheap. Data
+  // segments are not copied in again. Returns false if its pages can not be
+  // committed, it has no pages then.
+  bool reset_memory(uint32_t mem_index);
+
+  // Number of instructions dispatched so far. Only counted in builds
+  // configured with -DWINTERP_COUNT_DISPATCH=ON, otherwise it stays 0.
+  uint64_t dispatch_count = 0;
+
+  // For TIERED, a function is promoted once its calls and back edges
+  // together reach tier_up_threshold, to optimized_tier. Set before running.
+  uint64_t tier_up_threshold = 1000;
+  Interpreter optimized_tier = JIT_COMPILER;
+
+  // Every promotion so far, in order
+  std::vector<TierUp> tier_ups;
+
+  // With TIERED, whether a function which becomes hot while running one of
+  // its loops continues in its optimized code at that loop, see enter_loop.
+  // Otherwise only its next call runs there.
+  bool on_stack_replacement = true;
+
+  // Every on stack replacement so far, in order
+  std::vector<OsrEntry> osr_entries;
+
+  // Counters of a function in the function index space, which must not be
+  // imported. Only available for TIERED.
+  const FunctionProfile &profile(uint32_t function_index) const;
+
 };
 
 #endif // RUNNER_HPP
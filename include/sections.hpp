@@ -2,7 +2,13 @@
 #define SECTIONS_HPP
 
 #include "instructions.hpp"
+#include "jit.hpp"
+#include "mapped_file.hpp"
+#include "registers.hpp"
+#include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -34,11 +40,31 @@ typedef uint32_t typeidx;
 
 bool is_valid_heap_type(uint8_t type);
 
+// Bytes of the module which are referenced instead of copied.
+// Only valid as long as the bytes given to WasmFile are.
+struct ByteView {
+  const uint8_t *ptr = nullptr;
+  size_t length = 0;
+
+  ByteView() = default;
+  ByteView(const uint8_t *ptr, size_t length) : ptr(ptr), length(length) {}
+
+  const uint8_t *data() const { return ptr; }
+  size_t size() const { return length; }
+  bool empty() const { return length == 0; }
+  const uint8_t *begin() const { return ptr; }
+  const uint8_t *end() const { return ptr + length; }
+  const uint8_t &operator[](size_t i) const { return ptr[i]; }
+};
+
 struct FunctionType {
   std::vector<ImmediateRepr> params;
   ImmediateRepr return_value;
 };
 
+// Bit of Memory::flag set if the limits have a maximum
+const uint8_t MEMORY_HAS_MAXIMUM = 0x01;
+
 struct Memory {
   uint8_t flag;
   uint64_t n;       // Minimum / start
@@ -70,9 +96,44 @@ struct Local {
   ImmediateRepr type;
 };
 
+// Marks a ValidationError outside of function bodies
+const uint32_t NO_FUNCTION = UINT32_MAX;
+
+// Why a module is invalid, see validator.hpp
+struct ValidationError {
+  std::string message;
+  // Index of the invalid function in the function index space and of the
+  // offending instruction in its body, or NO_FUNCTION
+  uint32_t function = NO_FUNCTION;
+  uint32_t pc = 0;
+};
+
+// Most locals a body may declare, not counting its parameters. Bodies
+// declaring more are rejected while decoding, before anything is allocated
+// for them.
+const uint32_t MAX_LOCALS = 50000;
+
 struct Code {
+  ByteView body; // Encoded locals and expression, the source of all others
   std::vector<Local> locals;
+  uint32_t num_params = 0; // Number of parameters of its signature
+  uint32_t num_locals = 0; // Sum of the counts of locals
   std::vector<Instr> expr;
+  // Number of instructions as decoded, before simplify_code and
+  // fuse_instructions
+  uint32_t decoded_size = 0;
+  // Targets of all br_table instructions, including their defaults.
+  // Filled with label depths by read_expr, resolved by resolve_branches.
+  std::vector<BranchTarget> br_tables;
+  // Most values on the operand stack at any point of the body, set by
+  // resolve_branches
+  uint32_t max_height = 0;
+  // First instruction of every loop in ascending order, which is where
+  // branches to the loop continue. Set by resolve_branches.
+  std::vector<uint32_t> loops;
+  // Why the body is invalid, only set for bodies decoded on first use, see
+  // WasmFile::lazy_code
+  ValidationError error;
 };
 
 struct Table {
@@ -82,7 +143,15 @@ struct Table {
   std::vector<Instr> expr; // Only given in special cases
 };
 
+// Only segments of function indices are supported, flags 0, 1 and 3
+// https://webassembly.github.io/spec/core/binary/modules.html#element-section
+const uint8_t ELEM_ACTIVE = 0x00;
+const uint8_t ELEM_PASSIVE = 0x01;
+const uint8_t ELEM_DECLARATIVE = 0x03;
+
 struct Element {
+  uint8_t flag = ELEM_ACTIVE;
+  // Offset into table 0, only given for active segments
   std::vector<Instr> expr;
   std::vector<uint32_t> function_indices;
 };
@@ -94,12 +163,24 @@ struct Import {
   uint32_t signature_index;
 };
 
+// Active segments are copied into their memory when instantiating the
+// module, passive ones only by memory.init. Only active segments with an
+// explicit memory index give memidx, it is 0 otherwise.
+const uint32_t DATA_ACTIVE = 0x00;
+const uint32_t DATA_PASSIVE = 0x01;
+const uint32_t DATA_ACTIVE_MEMORY = 0x02;
+
 struct DataSegment {
   uint32_t flag;
-  // The following 3 members can all be uninitialised based on the value of flag
   uint32_t memidx;
+  // Offset into the memory, empty for passive segments
   std::vector<Instr> expr;
-  std::vector<uint8_t> bytes;
+  ByteView bytes;
+};
+
+struct CustomSection {
+  std::string name;
+  ByteView bytes; // Contents following the name
 };
 
 // Stores the data of the varios sections
@@ -109,50 +190,141 @@ struct WasmFile {
 
     // Reads in a valtype as defined in
     // https://webassembly.github.io/spec/core/binary/types.html#value-types
-    ImmediateRepr read_valtype(const uint8_t* &ptr, const uint8_t* end);
+    ImmediateRepr read_valtype(const uint8_t* &ptr, const uint8_t* end) const;
 
     // Parses the Type Section and stores the resulting types in wasm.type_section
-    void parse_type_section(const std::vector<uint8_t> &data);
+    void parse_type_section(ByteView data);
 
     // Stores the resulting function indices in wasm.function_section
-    void parse_functions(const std::vector<uint8_t> &data);
+    void parse_functions(ByteView data);
 
     // Stores the list of memories into wasm.memory
-    void parse_memory(const std::vector<uint8_t> &data);
+    void parse_memory(ByteView data);
 
     // Stores the list of globals into wasm.global
-    void parse_global(const std::vector<uint8_t> &data);
+    void parse_global(ByteView data);
 
     // Stores the list of exports into wasm.exports
-    void parse_exports(const std::vector<uint8_t> &data);
+    void parse_exports(ByteView data);
 
     // Stores the list of codes into wasm.codes
-    void parse_code(const std::vector<uint8_t> &data);
+    // The function bodies are decoded by parse_threads threads, or only
+    // located if lazy_code is set.
+    void parse_code(ByteView data);
+
+    // Decodes and validates wasm.codes[index].body into the rest of
+    // wasm.codes[index]. Returns false and fills error if it is invalid.
+    bool parse_function_body(uint32_t index, ValidationError &error) const;
+
+    // Stores the number of data segments into wasm.data_count
+    void parse_data_count(ByteView data);
 
     // Stores the list of tables into wasm.table
-    void parse_table(const std::vector<uint8_t> &data);
+    void parse_table(ByteView data);
 
     // Stores the list of elements into wasm.elems
-    void parse_elems(const std::vector<uint8_t> &data);
+    void parse_elems(ByteView data);
 
     // Stores the list of data into wasm.data
-    void parse_data(const std::vector<uint8_t> &data);
+    void parse_data(ByteView data);
 
     // Stores the list of imports into wasm.imports
-    void parse_imports(const std::vector<uint8_t> &data);
+    void parse_imports(ByteView data);
+
+    // Stores the name and contents of a custom section into
+    // wasm.custom_sections
+    void parse_custom(ByteView data);
+
+    // Parses all sections of a module
+    int parse(const uint8_t *bytes, size_t size);
+
+    // Keeps the file alive, which the views into the module point to
+    std::shared_ptr<MappedFile> file;
+
+    // One flag per entry of codes, only allocated if lazy_code is set
+    std::unique_ptr<std::once_flag[]> code_decoded;
+
+    // One flag per entry of codes, set once its register code is translated
+    std::unique_ptr<std::once_flag[]> register_translated;
+
+    // One flag per entry of codes, set once it is compiled
+    std::unique_ptr<std::once_flag[]> jit_compiled;
   public:
     std::vector<FunctionType> type_section;
+    // Canonical signature of every entry of type_section. Identical types
+    // share one id, the index of the first of them, such that comparing two
+    // signatures is a single integer compare.
+    std::vector<uint32_t> type_ids;
     std::vector<typeidx> function_section;
     std::vector<Memory> memory;
     std::vector<Global> globals;
     std::vector<Export> exports;
-    std::vector<Code> codes;
+    // Only complete for decoded functions, see lazy_code and function_code.
+    // Decoding on first use fills in entries of a const WasmFile.
+    mutable std::vector<Code> codes;
+    // Only filled for functions run by the register interpreter, see
+    // register_code
+    mutable std::vector<RegisterCode> register_codes;
+    // Only filled for functions run by the JIT compiler, see jit_function
+    mutable std::vector<JitFunction> jit_functions;
     std::vector<Table> tables;
     std::vector<Element> elems;
     std::vector<DataSegment> data;
     std::vector<Import> imports;
+    std::vector<CustomSection> custom_sections;
+
+    // Number of data segments announced before the code section, which is
+    // required by memory.init and data.drop
+    bool has_data_count = false;
+    uint32_t data_count = 0;
+
+    // Set if read fails because the module is invalid
+    ValidationError validation_error;
+
+    // Number of threads decoding function bodies, set before reading.
+    // 0 picks one per hardware thread, but only for large code sections.
+    unsigned parse_threads = 0;
+
+    // Decode and validate each function body on its first use instead of
+    // while reading, set before reading.
+    bool lazy_code = false;
 
+    // Fold constants and remove instructions which are never executed, see
+    // simplify.hpp. Set before reading.
+    bool simplify = true;
+
+    // Replace common sequences of instructions by superinstructions, see
+    // fusion.hpp. Set before reading.
+    bool superinstructions = true;
+
+    // Maps the file into memory, parses and validates it. Data segments and
+    // custom sections reference the mapped bytes.
     int read(const char* file);
+
+    // Parses a module which is already in memory. Data segments and custom
+    // sections reference bytes, which must outlive this WasmFile.
+    int read_from_memory(const uint8_t *bytes, size_t size);
+
+    // Returns the decoded body of codes[code_index], which is decoded first if
+    // needed. Safe to call from several threads. Raises INVALID_FUNCTION if
+    // the body is invalid, the reason is kept in its Code::error.
+    const Code &function_code(uint32_t code_index) const;
+
+    // Returns the register code of codes[code_index], which is translated on
+    // first use. Safe to call from several threads.
+    const RegisterCode &register_code(uint32_t code_index) const;
+
+    // Returns the machine code of codes[code_index], which is compiled from
+    // its register code on first use. Safe to call from several threads.
+    const JitFunction &jit_function(uint32_t code_index) const;
+
+    // Returns the signature of a function in the function index space, which
+    // starts with the imported functions
+    const FunctionType &function_type(uint32_t function_index) const;
+
+    // Returns the canonical signature id of a function in the function index
+    // space, see type_ids
+    uint32_t function_type_id(uint32_t function_index) const;
 };
 
 
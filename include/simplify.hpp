@@ -0,0 +1,21 @@
+#ifndef SIMPLIFY_HPP
+#define SIMPLIFY_HPP
+
+#include "sections.hpp"
+
+// Simplifies a decoded and validated function body before resolve_branches:
+//  - numeric instructions whose operands are all constants are folded into a
+//    constant, computed by the handlers of numeric.hpp such that the result
+//    is the one of the interpreters. Instructions which may trap, integer
+//    division and remainder and the truncations of floats, are kept.
+//  - br_if and if with a constant condition become br, nothing or a block,
+//    br_table with a constant index becomes br
+//  - a constant or local.get followed by drop is removed
+//  - instructions which can never be executed, behind br, br_table, return
+//    or unreachable up to the end of their block, are removed
+// Blocks stay balanced and branches keep their label depths. Unreachable
+// instructions containing a loop are kept, such that the loops of the body
+// are numbered as in the register code (see RegisterCode::loops).
+void simplify_code(Code &code);
+
+#endif // SIMPLIFY_HPP
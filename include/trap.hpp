@@ -0,0 +1,86 @@
+#ifndef TRAP_HPP
+#define TRAP_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "linear_memory.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <setjmp.h>
+// The signal mask is left alone, the fault handler runs with SA_NODEFER
+#define WINTERP_SETJMP(env) sigsetjmp(env, 0)
+typedef sigjmp_buf TrapJumpBuffer;
+#else
+#include <csetjmp>
+#define WINTERP_SETJMP(env) setjmp(env)
+typedef std::jmp_buf TrapJumpBuffer;
+#endif
+
+// Why Runtime::run stopped
+// https://webassembly.github.io/spec/core/exec/runtime.html#results
+enum Trap : uint8_t {
+  NO_TRAP,
+  UNREACHABLE,
+  MEMORY_OUT_OF_BOUNDS,
+  INTEGER_DIVIDE_BY_ZERO,
+  // Signed division of the minimum by -1, or truncating a float to an
+  // integer which can not hold it
+  INTEGER_OVERFLOW,
+  // Truncating NaN to an integer
+  INVALID_CONVERSION_TO_INTEGER,
+  // call_indirect with an index behind the table, of an entry without a
+  // function or of a function of another type
+  UNDEFINED_ELEMENT,
+  UNINITIALIZED_ELEMENT,
+  INDIRECT_CALL_TYPE_MISMATCH,
+  // table.init or table.copy of entries behind a table or element segment
+  TABLE_OUT_OF_BOUNDS,
+  // Calls nested too deep for the operand stack or the native stack
+  CALL_STACK_EXHAUSTED,
+  // Calling a function of a lazy module whose body turned out invalid when
+  // it was decoded, see WasmFile::lazy_code
+  INVALID_FUNCTION,
+  // The initial pages of a memory could not be committed when instantiating
+  // the module
+  OUT_OF_MEMORY,
+};
+
+const char *trap_message(Trap trap);
+
+// Where traps unwind to, set up by Runtime::run around the function it
+// executes. Boundaries are kept per thread, the innermost one catches.
+// Instructions which can trap check their operands and call raise_trap out of
+// line, so nothing on the way back to the boundary checks for traps.
+//
+// Out of bounds loads and stores are not checked by the interpreters and the
+// compiled code in builds with WINTERP_SIGNAL_TRAPS. They run into the guard
+// region of their memory, see LinearMemory, and the fault handler installed by
+// the first boundary turns the SIGSEGV or SIGBUS into a trap of the boundary.
+// Faults anywhere else are passed on to the handler installed before.
+//
+// Nothing between the boundary and a trap may rely on destructors, the stack
+// is unwound with longjmp.
+struct TrapBoundary {
+  // Faults inside the reservation of any of memories are out of bounds
+  // accesses
+  explicit TrapBoundary(const std::vector<LinearMemory *> &memories);
+  ~TrapBoundary();
+
+  TrapBoundary(const TrapBoundary &) = delete;
+  TrapBoundary &operator=(const TrapBoundary &) = delete;
+
+  // WINTERP_SETJMP(env) returns again, with a value other than 0, after a
+  // trap, which is stored in trap
+  TrapJumpBuffer env;
+  volatile Trap trap = NO_TRAP;
+
+  const std::vector<LinearMemory *> &memories;
+  TrapBoundary *outer;
+};
+
+// Unwinds to the innermost boundary of the thread with trap. Without any,
+// prints the trap and aborts.
+[[noreturn]] void raise_trap(Trap trap);
+
+#endif // TRAP_HPP
@@ -0,0 +1,38 @@
+#ifndef VALIDATOR_HPP
+#define VALIDATOR_HPP
+
+#include <cstdint>
+
+#include "sections.hpp"
+
+// Validation of modules as defined in
+// https://webassembly.github.io/spec/core/valid/index.html
+// limited to what the interpreter supports.
+// A module which passes validation can be executed without checking types,
+// stack heights, indices or mutability at run time. Only checks which depend
+// on values, like memory bounds and division by zero, remain in the runtime.
+
+// Validates everything outside of function bodies: signatures, imports,
+// exports, globals, tables, elements and data segments.
+// Returns false and fills error if the module is invalid.
+bool validate_module(const WasmFile &wasm, ValidationError &error);
+
+// Validates the decoded body of wasm.codes[code_index] by simulating the
+// types on its operand stack. Must run before resolve_branches, which
+// assumes a valid body.
+// Returns false and fills error if the body is invalid.
+bool validate_function(const WasmFile &wasm, uint32_t code_index,
+                       const Code &code, ValidationError &error);
+
+// Operand and result types of a numeric instruction. b is None for unops.
+struct NumericType {
+  ImmediateRepr a;
+  ImmediateRepr b;
+  ImmediateRepr result;
+};
+
+// Looks up the types of the numeric instructions 0x45 to 0xBF, returns false
+// for all other instructions
+bool numeric_type(OpCode op, NumericType &type);
+
+#endif // VALIDATOR_HPP
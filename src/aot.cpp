@@ -0,0 +1,572 @@
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "aot.hpp"
+#include "instructions.hpp"
+#include "linear_memory.hpp"
+#include "numeric.hpp"
+#include "registers.hpp"
+#include "sections.hpp"
+
+// Name of a slot of the frame, which is a local variable
+static std::string slot(uint32_t index) { return "r" + std::to_string(index); }
+
+static std::string hex(uint64_t value) {
+  std::ostringstream out;
+  out << "0x" << std::hex << value << "ull";
+  return out.str();
+}
+
+// The handler of a numeric instruction in numeric.hpp, nullptr for all others
+static const char *numeric_handler(OpCode op) {
+  switch (op) {
+#define HANDLER(name, handler)                                                 \
+  case OpCode::name:                                                           \
+    return #handler "<OpCode::" #name ">";
+    NUMERIC_INSTRUCTIONS(HANDLER, HANDLER)
+#undef HANDLER
+  default:
+    return nullptr;
+  }
+}
+
+static bool is_binop(OpCode op) {
+  switch (op) {
+#define UNOP(name, handler)                                                    \
+  case OpCode::name:                                                           \
+    return false;
+#define BINOP(name, handler)                                                   \
+  case OpCode::name:                                                           \
+    return true;
+    NUMERIC_INSTRUCTIONS(UNOP, BINOP)
+#undef UNOP
+#undef BINOP
+  default:
+    return false;
+  }
+}
+
+// Name of a load or store, nullptr for all others
+static const char *memory_access(OpCode op) {
+  switch (op) {
+#define ACCESS(name)                                                           \
+  case OpCode::name:                                                           \
+    return #name;
+    MEMORY_ACCESSES(ACCESS, ACCESS)
+#undef ACCESS
+  default:
+    return nullptr;
+  }
+}
+
+static bool is_load(OpCode op) {
+  switch (op) {
+#define LOAD(name)                                                             \
+  case OpCode::name:                                                           \
+    return true;
+#define STORE(name)
+    MEMORY_ACCESSES(LOAD, STORE)
+#undef LOAD
+#undef STORE
+  default:
+    return false;
+  }
+}
+
+static bool same_signature(const FunctionType &a, const FunctionType &b) {
+  return a.params == b.params && a.return_value == b.return_value;
+}
+
+static bool has_result(const FunctionType &type) {
+  return type.return_value != ImmediateRepr::None;
+}
+
+// The parameters of a function with the given signature, named as the first
+// slots of its frame
+static std::string parameters(const FunctionType &type) {
+  std::string result;
+  for (size_t i = 0; i < type.params.size(); i++) {
+    result += (i > 0 ? ", Value " : "Value ") + slot(i);
+  }
+  return result;
+}
+
+// The slots first to first + count, as arguments of a call
+static std::string arguments(uint32_t first, uint32_t count) {
+  std::string result;
+  for (uint32_t i = 0; i < count; i++) {
+    result += (i > 0 ? ", " : "") + slot(first + i);
+  }
+  return result;
+}
+
+class ModuleTranslator {
+public:
+  ModuleTranslator(const WasmFile &wasm, std::ostream &out)
+      : wasm(wasm), out(out), num_imports(wasm.imports.size()) {}
+
+  int run(const char *create) {
+    for (const Import &import : wasm.imports) {
+      if (import.kind != 0 || import.field_name != "fd_write") {
+        std::cerr << "unsupported import " << import.module << "."
+                  << import.field_name << std::endl;
+        return 1;
+      }
+    }
+    if (wasm.memory.size() > 1) {
+      std::cerr << "modules with more than one memory are not supported"
+                << std::endl;
+      return 1;
+    }
+
+    // Every signature used by call_indirect gets a function which calls the
+    // matching entry of the function table
+    for (uint32_t i = 0; i < wasm.codes.size(); i++) {
+      for (const RegInstr &instr : wasm.register_code(i).instrs) {
+        if (instr.op == OpCode::CallIndirect) {
+          indirect_types.insert(instr.imm);
+        }
+      }
+    }
+
+    out << "// Generated by winterp_aot, do not edit\n"
+        << "#include \"aot_runtime.hpp\"\n\n"
+        << "namespace {\n\n";
+
+    for (uint32_t i = 0; i < wasm.data.size(); i++) {
+      data_segment(i);
+    }
+
+    declare_module();
+    define_constructor();
+    define_exports();
+
+    for (uint32_t i = 0; i < num_imports; i++) {
+      define_import(i);
+    }
+    for (uint32_t i = 0; i < wasm.codes.size(); i++) {
+      if (define_function(i) != 0) {
+        return 1;
+      }
+    }
+    for (uint32_t type : indirect_types) {
+      define_call_indirect(type);
+    }
+
+    out << "} // namespace\n\n"
+        << "extern \"C\" AotModule *" << create << "() { return new Module(); }\n";
+    return 0;
+  }
+
+private:
+  const WasmFile &wasm;
+  std::ostream &out;
+  uint32_t num_imports;
+  std::set<uint32_t> indirect_types;
+
+  std::string function_name(uint32_t function_index) {
+    return "f" + std::to_string(function_index);
+  }
+
+  std::string declaration(const std::string &name, const FunctionType &type,
+                          const std::string &params) {
+    return std::string(has_result(type) ? "Value " : "void ") + name + "(" +
+           params + ")";
+  }
+
+  // Calls the function at an index of the function table, which must have
+  // the signature type
+  std::string call_indirect_declaration(const std::string &scope,
+                                        uint32_t type) {
+    const FunctionType &signature = wasm.type_section[type];
+    std::string params = "uint32_t index";
+    if (!signature.params.empty()) {
+      params += ", " + parameters(signature);
+    }
+    return declaration(scope + "call_indirect_" + std::to_string(type),
+                       signature, params);
+  }
+
+  // The value of a constant expression
+  std::string constant(const std::vector<Instr> &expr, bool i32) {
+    const Instr &instr = expr[0];
+    if (instr.op == OpCode::GlobalGet) {
+      return "global_" + std::to_string(instr.imm) + (i32 ? ".n32" : "");
+    }
+    return i32 ? std::to_string(instr.value.v.n32) + "u"
+               : hex(instr.value.v.n64);
+  }
+
+  void data_segment(uint32_t index) {
+    const ByteView &bytes = wasm.data[index].bytes;
+    out << "const uint8_t data_" << index << "[] = {";
+    for (size_t i = 0; i < bytes.size(); i++) {
+      out << (i % 16 == 0 ? "\n    " : " ") << static_cast<int>(bytes[i])
+          << ",";
+    }
+    // Arrays must not be empty
+    out << (bytes.empty() ? "0" : "") << "\n};\n\n";
+  }
+
+  void declare_module() {
+    out << "class Module final : public AotModule {\n"
+        << "public:\n"
+        << "  Module();\n\n"
+        << "private:\n"
+        << "  bool call_export(const std::string &function) override;\n\n";
+
+    for (uint32_t i = 0; i < wasm.globals.size(); i++) {
+      out << "  Value global_" << i << ";\n";
+    }
+    if (!wasm.globals.empty()) {
+      out << "\n";
+    }
+
+    // Functions which are neither called, exported nor in the table are
+    // still translated
+    for (uint32_t i = 0; i < num_imports + wasm.codes.size(); i++) {
+      const FunctionType &type = wasm.function_type(i);
+      out << "  [[maybe_unused]] "
+          << declaration(function_name(i), type, parameters(type)) << ";\n";
+    }
+    for (uint32_t type : indirect_types) {
+      out << "  " << call_indirect_declaration("", type) << ";\n";
+    }
+    out << "};\n\n";
+  }
+
+  // Initialises globals, the function table and memory like the Runtime
+  void define_constructor() {
+    out << "Module::Module() {\n";
+
+    for (uint32_t i = 0; i < wasm.globals.size(); i++) {
+      const std::vector<Instr> &expr = wasm.globals[i].expr;
+      if (expr[0].op == OpCode::GlobalGet) {
+        out << "  global_" << i << " = " << constant(expr, false) << ";\n";
+      } else {
+        out << "  global_" << i << ".n64 = " << constant(expr, false) << ";\n";
+      }
+    }
+
+    for (const Table &table : wasm.tables) {
+      out << "  function_table.resize("
+          << std::max(table.limit_n, table.limit_m) << ", AOT_NULL_ENTRY);\n";
+    }
+    // Segments behind the table fail instantiation in the Runtime
+    for (const Element &elem : wasm.elems) {
+      if (elem.flag != ELEM_ACTIVE) {
+        continue;
+      }
+      std::string offset = constant(elem.expr, true);
+      out << "  if (uint64_t(" << offset << ") + "
+          << elem.function_indices.size() << " > function_table.size()) {\n"
+          << "    aot_trap(\"out of bounds table access\");\n"
+          << "  }\n";
+      for (size_t i = 0; i < elem.function_indices.size(); i++) {
+        out << "  function_table[" << offset << " + " << i
+            << "] = " << elem.function_indices[i] << ";\n";
+      }
+    }
+    // Only passive segments are left for table.init
+    if (!wasm.elems.empty()) {
+      out << "  elems = {";
+      for (uint32_t i = 0; i < wasm.elems.size(); i++) {
+        const Element &elem = wasm.elems[i];
+        out << (i > 0 ? ", " : "") << "{";
+        for (size_t j = 0; elem.flag == ELEM_PASSIVE &&
+                           j < elem.function_indices.size();
+             j++) {
+          out << (j > 0 ? ", " : "") << elem.function_indices[j];
+        }
+        out << "}";
+      }
+      out << "};\n";
+    }
+
+    // AotModule starts with a single page
+    uint64_t pages = wasm.memory.empty() ? 0 : wasm.memory[0].n;
+    if (pages != 1) {
+      out << "  memory.assign(size_t(" << pages << ") * AOT_PAGE_SIZE, 0);\n"
+          << "  pages = " << pages << ";\n";
+    }
+    if (!wasm.memory.empty() && (wasm.memory[0].flag & MEMORY_HAS_MAXIMUM) &&
+        wasm.memory[0].maximum < MAX_MEMORY_PAGES) {
+      out << "  max_pages = " << wasm.memory[0].maximum << ";\n";
+    }
+
+    if (!wasm.data.empty()) {
+      out << "  data = {";
+      for (uint32_t i = 0; i < wasm.data.size(); i++) {
+        out << (i > 0 ? ", " : "") << "{data_" << i << ", "
+            << wasm.data[i].bytes.size() << "}";
+      }
+      out << "};\n";
+    }
+    for (uint32_t i = 0; i < wasm.data.size(); i++) {
+      if (wasm.data[i].flag == DATA_PASSIVE) {
+        continue;
+      }
+      out << "  init_data(" << constant(wasm.data[i].expr, true) << ", data["
+          << i << "]);\n";
+    }
+    out << "}\n\n";
+  }
+
+  void define_exports() {
+    out << "bool Module::call_export(const std::string &function) {\n"
+        << "  Value zero;\n"
+        << "  zero.n64 = 0;\n"
+        << "  (void)zero;\n";
+    for (const Export &e : wasm.exports) {
+      if (e.kind != ExportKind::func) {
+        continue;
+      }
+      const FunctionType &type = wasm.function_type(e.idx);
+      std::string zeros;
+      for (size_t i = 0; i < type.params.size(); i++) {
+        zeros += i > 0 ? ", zero" : "zero";
+      }
+      out << "  if (function == \"" << e.name << "\") {\n"
+          << "    " << function_name(e.idx) << "(" << zeros << ");\n"
+          << "    return true;\n"
+          << "  }\n";
+    }
+    out << "  return false;\n"
+        << "}\n\n";
+  }
+
+  void define_import(uint32_t function_index) {
+    const FunctionType &type = wasm.function_type(function_index);
+    out << declaration("Module::" + function_name(function_index), type,
+                       parameters(type))
+        << " {\n"
+        << "  Value result;\n"
+        << "  result.n32 = fd_write(r0.n32, r1.n32, r2.n32, r3.n32);\n"
+        << "  return result;\n"
+        << "}\n\n";
+  }
+
+  void define_call_indirect(uint32_t type) {
+    const FunctionType &signature = wasm.type_section[type];
+    std::string args = arguments(0, signature.params.size());
+
+    out << call_indirect_declaration("Module::", type) << " {\n"
+        << "  if (index >= function_table.size()) {\n"
+        << "    aot_trap(\"undefined element\");\n"
+        << "  }\n"
+        << "  switch (function_table[index]) {\n";
+    for (uint32_t i = 0; i < num_imports + wasm.codes.size(); i++) {
+      if (!same_signature(wasm.function_type(i), signature)) {
+        continue;
+      }
+      out << "  case " << i << ":\n";
+      if (has_result(signature)) {
+        out << "    return " << function_name(i) << "(" << args << ");\n";
+      } else {
+        out << "    " << function_name(i) << "(" << args << ");\n"
+            << "    return;\n";
+      }
+    }
+    out << "  case AOT_NULL_ENTRY:\n"
+        << "    aot_trap(\"uninitialized element\");\n"
+        << "  default:\n"
+        << "    aot_trap(\"indirect call type mismatch\");\n"
+        << "  }\n"
+        << "}\n\n";
+  }
+
+  int define_function(uint32_t code_index) {
+    uint32_t function_index = num_imports + code_index;
+    const FunctionType &type = wasm.function_type(function_index);
+    const RegisterCode &code = wasm.register_code(code_index);
+
+    out << declaration("Module::" + function_name(function_index), type,
+                       parameters(type))
+        << " {\n";
+
+    // The frame is declared as a whole, not every slot of it is used by the
+    // body
+    if (code.frame_size > code.num_params) {
+      out << "  [[maybe_unused]] Value";
+      for (uint32_t i = code.num_params; i < code.frame_size; i++) {
+        out << (i > code.num_params ? ", " : " ") << slot(i);
+      }
+      out << ";\n";
+    }
+    for (uint32_t i = 0; i < code.num_locals; i++) {
+      out << "  " << slot(code.num_params + i) << ".n64 = 0;\n";
+    }
+    for (uint32_t i = 0; i < code.constants.size(); i++) {
+      out << "  " << slot(code.constants_slot + i)
+          << ".n64 = " << hex(code.constants[i].n64) << ";\n";
+    }
+
+    // Only branch targets get a label
+    std::vector<bool> targets(code.instrs.size() + 1, false);
+    for (const RegInstr &instr : code.instrs) {
+      if (instr.op == OpCode::If || instr.op == OpCode::Br ||
+          instr.op == OpCode::BrIf) {
+        targets[instr.imm] = true;
+      } else if (instr.op == OpCode::BrTable) {
+        for (uint32_t i = 0; i <= instr.imm2; i++) {
+          targets[code.br_tables[instr.imm + i].pc] = true;
+        }
+      }
+    }
+
+    for (uint32_t pc = 0; pc < code.instrs.size(); pc++) {
+      if (targets[pc]) {
+        out << "L" << pc << ":\n";
+      }
+      if (instruction(code, code.instrs[pc]) != 0) {
+        std::cerr << "unsupported instruction " << code.instrs[pc].op
+                  << " in function " << function_index << std::endl;
+        return 1;
+      }
+    }
+
+    out << "}\n\n";
+    return 0;
+  }
+
+  std::string jump(uint32_t dst, uint32_t src, uint32_t pc) {
+    std::string move =
+        dst != src ? slot(dst) + " = " + slot(src) + "; " : std::string();
+    return move + "goto L" + std::to_string(pc) + ";";
+  }
+
+  int instruction(const RegisterCode &code, const RegInstr &instr) {
+    std::string dst = slot(instr.dst);
+    std::string a = slot(instr.a);
+    std::string b = slot(instr.b);
+    std::string c = slot(instr.c);
+
+    if (const char *handler = numeric_handler(instr.op)) {
+      out << "  " << dst << " = " << handler << "(" << a
+          << (is_binop(instr.op) ? ", " + b : "") << ");\n";
+      return 0;
+    }
+
+    if (const char *name = memory_access(instr.op)) {
+      std::string address = a + ".n32 + " + std::to_string(instr.imm) + "u";
+      if (is_load(instr.op)) {
+        out << "  " << dst << " = load<OpCode::" << name << ">(" << address
+            << ");\n";
+      } else {
+        out << "  store<OpCode::" << name << ">(" << address << ", " << b
+            << ");\n";
+      }
+      return 0;
+    }
+
+    switch (instr.op) {
+    case OpCode::Unreachable:
+      out << "  aot_trap(\"unreachable\");\n";
+      return 0;
+    case OpCode::If:
+      out << "  if (" << a << ".n32 == 0) goto L" << instr.imm << ";\n";
+      return 0;
+    case OpCode::Br:
+      out << "  " << jump(instr.dst, instr.a, instr.imm) << "\n";
+      return 0;
+    case OpCode::BrIf:
+      out << "  if (" << b << ".n32 != 0) { "
+          << jump(instr.dst, instr.a, instr.imm) << " }\n";
+      return 0;
+    case OpCode::BrTable:
+      out << "  switch (" << a << ".n32) {\n";
+      for (uint32_t i = 0; i <= instr.imm2; i++) {
+        const RegTableEntry &entry = code.br_tables[instr.imm + i];
+        if (i < instr.imm2) {
+          out << "  case " << i << ": ";
+        } else {
+          out << "  default: ";
+        }
+        out << jump(entry.dst, instr.b, entry.pc) << "\n";
+      }
+      out << "  }\n";
+      return 0;
+    case OpCode::Return:
+      if (instr.imm == 0) {
+        out << "  return;\n";
+      } else {
+        out << "  return " << a << ";\n";
+      }
+      return 0;
+    case OpCode::Call:
+    case OpCode::CallIndirect: {
+      std::string callee;
+      const FunctionType *type;
+      std::string args = arguments(instr.a, instr.c);
+      if (instr.op == OpCode::Call) {
+        callee = function_name(instr.imm) + "(" + args + ")";
+        type = &wasm.function_type(instr.imm);
+      } else {
+        callee = "call_indirect_" + std::to_string(instr.imm) + "(" + b +
+                 ".n32" + (instr.c > 0 ? ", " : "") + args + ")";
+        type = &wasm.type_section[instr.imm];
+      }
+      // The result replaces the arguments
+      out << "  " << (has_result(*type) ? a + " = " : "") << callee << ";\n";
+      return 0;
+    }
+    case OpCode::Select:
+      out << "  " << dst << " = " << c << ".n32 != 0 ? " << a << " : " << b
+          << ";\n";
+      return 0;
+    case OpCode::Move:
+      out << "  " << dst << " = " << a << ";\n";
+      return 0;
+    case OpCode::GlobalGet:
+      out << "  " << dst << " = global_" << instr.imm << ";\n";
+      return 0;
+    case OpCode::GlobalSet:
+      out << "  global_" << instr.imm << " = " << a << ";\n";
+      return 0;
+    case OpCode::MemorySize:
+      out << "  " << dst << ".n32 = pages;\n";
+      return 0;
+    case OpCode::MemoryGrow:
+      out << "  " << dst << ".n32 = memory_grow(" << a << ".n32);\n";
+      return 0;
+    case OpCode::MemoryFill:
+      out << "  memory_fill(" << a << ".n32, " << b << ", " << c << ".n32);\n";
+      return 0;
+    case OpCode::MemoryCopy:
+      out << "  memory_copy(" << a << ".n32, " << b << ".n32, " << c
+          << ".n32);\n";
+      return 0;
+    case OpCode::MemoryInit:
+      out << "  memory_init(" << instr.imm << ", " << a << ".n32, " << b
+          << ".n32, " << c << ".n32);\n";
+      return 0;
+    case OpCode::DataDrop:
+      out << "  data_drop(" << instr.imm << ");\n";
+      return 0;
+    case OpCode::TableInit:
+      out << "  table_init(" << instr.imm << ", " << a << ".n32, " << b
+          << ".n32, " << c << ".n32);\n";
+      return 0;
+    case OpCode::ElemDrop:
+      out << "  elem_drop(" << instr.imm << ");\n";
+      return 0;
+    case OpCode::TableCopy:
+      out << "  table_copy(" << a << ".n32, " << b << ".n32, " << c
+          << ".n32);\n";
+      return 0;
+    default:
+      return 1;
+    }
+  }
+};
+
+int translate_module(const WasmFile &wasm, const char *create,
+                     std::ostream &out) {
+  ModuleTranslator translator(wasm, out);
+  return translator.run(create);
+}
@@ -0,0 +1,166 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#if defined(__unix__)
+#include <dlfcn.h>
+#endif
+
+#include "aot_runtime.hpp"
+
+void aot_trap(const char *message) {
+  std::cerr << "trap: " << message << std::endl;
+  std::abort();
+}
+
+void AotModule::run(std::string &function) {
+  bool found = call_export(function);
+  assert(found && "export function not found!");
+  (void)found;
+}
+
+Immediate AotModule::read_memory(const uint32_t &mem_index,
+                                 const uint32_t &offset,
+                                 const ImmediateRepr repr) {
+  Immediate read;
+  read.t = repr;
+
+  // winterp_aot only translates modules with a single memory
+  if (mem_index != 0) {
+    aot_trap("unknown memory");
+  }
+  switch (repr) {
+  case ImmediateRepr::Byte:
+    read.v = load<OpCode::I32Load8U>(offset);
+    break;
+  case ImmediateRepr::I32:
+  case ImmediateRepr::F32:
+    read.v = load<OpCode::I32Load>(offset);
+    break;
+  case ImmediateRepr::I64:
+  case ImmediateRepr::F64:
+    read.v = load<OpCode::I64Load>(offset);
+    break;
+  default:
+    assert(false && "Invalid repr found.");
+  }
+
+  return read;
+}
+
+uint32_t AotModule::memory_grow(uint32_t delta) {
+  uint32_t old_pages = pages;
+
+  if (uint64_t(pages) + delta > max_pages) {
+    return UINT32_MAX;
+  }
+  pages += delta;
+  memory.resize(static_cast<size_t>(pages) * AOT_PAGE_SIZE);
+  return old_pages;
+}
+
+void AotModule::memory_fill(uint32_t offset, Value value, uint32_t n) {
+  check_access(offset, n);
+  std::memset(&memory[0] + offset, static_cast<uint8_t>(value.n32), n);
+}
+
+void AotModule::memory_copy(uint32_t dst, uint32_t src, uint32_t n) {
+  check_access(dst, n);
+  check_access(src, n);
+  std::memmove(&memory[0] + dst, &memory[0] + src, n);
+}
+
+void AotModule::memory_init(uint32_t data_segment_index, uint32_t dst,
+                            uint32_t src, uint32_t n) {
+  const AotData &segment = data[data_segment_index];
+  if (static_cast<uint64_t>(src) + n > segment.size) {
+    aot_trap("out of bounds memory access");
+  }
+  check_access(dst, n);
+  std::memcpy(&memory[0] + dst, segment.bytes + src, n);
+}
+
+void AotModule::data_drop(uint32_t data_segment_index) {
+  data[data_segment_index].size = 0;
+}
+
+void AotModule::table_init(uint32_t elem_index, uint32_t dst, uint32_t src,
+                           uint32_t n) {
+  const std::vector<uint32_t> &functions = elems[elem_index];
+  if (static_cast<uint64_t>(src) + n > functions.size() ||
+      static_cast<uint64_t>(dst) + n > function_table.size()) {
+    aot_trap("out of bounds table access");
+  }
+  std::copy(functions.begin() + src, functions.begin() + src + n,
+            function_table.begin() + dst);
+}
+
+void AotModule::elem_drop(uint32_t elem_index) {
+  elems[elem_index] = std::vector<uint32_t>();
+}
+
+void AotModule::table_copy(uint32_t dst, uint32_t src, uint32_t n) {
+  if (static_cast<uint64_t>(src) + n > function_table.size() ||
+      static_cast<uint64_t>(dst) + n > function_table.size()) {
+    aot_trap("out of bounds table access");
+  }
+  auto from = function_table.begin() + src;
+  if (dst <= src) {
+    std::copy(from, from + n, function_table.begin() + dst);
+  } else {
+    std::copy_backward(from, from + n, function_table.begin() + dst + n);
+  }
+}
+
+void AotModule::init_data(uint32_t offset, const AotData &segment) {
+  check_access(offset, segment.size);
+  std::memcpy(&memory[0] + offset, segment.bytes, segment.size);
+}
+
+uint32_t AotModule::fd_write(uint32_t fd, uint32_t iovs_ptr, uint32_t iovs_len,
+                             uint32_t nwritten) {
+  uint32_t written = 0;
+
+  for (uint32_t i = 0; i < iovs_len; i++) {
+    uint32_t base_addr = load<OpCode::I32Load>(iovs_ptr + i * 8).n32;
+    uint32_t len = load<OpCode::I32Load>(iovs_ptr + i * 8 + 4).n32;
+    check_access(base_addr, len);
+
+    std::string chunk(&memory[0] + base_addr, &memory[0] + base_addr + len);
+    if (fd == 1) {
+      std::cout << chunk << std::endl;
+    } else {
+      std::cerr << chunk << std::endl;
+    }
+    written += len;
+  }
+
+  Value result;
+  result.n32 = written;
+  store<OpCode::I32Store>(nwritten, result);
+  return 0;
+}
+
+std::unique_ptr<AotModule> aot_load(const char *library, const char *create) {
+#if defined(__unix__)
+  void *handle = dlopen(library, RTLD_NOW | RTLD_LOCAL);
+  if (handle == nullptr) {
+    std::cerr << "unable to load " << library << ": " << dlerror()
+              << std::endl;
+    return nullptr;
+  }
+
+  void *symbol = dlsym(handle, create);
+  if (symbol == nullptr) {
+    std::cerr << library << " has no function " << create << std::endl;
+    return nullptr;
+  }
+  return std::unique_ptr<AotModule>(reinterpret_cast<AotCreate>(symbol)());
+#else
+  std::cerr << "loading shared libraries is not supported" << std::endl;
+  return nullptr;
+#endif
+}
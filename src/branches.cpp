@@ -0,0 +1,290 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include "branches.hpp"
+#include "instructions.hpp"
+#include "sections.hpp"
+
+// A label which has been entered but whose end has not been reached yet
+struct OpenLabel {
+  OpCode op;
+  uint32_t height; // Operand stack height when entering the label
+  uint32_t arity;  // Number of values left on the stack at its end
+  uint32_t start;  // First instruction inside of the label
+  // Remaining instructions until the end (or else) can never be executed,
+  // e.g. after a br. The operand stack is polymorphic in this case.
+  bool unreachable;
+  // Forward branches which jump behind the end of this label. These can only
+  // be resolved once the end is found.
+  // Positive entries are pcs of instructions, negative entries are
+  // -(index + 1) into Code::br_tables
+  std::vector<int64_t> pending;
+};
+
+// Number of values produced by a block type, only the empty type and single
+// value types are supported
+static uint32_t block_arity(const Instr &instr) {
+  return instr.imm == 0x40 ? 0 : 1;
+}
+
+// Counts how many values the instruction pops and pushes
+// Control instructions are handled by resolve_branches directly.
+static void stack_effect(const WasmFile &wasm, const Instr &instr,
+                         uint32_t &pops, uint32_t &pushes) {
+  pops = 0;
+  pushes = 0;
+
+  switch (instr.op) {
+  case OpCode::Nop:
+  case OpCode::DataDrop:
+  case OpCode::ElemDrop:
+    return;
+  case OpCode::Drop:
+  case OpCode::LocalSet:
+  case OpCode::GlobalSet:
+    pops = 1;
+    return;
+  case OpCode::Select:
+    pops = 3;
+    pushes = 1;
+    return;
+  case OpCode::I32Const:
+  case OpCode::I64Const:
+  case OpCode::F32Const:
+  case OpCode::F64Const:
+  case OpCode::LocalGet:
+  case OpCode::GlobalGet:
+  case OpCode::MemorySize:
+    pushes = 1;
+    return;
+  case OpCode::LocalTee:
+  case OpCode::MemoryGrow:
+    pops = 1;
+    pushes = 1;
+    return;
+  case OpCode::MemoryInit:
+  case OpCode::MemoryCopy:
+  case OpCode::MemoryFill:
+  case OpCode::TableInit:
+  case OpCode::TableCopy:
+    pops = 3;
+    return;
+  case OpCode::Call: {
+    const FunctionType &type = wasm.function_type(instr.imm);
+    pops = type.params.size();
+    pushes = type.return_value == ImmediateRepr::None ? 0 : 1;
+    return;
+  }
+  case OpCode::CallIndirect: {
+    const FunctionType &type = wasm.type_section[instr.imm];
+    // +1 for the index into the table
+    pops = type.params.size() + 1;
+    pushes = type.return_value == ImmediateRepr::None ? 0 : 1;
+    return;
+  }
+  default:
+    break;
+  }
+
+  OpCode op = instr.op;
+
+  if (op >= 0x28 && op <= 0x35) {
+    // Loads
+    pops = 1;
+    pushes = 1;
+  } else if (op >= 0x36 && op <= 0x3E) {
+    // Stores
+    pops = 2;
+  } else if (op == 0x45 || op == 0x50 || (op >= 0x67 && op <= 0x69) ||
+             (op >= 0x79 && op <= 0x7B) || (op >= 0x8B && op <= 0x91) ||
+             (op >= 0x99 && op <= 0x9F) || (op >= 0xA7 && op <= 0xBF)) {
+    // Unops, conversions and reinterpretations
+    pops = 1;
+    pushes = 1;
+  } else if ((op >= 0x46 && op <= 0x66) || (op >= 0x6A && op <= 0xA6)) {
+    // Binops and comparisons, eqz and the unops are handled above
+    pops = 2;
+    pushes = 1;
+  } else {
+    assert(false && "todo: missing stack effect of opcode");
+  }
+}
+
+// Sets the target of a branch to label
+static void branch_to(std::vector<OpenLabel> &labels, uint32_t depth,
+                      BranchTarget &target, int64_t pending_entry) {
+  assert(depth < labels.size() && "invalid label depth");
+  OpenLabel &label = labels[labels.size() - 1 - depth];
+  target.height = label.height;
+
+  if (label.op == OpCode::Loop) {
+    // Branching to a loop continues with its first instruction
+    // and carries no values, since loops in WebAssembly 1.0 have no params
+    target.pc = label.start;
+    target.arity = 0;
+  } else {
+    target.arity = label.arity;
+    label.pending.push_back(pending_entry);
+  }
+}
+
+void resolve_branches(const WasmFile &wasm, const FunctionType &signature,
+                      Code &code) {
+  std::vector<Instr> &expr = code.expr;
+
+  // The function body itself is the outermost label, branching to it returns.
+  // The final end of the body is not part of expr, it is replaced by a return
+  // appended at expr.size()
+  std::vector<OpenLabel> labels(1);
+  labels[0].op = OpCode::Block;
+  labels[0].height = 0;
+  labels[0].arity = signature.return_value == ImmediateRepr::None ? 0 : 1;
+  labels[0].start = 0;
+  labels[0].unreachable = false;
+
+  uint32_t height = 0;
+
+  for (uint32_t pc = 0; pc < expr.size(); pc++) {
+    Instr &instr = expr[pc];
+    OpenLabel &current = labels.back();
+
+    switch (instr.op) {
+    case OpCode::Block:
+    case OpCode::Loop:
+    case OpCode::If: {
+      if (instr.op == OpCode::If) {
+        assert((height > current.height || current.unreachable) &&
+               "missing condition of if");
+        height = height > current.height ? height - 1 : height;
+      }
+
+      OpenLabel label;
+      label.op = instr.op;
+      label.height = height;
+      label.arity = block_arity(instr);
+      label.start = pc + 1;
+      label.unreachable = false;
+      labels.push_back(label);
+
+      if (instr.op == OpCode::Loop) {
+        code.loops.push_back(label.start);
+      }
+
+      // The false branch of an if continues after its else or end, which is
+      // patched in as soon as one of these is found
+      instr.target = {0, height, 0};
+      break;
+    }
+    case OpCode::Else: {
+      assert(current.op == OpCode::If && "else without matching if");
+      // The if jumps into the instruction after the else when its condition
+      // is false
+      expr[current.start - 1].target.pc = pc + 1;
+      // Reaching the else means the true branch is done, jump behind the end
+      instr.target = {0, current.height, current.arity};
+      current.pending.push_back(pc);
+      current.op = OpCode::Else;
+      current.unreachable = false;
+      height = current.height;
+      break;
+    }
+    case OpCode::End: {
+      assert(labels.size() > 1 && "end without matching block");
+      // Nothing but the label's results remain on the stack
+      height = current.height + current.arity;
+
+      if (current.op == OpCode::If) {
+        // if without else, the false branch continues after the end
+        expr[current.start - 1].target.pc = pc + 1;
+      }
+
+      for (int64_t entry : current.pending) {
+        if (entry >= 0) {
+          expr[entry].target.pc = pc + 1;
+        } else {
+          code.br_tables[-(entry + 1)].pc = pc + 1;
+        }
+      }
+
+      labels.pop_back();
+      break;
+    }
+    case OpCode::Br:
+    case OpCode::BrIf: {
+      if (instr.op == OpCode::BrIf) {
+        height = height > current.height ? height - 1 : height;
+      }
+      branch_to(labels, instr.imm, instr.target, pc);
+
+      if (instr.op == OpCode::Br) {
+        current.unreachable = true;
+        height = current.height;
+      }
+      break;
+    }
+    case OpCode::BrTable: {
+      height = height > current.height ? height - 1 : height;
+
+      // The instruction only stores where its entries start, all labels
+      // including the default follow consecutively in br_tables. Until
+      // resolved, the pc of an entry holds its label depth.
+      for (int64_t entry = instr.target.pc;
+           entry <= instr.target.pc + instr.imm; entry++) {
+        BranchTarget &target = code.br_tables[entry];
+        branch_to(labels, target.pc, target, -(entry + 1));
+      }
+
+      current.unreachable = true;
+      height = current.height;
+      break;
+    }
+    case OpCode::Return: {
+      branch_to(labels, labels.size() - 1, instr.target, pc);
+      current.unreachable = true;
+      height = current.height;
+      break;
+    }
+    case OpCode::Unreachable: {
+      current.unreachable = true;
+      height = current.height;
+      break;
+    }
+    default: {
+      uint32_t pops, pushes;
+      stack_effect(wasm, instr, pops, pushes);
+
+      if (height < current.height + pops) {
+        assert(current.unreachable && "operand stack underflow");
+        height = current.height;
+      } else {
+        height -= pops;
+      }
+      height += pushes;
+      break;
+    }
+    }
+
+    code.max_height = std::max(code.max_height, height);
+  }
+
+  assert(labels.size() == 1 && "missing end of a block");
+
+  // Branches to the function body leave the function through the final return
+  const uint32_t function_end = expr.size();
+  for (int64_t entry : labels[0].pending) {
+    if (entry >= 0) {
+      expr[entry].target.pc = function_end;
+    } else {
+      code.br_tables[-(entry + 1)].pc = function_end;
+    }
+  }
+
+  // Every body ends with a return, such that the runtime never has to check
+  // whether the pc ran past the last instruction
+  Instr ret{};
+  ret.op = OpCode::Return;
+  ret.target = {function_end, 0, labels[0].arity};
+  expr.push_back(ret);
+}
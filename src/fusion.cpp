@@ -0,0 +1,202 @@
+#include <cstdint>
+#include <vector>
+
+#include "fusion.hpp"
+#include "instructions.hpp"
+#include "sections.hpp"
+
+// The forms of a fused binop, which follow each other in OpCode
+enum BinopForm { FORM_C = 0, FORM_L = 1, FORM_LC = 2, FORM_LL = 3 };
+
+// Returns the superinstruction of op in the given form, or Nop if op has none
+static OpCode fused_binop(OpCode op, BinopForm form) {
+  switch (op) {
+#define FUSED_BINOP_CASE(name)                                                 \
+  case OpCode::name:                                                           \
+    return static_cast<OpCode>(OpCode::name##C + form);
+    FUSED_BINOPS(FUSED_BINOP_CASE)
+#undef FUSED_BINOP_CASE
+  default:
+    return OpCode::Nop;
+  }
+}
+
+// Returns the superinstruction of condition followed by br_if or if, or Nop.
+// constant selects the form whose second operand is an i32.const.
+static OpCode fused_condition(OpCode condition, OpCode branch, bool constant) {
+  bool br_if = branch == OpCode::BrIf;
+  switch (condition) {
+#define FUSED_COMPARISON_CASE(name)                                            \
+  case OpCode::name:                                                           \
+    if (constant) {                                                            \
+      return br_if ? OpCode::BrIf##name##C : OpCode::If##name##C;              \
+    }                                                                          \
+    return br_if ? OpCode::BrIf##name : OpCode::If##name;
+    FUSED_COMPARISONS(FUSED_COMPARISON_CASE)
+#undef FUSED_COMPARISON_CASE
+  case OpCode::I32eqz:
+    if (constant) {
+      return OpCode::Nop;
+    }
+    return br_if ? OpCode::BrIfI32eqz : OpCode::IfI32eqz;
+  default:
+    return OpCode::Nop;
+  }
+}
+
+// Whether target.pc of the instruction is a branch target
+static bool has_target(OpCode op) {
+  switch (op) {
+  case OpCode::If:
+  case OpCode::Else:
+  case OpCode::Br:
+  case OpCode::BrIf:
+  case OpCode::Return:
+    return true;
+  default:
+    return (op >= OpCode::BrIfI32eq && op <= OpCode::IfI32eqz);
+  }
+}
+
+// Matches the sequence starting at pc against all superinstructions.
+// Returns the number of instructions replaced by fused, 1 if nothing matched.
+static uint32_t match(const std::vector<Instr> &expr,
+                      const std::vector<bool> &is_target, uint32_t pc,
+                      Instr &fused) {
+  // Whether the next length instructions can be executed as one
+  auto fusable = [&](uint32_t length) {
+    if (pc + length > expr.size()) {
+      return false;
+    }
+    for (uint32_t i = 1; i < length; i++) {
+      if (is_target[pc + i]) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  const Instr &a = expr[pc];
+  fused = Instr{};
+
+  if (fusable(3)) {
+    const Instr &b = expr[pc + 1];
+    const Instr &c = expr[pc + 2];
+
+    if (a.op == OpCode::LocalGet &&
+        (b.op == OpCode::I32Const || b.op == OpCode::LocalGet)) {
+      bool constant = b.op == OpCode::I32Const;
+      fused.op = fused_binop(c.op, constant ? FORM_LC : FORM_LL);
+      if (fused.op != OpCode::Nop) {
+        fused.imm = a.imm;
+        fused.imm2 = constant ? b.value.v.n32 : b.imm;
+        return 3;
+      }
+    }
+
+    if (a.op == OpCode::I32Const &&
+        (c.op == OpCode::BrIf || c.op == OpCode::If)) {
+      fused.op = fused_condition(b.op, c.op, true);
+      if (fused.op != OpCode::Nop) {
+        fused.imm = a.value.v.n32;
+        fused.target = c.target;
+        return 3;
+      }
+    }
+  }
+
+  if (fusable(2)) {
+    const Instr &b = expr[pc + 1];
+
+    if (a.op == OpCode::I32Const || a.op == OpCode::LocalGet) {
+      bool constant = a.op == OpCode::I32Const;
+      fused.op = fused_binop(b.op, constant ? FORM_C : FORM_L);
+      if (fused.op != OpCode::Nop) {
+        fused.imm = constant ? a.value.v.n32 : a.imm;
+        return 2;
+      }
+    }
+
+    if (a.op == OpCode::I32Const && b.op == OpCode::I32Store && b.imm == 0) {
+      fused.op = OpCode::I32StoreC;
+      fused.imm = a.value.v.n32;
+      fused.imm2 = b.imm2;
+      return 2;
+    }
+
+    if (a.op == OpCode::LocalSet && b.op == OpCode::LocalGet) {
+      fused.op = OpCode::LocalSetGet;
+      fused.imm = a.imm;
+      fused.imm2 = b.imm;
+      return 2;
+    }
+
+    if (b.op == OpCode::BrIf || b.op == OpCode::If) {
+      fused.op = fused_condition(a.op, b.op, false);
+      if (fused.op != OpCode::Nop) {
+        fused.imm = b.imm;
+        fused.target = b.target;
+        return 2;
+      }
+    }
+  }
+
+  fused = a;
+  return 1;
+}
+
+void fuse_instructions(Code &code) {
+  std::vector<Instr> &expr = code.expr;
+
+  // Branches may only continue at the first instruction of a sequence
+  std::vector<bool> is_target(expr.size() + 1, false);
+  for (const Instr &instr : expr) {
+    if (has_target(instr.op)) {
+      is_target[instr.target.pc] = true;
+    }
+  }
+  for (const BranchTarget &target : code.br_tables) {
+    is_target[target.pc] = true;
+  }
+
+  // The new pc of every instruction, instructions of a sequence are moved to
+  // its superinstruction
+  std::vector<uint32_t> new_pc(expr.size() + 1);
+  std::vector<Instr> fused_expr;
+  fused_expr.reserve(expr.size());
+
+  uint32_t pc = 0;
+  while (pc < expr.size()) {
+    // Nop, block and end do nothing once the branches are resolved, they are
+    // dropped and branches to them continue at the next instruction
+    OpCode op = expr[pc].op;
+    if (op == OpCode::Nop || op == OpCode::Block || op == OpCode::End) {
+      new_pc[pc] = fused_expr.size();
+      pc++;
+      continue;
+    }
+
+    Instr fused;
+    uint32_t length = match(expr, is_target, pc, fused);
+    for (uint32_t i = 0; i < length; i++) {
+      new_pc[pc + i] = fused_expr.size();
+    }
+    fused_expr.push_back(fused);
+    pc += length;
+  }
+  new_pc[expr.size()] = fused_expr.size();
+
+  for (Instr &instr : fused_expr) {
+    if (has_target(instr.op)) {
+      instr.target.pc = new_pc[instr.target.pc];
+    }
+  }
+  for (BranchTarget &target : code.br_tables) {
+    target.pc = new_pc[target.pc];
+  }
+  for (uint32_t &loop : code.loops) {
+    loop = new_pc[loop];
+  }
+
+  expr = std::move(fused_expr);
+}
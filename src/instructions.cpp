@@ -14,7 +14,7 @@ void immediates(OpCode op, ImmediateRepr &imm0, ImmediateRepr &imm1,
   imm2 = ImmediateRepr::Uninitialised;
 
   // Numeric instructions without any immediates
-  if (static_cast<uint8_t>(op) >= 0x45 && static_cast<uint8_t>(op) <= 0xC4) {
+  if (op >= 0x45 && op <= 0xC4) {
     return;
   }
 
@@ -51,6 +51,7 @@ void immediates(OpCode op, ImmediateRepr &imm0, ImmediateRepr &imm1,
   case OpCode::Br:
   case OpCode::BrIf:
   case OpCode::DataDrop:
+  case OpCode::ElemDrop:
     imm0 = ImmediateRepr::I32;
     break;
 
@@ -65,6 +66,8 @@ void immediates(OpCode op, ImmediateRepr &imm0, ImmediateRepr &imm1,
   case OpCode::ReturncalIndirect:
   case OpCode::MemoryInit:
   case OpCode::MemoryCopy:
+  case OpCode::TableInit:
+  case OpCode::TableCopy:
     imm0 = ImmediateRepr::I32;
     imm1 = ImmediateRepr::I32;
     break;
@@ -94,6 +97,9 @@ Immediate parse_immediate(const ImmediateRepr repr, const uint8_t *&start,
 
   Immediate imm;
   imm.t = repr;
+  // 32 bit values leave the upper half untouched, which is zeroed such that
+  // decoding the same bytes always yields the same instruction
+  imm.v.n64 = 0;
   if (repr == ImmediateRepr::I32) {
     // TODO: all immediates are currently assumed to be signed...
     imm.v.n32 = leb128_decode<int32_t>(start, end);
@@ -112,93 +118,106 @@ Immediate parse_immediate(const ImmediateRepr repr, const uint8_t *&start,
   return imm;
 }
 
-// For memargs, depending on the value N, there can be two or three immediates
+// For memargs, depending on the value of align, the memory index follows
+// before the offset
 // https://webassembly.github.io/spec/core/binary/instructions.html#memory-instructions
 void parse_memarg(const uint8_t *&start, const uint8_t *end, Instr &instr) {
-  Immediate n = parse_immediate(ImmediateRepr::I32, start, end);
-  instr.imms.push_back(n);
+  uint32_t align = uleb128_decode<uint32_t>(start, end);
 
-  if (n.v.n32 >= 64) { // 2^6
-    // x
-    instr.imms.push_back(parse_immediate(ImmediateRepr::I32, start, end));
+  instr.imm = 0;
+  if (align >= 64) { // 2^6
+    instr.imm = uleb128_decode<uint32_t>(start, end);
   }
 
-  // m
-  instr.imms.push_back(parse_immediate(ImmediateRepr::I64, start, end));
+  instr.imm2 = uleb128_decode<uint32_t>(start, end);
 }
 
-Instr parse_instruction(const uint8_t *&start, const uint8_t *end) {
-  Instr instr;
+Instr parse_instruction(const uint8_t *&start, const uint8_t *end,
+                        std::vector<BranchTarget> &br_tables) {
+  Instr instr{};
   instr.op = static_cast<OpCode>(read_byte(start, end));
 
   if (instr.op == OpCode::End) {
     return instr;
   }
 
-  if(instr.op == OpCode::MemoryInit) {
+  if(instr.op == OpCode::MiscPrefix) {
      // This opcode has a differenet meaning dependeng on the flag 
      uint32_t flag = uleb128_decode<uint32_t>(start, end);
      if(flag == 8) {
-       // MemoryInit
+       instr.op = MemoryInit;
      } else if(flag == 9) {
        instr.op = DataDrop;
      } else if(flag == 10) {
        instr.op = MemoryCopy;
      }  else if (flag == 11) {
        instr.op = MemoryFill;
+     }  else if (flag == 12) {
+       instr.op = TableInit;
+     }  else if (flag == 13) {
+       instr.op = ElemDrop;
+     }  else if (flag == 14) {
+       instr.op = TableCopy;
      }  else {
        assert(false && "todo: invalid memory init flag!");
      }
   }
 
-  
-
   // Instructions using memarg
-  if (static_cast<uint8_t>(instr.op) >= 0x28 &&
-      static_cast<uint8_t>(instr.op) <= 0x3E) {
+  if (instr.op >= 0x28 && instr.op <= 0x3E) {
     parse_memarg(start, end, instr);
     return instr;
   }
 
   if (instr.op == BrTable) {
     uint32_t num_targets = uleb128_decode<uint32_t>(start, end);
-    // +1 due to there being a default target at the end
-    for (int i = 0; i < num_targets + 1; i++) {
-      uint32_t break_depth = uleb128_decode<uint32_t>(start, end);
-      Immediate imm;
-      imm.t = ImmediateRepr::I32;
-      imm.v.n32 = break_depth;
-      instr.imms.push_back(imm);
+    instr.imm = num_targets;
+    instr.target = {static_cast<uint32_t>(br_tables.size()), 0, 0};
+    // +1 due to there being a default target at the end.
+    // The depths are decoded in chunks, to use the bulk decoder without
+    // allocating.
+    uint32_t depths[64];
+    uint32_t remaining = num_targets + 1;
+    while (remaining > 0) {
+      uint32_t chunk = remaining < 64 ? remaining : 64;
+      uleb128_decode_u32s(start, end, depths, chunk);
+      for (uint32_t i = 0; i < chunk; i++) {
+        br_tables.push_back({depths[i], 0, 0});
+      }
+      remaining -= chunk;
     }
     return instr;
   }
 
   ImmediateRepr imm0, imm1, imm2;
   immediates(instr.op, imm0, imm1, imm2);
+  assert(imm2 == ImmediateRepr::Uninitialised && "todo: third immediate");
 
-  
-
-  // TODO: maybe precount to use resize
-  // the reason i dont use fixed imm0-2 in Instr is due to edge cases requiring
-  // lists
-  if (imm0 != ImmediateRepr::Uninitialised) {
-    instr.imms.push_back(parse_immediate(imm0, start, end));
+  if (instr.op == I32Const || instr.op == I64Const || instr.op == F32Const ||
+      instr.op == F64Const) {
+    // Constants are the only signed immediates
+    instr.value = parse_immediate(imm0, start, end);
+    return instr;
   }
 
-  if (imm1 != ImmediateRepr::Uninitialised) {
-    instr.imms.push_back(parse_immediate(imm1, start, end));
+  // All other immediates are unsigned indices, depths or block types
+  if (imm0 == ImmediateRepr::Byte) {
+    instr.imm = read_byte(start, end);
+  } else if (imm0 != ImmediateRepr::Uninitialised) {
+    instr.imm = uleb128_decode<uint32_t>(start, end);
   }
 
-  if (imm2 != ImmediateRepr::Uninitialised) {
-    instr.imms.push_back(parse_immediate(imm2, start, end));
+  if (imm1 != ImmediateRepr::Uninitialised) {
+    instr.imm2 = uleb128_decode<uint32_t>(start, end);
   }
 
   return instr;
 }
 
 void read_expr(const uint8_t *&ptr, const uint8_t *end,
-               std::vector<Instr> &result) {
-  Instr instr = parse_instruction(ptr, end);
+               std::vector<Instr> &result,
+               std::vector<BranchTarget> &br_tables) {
+  Instr instr = parse_instruction(ptr, end, br_tables);
 
   // for all condition instruction 0x02, 0x03, 0x04, this will be increased by
   // one, then when we exit the if/else, a End code will be read, for this End
@@ -208,8 +227,7 @@ void read_expr(const uint8_t *&ptr, const uint8_t *end,
   int conditional_nesting = 0;
   while (instr.op != OpCode::End || conditional_nesting > 0) {
 
-    uint8_t op = static_cast<uint8_t>(instr.op);
-    if (0x02 <= op && op <= 0x04) {
+    if (0x02 <= instr.op && instr.op <= 0x04) {
       // Not inclusive 0x05, because else does not continue the nesting
       conditional_nesting++;
     }
@@ -221,6 +239,13 @@ void read_expr(const uint8_t *&ptr, const uint8_t *end,
     // Push all instructions, even ending, to know when control blocks end
     result.push_back(instr);
 
-    instr = parse_instruction(ptr, end);
+    instr = parse_instruction(ptr, end, br_tables);
   }
 }
+
+void read_expr(const uint8_t *&ptr, const uint8_t *end,
+               std::vector<Instr> &result) {
+  std::vector<BranchTarget> br_tables;
+  read_expr(ptr, end, result, br_tables);
+  assert(br_tables.empty() && "br_table in constant expression");
+}
@@ -0,0 +1,619 @@
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include "jit.hpp"
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#define WINTERP_JIT 1
+#else
+#define WINTERP_JIT 0
+#endif
+
+JitFunction::JitFunction(JitFunction &&other)
+    : entry(other.entry), loop_entries(std::move(other.loop_entries)),
+      code(other.code), size(other.size) {
+  other.entry = nullptr;
+  other.code = nullptr;
+  other.size = 0;
+}
+
+JitFunction &JitFunction::operator=(JitFunction &&other) {
+  std::swap(entry, other.entry);
+  std::swap(loop_entries, other.loop_entries);
+  std::swap(code, other.code);
+  std::swap(size, other.size);
+  return *this;
+}
+
+JitFunction::~JitFunction() {
+#if WINTERP_JIT
+  if (code != nullptr) {
+    munmap(code, size);
+  }
+#endif
+}
+
+bool jit_supported() { return WINTERP_JIT; }
+
+#if WINTERP_JIT
+
+enum Reg : uint8_t {
+  RAX = 0, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+  R8, R9, R10, R11, R12, R13, R14, R15,
+};
+
+// Condition codes of jcc, setcc and cmovcc
+enum Cond : uint8_t {
+  CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_BE = 0x6, CC_A = 0x7,
+  CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF,
+};
+
+// The frame is kept in rbx and the JitContext in r12, which both survive
+// calls. Everything else is scratch.
+const Reg FRAME = RBX;
+const Reg CONTEXT = R12;
+
+// Encodes the few x86-64 instructions the compiler needs
+class Assembler {
+public:
+  std::vector<uint8_t> code;
+
+  size_t size() const { return code.size(); }
+  void byte(uint8_t b) { code.push_back(b); }
+
+  void u32(uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+      byte(value >> (8 * i));
+    }
+  }
+
+  void u64(uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+      byte(value >> (8 * i));
+    }
+  }
+
+  void patch32(size_t at, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+      code[at + i] = value >> (8 * i);
+    }
+  }
+
+  // Instruction with a ModRM operand [base + disp], reg is the register
+  // operand or the opcode extension. prefix is a legacy prefix or 0.
+  void mem(uint8_t prefix, bool wide, std::initializer_list<uint8_t> opcode,
+           uint8_t reg, Reg base, int32_t disp) {
+    start(prefix, wide, reg, 0, base, opcode);
+    bool short_disp = disp >= -128 && disp <= 127;
+    uint8_t mod = (disp == 0 && (base & 7) != RBP) ? 0 : short_disp ? 1 : 2;
+    byte(mod << 6 | (reg & 7) << 3 | (base & 7));
+    if ((base & 7) == RSP) {
+      byte(0x24); // SIB without index
+    }
+    if (mod == 1) {
+      byte(disp);
+    } else if (mod == 2) {
+      u32(disp);
+    }
+  }
+
+  // Instruction with a ModRM operand [base + index << scale]
+  void mem_index(uint8_t prefix, bool wide,
+                 std::initializer_list<uint8_t> opcode, uint8_t reg, Reg base,
+                 Reg index, uint8_t scale = 0) {
+    start(prefix, wide, reg, index, base, opcode);
+    bool disp = (base & 7) == RBP;
+    byte((disp ? 1 : 0) << 6 | (reg & 7) << 3 | RSP);
+    byte(scale << 6 | (index & 7) << 3 | (base & 7));
+    if (disp) {
+      byte(0);
+    }
+  }
+
+  // Instruction with two register operands
+  void reg(uint8_t prefix, bool wide, std::initializer_list<uint8_t> opcode,
+           uint8_t reg, Reg rm) {
+    start(prefix, wide, reg, 0, rm, opcode);
+    byte(0xC0 | (reg & 7) << 3 | (rm & 7));
+  }
+
+  void mov_imm32(Reg dst, uint32_t value) {
+    if (dst >= R8) {
+      byte(0x41);
+    }
+    byte(0xB8 + (dst & 7));
+    u32(value);
+  }
+
+  void mov_imm64(Reg dst, uint64_t value) {
+    byte(0x48 | (dst >= R8 ? 1 : 0));
+    byte(0xB8 + (dst & 7));
+    u64(value);
+  }
+
+  // Jumps with a 32 bit displacement, returns where it has to be patched
+  size_t jmp() {
+    byte(0xE9);
+    u32(0);
+    return size() - 4;
+  }
+
+  size_t jcc(Cond cond) {
+    byte(0x0F);
+    byte(0x80 | cond);
+    u32(0);
+    return size() - 4;
+  }
+
+  // Lets the jump whose displacement is at `at` continue at target
+  void bind(size_t at, size_t target) { patch32(at, target - (at + 4)); }
+
+private:
+  void start(uint8_t prefix, bool wide, uint8_t reg, uint8_t index,
+             uint8_t base, std::initializer_list<uint8_t> opcode) {
+    if (prefix != 0) {
+      byte(prefix);
+    }
+    uint8_t rex = 0x40 | (wide ? 8 : 0) | (reg & 8 ? 4 : 0) |
+                  (index & 8 ? 2 : 0) | (base & 8 ? 1 : 0);
+    if (rex != 0x40) {
+      byte(rex);
+    }
+    for (uint8_t b : opcode) {
+      byte(b);
+    }
+  }
+};
+
+// ModRM opcode extensions of the group 2 shifts
+const uint8_t SHIFT_ROL = 0, SHIFT_ROR = 1, SHIFT_SHL = 4, SHIFT_SHR = 5,
+              SHIFT_SAR = 7;
+
+class FunctionCompiler {
+public:
+  FunctionCompiler(const RegisterCode &code) : code(code) {}
+
+  void run() {
+    prologue();
+
+    pc_offsets.resize(code.instrs.size() + 1);
+    for (uint32_t pc = 0; pc < code.instrs.size(); pc++) {
+      pc_offsets[pc] = a.size();
+      instruction(code.instrs[pc]);
+    }
+    pc_offsets[code.instrs.size()] = a.size();
+
+    for (const auto &jump : jumps) {
+      a.bind(jump.first, pc_offsets[jump.second]);
+    }
+
+    // Shared by all memory accesses of the function
+    if (!traps.empty()) {
+      size_t trap = a.size();
+      a.mov_imm32(RDI, MEMORY_OUT_OF_BOUNDS);
+      call(reinterpret_cast<void *>(&jit_trap));
+      for (size_t at : traps) {
+        a.bind(at, trap);
+      }
+    }
+
+    // Entries at the start of loops, with the same prologue as the function
+    for (const RegLoop &loop : code.loops) {
+      if (loop.pc == UNREACHABLE_LOOP) {
+        loop_offsets.push_back(UNREACHABLE_LOOP);
+        continue;
+      }
+      loop_offsets.push_back(a.size());
+      prologue();
+      a.bind(a.jmp(), pc_offsets[loop.pc]);
+    }
+  }
+
+  std::vector<uint8_t> &machine_code() { return a.code; }
+
+  // Machine code offset of the entry of every loop, UNREACHABLE_LOOP for
+  // loops without one
+  std::vector<size_t> loop_offsets;
+
+private:
+  const RegisterCode &code;
+  Assembler a;
+  // Machine code offset of every instruction
+  std::vector<size_t> pc_offsets;
+  // Jumps to be patched with the offset of an instruction
+  std::vector<std::pair<size_t, uint32_t>> jumps;
+  // Jumps to the trap of out of bounds memory accesses
+  std::vector<size_t> traps;
+
+  static int32_t slot(uint32_t index) {
+    assert(index < (1u << 28) && "frame too large to compile");
+    return index * 8;
+  }
+
+  void jump_to(size_t at, uint32_t pc) { jumps.push_back({at, pc}); }
+
+  // Loads the value in a slot of the frame into reg, its low 32 bits only if
+  // not wide
+  void load(Reg reg, uint32_t index, bool wide) {
+    a.mem(0, wide, {0x8B}, reg, FRAME, slot(index));
+  }
+
+  void store(Reg reg, uint32_t index, bool wide) {
+    a.mem(0, wide, {0x89}, reg, FRAME, slot(index));
+  }
+
+  void move(uint32_t dst, uint32_t src) {
+    if (dst != src) {
+      load(RAX, src, true);
+      store(RAX, dst, true);
+    }
+  }
+
+  void call(void *function) {
+    a.mov_imm64(RAX, reinterpret_cast<uint64_t>(function));
+    a.reg(0, false, {0xFF}, 2, RAX); // call rax
+  }
+
+  void prologue() {
+    a.byte(0x53); // push rbx
+    a.byte(0x41); // push r12
+    a.byte(0x54);
+    // Keeps the stack 16 byte aligned for calls
+    a.reg(0, true, {0x83}, 5, RSP); // sub rsp, 8
+    a.byte(8);
+    a.reg(0, true, {0x89}, RSI, FRAME);
+    a.reg(0, true, {0x89}, RDI, CONTEXT);
+  }
+
+  void epilogue() {
+    a.reg(0, true, {0x83}, 0, RSP); // add rsp, 8
+    a.byte(8);
+    a.byte(0x41); // pop r12
+    a.byte(0x5C);
+    a.byte(0x5B); // pop rbx
+    a.byte(0xC3); // ret
+  }
+
+  // dst = a op b, for add, sub, and, or, xor and imul
+  void binop(const RegInstr &instr, std::initializer_list<uint8_t> opcode,
+             bool wide) {
+    load(RAX, instr.a, wide);
+    a.mem(0, wide, opcode, RAX, FRAME, slot(instr.b));
+    store(RAX, instr.dst, wide);
+  }
+
+  void shift(const RegInstr &instr, uint8_t kind, bool wide) {
+    load(RAX, instr.a, wide);
+    load(RCX, instr.b, false);
+    a.reg(0, wide, {0xD3}, kind, RAX); // shift rax by cl
+    store(RAX, instr.dst, wide);
+  }
+
+  // dst = a cond b as i32
+  void compare(const RegInstr &instr, Cond cond, bool wide) {
+    load(RAX, instr.a, wide);
+    a.mem(0, wide, {0x3B}, RAX, FRAME, slot(instr.b)); // cmp rax, [b]
+    set(cond, instr.dst);
+  }
+
+  void eqz(const RegInstr &instr, bool wide) {
+    load(RAX, instr.a, wide);
+    a.reg(0, wide, {0x85}, RAX, RAX); // test rax, rax
+    set(CC_E, instr.dst);
+  }
+
+  void set(Cond cond, uint32_t dst) {
+    a.reg(0, false, {0x0F, uint8_t(0x90 | cond)}, 0, RAX); // setcc al
+    a.reg(0, false, {0x0F, 0xB6}, RAX, RAX);              // movzx eax, al
+    store(RAX, dst, false);
+  }
+
+  // dst = a op b for f32 (prefix 0xF3) or f64 (prefix 0xF2)
+  void float_binop(const RegInstr &instr, uint8_t prefix, uint8_t opcode) {
+    a.mem(prefix, false, {0x0F, 0x10}, 0, FRAME, slot(instr.a));
+    a.mem(prefix, false, {0x0F, opcode}, 0, FRAME, slot(instr.b));
+    a.mem(prefix, false, {0x0F, 0x11}, 0, FRAME, slot(instr.dst));
+  }
+
+  // Computes the address of a load or store of size bytes into rax and the
+  // start of the memory into rcx, trapping if it is out of bounds. With
+  // WINTERP_SIGNAL_TRAPS the access itself faults in the guard region.
+  void address(const RegInstr &instr, uint32_t size) {
+    load(RAX, instr.a, false); // zero extends to 64 bit
+    if (instr.imm != 0) {
+      a.mov_imm32(RCX, instr.imm);
+      a.reg(0, true, {0x01}, RCX, RAX); // add rax, rcx
+    }
+#if !WINTERP_SIGNAL_TRAPS
+    a.mem(0, true, {0x8D}, RDX, RAX, size); // lea rdx, [rax + size]
+    a.mem(0, true, {0x3B}, RDX, CONTEXT, offsetof(JitContext, memory_size));
+    traps.push_back(a.jcc(CC_A));
+#else
+    (void)size;
+#endif
+    a.mem(0, true, {0x8B}, RCX, CONTEXT, offsetof(JitContext, memory));
+  }
+
+  // Only memory 0 is accessed directly, through the context. imm2 is the
+  // memory index.
+  void load_memory(const RegInstr &instr, uint32_t size, bool wide,
+                   std::initializer_list<uint8_t> opcode, bool wide_result) {
+    if (instr.imm2 != 0) {
+      return fallback(instr);
+    }
+    address(instr, size);
+    a.mem_index(0, wide, opcode, RAX, RCX, RAX);
+    store(RAX, instr.dst, wide_result);
+  }
+
+  void store_memory(const RegInstr &instr, uint32_t size) {
+    if (instr.imm2 != 0) {
+      return fallback(instr);
+    }
+    address(instr, size);
+    load(RDX, instr.b, size == 8);
+    switch (size) {
+    case 1:
+      a.mem_index(0, false, {0x88}, RDX, RCX, RAX);
+      break;
+    case 2:
+      a.mem_index(0x66, false, {0x89}, RDX, RCX, RAX);
+      break;
+    case 4:
+      a.mem_index(0, false, {0x89}, RDX, RCX, RAX);
+      break;
+    default:
+      a.mem_index(0, true, {0x89}, RDX, RCX, RAX);
+      break;
+    }
+  }
+
+  // Executes instr with jit_execute
+  void fallback(const RegInstr &instr) {
+    a.reg(0, true, {0x89}, CONTEXT, RDI);
+    a.mov_imm64(RSI, reinterpret_cast<uint64_t>(&instr));
+    a.reg(0, true, {0x89}, FRAME, RDX);
+    call(reinterpret_cast<void *>(&jit_execute));
+  }
+
+  void call_function(const RegInstr &instr, bool indirect) {
+    a.reg(0, true, {0x89}, CONTEXT, RDI);
+    if (indirect) {
+      load(RSI, instr.b, false);
+    } else {
+      a.mov_imm32(RSI, instr.imm);
+    }
+    a.mem(0, true, {0x8D}, RDX, FRAME, slot(instr.a + instr.c));
+    if (indirect) {
+      a.mov_imm32(RCX, instr.imm);
+    }
+    call(indirect ? reinterpret_cast<void *>(&jit_call_indirect)
+                  : reinterpret_cast<void *>(&jit_call));
+  }
+
+  void br_table(const RegInstr &instr) {
+    uint32_t num_labels = instr.imm2;
+
+    // Clamp the index to the default label
+    load(RAX, instr.a, false);
+    a.mov_imm32(RCX, num_labels);
+    a.reg(0, false, {0x39}, RCX, RAX);       // cmp eax, ecx
+    a.reg(0, false, {0x0F, 0x47}, RAX, RCX); // cmova eax, ecx
+
+    // Jump through a table of 32 bit offsets relative to the table
+    a.byte(0x48); // lea rcx, [rip + table]
+    a.byte(0x8D);
+    a.byte(0x0D);
+    size_t table_address = a.size();
+    a.u32(0);
+    a.mem_index(0, true, {0x63}, RAX, RCX, RAX, 2); // movsxd rax, [rcx+rax*4]
+    a.reg(0, true, {0x01}, RCX, RAX);               // add rax, rcx
+    a.reg(0, false, {0xFF}, 4, RAX);                // jmp rax
+
+    size_t table = a.size();
+    a.patch32(table_address, table - (table_address + 4));
+    for (uint32_t i = 0; i <= num_labels; i++) {
+      a.u32(0);
+    }
+
+    // One stub per label, which moves the value carried over
+    for (uint32_t i = 0; i <= num_labels; i++) {
+      const RegTableEntry &entry = code.br_tables[instr.imm + i];
+      a.patch32(table + 4 * i, a.size() - table);
+      move(entry.dst, instr.b);
+      jump_to(a.jmp(), entry.pc);
+    }
+  }
+
+  void instruction(const RegInstr &instr) {
+    switch (instr.op) {
+    case OpCode::If:
+      load(RAX, instr.a, false);
+      a.reg(0, false, {0x85}, RAX, RAX);
+      jump_to(a.jcc(CC_E), instr.imm);
+      return;
+    case OpCode::Br:
+      move(instr.dst, instr.a);
+      jump_to(a.jmp(), instr.imm);
+      return;
+    case OpCode::BrIf: {
+      load(RAX, instr.b, false);
+      a.reg(0, false, {0x85}, RAX, RAX);
+      if (instr.dst == instr.a) {
+        jump_to(a.jcc(CC_NE), instr.imm);
+        return;
+      }
+      size_t skip = a.jcc(CC_E);
+      move(instr.dst, instr.a);
+      jump_to(a.jmp(), instr.imm);
+      a.bind(skip, a.size());
+      return;
+    }
+    case OpCode::BrTable:
+      br_table(instr);
+      return;
+    case OpCode::Return:
+      move(0, instr.a);
+      epilogue();
+      return;
+    case OpCode::Call:
+      call_function(instr, false);
+      return;
+    case OpCode::CallIndirect:
+      call_function(instr, true);
+      return;
+    case OpCode::Move:
+      move(instr.dst, instr.a);
+      return;
+    case OpCode::Select:
+      load(RAX, instr.a, true);
+      load(RDX, instr.c, false);
+      a.reg(0, false, {0x85}, RDX, RDX);
+      a.mem(0, true, {0x0F, 0x44}, RAX, FRAME, slot(instr.b)); // cmovz
+      store(RAX, instr.dst, true);
+      return;
+
+    case OpCode::I32Add: return binop(instr, {0x03}, false);
+    case OpCode::I32Sub: return binop(instr, {0x2B}, false);
+    case OpCode::I32Mul: return binop(instr, {0x0F, 0xAF}, false);
+    case OpCode::I32and: return binop(instr, {0x23}, false);
+    case OpCode::I32or: return binop(instr, {0x0B}, false);
+    case OpCode::I32xor: return binop(instr, {0x33}, false);
+    case OpCode::I32shl: return shift(instr, SHIFT_SHL, false);
+    case OpCode::I32shrs: return shift(instr, SHIFT_SAR, false);
+    case OpCode::I32shru: return shift(instr, SHIFT_SHR, false);
+    case OpCode::I32rotl: return shift(instr, SHIFT_ROL, false);
+    case OpCode::I32rotr: return shift(instr, SHIFT_ROR, false);
+    case OpCode::I32eqz: return eqz(instr, false);
+    case OpCode::I32eq: return compare(instr, CC_E, false);
+    case OpCode::I32ne: return compare(instr, CC_NE, false);
+    case OpCode::I32lts: return compare(instr, CC_L, false);
+    case OpCode::I32ltu: return compare(instr, CC_B, false);
+    case OpCode::I32gts: return compare(instr, CC_G, false);
+    case OpCode::I32gtu: return compare(instr, CC_A, false);
+    case OpCode::I32le_s: return compare(instr, CC_LE, false);
+    case OpCode::I32le_u: return compare(instr, CC_BE, false);
+    case OpCode::I32ge_s: return compare(instr, CC_GE, false);
+    case OpCode::I32ge_u: return compare(instr, CC_AE, false);
+
+    case OpCode::I64Add: return binop(instr, {0x03}, true);
+    case OpCode::I64Sub: return binop(instr, {0x2B}, true);
+    case OpCode::I64Mul: return binop(instr, {0x0F, 0xAF}, true);
+    case OpCode::I64and: return binop(instr, {0x23}, true);
+    case OpCode::I64or: return binop(instr, {0x0B}, true);
+    case OpCode::I64xor: return binop(instr, {0x33}, true);
+    case OpCode::I64shl: return shift(instr, SHIFT_SHL, true);
+    case OpCode::I64shru: return shift(instr, SHIFT_SHR, true);
+    case OpCode::I64rotl: return shift(instr, SHIFT_ROL, true);
+    case OpCode::I64rotr: return shift(instr, SHIFT_ROR, true);
+    case OpCode::I64eqz: return eqz(instr, true);
+    case OpCode::I64eq: return compare(instr, CC_E, true);
+    case OpCode::I64ne: return compare(instr, CC_NE, true);
+    case OpCode::I64lts: return compare(instr, CC_L, true);
+    case OpCode::I64ltu: return compare(instr, CC_B, true);
+    case OpCode::I64gts: return compare(instr, CC_G, true);
+    case OpCode::I64gtu: return compare(instr, CC_A, true);
+    case OpCode::I64les: return compare(instr, CC_LE, true);
+    case OpCode::I64leu: return compare(instr, CC_BE, true);
+    case OpCode::I64ges: return compare(instr, CC_GE, true);
+    case OpCode::I64geu: return compare(instr, CC_AE, true);
+
+    case OpCode::F32Add: return float_binop(instr, 0xF3, 0x58);
+    case OpCode::F32Sub: return float_binop(instr, 0xF3, 0x5C);
+    case OpCode::F32Mul: return float_binop(instr, 0xF3, 0x59);
+    case OpCode::F32Div: return float_binop(instr, 0xF3, 0x5E);
+    case OpCode::F64Add: return float_binop(instr, 0xF2, 0x58);
+    case OpCode::F64Sub: return float_binop(instr, 0xF2, 0x5C);
+    case OpCode::F64Mul: return float_binop(instr, 0xF2, 0x59);
+    case OpCode::F64Div: return float_binop(instr, 0xF2, 0x5E);
+
+    case OpCode::I32Load:
+    case OpCode::F32Load:
+      return load_memory(instr, 4, false, {0x8B}, false);
+    case OpCode::I64Load:
+    case OpCode::F64Load:
+      return load_memory(instr, 8, true, {0x8B}, true);
+    case OpCode::I32Load8S: return load_memory(instr, 1, false, {0x0F, 0xBE}, false);
+    case OpCode::I32Load8U: return load_memory(instr, 1, false, {0x0F, 0xB6}, false);
+    case OpCode::I32Load16S: return load_memory(instr, 2, false, {0x0F, 0xBF}, false);
+    case OpCode::I32Load16U: return load_memory(instr, 2, false, {0x0F, 0xB7}, false);
+    case OpCode::I64Load8S: return load_memory(instr, 1, true, {0x0F, 0xBE}, true);
+    case OpCode::I64Load8U: return load_memory(instr, 1, false, {0x0F, 0xB6}, true);
+    case OpCode::I64Load16S: return load_memory(instr, 2, true, {0x0F, 0xBF}, true);
+    case OpCode::I64Load16U: return load_memory(instr, 2, false, {0x0F, 0xB7}, true);
+    case OpCode::I64Load32S: return load_memory(instr, 4, true, {0x63}, true);
+    case OpCode::I64Load32U: return load_memory(instr, 4, false, {0x8B}, true);
+
+    case OpCode::I32Store:
+    case OpCode::F32Store:
+    case OpCode::I64Store32:
+      return store_memory(instr, 4);
+    case OpCode::I64Store:
+    case OpCode::F64Store:
+      return store_memory(instr, 8);
+    case OpCode::I32Store8:
+    case OpCode::I64Store8:
+      return store_memory(instr, 1);
+    case OpCode::I32Store16:
+    case OpCode::I64Store16:
+      return store_memory(instr, 2);
+
+    default:
+      // Division, which has to check its operands, the remaining float
+      // instructions, conversions, globals and the memory instructions
+      fallback(instr);
+      return;
+    }
+  }
+};
+
+void compile_function(const RegisterCode &code, JitFunction &result) {
+  FunctionCompiler compiler(code);
+  compiler.run();
+  const std::vector<uint8_t> &machine_code = compiler.machine_code();
+
+  // Written while only writable, then executed while only executable.
+  // Without the pages, result stays empty and the function runs in the
+  // register interpreter.
+  result = JitFunction();
+  size_t size = machine_code.size();
+  void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) {
+    std::cerr << "unable to map memory for compiled code" << std::endl;
+    return;
+  }
+  std::memcpy(memory, machine_code.data(), size);
+  if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+    std::cerr << "unable to make compiled code executable" << std::endl;
+    munmap(memory, size);
+    return;
+  }
+
+  result.code = memory;
+  result.size = size;
+  result.entry = reinterpret_cast<JitEntry>(memory);
+  for (size_t offset : compiler.loop_offsets) {
+    result.loop_entries.push_back(
+        offset == UNREACHABLE_LOOP
+            ? nullptr
+            : reinterpret_cast<JitEntry>(static_cast<uint8_t *>(memory) +
+                                         offset));
+  }
+}
+
+#else
+
+void compile_function(const RegisterCode &code, JitFunction &result) {
+  assert(false && "compiling to machine code is only supported on x86-64 "
+                  "Linux");
+}
+
+#endif
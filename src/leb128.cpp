@@ -1,22 +1,55 @@
 #include <cassert>
 #include <cstring>
 
+#if WINTERP_BMI2
+#include <immintrin.h>
+#endif
+
 #include "leb128.hpp"
 
-uint32_t file_uleb128_u32t(std::ifstream &file) {
+void uleb128_decode_u32s(const uint8_t *&start, const uint8_t *end,
+                         uint32_t *out, size_t count) {
+  const uint64_t msbs = 0x8080808080808080ull;
+  size_t i = 0;
+
+  // Whole words of 8 bytes are read at once, as long as they are in bounds
+  while (end - start >= 8 && i < count) {
+    uint64_t word;
+    std::memcpy(&word, start, 8);
 
-  // Read in bits of 8 until msb is 0
-  // TODO: preallocate, known max size,
-  // https://webassembly.github.io/spec/core/binary/values.html#integers
-  std::vector<uint8_t> blocks;
-  uint8_t block;
+    if ((word & msbs) == 0 && count - i >= 8) {
+      // Eight single byte values, the common case for indices.
+      // Written as a plain loop, which compilers turn into a byte to
+      // dword widening.
+      for (int j = 0; j < 8; j++) {
+        out[i + j] = static_cast<uint8_t>(word >> (j * 8));
+      }
+      i += 8;
+      start += 8;
+      continue;
+    }
 
-  do {
-    file.read((char *)&block, 1);
-    blocks.push_back(block);
-  } while ((block & 0x80) > 0);
+#if WINTERP_BMI2
+    // The first byte with a cleared msb ends the value. Its payload bits are
+    // gathered with a single pext instead of a loop over the bytes.
+    uint64_t ends = ~word & msbs;
+    int length = ends != 0 ? __builtin_ctzll(ends) / 8 + 1 : 8;
+    if (length <= leb128_max_bytes<uint32_t>()) {
+      uint64_t bytes = word & (~uint64_t(0) >> (64 - length * 8));
+      out[i] = static_cast<uint32_t>(_pext_u64(bytes, 0x7F7F7F7F7F7F7F7Full));
+      i++;
+      start += length;
+      continue;
+    }
+#endif
 
-  return uleb128_from_blocks<uint32_t>(blocks);
+    out[i] = uleb128_decode<uint32_t>(start, end);
+    i++;
+  }
+
+  for (; i < count; i++) {
+    out[i] = uleb128_decode<uint32_t>(start, end);
+  }
 }
 
 uint8_t read_byte(const uint8_t* &start, const uint8_t* end) {
@@ -0,0 +1,110 @@
+#include <cassert>
+#include <cstdint>
+
+#include "linear_memory.hpp"
+
+// Reserving the guard region needs a 64 bit address space
+#if (defined(__unix__) || defined(__APPLE__)) && UINTPTR_MAX > UINT32_MAX
+#define WINTERP_RESERVE_MEMORY 1
+#include <sys/mman.h>
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+#else
+#define WINTERP_RESERVE_MEMORY 0
+#endif
+
+#if WINTERP_RESERVE_MEMORY
+// The largest memory followed by its guard region
+const uint64_t RESERVATION_SIZE =
+    uint64_t(MAX_MEMORY_PAGES) * MEMORY_PAGE_SIZE + MEMORY_GUARD_SIZE;
+#endif
+
+LinearMemory::~LinearMemory() {
+#if WINTERP_RESERVE_MEMORY
+  if (reservation != 0) {
+    munmap(bytes, reservation);
+  }
+#endif
+}
+
+bool LinearMemory::reset(uint32_t pages) {
+  if (pages > MAX_MEMORY_PAGES) {
+    reset(0);
+    return false;
+  }
+  size_t size = static_cast<size_t>(pages) * MEMORY_PAGE_SIZE;
+
+#if WINTERP_RESERVE_MEMORY
+  if (reservation == 0) {
+    // Only address space, no memory is used until pages are committed
+    void *address = mmap(nullptr, RESERVATION_SIZE, PROT_NONE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (address != MAP_FAILED) {
+      bytes = static_cast<uint8_t *>(address);
+      reservation = RESERVATION_SIZE;
+      length = 0;
+    }
+  }
+
+  if (reservation != 0) {
+    decommit(0, length);
+    length = 0;
+    if (!commit(0, size)) {
+      return false;
+    }
+    length = size;
+    return true;
+  }
+#endif
+
+  // The address space could not be reserved
+  buffer.assign(size, 0);
+  bytes = buffer.data();
+  length = size;
+  return true;
+}
+
+bool LinearMemory::grow(uint32_t delta) {
+  if (delta > MAX_MEMORY_PAGES - pages()) {
+    return false;
+  }
+  size_t size = length + static_cast<size_t>(delta) * MEMORY_PAGE_SIZE;
+
+  if (reservation != 0) {
+    if (!commit(length, size)) {
+      return false;
+    }
+  } else {
+    buffer.resize(size);
+    bytes = buffer.data();
+  }
+  length = size;
+  return true;
+}
+
+bool LinearMemory::commit(size_t from, size_t to) {
+#if WINTERP_RESERVE_MEMORY
+  if (from == to) {
+    return true;
+  }
+  return mprotect(bytes + from, to - from, PROT_READ | PROT_WRITE) == 0;
+#else
+  return false;
+#endif
+}
+
+void LinearMemory::decommit(size_t from, size_t to) {
+#if WINTERP_RESERVE_MEMORY
+  if (from == to) {
+    return;
+  }
+  // Mapping fresh pages over the range releases the old ones, and the new
+  // ones are zero once they are committed again
+  void *address = mmap(bytes + from, to - from, PROT_NONE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE,
+                       -1, 0);
+  assert(address != MAP_FAILED && "unable to release memory");
+  (void)address;
+#endif
+}
@@ -0,0 +1,66 @@
+#include <fstream>
+
+#include "mapped_file.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define WINTERP_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+#if WINTERP_HAS_MMAP
+  if (mapped) {
+    munmap(const_cast<uint8_t *>(bytes), length);
+  }
+#endif
+}
+
+std::shared_ptr<MappedFile> MappedFile::open(const char *path) {
+  std::shared_ptr<MappedFile> file(new MappedFile());
+
+#if WINTERP_HAS_MMAP
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0) {
+    close(fd);
+    return nullptr;
+  }
+
+  void *address =
+      mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping stays valid after closing the file
+  close(fd);
+
+  if (address != MAP_FAILED) {
+    // Sections are parsed front to back
+    madvise(address, info.st_size, MADV_SEQUENTIAL);
+    file->bytes = static_cast<const uint8_t *>(address);
+    file->length = info.st_size;
+    file->mapped = true;
+    return file;
+  }
+#endif
+
+  std::ifstream stream(path, std::ios::binary | std::ios::ate);
+  if (!stream || stream.tellg() <= 0) {
+    return nullptr;
+  }
+
+  file->buffer.resize(stream.tellg());
+  stream.seekg(0);
+  if (!stream.read(reinterpret_cast<char *>(file->buffer.data()),
+                   file->buffer.size())) {
+    return nullptr;
+  }
+
+  file->bytes = file->buffer.data();
+  file->length = file->buffer.size();
+  return file;
+}
@@ -0,0 +1,558 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "instructions.hpp"
+#include "leb128.hpp"
+#include "registers.hpp"
+#include "sections.hpp"
+
+const uint32_t NO_PRODUCER = UINT32_MAX;
+
+// A value on the operand stack while translating
+struct Operand {
+  uint32_t slot;
+  // Instruction which wrote slot and nothing was emitted after it, such that
+  // it can write somewhere else instead. NO_PRODUCER if there is none.
+  uint32_t producer;
+};
+
+// A label which has been entered but whose end has not been reached yet
+struct RegLabel {
+  OpCode op;       // Block, Loop, If or Else
+  uint32_t height; // Operand stack height when entering the label
+  uint32_t arity;  // Number of values left on the stack at its end
+  // First instruction of a loop, or the instruction of an if
+  uint32_t start;
+  // Remaining instructions until the end (or else) can never be executed,
+  // no code is generated for them
+  bool unreachable;
+  // Branches to the end of the label, see resolve_branches
+  std::vector<int64_t> pending;
+};
+
+static bool is_const(OpCode op) {
+  return op == OpCode::I32Const || op == OpCode::I64Const ||
+         op == OpCode::F32Const || op == OpCode::F64Const;
+}
+
+// Simulates the operand stack of a valid function body, tracking which slot
+// holds every value instead of its type
+class RegisterTranslator {
+public:
+  RegisterTranslator(const WasmFile &wasm, const Code &code,
+                     const FunctionType &signature, RegisterCode &result)
+      : wasm(wasm), result(result), dead_depth(0) {
+    result.num_params = signature.params.size();
+    result.num_results = signature.return_value == ImmediateRepr::None ? 0 : 1;
+    result.num_locals = code.num_locals;
+    result.constants_slot = result.num_params + result.num_locals;
+
+    RegLabel body;
+    body.op = OpCode::Block;
+    body.height = 0;
+    body.arity = result.num_results;
+    body.start = 0;
+    body.unreachable = false;
+    labels.push_back(body);
+  }
+
+  void run(const std::vector<Instr> &expr,
+           const std::vector<BranchTarget> &br_tables) {
+    // All constants are placed in front of the intermediate results, such
+    // that a call never overwrites them with the frame of its callee
+    for (const Instr &instr : expr) {
+      if (is_const(instr.op) && !constants.count(instr.value.v.n64)) {
+        uint32_t slot = result.constants_slot + result.constants.size();
+        constants[instr.value.v.n64] = slot;
+        result.constants.push_back(instr.value.v);
+      }
+    }
+    temps = result.constants_slot + result.constants.size();
+    result.temps_slot = temps;
+    max_height = 0;
+
+    for (const Instr &instr : expr) {
+      instruction(instr, br_tables);
+    }
+
+    // The final end of the body, which is not part of expr
+    RegLabel &body = labels.back();
+    RegInstr ret = make(OpCode::Return);
+    ret.imm = body.arity;
+    if (body.pending.empty()) {
+      if (!body.unreachable && body.arity) {
+        ret.a = stack.back().slot;
+      }
+    } else {
+      // Branches to the body moved their value to the first slot
+      if (!body.unreachable && body.arity) {
+        assign(stack.back(), temp(0));
+      }
+      resolve(body, result.instrs.size());
+      ret.a = temp(0);
+    }
+    emit(ret);
+
+    result.frame_size = temps + max_height;
+    result.instrs.shrink_to_fit();
+  }
+
+private:
+  const WasmFile &wasm;
+  RegisterCode &result;
+  std::vector<Operand> stack;
+  std::vector<RegLabel> labels;
+  std::unordered_map<uint64_t, uint32_t> constants;
+  // First slot of the intermediate results
+  uint32_t temps;
+  uint32_t max_height;
+  // Number of blocks entered while skipping unreachable code
+  uint32_t dead_depth;
+
+  // The slot of the value at height of the operand stack
+  uint32_t temp(uint32_t height) const { return temps + height; }
+
+  static RegInstr make(OpCode op) {
+    RegInstr instr{};
+    instr.op = op;
+    return instr;
+  }
+
+  uint32_t emit(const RegInstr &instr) {
+    result.instrs.push_back(instr);
+    return result.instrs.size() - 1;
+  }
+
+  uint32_t next_pc() const { return result.instrs.size(); }
+
+  Operand pop() {
+    Operand operand = stack.back();
+    stack.pop_back();
+    return operand;
+  }
+
+  // Pushes the result of the instruction emitted next and returns its slot
+  uint32_t push_result() {
+    uint32_t slot = temp(stack.size());
+    stack.push_back({slot, next_pc()});
+    max_height = std::max<uint32_t>(max_height, stack.size());
+    return slot;
+  }
+
+  void push(uint32_t slot) {
+    stack.push_back({slot, NO_PRODUCER});
+    max_height = std::max<uint32_t>(max_height, stack.size());
+  }
+
+  // Writes value to slot, by changing the instruction producing it if
+  // possible and otherwise with a move
+  void assign(const Operand &value, uint32_t slot) {
+    if (value.slot == slot) {
+      return;
+    }
+    if (value.producer != NO_PRODUCER && value.producer + 1 == next_pc()) {
+      result.instrs[value.producer].dst = slot;
+      return;
+    }
+    RegInstr move = make(OpCode::Move);
+    move.dst = slot;
+    move.a = value.slot;
+    emit(move);
+  }
+
+  // Moves the value at height into its own slot, if it still refers to a
+  // local or constant
+  void materialize(uint32_t height) {
+    Operand &operand = stack[height];
+    if (operand.slot != temp(height)) {
+      assign(operand, temp(height));
+      operand.slot = temp(height);
+      operand.producer = next_pc() - 1;
+    }
+  }
+
+  // Control flow joins at labels, where every value has to be in its own slot
+  void materialize_all() {
+    for (uint32_t height = 0; height < stack.size(); height++) {
+      materialize(height);
+    }
+  }
+
+  void set_local(uint32_t local, const Operand &value) {
+    if (value.slot == local) {
+      return;
+    }
+    // Values still referring to the local need to keep its old value
+    for (uint32_t height = 0; height < stack.size(); height++) {
+      if (stack[height].slot == local) {
+        materialize(height);
+      }
+    }
+    assign(value, local);
+  }
+
+  RegLabel &label(uint32_t depth) { return labels[labels.size() - 1 - depth]; }
+
+  void resolve(RegLabel &label, uint32_t pc) {
+    for (int64_t entry : label.pending) {
+      if (entry >= 0) {
+        result.instrs[entry].imm = pc;
+      } else {
+        result.br_tables[-(entry + 1)].pc = pc;
+      }
+    }
+  }
+
+  // Emits br or br_if, whose condition is in the slot condition
+  void branch(OpCode op, uint32_t depth, uint32_t condition) {
+    RegLabel &target = label(depth);
+    RegInstr instr = make(op);
+    instr.b = condition;
+
+    if (target.op == OpCode::Loop) {
+      // Branching to a loop continues with its first instruction and
+      // carries no values
+      instr.imm = target.start;
+      emit(instr);
+      return;
+    }
+
+    if (target.arity) {
+      instr.a = stack.back().slot;
+      instr.dst = temp(target.height);
+    }
+
+    if (op == OpCode::Br && depth == labels.size() - 1) {
+      // Leaves the function right away
+      RegInstr ret = make(OpCode::Return);
+      ret.a = instr.a;
+      ret.imm = target.arity;
+      emit(ret);
+      return;
+    }
+
+    target.pending.push_back(emit(instr));
+  }
+
+  void set_unreachable() {
+    RegLabel &current = labels.back();
+    stack.resize(current.height);
+    current.unreachable = true;
+  }
+
+  // Emits a call of a function of type, whose arguments are on the stack
+  void call(RegInstr instr, const FunctionType &type) {
+    uint32_t num_params = type.params.size();
+    uint32_t first = stack.size() - num_params;
+    // The arguments become the first locals of the callee's frame
+    for (uint32_t height = first; height < stack.size(); height++) {
+      materialize(height);
+    }
+    instr.a = temp(first);
+    instr.c = num_params;
+    emit(instr);
+
+    stack.resize(first);
+    if (type.return_value != ImmediateRepr::None) {
+      push(temp(first));
+    }
+  }
+
+  void instruction(const Instr &instr,
+                   const std::vector<BranchTarget> &br_tables) {
+    if (labels.back().unreachable) {
+      // Skip everything up to the else or end of the label
+      switch (instr.op) {
+      case OpCode::Loop:
+        result.loops.push_back({UNREACHABLE_LOOP, 0});
+        dead_depth++;
+        return;
+      case OpCode::Block:
+      case OpCode::If:
+        dead_depth++;
+        return;
+      case OpCode::Else:
+        if (dead_depth > 0) {
+          return;
+        }
+        break;
+      case OpCode::End:
+        if (dead_depth > 0) {
+          dead_depth--;
+          return;
+        }
+        break;
+      default:
+        return;
+      }
+    }
+
+    OpCode op = instr.op;
+
+    switch (op) {
+    case OpCode::Nop:
+      return;
+    case OpCode::Unreachable:
+      emit(make(OpCode::Unreachable));
+      set_unreachable();
+      return;
+    case OpCode::Block:
+    case OpCode::Loop:
+    case OpCode::If: {
+      uint32_t condition = 0;
+      if (op == OpCode::If) {
+        condition = pop().slot;
+      }
+      materialize_all();
+
+      RegLabel label;
+      label.op = op;
+      label.height = stack.size();
+      label.arity = instr.imm == 0x40 ? 0 : 1;
+      label.start = next_pc();
+      label.unreachable = false;
+
+      if (op == OpCode::Loop) {
+        result.loops.push_back({label.start, label.height});
+      }
+      if (op == OpCode::If) {
+        // Jumps behind the else or end if the condition is false
+        RegInstr branch = make(OpCode::If);
+        branch.a = condition;
+        emit(branch);
+      }
+      labels.push_back(label);
+      return;
+    }
+    case OpCode::Else: {
+      RegLabel &current = labels.back();
+      if (!current.unreachable) {
+        // The true branch is done, jump behind the end
+        if (current.arity) {
+          assign(stack.back(), temp(current.height));
+        }
+        current.pending.push_back(emit(make(OpCode::Br)));
+      }
+      result.instrs[current.start].imm = next_pc();
+      stack.resize(current.height);
+      current.op = OpCode::Else;
+      current.unreachable = false;
+      return;
+    }
+    case OpCode::End: {
+      RegLabel &current = labels.back();
+      if (!current.unreachable && current.arity) {
+        assign(stack.back(), temp(current.height));
+      }
+      if (current.op == OpCode::If) {
+        result.instrs[current.start].imm = next_pc();
+      }
+      resolve(current, next_pc());
+
+      stack.resize(current.height);
+      if (current.arity) {
+        push(temp(current.height));
+      }
+      labels.pop_back();
+      return;
+    }
+    case OpCode::Br:
+      branch(op, instr.imm, 0);
+      set_unreachable();
+      return;
+    case OpCode::BrIf:
+      branch(op, instr.imm, pop().slot);
+      return;
+    case OpCode::BrTable: {
+      RegInstr table = make(OpCode::BrTable);
+      table.a = pop().slot;
+      table.imm = result.br_tables.size();
+      table.imm2 = instr.imm;
+
+      // All labels carry the same values, the default one included
+      uint32_t last = instr.target.pc + instr.imm;
+      const RegLabel &fallback = label(br_tables[last].pc);
+      bool carries = fallback.op != OpCode::Loop && fallback.arity;
+      table.b = carries ? stack.back().slot : 0;
+
+      for (uint32_t i = instr.target.pc; i <= last; i++) {
+        RegLabel &target = label(br_tables[i].pc);
+        RegTableEntry entry;
+        entry.dst = carries ? temp(target.height) : table.b;
+        entry.pc = target.start;
+        if (target.op != OpCode::Loop) {
+          target.pending.push_back(-static_cast<int64_t>(result.br_tables.size()) - 1);
+        }
+        result.br_tables.push_back(entry);
+      }
+
+      emit(table);
+      set_unreachable();
+      return;
+    }
+    case OpCode::Return: {
+      RegInstr ret = make(OpCode::Return);
+      ret.imm = labels[0].arity;
+      if (ret.imm) {
+        ret.a = stack.back().slot;
+      }
+      emit(ret);
+      set_unreachable();
+      return;
+    }
+    case OpCode::Call: {
+      RegInstr call_instr = make(OpCode::Call);
+      call_instr.imm = instr.imm;
+      call(call_instr, wasm.function_type(instr.imm));
+      return;
+    }
+    case OpCode::CallIndirect: {
+      RegInstr call_instr = make(OpCode::CallIndirect);
+      call_instr.b = pop().slot;
+      call_instr.imm = instr.imm;
+      call_instr.imm2 = instr.imm2;
+      call(call_instr, wasm.type_section[instr.imm]);
+      return;
+    }
+    case OpCode::Drop:
+      pop();
+      return;
+    case OpCode::Select: {
+      RegInstr select = make(OpCode::Select);
+      select.c = pop().slot;
+      select.b = pop().slot;
+      select.a = pop().slot;
+      select.dst = push_result();
+      emit(select);
+      return;
+    }
+    case OpCode::LocalGet:
+      push(instr.imm);
+      return;
+    case OpCode::LocalSet:
+      set_local(instr.imm, pop());
+      return;
+    case OpCode::LocalTee:
+      set_local(instr.imm, pop());
+      push(instr.imm);
+      return;
+    case OpCode::GlobalGet: {
+      RegInstr get = make(OpCode::GlobalGet);
+      get.imm = instr.imm;
+      get.dst = push_result();
+      emit(get);
+      return;
+    }
+    case OpCode::GlobalSet: {
+      RegInstr set = make(OpCode::GlobalSet);
+      set.imm = instr.imm;
+      set.a = pop().slot;
+      emit(set);
+      return;
+    }
+    case OpCode::I32Const:
+    case OpCode::I64Const:
+    case OpCode::F32Const:
+    case OpCode::F64Const:
+      push(constants[instr.value.v.n64]);
+      return;
+    case OpCode::MemorySize: {
+      RegInstr size = make(op);
+      size.imm2 = instr.imm;
+      size.dst = push_result();
+      emit(size);
+      return;
+    }
+    case OpCode::MemoryGrow: {
+      RegInstr grow = make(op);
+      grow.imm2 = instr.imm;
+      grow.a = pop().slot;
+      grow.dst = push_result();
+      emit(grow);
+      return;
+    }
+    case OpCode::MemoryInit:
+    case OpCode::MemoryCopy:
+    case OpCode::MemoryFill:
+    case OpCode::TableInit:
+    case OpCode::TableCopy: {
+      RegInstr bulk = make(op);
+      bulk.imm = instr.imm;
+      bulk.imm2 = instr.imm2;
+      bulk.c = pop().slot;
+      bulk.b = pop().slot;
+      bulk.a = pop().slot;
+      emit(bulk);
+      return;
+    }
+    case OpCode::DataDrop:
+    case OpCode::ElemDrop: {
+      RegInstr drop = make(op);
+      drop.imm = instr.imm;
+      emit(drop);
+      return;
+    }
+    default:
+      break;
+    }
+
+    RegInstr numeric = make(op);
+    if (op >= 0x28 && op <= 0x35) {
+      // Loads
+      numeric.imm = instr.imm2;
+      numeric.imm2 = instr.imm;
+      numeric.a = pop().slot;
+      numeric.dst = push_result();
+    } else if (op >= 0x36 && op <= 0x3E) {
+      // Stores
+      numeric.imm = instr.imm2;
+      numeric.imm2 = instr.imm;
+      numeric.b = pop().slot;
+      numeric.a = pop().slot;
+    } else if (op >= 0xBC && op <= 0xBF) {
+      // Reinterpretations keep the bits as they are
+      return;
+    } else if (op == 0x45 || op == 0x50 || (op >= 0x67 && op <= 0x69) ||
+               (op >= 0x79 && op <= 0x7B) || (op >= 0x8B && op <= 0x91) ||
+               (op >= 0x99 && op <= 0x9F) || (op >= 0xA7 && op <= 0xBB)) {
+      // Unops and conversions
+      numeric.a = pop().slot;
+      numeric.dst = push_result();
+    } else if ((op >= 0x46 && op <= 0x66) || (op >= 0x6A && op <= 0xA6)) {
+      // Binops and comparisons
+      numeric.b = pop().slot;
+      numeric.a = pop().slot;
+      numeric.dst = push_result();
+    } else {
+      assert(false && "todo: missing register translation of opcode");
+    }
+    emit(numeric);
+  }
+};
+
+void translate_registers(const WasmFile &wasm, uint32_t code_index,
+                         RegisterCode &result) {
+  const Code &code = wasm.function_code(code_index);
+  const FunctionType &signature =
+      wasm.type_section[wasm.function_section[code_index]];
+
+  // The decoded body has already been rewritten for the stack interpreter,
+  // hence the instructions are decoded once more
+  const uint8_t *ptr = code.body.begin();
+  const uint8_t *end = code.body.end();
+  uint32_t num_locals = uleb128_decode<uint32_t>(ptr, end);
+  for (uint32_t i = 0; i < num_locals; i++) {
+    uleb128_decode<uint32_t>(ptr, end);
+    ptr++; // valtype
+  }
+
+  std::vector<Instr> expr;
+  std::vector<BranchTarget> br_tables;
+  read_expr(ptr, end, expr, br_tables);
+
+  RegisterTranslator translator(wasm, code, signature, result);
+  translator.run(expr, br_tables);
+}
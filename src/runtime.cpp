@@ -1,19 +1,54 @@
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cmath>
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <mutex>
 
 #include "bits.hpp"
 #include "instructions.hpp"
+#include "numeric.hpp"
+#include "registers.hpp"
 #include "sections.hpp"
 #include "runtime.hpp"
+#include "trap.hpp"
 
-Runtime::Runtime(const struct WasmFile &wasm) : wasm(wasm) {
-  // TODO: instantiate memory from wasm.memory
-  memory.resize(MEMORY_PAGE_SIZE);
-  std::fill(memory.begin(), memory.end(), 0);
-  pages = 1;
+Runtime::Runtime(const struct WasmFile &wasm, Interpreter interpreter)
+    : wasm(wasm), interpreter(interpreter), stack(new Value[STACK_SLOTS]) {
+  sp = stack.get();
+
+  if (interpreter == JIT_COMPILER && !jit_supported()) {
+    this->interpreter = REGISTER_INTERPRETER;
+  }
+
+  // Memory 0 exists even without a memory, it has no pages then
+  memories.push_back(&memory);
+  for (size_t i = 1; i < wasm.memory.size(); i++) {
+    additional_memories.emplace_back(new LinearMemory());
+    memories.push_back(additional_memories.back().get());
+  }
+  for (size_t i = 0; i < memories.size(); i++) {
+    if (!memories[i]->reset(i < wasm.memory.size() ? wasm.memory[i].n : 0)) {
+      instantiation_trap = OUT_OF_MEMORY;
+    }
+#if WINTERP_SIGNAL_TRAPS
+    // Out of bounds loads and stores are only caught by the guard region
+    if (!memories[i]->reserved()) {
+      std::cerr << "unable to reserve the address space of memory" << std::endl;
+      std::abort();
+    }
+#endif
+  }
+
+  jit_context.runtime = this;
+  jit_context.memory = memory.data();
+  jit_context.memory_size = memory.size();
+  if (instantiation_trap != NO_TRAP) {
+    return;
+  }
 
   // Reserve memory of table, also verify only supported reftype is used
   for (const auto &table : wasm.tables) {
@@ -25,70 +60,113 @@ Runtime::Runtime(const struct WasmFile &wasm) : wasm(wasm) {
 
   // Put function indices into function table
   for (const auto &elem : wasm.elems) {
+    // Passive segments are kept for table.init
+    if (elem.flag == ELEM_PASSIVE) {
+      this->elems.push_back(elem.function_indices);
+      continue;
+    }
+    this->elems.emplace_back();
+    if (elem.flag != ELEM_ACTIVE) {
+      continue;
+    }
+
     /* Evaluate expression to know offset of function index */
 
-    this->execute_block(elem.expr);
-    Immediate offset = this->pop_stack();
-    assert(offset.t == ImmediateRepr::I32 && "todo: wrong repr assumed.");
+    Immediate offset = this->evaluate_constant_expr(elem.expr);
+    if (uint64_t(offset.v.n32) + elem.function_indices.size() >
+        function_table.size()) {
+      instantiation_trap = TABLE_OUT_OF_BOUNDS;
+      return;
+    }
 
     for (int i = 0; i < elem.function_indices.size(); i++) {
       uint32_t entry_index = offset.v.n32 + i;
-      this->function_table[entry_index] = elem.function_indices[i];
+      this->function_table[entry_index] =
+          make_table_entry(elem.function_indices[i]);
     }
   }
 
   // Put initial data into memory
   for (const auto &data : wasm.data) {
-    this->execute_block(data.expr);
-    Immediate offset = this->pop_stack();
-    assert(offset.t == ImmediateRepr::I32 && "todo: wrong repr assumed.");
+    if (data.flag == DATA_PASSIVE) {
+      continue;
+    }
+    Immediate offset = this->evaluate_constant_expr(data.expr);
+    // Checked here, there is no TrapBoundary to raise a trap to yet
+    LinearMemory &instance = memory_instance(data.memidx);
+    if (uint64_t(offset.v.n32) + data.bytes.size() > instance.size()) {
+      instantiation_trap = MEMORY_OUT_OF_BOUNDS;
+      return;
+    }
 
-    std::memcpy(&this->memory[offset.v.n32], data.bytes.data(),
+    std::memcpy(instance.data() + offset.v.n32, data.bytes.data(),
                 data.bytes.size());
   }
 
   // Setup Globals
   for (const auto &global : wasm.globals) {
-    this->execute_block(global.expr);
     GlobalInstance instance;
     instance.mut = global.mutability;
-    instance.value = this->pop_stack();
+    instance.value = this->evaluate_constant_expr(global.expr);
     this->globals.push_back(instance);
   }
 
   // Setup data segments
   this->data = wasm.data;
+
+  // Translated up front like the bodies are decoded, unless decoding is
+  // deferred to the first call as well
+  if (this->interpreter == TIERED) {
+    profiles.resize(wasm.codes.size());
+  } else if (this->interpreter != STACK_INTERPRETER && !wasm.lazy_code) {
+    for (uint32_t i = 0; i < wasm.codes.size(); i++) {
+      if (this->interpreter == JIT_COMPILER) {
+        wasm.jit_function(i);
+      } else {
+        wasm.register_code(i);
+      }
+    }
+  }
+}
+
+void Runtime::push_stack(Value value) {
+  assert(this->sp < this->stack.get() + STACK_SLOTS && "stack overflow");
+  *this->sp++ = value;
+}
+
+Value Runtime::pop_stack() {
+  assert(this->sp > this->stack.get() && "malformed stack size.");
+  return *--this->sp;
 }
 
-void Runtime::push_stack(const Immediate &imm) {
-  assert(imm.t != ImmediateRepr::Uninitialised);
-  this->stack.push_back(imm);
+LinearMemory &Runtime::memory_instance(uint32_t mem_index) {
+  return mem_index == 0 ? memory : *memories[mem_index];
 }
 
-Immediate Runtime::pop_stack() {
-    assert(this->stack.size() > 0 && "malformed stack size.");
-    Immediate value = this->stack.back();
-    assert(value.t != ImmediateRepr::Uninitialised);
-    this->stack.pop_back();
-    return value;
+template <size_t size>
+uint8_t *Runtime::memory_at(LinearMemory &instance, uint64_t address) {
+#if !WINTERP_SIGNAL_TRAPS
+  if (address + size > instance.size()) {
+    raise_trap(MEMORY_OUT_OF_BOUNDS);
+  }
+#endif
+  return instance.data() + address;
 }
 
 void Runtime::write_memory(const uint32_t &mem_index, const uint32_t &offset,
                            const Immediate &imm) {
-  // TODO: actual store with mem_index
+  LinearMemory &instance = memory_instance(mem_index);
   switch (imm.t) {
   case ImmediateRepr::Uninitialised:
     assert(false && "Invalid repr found.");
     break;
   case ImmediateRepr::I32:
   case ImmediateRepr::F32:
-    assert(offset + 4 < this->memory.size() && "invalid memory access");
-    std::memcpy(&this->memory[offset], &imm.v.n32, 4);
+    std::memcpy(memory_at<4>(instance, offset), &imm.v.n32, 4);
     break;
   case ImmediateRepr::I64:
   case ImmediateRepr::F64:
-    assert(offset + 8 < this->memory.size() && "invalid memory access");
-    std::memcpy(&this->memory[offset], &imm.v.n64, 8);
+    std::memcpy(memory_at<8>(instance, offset), &imm.v.n64, 8);
     break;
   default:
     assert(false && "todo");
@@ -98,34 +176,28 @@ void Runtime::write_memory(const uint32_t &mem_index, const uint32_t &offset,
 Immediate Runtime::read_memory(const uint32_t &mem_index,
                                const uint32_t &offset,
                                const ImmediateRepr repr) {
-
+  LinearMemory &instance = memory_instance(mem_index);
   Immediate read;
   read.t = repr;
 
-  // TODO: actual store with mem_index
   switch (repr) {
   case ImmediateRepr::Uninitialised:
     assert(false && "Invalid repr found.");
     break;
   case ImmediateRepr::Byte:
-    assert(offset + 1 <= this->memory.size() && "invalid memory access");
-    read.v.n32 = static_cast<uint32_t>(this->memory[offset]);
+    read.v.n32 = static_cast<uint32_t>(*memory_at<1>(instance, offset));
     break;
   case ImmediateRepr::I32:
-    assert(offset + 4 <= this->memory.size() && "invalid memory access");
-    std::memcpy(&read.v.n32, &this->memory[offset], 4);
+    std::memcpy(&read.v.n32, memory_at<4>(instance, offset), 4);
     break;
   case ImmediateRepr::F32:
-    assert(offset + 4 <= this->memory.size() && "invalid memory access");
-    std::memcpy(&read.v.p32, &this->memory[offset], 4);
+    std::memcpy(&read.v.p32, memory_at<4>(instance, offset), 4);
     break;
   case ImmediateRepr::I64:
-    assert(offset + 8 <= this->memory.size() && "invalid memory access");
-    std::memcpy(&read.v.n64, &this->memory[offset], 8);
+    std::memcpy(&read.v.n64, memory_at<8>(instance, offset), 8);
     break;
   case ImmediateRepr::F64:
-    assert(offset + 8 <= this->memory.size() && "invalid memory access");
-    std::memcpy(&read.v.p64, &this->memory[offset], 8);
+    std::memcpy(&read.v.p64, memory_at<8>(instance, offset), 8);
     break;
   default:
     assert(false && "todo");
@@ -134,1024 +206,1289 @@ Immediate Runtime::read_memory(const uint32_t &mem_index,
   return read;
 }
 
-void Runtime::skip_control_block(const std::vector<Instr> &block, int &pc) {
+Value *Runtime::branch(const BranchTarget &target, Value *frame, Value *sp,
+                       int &pc) {
+  Value *height = frame + target.height;
 
-  // Assumes skip_block was called directly while pc is still one the if
-  pc++;
+  // Move the values carried over to the label down to its height, dropping
+  // everything in between
+  Value *carried = sp - target.arity;
+  if (carried != height) {
+    std::copy(carried, sp, height);
+  }
 
-  int conditional_nesting = 0;
+  pc = target.pc;
+  return height + target.arity;
+}
 
-  while ((block[pc].op != OpCode::End && block[pc].op != OpCode::Else) ||
-         conditional_nesting > 0) {
+bool Runtime::count_back_edge(FunctionProfile &profile, const Code &code,
+                              uint32_t pc) {
+  auto loop = std::lower_bound(code.loops.begin(), code.loops.end(), pc);
+  assert(loop != code.loops.end() && *loop == pc && "branch back to no loop");
+  profile.loop_back_edges[loop - code.loops.begin()]++;
+  profile.back_edges++;
 
-    uint8_t op = static_cast<uint8_t>(block[pc].op);
-    if (0x02 <= op && op <= 0x04) {
-      // Not inclusive 0x05, because else does not continue the nesting, instead
-      // is must already have been added by its corresponding if
-      conditional_nesting++;
-    }
+  return on_stack_replacement &&
+         (profile.tier != STACK_INTERPRETER ||
+          profile.calls + profile.back_edges >= tier_up_threshold);
+}
 
-    // This case can happen, after block_branch was called, and else is
-    // immediatly after a br.
-    if (block[pc].op == OpCode::Else) {
-      conditional_nesting--;
-    }
+void Runtime::enter_loop(FunctionProfile &profile, const Code &code,
+                         Value *locals, Value *operands, Value *sp,
+                         uint32_t pc) {
+  uint32_t code_index = &profile - profiles.data();
+  if (profile.tier == STACK_INTERPRETER) {
+    tier_up(code_index);
+  }
 
-    if (block[pc].op == OpCode::End) {
-      conditional_nesting--;
-    }
+  uint32_t loop =
+      std::lower_bound(code.loops.begin(), code.loops.end(), pc) -
+      code.loops.begin();
+  const RegisterCode &registers = wasm.register_codes[code_index];
+  assert(registers.loops.size() == code.loops.size() &&
+         "loops of register code do not match");
+  const RegLoop &target = registers.loops[loop];
+
+  // The operand stack of the stack interpreter starts behind the locals,
+  // where register code keeps its constants. It moves to the slots of the
+  // intermediate results.
+  uint32_t height = sp - operands;
+  assert(target.pc != UNREACHABLE_LOOP && height == target.height &&
+         "operand stack does not match the loop");
+  check_stack(locals + registers.frame_size);
+
+  std::memmove(locals + registers.temps_slot, operands,
+               height * sizeof(Value));
+  std::copy(registers.constants.begin(), registers.constants.end(),
+            locals + registers.constants_slot);
+  this->sp = locals + registers.frame_size;
+
+  osr_entries.push_back(OsrEntry{
+      static_cast<uint32_t>(code_index + wasm.imports.size()), loop,
+      profile.loop_back_edges[loop], profile.tier});
+
+  if (profile.tier == REGISTER_INTERPRETER) {
+    execute_registers(registers, locals, target.pc);
+    return;
+  }
+  wasm.jit_functions[code_index].loop_entries[loop](&jit_context, locals);
+  this->sp = locals + registers.num_results;
+}
 
-    pc++;
+void Runtime::tier_up(uint32_t code_index) {
+  FunctionProfile &profile = profiles[code_index];
+  Interpreter tier = optimized_tier;
+  if (tier == JIT_COMPILER && !jit_supported()) {
+    tier = REGISTER_INTERPRETER;
+  }
+  assert((tier == REGISTER_INTERPRETER || tier == JIT_COMPILER) &&
+         "functions can only be promoted to register code");
+
+  if (tier == JIT_COMPILER) {
+    // Loops are entered in the register interpreter as well if the function
+    // could not be compiled
+    if (wasm.jit_function(code_index).entry == nullptr) {
+      tier = REGISTER_INTERPRETER;
+    }
+  } else {
+    wasm.register_code(code_index);
   }
 
-  pc++;
+  profile.tier = tier;
+  tier_ups.push_back(TierUp{
+      static_cast<uint32_t>(code_index + wasm.imports.size()), profile.calls,
+      profile.back_edges, tier});
 }
 
-void Runtime::branch_block(const std::vector<Instr> &block, int &pc,
-                           int label) {
+const FunctionProfile &Runtime::profile(uint32_t function_index) const {
+  assert(function_index >= wasm.imports.size() &&
+         "imported functions have no profile");
+  assert(!profiles.empty() && "profiles are only kept for TIERED");
+  return profiles[function_index - wasm.imports.size()];
+}
 
-  // Branch block behaves differently for loops and blocks
-  // For blocks, pc is set to after the block
-  // while for loop pc it is set to the beginning of the loop!
-  // Label tells us how many blocks / loops were trying to escape out of, in
-  // this case its not really a label, more a counter of how many blocks/loops
-  // were trying to escape out of
+template <OpCode op>
+Value Runtime::handle_load(LinearMemory &instance, uint64_t address) {
+  Value result;
+  if constexpr (op == OpCode::I32Load || op == OpCode::F32Load) {
+    std::memcpy(&result.n32, memory_at<4>(instance, address), 4);
+  } else if constexpr (op == OpCode::I64Load || op == OpCode::F64Load) {
+    std::memcpy(&result.n64, memory_at<8>(instance, address), 8);
+  } else if constexpr (op == OpCode::I32Load8S) {
+    int8_t data;
+    std::memcpy(&data, memory_at<1>(instance, address), 1);
+    result.n32 = static_cast<int32_t>(data);
+  }
 
-  // label = 0
-  // -> in a block, go to the end of the block
-  // -> in a loop, go to the start of the loop
+  else if constexpr (op == OpCode::I32Load8U) {
+    uint8_t data;
+    std::memcpy(&data, memory_at<1>(instance, address), 1);
+    result.n32 = static_cast<uint32_t>(data);
+  }
 
-  // Need to increase by one since it start at 0
-  label++;
+  else if constexpr (op == OpCode::I32Load16S) {
+    int16_t data;
+    std::memcpy(&data, memory_at<2>(instance, address), 2);
+    result.n32 = static_cast<int32_t>(data);
+  }
 
-  int conditional_nesting = 0;
+  else if constexpr (op == OpCode::I32Load16U) {
+    uint16_t data;
+    std::memcpy(&data, memory_at<2>(instance, address), 2);
+    result.n32 = static_cast<uint32_t>(data);
+  }
 
-  while (label > 0) {
+  else if constexpr (op == OpCode::I64Load8S) {
+    int8_t data;
+    std::memcpy(&data, memory_at<1>(instance, address), 1);
+    result.n64 = static_cast<int64_t>(data);
+  }
 
-    uint8_t op = static_cast<uint8_t>(block[pc].op);
+  else if constexpr (op == OpCode::I64Load8U) {
+    uint8_t data;
+    std::memcpy(&data, memory_at<1>(instance, address), 1);
+    result.n64 = static_cast<uint64_t>(data);
+  }
 
-    // Found a block / loop
-    if ((op == 0x02 || op == 0x03) && conditional_nesting == 0) {
-      label--;
-    } else if ((op == 0x02 || op == 0x03)) {
-      conditional_nesting--;
-    }
+  else if constexpr (op == OpCode::I64Load16S) {
+    int16_t data;
+    std::memcpy(&data, memory_at<2>(instance, address), 2);
+    result.n64 = static_cast<int64_t>(data);
+  }
 
-    // We are moving up and have found an end, hence the above must be nested!
-    if (op == 0x0b) {
-      conditional_nesting++;
-    }
+  else if constexpr (op == OpCode::I64Load16U) {
+    uint16_t data;
+    std::memcpy(&data, memory_at<2>(instance, address), 2);
+    result.n64 = static_cast<uint64_t>(data);
+  }
 
-    if (label > 0) {
-      pc--;
-    }
+  else if constexpr (op == OpCode::I64Load32S) {
+    int32_t data;
+    std::memcpy(&data, memory_at<4>(instance, address), 4);
+    result.n64 = static_cast<int64_t>(data);
   }
 
-  if (block[pc].op == OpCode::Block) {
-    // We are branching to the end
-    skip_control_block(block, pc);
-  } else if (block[pc].op == OpCode::Loop) {
-    // Looping! We are staying but advancing by once
-    pc++;
+  else if constexpr (op == OpCode::I64Load32U) {
+    uint32_t data;
+    std::memcpy(&data, memory_at<4>(instance, address), 4);
+    result.n64 = static_cast<uint64_t>(data);
   } else {
-    assert(false && "Branching stopped at an invalid op code.");
+    assert(false && "todo: missing case");
   }
 
+  return result;
 }
 
-Immediate Runtime::handle_numeric_binop_i32(const OpCode &op,
-                                            const Immediate &a,
-                                            const Immediate &b) {
-  Immediate result;
-  result.t = ImmediateRepr::I32;
-  if (op == OpCode::I32Add) {
-    result.v.n32 = a.v.n32 + b.v.n32;
-  } else if (op == OpCode::I32Mul) {
-    result.v.n32 = a.v.n32 * b.v.n32;
-  } else if (op == OpCode::I32Sub) {
-    result.v.n32 = a.v.n32 - b.v.n32;
-  } else if (op == OpCode::I32DivS) {
-    assert(b.v.n32 != 0 && "division by 0");
-    result.v.n32 =
-        static_cast<int32_t>(a.v.n32) / static_cast<int32_t>(b.v.n32);
-  } else if (op == OpCode::I32DivU) {
-    assert(b.v.n32 != 0 && "division by 0");
-    result.v.n32 = a.v.n32 / b.v.n32;
-  } else if (op == OpCode::I32RemS) {
-    assert(b.v.n32 != 0 && "division by 0");
-    result.v.n32 =
-        static_cast<int32_t>(a.v.n32) % static_cast<int32_t>(b.v.n32);
-  } else if (op == OpCode::I32RemU) {
-    assert(b.v.n32 != 0 && "division by 0");
-    result.v.n32 = a.v.n32 % b.v.n32;
-  } else if (op == OpCode::I32eq) {
-    result.v.n32 = (a.v.n32 == b.v.n32);
-  } else if (op == OpCode::I32ne) {
-    result.v.n32 = (a.v.n32 != b.v.n32);
-  } else if (op == OpCode::I32ltu) {
-    result.v.n32 = a.v.n32 < b.v.n32;
-  } else if (op == OpCode::I32lts) {
-    result.v.n32 =
-        (static_cast<int32_t>(a.v.n32) < static_cast<int32_t>(b.v.n32));
-  } else if (op == OpCode::I32gtu) {
-    result.v.n32 = a.v.n32 > b.v.n32;
-  } else if (op == OpCode::I32gts) {
-    result.v.n32 =
-        (static_cast<int32_t>(a.v.n32) > static_cast<int32_t>(b.v.n32));
-  } else if (op == OpCode::I32le_s) {
-    result.v.n32 =
-        (static_cast<int32_t>(a.v.n32) <= static_cast<int32_t>(b.v.n32));
-  } else if (op == OpCode::I32le_u) {
-    result.v.n32 = a.v.n32 <= b.v.n32;
-  } else if (op == OpCode::I32ge_s) {
-    result.v.n32 =
-        (static_cast<int32_t>(a.v.n32) >= static_cast<int32_t>(b.v.n32));
-  } else if (op == OpCode::I32ge_u) {
-    result.v.n32 = a.v.n32 >= b.v.n32;
-  } else if (op == OpCode::I32and) {
-    result.v.n32 = a.v.n32 & b.v.n32;
-  } else if (op == OpCode::I32or) {
-    result.v.n32 = a.v.n32 | b.v.n32;
-  } else if (op == OpCode::I32xor) {
-    result.v.n32 = a.v.n32 ^ b.v.n32;
-  } else if (op == OpCode::I32shl) {
-    result.v.n32 = a.v.n32 << b.v.n32;
-  } else if (op == OpCode::I32shrs) {
-    result.v.n32 =
-        static_cast<int32_t>(a.v.n32) >> static_cast<int32_t>(b.v.n32);
-  } else if (op == OpCode::I32shru) {
-    result.v.n32 = a.v.n32 >> b.v.n32;
-  } else if (op == OpCode::I32rotl) {
-    uint32_t shift = b.v.n32 & 0x3F;
-    result.v.n32 = (a.v.n32 << shift) | (a.v.n32 >> (32 - shift));
-  } else if (op == OpCode::I32rotr) {
-    uint32_t shift = b.v.n32 & 0x3F;
-    result.v.n32 = (a.v.n32 >> shift) | (a.v.n32 << (32 - shift));
+template <OpCode op>
+void Runtime::handle_store(LinearMemory &instance, uint64_t address,
+                           Value value) {
+  if constexpr (op == OpCode::I32Store || op == OpCode::F32Store) {
+    std::memcpy(memory_at<4>(instance, address), &value.n32, 4);
+  } else if constexpr (op == OpCode::I64Store || op == OpCode::F64Store) {
+    std::memcpy(memory_at<8>(instance, address), &value.n64, 8);
+  } else if constexpr (op == I32Store8) {
+    *memory_at<1>(instance, address) = static_cast<uint8_t>(value.n32 & 0xFF);
+  } else if constexpr (op == I32Store16) {
+    std::memcpy(memory_at<2>(instance, address), &value.n32, 2);
+  } else if constexpr (op == I64Store8) {
+    *memory_at<1>(instance, address) = static_cast<uint8_t>(value.n64 & 0xFF);
+  } else if constexpr (op == I64Store16) {
+    std::memcpy(memory_at<2>(instance, address), &value.n64, 2);
+  } else if constexpr (op == I64Store32) {
+    std::memcpy(memory_at<4>(instance, address), &value.n64, 4);
   } else {
-    assert(false && "todo: invalid binop for i32");
+    assert(false && "invalid op!");
   }
-
-  return result;
 }
 
-Immediate Runtime::handle_numeric_unop_i32(const OpCode &op,
-                                           const Immediate &a) {
-
-  Immediate result;
-  result.t = ImmediateRepr::I32;
+uint32_t Runtime::memory_grow(uint32_t mem_index, uint32_t delta) {
+  LinearMemory &instance = memory_instance(mem_index);
+  // for some reason old page size is returned...
+  uint32_t old_pages = instance.pages();
 
-  if (op == I32eqz) {
-    result.v.n32 = a.v.n32 == 0;
-  } else if (op == OpCode::I32clz) {
-    result.v.n32 = clz(a.v.n32);
-  } else if (op == OpCode::I32ctz) {
-    result.v.n32 = ctz(a.v.n32);
-  } else if (op == OpCode::I32popcnt) {
-    result.v.n32 = popcnt(a.v.n32);
-  } else {
-    assert(false && "todo: missing opcode");
+  const Memory &limits = wasm.memory[mem_index];
+  if ((limits.flag & MEMORY_HAS_MAXIMUM) &&
+      uint64_t(old_pages) + delta > limits.maximum) {
+    return UINT32_MAX;
+  }
+  if (!instance.grow(delta)) {
+    return UINT32_MAX;
   }
+  // The memory only moves if its address space could not be reserved
+  jit_context.memory = memory.data();
+  jit_context.memory_size = memory.size();
+  return old_pages;
+}
 
-  return result;
+bool Runtime::reset_memory(uint32_t mem_index) {
+  assert(mem_index < memories.size() && "invalid memory index");
+  LinearMemory &instance = memory_instance(mem_index);
+  bool reset = instance.reset(
+      mem_index < wasm.memory.size() ? wasm.memory[mem_index].n : 0);
+  jit_context.memory = memory.data();
+  jit_context.memory_size = memory.size();
+  return reset;
 }
 
-Immediate Runtime::handle_numeric_unop_i64(const OpCode &op,
-                                           const Immediate &a) {
+uint8_t *Runtime::memory_range(uint32_t mem_index, uint64_t address,
+                               uint64_t n) {
+  LinearMemory &instance = memory_instance(mem_index);
+  if (address + n > instance.size()) {
+    raise_trap(MEMORY_OUT_OF_BOUNDS);
+  }
+  return instance.data() + address;
+}
 
-  Immediate result;
-  result.t = ImmediateRepr::I64;
+void Runtime::memory_fill(uint32_t mem_index, uint32_t offset, Value value,
+                          uint32_t n) {
+  std::memset(memory_range(mem_index, offset, n),
+              static_cast<uint8_t>(value.n32), n);
+}
 
-  if (op == I64eqz) {
-    result.v.n64 = a.v.n64 == 0;
-  } else if (op == OpCode::I64clz) {
-    result.v.n64 = clz(a.v.n64);
-  } else if (op == OpCode::I64ctz) {
-    result.v.n64 = ctz(a.v.n64);
-  } else if (op == OpCode::I64popcnt) {
-    result.v.n64 = popcnt(a.v.n64);
-  } else {
-    assert(false && "todo: missing opcode");
+void Runtime::memory_copy(uint32_t dst_mem, uint32_t src_mem, uint32_t dst,
+                          uint32_t src, uint32_t n) {
+  uint8_t *to = memory_range(dst_mem, dst, n);
+  // The ranges may overlap, memmove copies as if through a buffer
+  std::memmove(to, memory_range(src_mem, src, n), n);
+}
+
+void Runtime::memory_init(uint32_t data_segment_index, uint32_t mem_index,
+                          uint32_t dst, uint32_t src, uint32_t n) {
+  const ByteView &bytes = data[data_segment_index].bytes;
+  if (uint64_t(src) + n > bytes.size()) {
+    raise_trap(MEMORY_OUT_OF_BOUNDS);
   }
+  std::memcpy(memory_range(mem_index, dst, n), bytes.data() + src, n);
+}
 
-  return result;
+void Runtime::data_drop(uint32_t data_segment_index) {
+  ByteView &bytes = data[data_segment_index].bytes;
+  // Every later memory.init of more than 0 bytes traps
+  bytes = ByteView(bytes.data(), 0);
 }
 
-Immediate Runtime::handle_numeric_binop_i64(const OpCode &op,
-                                            const Immediate &a,
-                                            const Immediate &b) {
-  Immediate result;
-  result.t = ImmediateRepr::I64;
-  if (op == OpCode::I64Add) {
-    result.v.n64 = a.v.n64 + b.v.n64;
-  } else if (op == OpCode::I64Mul) {
-    result.v.n64 = a.v.n64 * b.v.n64;
-  } else if (op == OpCode::I64Sub) {
-    result.v.n64 = a.v.n64 - b.v.n64;
-  } else if (op == OpCode::I64DivS) {
-    assert(b.v.n64 != 0 && "division by 0");
-    result.v.n64 =
-        static_cast<int64_t>(a.v.n64) / static_cast<int64_t>(b.v.n64);
-  } else if (op == OpCode::I64DivU) {
-    assert(b.v.n64 != 0 && "division by 0");
-    result.v.n64 = a.v.n64 / b.v.n64;
-  } else if (op == OpCode::I64RemS) {
-    assert(b.v.n64 != 0 && "division by 0");
-    result.v.n64 =
-        static_cast<int64_t>(a.v.n64) % static_cast<int64_t>(b.v.n64);
-  } else if (op == OpCode::I64RemU) {
-    assert(b.v.n64 != 0 && "division by 0");
-    result.v.n64 = a.v.n64 % b.v.n64;
-  } else if (op == OpCode::I64and) {
-    result.v.n64 = a.v.n64 & b.v.n64;
-  } else if (op == OpCode::I64or) {
-    result.v.n64 = a.v.n64 | b.v.n64;
-  } else if (op == OpCode::I64xor) {
-    result.v.n64 = a.v.n64 ^ b.v.n64;
-  } else if (op == OpCode::I64shl) {
-    result.v.n64 = a.v.n64 << b.v.n64;
-  } else if (op == OpCode::I64shrs) {
-    result.v.n64 =
-        static_cast<uint64_t>(a.v.n64) >> static_cast<uint64_t>(b.v.n64);
-  } else if (op == OpCode::I64shru) {
-    result.v.n64 = a.v.n64 >> b.v.n64;
-  } else if (op == OpCode::I64rotl) {
-    uint64_t shift = b.v.n64 & 0x3F;
-    result.v.n64 = (a.v.n64 << shift) | (a.v.n64 >> (64 - shift));
-  } else if (op == OpCode::I64rotr) {
-    uint64_t shift = b.v.n64 & 0x3F;
-    result.v.n64 = (a.v.n64 >> shift) | (a.v.n64 << (64 - shift));
-  } else if (op == OpCode::I64eqz) {
-    result.v.n32 = (a.v.n64 == 0) ? 1 : 0;
-  } else if (op == OpCode::I64eq) {
-    result.v.n32 = (a.v.n64 == b.v.n64) ? 1 : 0;
-  } else if (op == OpCode::I64ne) {
-    result.v.n32 = (a.v.n64 != b.v.n64) ? 1 : 0;
-  } else if (op == OpCode::I64lts) {
-    result.v.n32 =
-        (static_cast<int64_t>(a.v.n64) < static_cast<int64_t>(b.v.n64)) ? 1 : 0;
-  } else if (op == OpCode::I64gts) {
-    result.v.n32 =
-        (static_cast<int64_t>(a.v.n64) > static_cast<int64_t>(b.v.n64)) ? 1 : 0;
-  } else if (op == OpCode::I64gts) {
-    result.v.n32 =
-        (static_cast<int64_t>(a.v.n64) > static_cast<int64_t>(b.v.n64)) ? 1 : 0;
-  } else if (op == OpCode::I64gtu) {
-    result.v.n32 = a.v.n64 > b.v.n64 ? 1 : 0;
-  } else if (op == OpCode::I64les) {
-    result.v.n32 =
-        (static_cast<int64_t>(a.v.n64) <= static_cast<int64_t>(b.v.n64)) ? 1
-                                                                         : 0;
-  } else if (op == OpCode::I64leu) {
-    result.v.n32 = a.v.n64 <= b.v.n64 ? 1 : 0;
-  } else if (op == OpCode::I64ges) {
-    result.v.n32 =
-        (static_cast<int64_t>(a.v.n64) >= static_cast<int64_t>(b.v.n64)) ? 1
-                                                                         : 0;
-  } else if (op == OpCode::I64geu) {
-    result.v.n32 = a.v.n64 >= b.v.n64 ? 1 : 0;
-  } else {
-    assert(false && "todo: invalid binop for i64");
+std::vector<TableEntry> &Runtime::table_instance(uint32_t table_index) {
+  if (table_index != 0) {
+    raise_trap(TABLE_OUT_OF_BOUNDS);
   }
+  return function_table;
+}
 
-  return result;
+void Runtime::table_init(uint32_t elem_index, uint32_t table_index,
+                         uint32_t dst, uint32_t src, uint32_t n) {
+  std::vector<TableEntry> &table = table_instance(table_index);
+  const std::vector<uint32_t> &functions = elems[elem_index];
+  if (uint64_t(src) + n > functions.size() ||
+      uint64_t(dst) + n > table.size()) {
+    raise_trap(TABLE_OUT_OF_BOUNDS);
+  }
+  for (uint32_t i = 0; i < n; i++) {
+    table[dst + i] = make_table_entry(functions[src + i]);
+  }
+}
+
+void Runtime::elem_drop(uint32_t elem_index) {
+  elems[elem_index] = std::vector<uint32_t>();
 }
 
-Immediate Runtime::handle_numeric_unop_f32(const OpCode &op,
-                                           const Immediate &a) {
-  Immediate result;
-  result.t = ImmediateRepr::F32;
-
-  if (op == OpCode::F32Abs) {
-    result.v.p32 = std::fabs(a.v.p32);
-  } else if (op == OpCode::F32Neg) {
-    result.v.p32 = -a.v.p32;
-  } else if (op == OpCode::F32Sqrt) {
-    result.v.p32 = std::sqrt(a.v.p32);
-  } else if (op == OpCode::F32Ceil) {
-    result.v.p32 = std::ceil(a.v.p32);
-  } else if (op == OpCode::F32Floor) {
-    result.v.p32 = std::floor(a.v.p32);
-  } else if (op == OpCode::F32Trunc) {
-    result.v.p32 = std::trunc(a.v.p32);
-  } else if (op == OpCode::F32Nearest) {
-    result.v.p32 = std::rintf(a.v.p32);
+void Runtime::table_copy(uint32_t dst_table, uint32_t src_table, uint32_t dst,
+                         uint32_t src, uint32_t n) {
+  std::vector<TableEntry> &to = table_instance(dst_table);
+  std::vector<TableEntry> &from = table_instance(src_table);
+  if (uint64_t(src) + n > from.size() || uint64_t(dst) + n > to.size()) {
+    raise_trap(TABLE_OUT_OF_BOUNDS);
+  }
+  // Both are the function table, whose ranges may overlap
+  if (dst <= src) {
+    std::copy(from.begin() + src, from.begin() + src + n, to.begin() + dst);
   } else {
-    assert(false && "todo: invalid f32 binop");
+    std::copy_backward(from.begin() + src, from.begin() + src + n,
+                       to.begin() + dst + n);
   }
-  return result;
 }
 
-Immediate Runtime::handle_numeric_binop_f32(const OpCode &op,
-                                            const Immediate &a,
-                                            const Immediate &b) {
-  Immediate result;
-  result.t = ImmediateRepr::F32;
-  if (op == OpCode::F32Add) {
-    result.v.p32 = a.v.p32 + b.v.p32;
-  } else if (op == OpCode::F32Mul) {
-    result.v.p32 = a.v.p32 * b.v.p32;
-  } else if (op == OpCode::F32Sub) {
-    result.v.p32 = a.v.p32 - b.v.p32;
-  } else if (op == OpCode::F32Div) {
-    result.v.p32 = a.v.p32 / b.v.p32;
-  } else if (op == OpCode::F32Min) {
-    result.v.p32 = std::min(a.v.p32, b.v.p32);
-  } else if (op == OpCode::F32Max) {
-    result.v.p32 = std::max(a.v.p32, b.v.p32);
-  } else if (op == OpCode::F32CopySign) {
-    result.v.p32 = std::copysign(a.v.p32, b.v.p32);
-  } else {
+TableEntry Runtime::make_table_entry(uint32_t function_index) const {
+  TableEntry entry;
+  entry.type_id = wasm.function_type_id(function_index);
+  entry.function_index = function_index;
+  // Prepared up front unless the module is lazy, then call_indirect skips
+  // execute_function. The register code and machine code are translated at
+  // the end of the constructor.
+  if (wasm.lazy_code || function_index < wasm.imports.size()) {
+    return entry;
+  }
+  uint32_t code_index = function_index - wasm.imports.size();
+  if (this->interpreter == STACK_INTERPRETER) {
+    entry.code = &wasm.codes[code_index];
+  } else if (this->interpreter != TIERED) {
+    entry.registers = &wasm.register_codes[code_index];
+  }
+  if (this->interpreter == JIT_COMPILER) {
+    entry.jit = &wasm.jit_functions[code_index];
+  }
+  return entry;
+}
 
-    // Most likely a Comparison op
-    result.t = ImmediateRepr::I32;
-    if (op == OpCode::F32EQ) {
-      result.v.n32 = a.v.p32 == b.v.p32;
-    } else if (op == OpCode::F32Ne) {
-      result.v.n32 = a.v.p32 != b.v.p32;
-    }
+// Slots between the locals and the operand stack of execute_block, see PUSH
+#if WINTERP_CACHE_TOP
+const uint32_t SCRATCH_SLOTS = 1;
+#else
+const uint32_t SCRATCH_SLOTS = 0;
+#endif
+
+// execute_block dispatches every instruction with a single jump on its OpCode.
+// With WINTERP_THREADED_DISPATCH, each handler jumps directly to the handler
+// of the next instruction through a table of label addresses (computed goto,
+// a GCC / Clang extension). Otherwise a dense switch is used, which compilers
+// also lower to a jump table.
+#if WINTERP_THREADED_DISPATCH
+#define CASE(name) op_##name:
+#define DISPATCH() goto *dispatch_table[block[pc].op]
+#else
+#define CASE(name) case OpCode::name:
+#define DISPATCH() continue
+#endif
+
+// Counts every dispatched instruction in dispatch_count, only enabled by
+// WINTERP_COUNT_DISPATCH as it slows down dispatching
+#if WINTERP_COUNT_DISPATCH
+#define COUNT_DISPATCH() this->dispatch_count++
+#else
+#define COUNT_DISPATCH()
+#endif
+
+// Continues with the next instruction
+#define NEXT()                                                                 \
+  pc++;                                                                        \
+  DISPATCH()
+
+// Continues at pc, which has already been set by a branch
+#define JUMP() DISPATCH()
+
+// Operand stack accesses through the local stack pointer sp. There are no
+// checks, the maximum height of every function is reserved when it is called.
+// With WINTERP_CACHE_TOP, the topmost value is kept in the local tos, which
+// the compiler can keep in a register, and sp points to the slot it is
+// spilled to. Below an empty stack is a scratch slot, such that a push never
+// needs to check the height. Otherwise sp points behind the topmost value.
+// SPILL and RELOAD move the topmost value to and from the stack, around
+// everything which accesses the stack directly.
+#if WINTERP_CACHE_TOP
+#define PUSH(value) (*sp++ = tos, tos = (value))
+#define POP() (popped = tos, tos = *--sp, popped)
+#define TOP() (tos)
+#define SPILL() (*sp++ = tos)
+#define RELOAD() (tos = *--sp)
+#else
+#define PUSH(value) (*sp++ = (value))
+#define POP() (*--sp)
+#define TOP() (sp[-1])
+#define SPILL()
+#define RELOAD()
+#endif
+
+// Takes a branch. A branch back to a loop is counted and, once the function
+// is hot, continues in its optimized code.
+#define BRANCH(target)                                                         \
+  SPILL();                                                                     \
+  if (profile != nullptr && (target).pc <= static_cast<uint32_t>(pc)) {        \
+    sp = branch(target, frame, sp, pc);                                        \
+    if (count_back_edge(*profile, code, pc)) {                                 \
+      enter_loop(*profile, code, locals, frame, sp, pc);                       \
+      return;                                                                  \
+    }                                                                          \
+  } else {                                                                     \
+    sp = branch(target, frame, sp, pc);                                        \
+  }                                                                            \
+  RELOAD()
+
+#define UNOP(name, handler)                                                    \
+  CASE(name) {                                                                 \
+    TOP() = handler<OpCode::name>(TOP());                                      \
+    NEXT();                                                                    \
+  }
 
-    else if (op == OpCode::F32Lt) {
-      result.v.n32 = a.v.p32 < b.v.p32;
-    } else if (op == OpCode::F32Gt) {
-      result.v.n32 = a.v.p32 > b.v.p32;
-    }
+#define BINOP(name, handler)                                                   \
+  CASE(name) {                                                                 \
+    Value b = POP();                                                           \
+    TOP() = handler<OpCode::name>(TOP(), b);                                   \
+    NEXT();                                                                    \
+  }
 
-    else if (op == OpCode::F32Le) {
-      result.v.n32 = a.v.p32 <= b.v.p32;
-    }
+// Memory 0 is accessed directly, all other memories by their indexed
+// OpCodes
+#define LOAD(name)                                                             \
+  CASE(name) {                                                                 \
+    uint64_t address = uint64_t(instr.imm2) + TOP().n32;                       \
+    TOP() = handle_load<OpCode::name>(memory, address);                        \
+    NEXT();                                                                    \
+  }                                                                            \
+  CASE(name##Indexed) {                                                        \
+    uint64_t address = uint64_t(instr.imm2) + TOP().n32;                       \
+    TOP() = handle_load<OpCode::name>(*memories[instr.imm], address);          \
+    NEXT();                                                                    \
+  }
 
-    else if (op == OpCode::F32Ge) {
-      result.v.n32 = a.v.p32 >= b.v.p32;
-    } else {
-      assert(false && "todo: invalid binop for f32");
-    }
+#define STORE(name)                                                            \
+  CASE(name) {                                                                 \
+    Value c = POP();                                                           \
+    Value i = POP();                                                           \
+    uint64_t address = uint64_t(instr.imm2) + i.n32;                           \
+    handle_store<OpCode::name>(memory, address, c);                            \
+    NEXT();                                                                    \
+  }                                                                            \
+  CASE(name##Indexed) {                                                        \
+    Value c = POP();                                                           \
+    Value i = POP();                                                           \
+    uint64_t address = uint64_t(instr.imm2) + i.n32;                           \
+    handle_store<OpCode::name>(*memories[instr.imm], address, c);              \
+    NEXT();                                                                    \
   }
-  return result;
-}
 
-Immediate Runtime::handle_numeric_unop_f64(const OpCode &op,
-                                           const Immediate &a) {
-  Immediate result;
-  result.t = ImmediateRepr::F64;
-
-  if (op == OpCode::F64Abs) {
-    result.v.p64 = std::fabs(a.v.p64);
-  } else if (op == OpCode::F64Neg) {
-    result.v.p64 = -a.v.p64;
-  } else if (op == OpCode::F64Sqrt) {
-    result.v.p64 = std::sqrt(a.v.p64);
-  } else if (op == OpCode::F64Ceil) {
-    result.v.p64 = std::ceil(a.v.p64);
-  } else if (op == OpCode::F64Floor) {
-    result.v.p64 = std::floor(a.v.p64);
-  } else if (op == OpCode::F64Trunc) {
-    result.v.p64 = std::trunc(a.v.p64);
-  } else if (op == OpCode::F64Nearest) {
-    result.v.p64 = std::rintf(a.v.p64);
-  } else {
-    assert(false && "todo");
+// Superinstructions of an i32 binop, see fuse_instructions
+#define FUSED_BINOP(name)                                                      \
+  CASE(name##C) {                                                              \
+    TOP() = handle_numeric_binop_i32<OpCode::name>(TOP(), Value{instr.imm});   \
+    NEXT();                                                                    \
+  }                                                                            \
+  CASE(name##L) {                                                              \
+    TOP() = handle_numeric_binop_i32<OpCode::name>(TOP(), locals[instr.imm]);  \
+    NEXT();                                                                    \
+  }                                                                            \
+  CASE(name##LC) {                                                             \
+    PUSH(handle_numeric_binop_i32<OpCode::name>(locals[instr.imm],             \
+                                                Value{instr.imm2}));           \
+    NEXT();                                                                    \
+  }                                                                            \
+  CASE(name##LL) {                                                             \
+    PUSH(handle_numeric_binop_i32<OpCode::name>(locals[instr.imm],             \
+                                                locals[instr.imm2]));          \
+    NEXT();                                                                    \
   }
-  return result;
-}
 
-Immediate Runtime::handle_numeric_binop_f64(const OpCode &op,
-                                            const Immediate &a,
-                                            const Immediate &b) {
-  Immediate result;
-  result.t = ImmediateRepr::F64;
-  if (op == OpCode::F64Add) {
-    result.v.p64 = a.v.p64 + b.v.p64;
-  } else if (op == OpCode::F64Mul) {
-    result.v.p64 = a.v.p64 * b.v.p64;
-  } else if (op == OpCode::F64Sub) {
-    result.v.p64 = a.v.p64 - b.v.p64;
-  } else if (op == OpCode::F64Div) {
-    result.v.p64 = a.v.p64 / b.v.p64;
-  } else if (op == OpCode::F64Min) {
-    result.v.p64 = std::min(a.v.p64, b.v.p64);
-  } else if (op == OpCode::F64Max) {
-    result.v.p64 = std::max(a.v.p64, b.v.p64);
-  } else if (op == OpCode::F64CopySign) {
-    result.v.p64 = std::copysign(a.v.p64, b.v.p64);
-  } else {
+// Superinstructions of an i32 comparison followed by br_if or if, with the
+// second operand on the stack or as constant
+#define FUSED_COMPARISON(name)                                                 \
+  CASE(BrIf##name) {                                                           \
+    Value b = POP();                                                           \
+    Value a = POP();                                                           \
+    if (handle_numeric_binop_i32<OpCode::name>(a, b).n32 != 0) {               \
+      BRANCH(instr.target);                                                    \
+      JUMP();                                                                  \
+    }                                                                          \
+    NEXT();                                                                    \
+  }                                                                            \
+  CASE(If##name) {                                                             \
+    Value b = POP();                                                           \
+    Value a = POP();                                                           \
+    if (handle_numeric_binop_i32<OpCode::name>(a, b).n32 != 0) {               \
+      NEXT();                                                                  \
+    }                                                                          \
+    pc = instr.target.pc;                                                      \
+    JUMP();                                                                    \
+  }                                                                            \
+  CASE(BrIf##name##C) {                                                        \
+    Value a = POP();                                                           \
+    if (handle_numeric_binop_i32<OpCode::name>(a, Value{instr.imm}).n32 != 0) { \
+      BRANCH(instr.target);                                                    \
+      JUMP();                                                                  \
+    }                                                                          \
+    NEXT();                                                                    \
+  }                                                                            \
+  CASE(If##name##C) {                                                          \
+    Value a = POP();                                                           \
+    if (handle_numeric_binop_i32<OpCode::name>(a, Value{instr.imm}).n32 != 0) { \
+      NEXT();                                                                  \
+    }                                                                          \
+    pc = instr.target.pc;                                                      \
+    JUMP();                                                                    \
+  }
 
-    // Most likely a Comparison op
-    result.t = ImmediateRepr::I64;
-    if (op == OpCode::F64EQ) {
-      result.v.n64 = a.v.p64 == b.v.p64;
-    } else if (op == OpCode::F64Ne) {
-      result.v.n64 = a.v.p64 != b.v.p64;
-    }
+// Values carry no type, reinterpreting them leaves the bits as they are
+#define REINTERP(name)                                                         \
+  CASE(name) { NEXT(); }
+
+// All OpCodes with a handler in execute_block
+// clang-format off
+#define EXECUTED_OPCODES(X)                                                    \
+  X(Unreachable) X(Nop) X(Block) X(Loop) X(If) X(Else) X(End) X(Br) X(BrIf)    \
+  X(BrTable) X(Return) X(Call) X(CallIndirect) X(Drop) X(Select)               \
+  X(LocalGet) X(LocalSet) X(LocalTee) X(GlobalGet) X(GlobalSet)                \
+  X(I32Load) X(I64Load) X(F32Load) X(F64Load) X(I32Load8S) X(I32Load8U)        \
+  X(I32Load16S) X(I32Load16U) X(I64Load8S) X(I64Load8U) X(I64Load16S)          \
+  X(I64Load16U) X(I64Load32S) X(I64Load32U) X(I32Store) X(I64Store)            \
+  X(F32Store) X(F64Store) X(I32Store8) X(I32Store16) X(I64Store8)              \
+  X(I64Store16) X(I64Store32) X(MemorySize) X(MemoryGrow) X(MemoryInit)        \
+  X(DataDrop) X(MemoryCopy) X(MemoryFill) X(TableInit) X(ElemDrop)             \
+  X(TableCopy)                                                                 \
+  X(I32Const) X(I64Const) X(F32Const) X(F64Const)                              \
+  X(I32eqz) X(I32eq) X(I32ne) X(I32lts) X(I32ltu) X(I32gts) X(I32gtu)          \
+  X(I32le_s) X(I32le_u) X(I32ge_s) X(I32ge_u)                                  \
+  X(I64eqz) X(I64eq) X(I64ne) X(I64lts) X(I64ltu) X(I64gts) X(I64gtu)          \
+  X(I64les) X(I64leu) X(I64ges) X(I64geu)                                      \
+  X(F32EQ) X(F32Ne) X(F32Lt) X(F32Gt) X(F32Le) X(F32Ge)                        \
+  X(F64EQ) X(F64Ne) X(F64Lt) X(F64Gt) X(F64Le) X(F64Ge)                        \
+  X(I32clz) X(I32ctz) X(I32popcnt) X(I32Add) X(I32Sub) X(I32Mul) X(I32DivS)    \
+  X(I32DivU) X(I32RemS) X(I32RemU) X(I32and) X(I32or) X(I32xor) X(I32shl)      \
+  X(I32shrs) X(I32shru) X(I32rotl) X(I32rotr)                                  \
+  X(I64clz) X(I64ctz) X(I64popcnt) X(I64Add) X(I64Sub) X(I64Mul) X(I64DivS)    \
+  X(I64DivU) X(I64RemS) X(I64RemU) X(I64and) X(I64or) X(I64xor) X(I64shl)      \
+  X(I64shrs) X(I64shru) X(I64rotl) X(I64rotr)                                  \
+  X(F32Abs) X(F32Neg) X(F32Ceil) X(F32Floor) X(F32Trunc) X(F32Nearest)         \
+  X(F32Sqrt) X(F32Add) X(F32Sub) X(F32Mul) X(F32Div) X(F32Min) X(F32Max)       \
+  X(F32CopySign)                                                               \
+  X(F64Abs) X(F64Neg) X(F64Ceil) X(F64Floor) X(F64Trunc) X(F64Nearest)         \
+  X(F64Sqrt) X(F64Add) X(F64Sub) X(F64Mul) X(F64Div) X(F64Min) X(F64Max)       \
+  X(F64CopySign)                                                               \
+  X(I32WrapI64) X(I32TruncSF32) X(I32TruncUF32) X(I32TruncSF64)                \
+  X(I32TruncUF64) X(I64ExtendSI32) X(I64ExtendUI32) X(I64TruncSF32)            \
+  X(I64TruncUF32) X(I64TruncSF64) X(I64TruncUF64) X(F32ConvertSI32)            \
+  X(F32ConvertUI32) X(F32ConvertSI64) X(F32ConvertUI64) X(F32DemoteF64)        \
+  X(F64ConvertSI32) X(F64ConvertUI32) X(F64ConvertSI64) X(F64ConvertUI64)      \
+  X(F32PromoteF64) X(I32ReinterpF32) X(I64ReinterpF64) X(F32ReinterpI32)       \
+  X(F64ReinterpI64)
+// clang-format on
+
+void Runtime::execute_block(const Code &code, Value *locals,
+                            FunctionProfile *profile) {
+
+  const std::vector<Instr> &block = code.expr;
+
+  // Kept in a local while executing, such that it can live in a register.
+  // Written back to this->sp whenever another function is called.
+  Value *sp = this->sp;
+
+  // Branch targets store stack heights relative to the start of the operand
+  // stack of the function, which starts right after its locals
+  Value *frame = sp + SCRATCH_SLOTS;
+
+#if WINTERP_CACHE_TOP
+  Value tos;
+  Value popped;
+  tos.n64 = 0;
+#endif
 
-    else if (op == OpCode::F64Lt) {
-      result.v.n64 = a.v.p64 < b.v.p64;
-    } else if (op == OpCode::F64Gt) {
-      result.v.n64 = a.v.p64 > b.v.p64;
+  // program counter, which instruction were currently running
+  // Every function ends with a return, hence pc never runs past the end.
+  int pc = 0;
+
+  // Instructions implemented based on description here
+  // https://webassembly.github.io/spec/core/exec/instructions.html
+
+#if WINTERP_THREADED_DISPATCH
+  // Labels are local to this function, hence the table can only be filled in
+  // here. It is shared by all runtimes, so it is filled exactly once.
+  static const void *dispatch_table[NUM_OPCODES];
+  static std::atomic<bool> dispatch_table_ready(false);
+
+  if (!dispatch_table_ready.load(std::memory_order_acquire)) {
+    static std::mutex dispatch_table_mutex;
+    std::lock_guard<std::mutex> lock(dispatch_table_mutex);
+    if (!dispatch_table_ready.load(std::memory_order_relaxed)) {
+      std::fill(dispatch_table, dispatch_table + NUM_OPCODES,
+                &&op_unimplemented);
+#define TABLE_ENTRY(name) dispatch_table[OpCode::name] = &&op_##name;
+      EXECUTED_OPCODES(TABLE_ENTRY)
+#define FUSED_BINOP_ENTRIES(name)                                              \
+  TABLE_ENTRY(name##C) TABLE_ENTRY(name##L) TABLE_ENTRY(name##LC)              \
+  TABLE_ENTRY(name##LL)
+      FUSED_BINOPS(FUSED_BINOP_ENTRIES)
+#undef FUSED_BINOP_ENTRIES
+#define FUSED_COMPARISON_ENTRIES(name)                                         \
+  TABLE_ENTRY(BrIf##name) TABLE_ENTRY(If##name) TABLE_ENTRY(BrIf##name##C)     \
+  TABLE_ENTRY(If##name##C)
+      FUSED_COMPARISONS(FUSED_COMPARISON_ENTRIES)
+#undef FUSED_COMPARISON_ENTRIES
+      TABLE_ENTRY(BrIfI32eqz)
+      TABLE_ENTRY(IfI32eqz)
+      TABLE_ENTRY(I32StoreC)
+      TABLE_ENTRY(LocalSetGet)
+#define INDEXED_ACCESS_ENTRY(name) TABLE_ENTRY(name##Indexed)
+      MEMORY_ACCESSES(INDEXED_ACCESS_ENTRY, INDEXED_ACCESS_ENTRY)
+#undef INDEXED_ACCESS_ENTRY
+#undef TABLE_ENTRY
+      dispatch_table_ready.store(true, std::memory_order_release);
     }
+  }
 
-    else if (op == OpCode::F64Le) {
-      result.v.n64 = a.v.p64 <= b.v.p64;
+  // The handlers below are only reached through the table
+  const Instr *current = &block[pc];
+#define instr (*current)
+#undef DISPATCH
+#define DISPATCH()                                                             \
+  current = &block[pc];                                                        \
+  COUNT_DISPATCH();                                                            \
+  goto *dispatch_table[current->op]
+
+  DISPATCH();
+#else
+  while (true) {
+    const Instr &instr = block[pc];
+    COUNT_DISPATCH();
+
+    switch (instr.op) {
+#endif
+
+  CASE(Unreachable) {
+    raise_trap(UNREACHABLE);
+  }
+
+  CASE(Nop)
+  CASE(End)
+  CASE(Block)
+  CASE(Loop) {
+    // Treat as nop, all branches to these labels are already resolved and the
+    // last end of a function is replaced by a return
+    NEXT();
+  }
+
+  CASE(If) {
+    Value c = POP();
+    if (c.n32) {
+      // execute first block
+      NEXT();
     }
+    // execute second block
+    // jump behind the matching else, or to the end if there is none
+    pc = instr.target.pc;
+    JUMP();
+  }
 
-    else if (op == OpCode::F64Ge) {
-      result.v.n64 = a.v.p64 >= b.v.p64;
-    } else {
-      assert(false && "todo: invalid binop for f64");
+  CASE(Else) {
+    // We have landed in a Else block, which we do not want to execute
+    // We know that we can skip this block, because if the if block would have
+    // taken the else route, it would have jumped to the first op after the
+    // else
+    SPILL();
+    sp = branch(instr.target, frame, sp, pc);
+    RELOAD();
+    JUMP();
+  }
+
+  CASE(Br) {
+    // Exit block!
+    BRANCH(instr.target);
+    JUMP();
+  }
+
+  CASE(BrIf) {
+    Value c = POP();
+    if (c.n32 != 0) {
+      BRANCH(instr.target);
+      JUMP();
     }
+    NEXT();
   }
-  return result;
-}
 
-Immediate Runtime::handle_conversion(const OpCode &op, const Immediate &a) {
-  Immediate result;
-  if (op == I32WrapI64) {
-    result.v.n32 = static_cast<uint32_t>(a.v.n64);
-    result.t = ImmediateRepr::I32;
-  } else if (op == F32ConvertSI32) {
-    result.t = ImmediateRepr::F32;
-    result.v.p32 = static_cast<float>((int32_t)a.v.n32);
-  } else if (op == F32ConvertUI32) {
-    result.t = ImmediateRepr::F32;
-    result.v.p32 = static_cast<float>(a.v.n32);
-  } else if (op == F32ConvertSI64) {
-    result.t = ImmediateRepr::F32;
-    result.v.p32 = static_cast<float>((int64_t)a.v.n64);
-  } else if (op == F32ConvertUI64) {
-    result.t = ImmediateRepr::F32;
-    result.v.p32 = static_cast<float>(a.v.n64);
-  } else if (op == F32DemoteF64) {
-    result.t = ImmediateRepr::F32;
-    result.v.p32 = static_cast<float>(a.v.p64);
-  } else if (op == F64ConvertSI32) {
-    result.t = ImmediateRepr::F64;
-    result.v.p64 = static_cast<double>((int32_t)a.v.n32);
-  } else if (op == F64ConvertUI32) {
-    result.t = ImmediateRepr::F64;
-    result.v.p64 = static_cast<double>(a.v.n32);
-  } else if (op == F64ConvertSI64) {
-    result.t = ImmediateRepr::F64;
-    result.v.p64 = static_cast<double>((int64_t)a.v.n64);
-  } else if (op == F64ConvertUI64) {
-    result.t = ImmediateRepr::F64;
-    result.v.p64 = static_cast<double>(a.v.n64);
-  } else if (op == F32PromoteF64) {
-    result.t = ImmediateRepr::F64;
-    result.v.p64 = static_cast<double>(a.v.p32);
-  } else if (op == I32TruncSF32) {
-    result.t = ImmediateRepr::I32;
-    result.v.n32 =
-        static_cast<int32_t>(static_cast<int64_t>(std::trunc(a.v.p32)));
-  } else if (op == I32TruncUF32) {
-    result.t = ImmediateRepr::I32;
-    result.v.n32 =
-        static_cast<uint32_t>(static_cast<uint64_t>(std::trunc(a.v.p32)));
-  } else if (op == I32TruncSF64) {
-    result.t = ImmediateRepr::I32;
-    result.v.n32 =
-        static_cast<int32_t>(static_cast<int64_t>(std::trunc(a.v.p64)));
-  } else if (op == I32TruncUF64) {
-    result.t = ImmediateRepr::I32;
-    result.v.n32 =
-        static_cast<uint32_t>(static_cast<uint64_t>(std::trunc(a.v.p64)));
-  } else if (op == I64ExtendSI32) {
-    result.t = ImmediateRepr::I64;
-    result.v.n64 = static_cast<int64_t>(static_cast<int32_t>(a.v.n32));
-  } else if (op == I64ExtendUI32) {
-    result.t = ImmediateRepr::I64;
-    result.v.n64 = static_cast<uint64_t>(static_cast<uint32_t>(a.v.n32));
-  } else if (op == I64TruncSF32) {
-    result.t = ImmediateRepr::I64;
-    result.v.n64 = static_cast<int64_t>(std::trunc(a.v.p32));
-  } else if (op == I64TruncUF32) {
-    result.t = ImmediateRepr::I64;
-    result.v.n64 = static_cast<uint64_t>(std::trunc(a.v.p32));
-  } else if (op == I64TruncSF64) {
-    result.t = ImmediateRepr::I64;
-    result.v.n64 = static_cast<int64_t>(std::trunc(a.v.p64));
-  } else if (op == I64TruncUF64) {
-    result.t = ImmediateRepr::I64;
-    result.v.n64 = static_cast<uint64_t>(std::trunc(a.v.p64));
-  } else {
-    assert(false && "todo: missing case");
+  CASE(BrTable) {
+    Value i = POP();
+
+    // Use default, aka last label, for out of range indices
+    uint32_t num_labels = instr.imm;
+    uint32_t entry = i.n32 < num_labels ? i.n32 : num_labels;
+
+    BRANCH(code.br_tables[instr.target.pc + entry]);
+    JUMP();
   }
-  return result;
-}
 
-Immediate Runtime::handle_load(const OpCode &op, const uint32_t &mem_index,
-                               const uint32_t &offset) {
-
-  Immediate result;
-  if (op == OpCode::I32Load) {
-    return this->read_memory(mem_index, offset, ImmediateRepr::I32);
-  } else if (op == OpCode::I64Load) {
-    return this->read_memory(mem_index, offset, ImmediateRepr::I64);
-  } else if (op == OpCode::F32Load) {
-    return this->read_memory(mem_index, offset, ImmediateRepr::F32);
-  } else if (op == OpCode::F64Load) {
-    return this->read_memory(mem_index, offset, ImmediateRepr::F64);
-  } else if (op == OpCode::I32Load8S) {
-    result.t = ImmediateRepr::I32;
-    int8_t data;
-    std::memcpy(&data, &this->memory[offset], 1);
-    result.v.n32 = static_cast<int32_t>(data);
+  CASE(Return) {
+    // Replaces the frame of the function by its results
+    uint32_t arity = instr.target.arity;
+    SPILL();
+    std::copy(sp - arity, sp, locals);
+    this->sp = locals + arity;
+    return;
   }
 
-  else if (op == OpCode::I32Load8U) {
-    result.t = ImmediateRepr::I32;
-    uint8_t data;
-    std::memcpy(&data, &this->memory[offset], 1);
-    result.v.n32 = static_cast<uint32_t>(data);
+  CASE(Call) {
+    SPILL();
+    this->sp = sp;
+    execute_function(instr.imm);
+    sp = this->sp;
+    RELOAD();
+    NEXT();
   }
 
-  else if (op == OpCode::I32Load16S) {
-    result.t = ImmediateRepr::I32;
-    int16_t data;
-    std::memcpy(&data, &this->memory[offset], 2);
-    result.v.n32 = static_cast<int32_t>(data);
+  CASE(CallIndirect) {
+    Value table_index = POP(); // index in table
+    const TableEntry &entry = table_entry(table_index.n32, instr.imm);
+
+    SPILL();
+    this->sp = sp;
+    if (entry.code != nullptr) {
+      execute_code(*entry.code, nullptr);
+    } else {
+      execute_function(entry.function_index);
+    }
+    sp = this->sp;
+    RELOAD();
+    NEXT();
   }
 
-  else if (op == OpCode::I32Load16U) {
-    result.t = ImmediateRepr::I32;
-    uint16_t data;
-    std::memcpy(&data, &this->memory[offset], 2);
-    result.v.n32 = static_cast<uint32_t>(data);
+  CASE(Drop) {
+    POP();
+    NEXT();
   }
 
-  else if (op == OpCode::I64Load8S) {
-    result.t = ImmediateRepr::I64;
-    int8_t data;
-    std::memcpy(&data, &this->memory[offset], 1);
-    result.v.n64 = static_cast<int64_t>(data);
+  CASE(Select) {
+    Value c = POP();
+    Value val2 = POP();
+
+    // val1 stays on the stack if it is selected
+    if (c.n32 == 0) {
+      TOP() = val2;
+    }
+    NEXT();
   }
 
-  else if (op == OpCode::I64Load8U) {
-    result.t = ImmediateRepr::I64;
-    uint8_t data;
-    std::memcpy(&data, &this->memory[offset], 1);
-    result.v.n64 = static_cast<uint64_t>(data);
+  /* VARIABLE INSTRUCTIONS */
+  CASE(LocalGet) {
+    // The parameters of the function are referenced through 0-based local
+    // indices in the function’s body; they are mutable.
+    // They are the first locals of the frame.
+    PUSH(locals[instr.imm]);
+    NEXT();
   }
 
-  else if (op == OpCode::I64Load16S) {
-    result.t = ImmediateRepr::I64;
-    int16_t data;
-    std::memcpy(&data, &this->memory[offset], 2);
-    result.v.n64 = static_cast<int64_t>(data);
+  CASE(LocalSet) {
+    locals[instr.imm] = POP();
+    NEXT();
   }
 
-  else if (op == OpCode::I64Load16U) {
-    result.t = ImmediateRepr::I64;
-    uint16_t data;
-    std::memcpy(&data, &this->memory[offset], 2);
-    result.v.n64 = static_cast<uint64_t>(data);
+  CASE(LocalTee) {
+    // The value stays on the stack
+    locals[instr.imm] = TOP();
+    NEXT();
   }
 
-  else if (op == OpCode::I64Load32S) {
-    result.t = ImmediateRepr::I64;
-    int32_t data;
-    std::memcpy(&data, &this->memory[offset], 4);
-    result.v.n64 = static_cast<int64_t>(data);
+  CASE(GlobalGet) {
+    PUSH(globals[instr.imm].value.v);
+    NEXT();
   }
 
-  else if (op == OpCode::I64Load32U) {
-    result.t = ImmediateRepr::I64;
-    uint32_t data;
-    std::memcpy(&data, &this->memory[offset], 4);
-    result.v.n64 = static_cast<uint64_t>(data);
-  } else {
-    assert(false && "todo: missing case");
+  CASE(GlobalSet) {
+    // Validation guarantees that the global exists and is mutable
+    globals[instr.imm].value.v = POP();
+    NEXT();
   }
 
-  return result;
-}
+  /* Load and store operations */
+  MEMORY_ACCESSES(LOAD, STORE)
 
-void Runtime::handle_store(const OpCode &op, const uint32_t &mem_index,
-                           const uint32_t &offset, const Immediate &value) {
-
-  uint8_t op_byte = static_cast<uint8_t>(op);
-
-  if (op_byte >= 0x36 && op_byte <= 0x39) {
-    this->write_memory(mem_index, offset, value);
-  }
-  // TODO: bounds checking...
-  else if (op == I32Store8) {
-    uint8_t byte = static_cast<uint8_t>(value.v.n32 & 0xFF);
-    memory[offset] = byte;
-  } else if (op == I32Store16) {
-    std::memcpy(&this->memory[offset], &value.v.n32, 2);
-  } else if (op == I64Store8) {
-    uint8_t byte = static_cast<uint8_t>(value.v.n64 & 0xFF);
-    memory[offset] = byte;
-  } else if (op == I64Store16) {
-    std::memcpy(&this->memory[offset], &value.v.n64, 2);
-  } else if (op == I64Store32) {
-    std::memcpy(&this->memory[offset], &value.v.n64, 4);
-  } else {
-    assert(false && "invalid op!");
+  /* Memory Instructions */
+  CASE(MemorySize) {
+    Value pages;
+    pages.n32 = memory_instance(instr.imm).pages();
+    PUSH(pages);
+    NEXT();
   }
-}
 
-Immediate Runtime::reinterp(const Immediate &a, const ImmediateRepr from,
-                            const ImmediateRepr to) {
-  assert(a.t == from && "invalid reinterpretation?");
-  Immediate c1 = a;
-  c1.t = to;
-  return c1;
-}
+  CASE(MemoryGrow) {
+    TOP().n32 = memory_grow(instr.imm, TOP().n32);
+    NEXT();
+  }
 
-void Runtime::execute_block(const std::vector<Instr> &block,
-                            std::vector<Immediate> &params,
-                            std::vector<Immediate> &locals) {
+  CASE(MemoryFill) {
+    Value n = POP();
+    Value val = POP();
+    Value i = POP();
+    memory_fill(instr.imm, i.n32, val, n.n32);
+    NEXT();
+  }
 
-  assert(block.size() > 0 && "execute block was called on empty expr");
+  CASE(MemoryCopy) {
+    Value n = POP();
+    Value i2 = POP();
+    Value i1 = POP();
+    memory_copy(instr.imm, instr.imm2, i1.n32, i2.n32, n.n32);
+    NEXT();
+  }
 
-  /* Emulate Instructions */
-  // program counter, which instruction were currently running
-  int pc = 0;
-  while (pc < block.size()) {
+  CASE(MemoryInit) {
+    Value n = POP();
+    Value j = POP();
+    Value i = POP();
+    memory_init(instr.imm, instr.imm2, i.n32, j.n32, n.n32);
+    NEXT();
+  }
 
-    const Instr &instr = block[pc];
+  CASE(DataDrop) {
+    data_drop(instr.imm);
+    NEXT();
+  }
 
-    uint8_t op_byte = static_cast<uint8_t>(instr.op);
+  CASE(TableInit) {
+    Value n = POP();
+    Value s = POP();
+    Value d = POP();
+    table_init(instr.imm, instr.imm2, d.n32, s.n32, n.n32);
+    NEXT();
+  }
 
-    bool is_i32_numeric_unop =
-        op_byte == 0x45 || (op_byte >= 0x67 && op_byte <= 0x69);
+  CASE(ElemDrop) {
+    elem_drop(instr.imm);
+    NEXT();
+  }
 
-    bool is_i32_numeric_binop = (op_byte >= 0x6A && op_byte <= 0x78) ||
-                                (op_byte >= 0x46 && op_byte <= 0x4F);
+  CASE(TableCopy) {
+    Value n = POP();
+    Value s = POP();
+    Value d = POP();
+    table_copy(instr.imm, instr.imm2, d.n32, s.n32, n.n32);
+    NEXT();
+  }
 
-    bool is_i64_numeric_unop = (op_byte >= 0x79 && op_byte <= 0x7B) ||
-                               (op_byte >= 0x50 && op_byte <= 0x50);
-    bool is_i64_numeric_binop = (op_byte >= 0x7C && op_byte <= 0x8A) ||
-                                (op_byte >= 0x51 && op_byte <= 0x5A);
+  CASE(I32Const)
+  CASE(I64Const)
+  CASE(F32Const)
+  CASE(F64Const) {
+    PUSH(instr.value.v);
+    NEXT();
+  }
 
-    bool is_f32_numeric_unop = op_byte >= 0x8B && op_byte <= 0x91;
-    bool is_f32_numeric_binop = (op_byte >= 0x92 && op_byte <= 0x98) ||
-                                (op_byte >= 0x5B && op_byte <= 0x60) ||
-                                (op_byte == 0x98);
+  /* Numeric instructions */
+  NUMERIC_INSTRUCTIONS(UNOP, BINOP)
 
-    bool is_f64_numeric_unop = (op_byte >= 0x99 && op_byte <= 0x9F);
-    bool is_f64_numeric_binop = (op_byte >= 0xA0 && op_byte <= 0xA6) ||
-                                (op_byte >= 0x61 && op_byte <= 0x66);
+  /* REINTERP */
+  REINTERP(I32ReinterpF32)
+  REINTERP(F32ReinterpI32)
+  REINTERP(I64ReinterpF64)
+  REINTERP(F64ReinterpI64)
 
-    // Instructions implemented based on description here
-    // https://webassembly.github.io/spec/core/exec/instructions.html
+  /* Superinstructions */
+  FUSED_BINOPS(FUSED_BINOP)
+  FUSED_COMPARISONS(FUSED_COMPARISON)
 
-    assert(instr.op != OpCode::Unreachable &&
-           "Unreachable statement has been hit!");
+  CASE(BrIfI32eqz) {
+    Value c = POP();
+    if (c.n32 == 0) {
+      BRANCH(instr.target);
+      JUMP();
+    }
+    NEXT();
+  }
 
-    if (instr.op == OpCode::End || instr.op == OpCode::Nop) {
-      // Treat as nop, only last End actually ends the function, the rest are
-      // useful to know when control blocks end
-    } else if (instr.op == OpCode::Drop) {
-      this->pop_stack();
-    } else if (instr.op == OpCode::Select) {
-      Immediate c = this->pop_stack();
-      Immediate val2 = this->pop_stack();
-      Immediate val1 = this->pop_stack();
+  CASE(IfI32eqz) {
+    Value c = POP();
+    if (c.n32 == 0) {
+      NEXT();
+    }
+    pc = instr.target.pc;
+    JUMP();
+  }
 
-      if (c.v.n32 != 0) {
-        this->push_stack(val1);
-      } else {
-        this->push_stack(val2);
-      }
+  CASE(I32StoreC) {
+    Value i = POP();
+    handle_store<OpCode::I32Store>(memory, uint64_t(instr.imm2) + i.n32,
+                                   Value{instr.imm});
+    NEXT();
+  }
 
-    } else if (instr.op == OpCode::Else) {
-      // We have landed in a Else block, which we do not want to execute
-      // We know that we can skip this block, because if the if block would have
-      // taken the else route, skip_block would have stoped at the first op to
-      // actually execute after the else
-      skip_control_block(block, pc);
-      continue;
-    } else if (instr.op == OpCode::Call) {
-      execute_function(instr.imms[0].v.n32);
-    } else if (instr.op == OpCode::CallIndirect) {
+  CASE(LocalSetGet) {
+    locals[instr.imm] = TOP();
+    TOP() = locals[instr.imm2];
+    NEXT();
+  }
 
-      const Immediate &x = instr.imms[0]; // What table to use
-      /* TODO: actually use x */
-      /* TODO: why is signature index required? For call frame? */
+#if WINTERP_THREADED_DISPATCH
+op_unimplemented:
+  assert(false && "todo: implement new opcode emulation");
+  NEXT();
+#undef instr
+#else
+    default:
+      assert(false && "todo: implement new opcode emulation");
+      NEXT();
+    }
+  }
+#endif
+}
 
-      Immediate table_index = this->pop_stack(); // index in table
+#undef PUSH
+#undef POP
+#undef TOP
+#undef SPILL
+#undef RELOAD
+#undef UNOP
+#undef BINOP
+#undef LOAD
+#undef STORE
+#undef REINTERP
+#undef FUSED_BINOP
+#undef FUSED_COMPARISON
+#undef BRANCH
+#undef EXECUTED_OPCODES
+
+// The handlers of execute_registers read their operands from and write their
+// result to the slots of the frame named by the instruction
+#define UNOP(name, handler)                                                    \
+  CASE(name) {                                                                 \
+    frame[instr.dst] = handler<OpCode::name>(frame[instr.a]);                  \
+    NEXT();                                                                    \
+  }
 
-      assert(table_index.v.n32 < this->function_table.size() &&
-             "invalid function table index!");
+#define BINOP(name, handler)                                                   \
+  CASE(name) {                                                                 \
+    frame[instr.dst] = handler<OpCode::name>(frame[instr.a], frame[instr.b]);  \
+    NEXT();                                                                    \
+  }
 
-      uint32_t ref_function_index = this->function_table[table_index.v.n32];
+#define LOAD(name)                                                             \
+  CASE(name) {                                                                 \
+    uint64_t address = uint64_t(instr.imm) + frame[instr.a].n32;               \
+    frame[instr.dst] =                                                         \
+        handle_load<OpCode::name>(memory_instance(instr.imm2), address);       \
+    NEXT();                                                                    \
+  }
 
-      execute_function(ref_function_index);
-    } else if (instr.op == OpCode::I32Const || instr.op == OpCode::F32Const ||
-               instr.op == OpCode::I64Const || instr.op == OpCode::F64Const) {
-      this->push_stack(instr.imms[0]);
-    }
-    /* Memory Instructions */
-    else if (instr.op == OpCode::MemorySize) {
-      Immediate pages;
-      pages.t = ImmediateRepr::I32;
-      pages.v.n32 = this->pages;
-      this->push_stack(pages);
-    } else if (instr.op == OpCode::MemoryGrow) {
-      Immediate grow_by = this->pop_stack();
-
-      // for some reason old page size is returned...
-      Immediate old_pages;
-      old_pages.t = ImmediateRepr::I32;
-      old_pages.v.n32 = this->pages;
-      this->push_stack(old_pages);
-
-      pages += grow_by.v.n32;
-      // TODO: check for failure, like not enough memory.
-      memory.resize(pages * MEMORY_PAGE_SIZE);
-    } else if (instr.op == MemoryFill) {
-      Immediate n = this->pop_stack();
-      Immediate val = this->pop_stack();
-      Immediate i = this->pop_stack();
-
-      // TODO: validate memory overflow
-
-      OpCode i32store8 = OpCode::I32Store8;
-      Immediate memidx = instr.imms[0];
-
-      for (int j = 0; j < n.v.n32; j++) {
-        uint32_t offset = i.v.n32 + j;
-        handle_store(i32store8, memidx.v.n32, offset, val);
-      }
-    } else if (instr.op == MemoryCopy) {
-
-      Immediate n = this->pop_stack();
-      Immediate i2 = this->pop_stack();
-      Immediate i1 = this->pop_stack();
-
-      OpCode i32Load8u = OpCode::I32Load8U;
-      OpCode i32store8 = OpCode::I32Store8;
-
-      for (int j = 0; j < n.v.n32; j++) {
-        if (i1.v.n32 <= i2.v.n32) {
-          uint32_t load_offset = i2.v.n32 + j;
-          Immediate imm =
-              handle_load(i32Load8u, instr.imms[1].v.n32, load_offset);
-
-          uint32_t store_offset = i1.v.n32 + j;
-          handle_store(i32store8, instr.imms[0].v.n32, store_offset, imm);
-        } else {
-          for (int j = n.v.n32 - 1; j >= 0; j--) {
-            uint32_t load_offset = i2.v.n32 + j;
-            Immediate imm =
-                handle_load(i32Load8u, instr.imms[1].v.n32, load_offset);
-
-            uint32_t store_offset = i1.v.n32 + j;
-            handle_store(i32store8, instr.imms[0].v.n32, store_offset, imm);
-          }
-        }
-      }
+#define STORE(name)                                                            \
+  CASE(name) {                                                                 \
+    uint64_t address = uint64_t(instr.imm) + frame[instr.a].n32;               \
+    handle_store<OpCode::name>(memory_instance(instr.imm2), address,           \
+                               frame[instr.b]);                                \
+    NEXT();                                                                    \
+  }
 
+// All OpCodes used by register code, besides MEMORY_ACCESSES and
+// NUMERIC_INSTRUCTIONS
+// clang-format off
+#define REGISTER_OPCODES(X)                                                    \
+  X(Unreachable) X(If) X(Br) X(BrIf) X(BrTable) X(Return) X(Call)              \
+  X(CallIndirect) X(Select) X(Move) X(GlobalGet) X(GlobalSet) X(MemorySize)    \
+  X(MemoryGrow) X(MemoryInit) X(DataDrop) X(MemoryCopy) X(MemoryFill)        \
+  X(TableInit) X(ElemDrop) X(TableCopy)
+// clang-format on
+
+void Runtime::execute_registers(const RegisterCode &code, Value *frame,
+                                uint32_t start) {
+
+  const std::vector<RegInstr> &block = code.instrs;
+  int pc = start;
+
+#if WINTERP_THREADED_DISPATCH
+  // Filled exactly once, like the table of execute_block
+  static const void *dispatch_table[NUM_OPCODES];
+  static std::atomic<bool> dispatch_table_ready(false);
+
+  if (!dispatch_table_ready.load(std::memory_order_acquire)) {
+    static std::mutex dispatch_table_mutex;
+    std::lock_guard<std::mutex> lock(dispatch_table_mutex);
+    if (!dispatch_table_ready.load(std::memory_order_relaxed)) {
+      std::fill(dispatch_table, dispatch_table + NUM_OPCODES,
+                &&op_unimplemented);
+#define TABLE_ENTRY(name) dispatch_table[OpCode::name] = &&op_##name;
+#define NUMERIC_ENTRY(name, handler) TABLE_ENTRY(name)
+      REGISTER_OPCODES(TABLE_ENTRY)
+      MEMORY_ACCESSES(TABLE_ENTRY, TABLE_ENTRY)
+      NUMERIC_INSTRUCTIONS(NUMERIC_ENTRY, NUMERIC_ENTRY)
+#undef NUMERIC_ENTRY
+#undef TABLE_ENTRY
+      dispatch_table_ready.store(true, std::memory_order_release);
     }
-    else if(instr.op == MemoryInit) {
-      Immediate n = this->pop_stack();
-      Immediate j = this->pop_stack();
-      Immediate i = this->pop_stack();
+  }
 
-      uint32_t data_segment_index = instr.imms[0].v.n32;
-      assert(data_segment_index < data.size() && "invalid data segment index");
+  const RegInstr *current = &block[pc];
+#define instr (*current)
+  DISPATCH();
+#else
+  while (true) {
+    const RegInstr &instr = block[pc];
+    COUNT_DISPATCH();
 
-      for(int h = 0; h < n.v.n32; h++) {
-          uint32_t data_segment_byte_index = h+j.v.n32;
+    switch (instr.op) {
+#endif
 
-          assert(data_segment_byte_index < data[data_segment_index].bytes.size() && "invalid data segment byte index");
+  CASE(Unreachable) {
+    raise_trap(UNREACHABLE);
+  }
 
-          Immediate byte;
-          byte.t = ImmediateRepr::Byte;
-          byte.v.n32 = static_cast<uint32_t>(data[data_segment_index].bytes[data_segment_byte_index]);
+  CASE(If) {
+    if (frame[instr.a].n32) {
+      NEXT();
+    }
+    // jump behind the matching else, or to the end if there is none
+    pc = instr.imm;
+    JUMP();
+  }
 
-          uint32_t store_offset = i.v.n32 + h;
-          OpCode i32store8 = OpCode::I32Store8;
-          handle_store(i32store8, instr.imms[1].v.n32, store_offset, byte);
-      }
-    } else if(instr.op == DataDrop) {
-      uint32_t data_segment_index = instr.imms[0].v.n32;
-      assert(data_segment_index < data.size() && "invalid data segment index");
-      DataSegment& seg = data[data_segment_index];
-      // Drop bytes, TODO: future requests should trap 
-      seg.bytes.clear();
+  CASE(Br) {
+    frame[instr.dst] = frame[instr.a];
+    pc = instr.imm;
+    JUMP();
+  }
+
+  CASE(BrIf) {
+    if (frame[instr.b].n32 != 0) {
+      frame[instr.dst] = frame[instr.a];
+      pc = instr.imm;
+      JUMP();
     }
-    /* STORE Instructions */
-    else if (op_byte >= 0x36 && op_byte <= 0x3E) {
+    NEXT();
+  }
 
-      if (instr.imms.size() > 2) {
-        assert(false &&
-               "todo: there are 3 immediates to I32Store, special case.");
-      }
+  CASE(BrTable) {
+    // Use default, aka last label, for out of range indices
+    uint32_t num_labels = instr.imm2;
+    uint32_t i = frame[instr.a].n32;
+    uint32_t entry = i < num_labels ? i : num_labels;
 
-      Immediate x = instr.imms[0];
-      Immediate ao = instr.imms[1];
+    const RegTableEntry &target = code.br_tables[instr.imm + entry];
+    frame[target.dst] = frame[instr.b];
+    pc = target.pc;
+    JUMP();
+  }
+
+  CASE(Return) {
+    frame[0] = frame[instr.a];
+    this->sp = frame + instr.imm;
+    return;
+  }
 
-      Immediate c = this->pop_stack();
-      Immediate i = this->pop_stack();
+  CASE(Call) {
+    // The arguments are the topmost values of the callee's frame, its result
+    // replaces them
+    this->sp = frame + instr.a + instr.c;
+    execute_function(instr.imm);
+    NEXT();
+  }
 
-      uint32_t offset = ao.v.n32 + i.v.n32;
-      handle_store(instr.op, x.v.n32, offset, c);
+  CASE(CallIndirect) {
+    const TableEntry &entry = table_entry(frame[instr.b].n32, instr.imm);
+    this->sp = frame + instr.a + instr.c;
+    if (entry.registers != nullptr) {
+      execute_compiled(*entry.registers, nullptr);
+    } else {
+      execute_function(entry.function_index);
     }
-    /* Load operations */
-    else if (op_byte >= 0x28 && op_byte <= 0x35) {
+    NEXT();
+  }
 
-      if (instr.imms.size() > 2) {
-        assert(
-            false &&
-            "todo: there are 3 immediates to a load operation, special case.");
-      }
+  CASE(Select) {
+    frame[instr.dst] = frame[instr.c].n32 != 0 ? frame[instr.a] : frame[instr.b];
+    NEXT();
+  }
 
-      Immediate x = instr.imms[0];
-      Immediate ao = instr.imms[1];
+  CASE(Move) {
+    frame[instr.dst] = frame[instr.a];
+    NEXT();
+  }
 
-      Immediate i = this->pop_stack();
+  CASE(GlobalGet) {
+    frame[instr.dst] = globals[instr.imm].value.v;
+    NEXT();
+  }
 
-      uint32_t offset = ao.v.n32 + i.v.n32;
-      this->push_stack(handle_load(instr.op, x.v.n32, offset));
-    }
-    /* VARIABLE INSTRUCTIONS */
-    else if (instr.op == OpCode::LocalGet) {
-      // The parameters of the function are referenced through 0-based local
-      // indices in the function’s body; they are mutable.
+  CASE(GlobalSet) {
+    globals[instr.imm].value.v = frame[instr.a];
+    NEXT();
+  }
 
-      uint32_t index = instr.imms[0].v.n32;
+  MEMORY_ACCESSES(LOAD, STORE)
 
-      if (index < params.size()) {
-        this->push_stack(params[index]);
-      } else {
-        index = index - params.size();
-        assert(index < locals.size() && "LocalGet invalid local index!");
-        Immediate v = locals[index];
-        this->push_stack(locals[index]);
-      }
+  CASE(MemorySize) {
+    frame[instr.dst].n32 = memory_instance(instr.imm2).pages();
+    NEXT();
+  }
 
-    } else if (instr.op == OpCode::LocalSet) {
-      Immediate val = this->pop_stack();
+  CASE(MemoryGrow) {
+    frame[instr.dst].n32 = memory_grow(instr.imm2, frame[instr.a].n32);
+    NEXT();
+  }
 
-      uint32_t index = instr.imms[0].v.n32;
-      if (index < params.size()) {
-        params[index] = val;
-      } else {
-        index = index - params.size();
-        assert(index < locals.size() && " LocalSet invalid local index!");
-        locals[index] = val;
-      }
-    } else if (instr.op == OpCode::LocalTee) {
-      Immediate val = this->pop_stack();
+  CASE(MemoryFill) {
+    memory_fill(instr.imm, frame[instr.a].n32, frame[instr.b],
+                frame[instr.c].n32);
+    NEXT();
+  }
 
-      // Push twice, but executing LocalSet after will pop the last one again
-      this->push_stack(val);
+  CASE(MemoryCopy) {
+    memory_copy(instr.imm, instr.imm2, frame[instr.a].n32, frame[instr.b].n32,
+                frame[instr.c].n32);
+    NEXT();
+  }
 
-      uint32_t index = instr.imms[0].v.n32;
-      if (index < params.size()) {
-        params[index] = val;
-      } else {
-        index = index - params.size();
-        assert(index < locals.size() && " LocalSet invalid local index!");
-        locals[index] = val;
-      }
-    } else if (instr.op == OpCode::GlobalGet) {
-      uint32_t index = instr.imms[0].v.n32;
-      assert(index < globals.size() && "invalid globals access");
-      this->push_stack(globals[index].value);
-    } else if (instr.op == OpCode::GlobalSet) {
-      Immediate val = this->pop_stack();
-      uint32_t index = instr.imms[0].v.n32;
-
-      assert(index < globals.size() && "invalid globals access");
-      assert(globals[index].mut && "invalid set to globals");
-      assert(globals[index].value.t == val.t && "invalid type set to globals");
-
-      globals[index].value = val;
-    }
-    /* Convertion, Promotion, Demotion */
-    else if (op_byte >= 0xA7 && op_byte <= 0xBB) {
-      Immediate a = this->pop_stack();
-      this->push_stack(handle_conversion(instr.op, a));
-    }
-    /* UNOP NUMERIC INSTRUCTIONS */
-    else if (is_i32_numeric_unop || is_f32_numeric_unop ||
-             is_f64_numeric_unop || is_i64_numeric_unop) {
-      Immediate a = this->pop_stack();
-      Immediate b;
-      if (is_f32_numeric_unop) {
-        b = handle_numeric_unop_f32(instr.op, a);
-      } else if (is_f64_numeric_unop) {
-        b = handle_numeric_unop_f64(instr.op, a);
-      } else if (is_i32_numeric_unop) {
-        b = handle_numeric_unop_i32(instr.op, a);
-      } else if (is_i64_numeric_unop) {
-        b = handle_numeric_unop_i64(instr.op, a);
-      } else {
-        assert(false && "todo!");
-      }
-      this->push_stack(b);
-    }
-    /* BINOP NUMERIC INSTRUCTIONS */
-    else if (is_i32_numeric_binop || is_f32_numeric_binop ||
-             is_f64_numeric_binop || is_i64_numeric_binop) {
-      Immediate b = this->pop_stack();
-      Immediate a = this->pop_stack();
-
-      Immediate c;
-
-      if (is_i32_numeric_binop) {
-        c = handle_numeric_binop_i32(instr.op, a, b);
-      } else if (is_i64_numeric_binop) {
-        c = handle_numeric_binop_i64(instr.op, a, b);
-      } else if (is_f32_numeric_binop) {
-        c = handle_numeric_binop_f32(instr.op, a, b);
-      } else if (is_f64_numeric_binop) {
-        c = handle_numeric_binop_f64(instr.op, a, b);
-      } else {
-        assert(false && "todo!");
-      }
+  CASE(MemoryInit) {
+    memory_init(instr.imm, instr.imm2, frame[instr.a].n32, frame[instr.b].n32,
+                frame[instr.c].n32);
+    NEXT();
+  }
 
-      this->push_stack(c);
-    }
-    /* REINTERP */
-    else if (op_byte >= 0xBC && op_byte <= 0xBF) {
-      Immediate a = this->pop_stack();
-      Immediate result;
-      if (instr.op == I32ReinterpF32) {
-        result = reinterp(a, ImmediateRepr::F32, ImmediateRepr::I32);
-      } else if (instr.op == F32ReinterpI32) {
-        result = reinterp(a, ImmediateRepr::I32, ImmediateRepr::F32);
-      } else if (instr.op == I64ReinterpF64) {
-        result = reinterp(a, ImmediateRepr::F64, ImmediateRepr::I64);
-      } else if (instr.op == F64ReinterpI64) {
-        result = reinterp(a, ImmediateRepr::I64, ImmediateRepr::F64);
-      }
-      this->push_stack(result);
-    } else if (instr.op == OpCode::If) {
-      Immediate c = this->pop_stack();
-      if (c.v.n32) {
-        // execute first block
-      } else {
-        // execute second block
-        // find Else statement or end statement, ignore else/end statements of
-        // nested ifs!
-        skip_control_block(block, pc);
-        // dont include pc++ below, this would skip the next meaningfull op
-        continue;
-      }
-    } else if (instr.op == OpCode::Loop) {
-      const Immediate &bt = instr.imms[0];
-      assert(bt.v.n32 == 0x40 &&
-             "todo: only void as bt for loops currently supported.");
-
-    } else if (instr.op == OpCode::Block) {
-      assert((instr.imms[0].v.n32 == 0x7f || instr.imms[0].v.n32 == 0x40) &&
-             "todo: currently only i32 blocks or 'e' blocks are allowed.");
-      /* TODO: what is "val"? */
-      /* This needs to be popped from the stack */
-    } else if (instr.op == OpCode::Br) {
-      // Exit block!
-      const Immediate &label = instr.imms[0];
-      assert(label.t == ImmediateRepr::I32 && "todo: wrong type assumed.");
-
-      branch_block(block, pc, label.v.n32);
-      continue; // we do not want to include the last pc++; pc is already at the
-                // next instruction
-    } else if (instr.op == OpCode::BrIf) {
-
-      Immediate c = this->pop_stack();
-
-      if (c.v.n32 != 0) {
-        const Immediate &label = instr.imms[0];
-        assert(label.t == ImmediateRepr::I32 && "todo: wrong type assumed.");
-
-        branch_block(block, pc, label.v.n32);
-        continue; // we do not want to include the last pc++; pc is already at
-                  // the next instruction
-      } else {
-        // Do nothing
-      }
-    } else if (instr.op == OpCode::BrTable) {
+  CASE(DataDrop) {
+    data_drop(instr.imm);
+    NEXT();
+  }
+
+  CASE(TableInit) {
+    table_init(instr.imm, instr.imm2, frame[instr.a].n32, frame[instr.b].n32,
+               frame[instr.c].n32);
+    NEXT();
+  }
 
-      Immediate i = this->pop_stack();
+  CASE(ElemDrop) {
+    elem_drop(instr.imm);
+    NEXT();
+  }
 
-      assert(i.v.n32 < instr.imms.size());
+  CASE(TableCopy) {
+    table_copy(instr.imm, instr.imm2, frame[instr.a].n32, frame[instr.b].n32,
+               frame[instr.c].n32);
+    NEXT();
+  }
 
-      if (i.v.n32 < instr.imms.size() - 1) {
-        branch_block(block, pc, instr.imms[i.v.n32].v.n32);
-      } else {
-        // Use default, aka last item in immediates
-        branch_block(block, pc, instr.imms.back().v.n32);
-      }
-      continue;
+  NUMERIC_INSTRUCTIONS(UNOP, BINOP)
 
-    } else if (instr.op == OpCode::Return) {
-      break;
-    } else {
+#if WINTERP_THREADED_DISPATCH
+op_unimplemented:
+  assert(false && "todo: implement new opcode emulation");
+  NEXT();
+#undef instr
+#else
+    default:
       assert(false && "todo: implement new opcode emulation");
+      NEXT();
     }
+  }
+#endif
+}
 
-    pc++;
+#undef CASE
+#undef DISPATCH
+#undef NEXT
+#undef JUMP
+#undef UNOP
+#undef BINOP
+#undef LOAD
+#undef STORE
+#undef COUNT_DISPATCH
+#undef REGISTER_OPCODES
+
+// execute_register_instruction runs the same handlers as execute_registers,
+// for a single instruction
+#define SINGLE_UNOP(name, handler)                                             \
+  case OpCode::name:                                                           \
+    frame[instr.dst] = handler<OpCode::name>(frame[instr.a]);                  \
+    return;
+
+#define SINGLE_BINOP(name, handler)                                            \
+  case OpCode::name:                                                           \
+    frame[instr.dst] = handler<OpCode::name>(frame[instr.a], frame[instr.b]);  \
+    return;
+
+#define SINGLE_LOAD(name)                                                      \
+  case OpCode::name:                                                           \
+    frame[instr.dst] = handle_load<OpCode::name>(                              \
+        memory_instance(instr.imm2), uint64_t(instr.imm) + frame[instr.a].n32); \
+    return;
+
+#define SINGLE_STORE(name)                                                     \
+  case OpCode::name:                                                           \
+    handle_store<OpCode::name>(memory_instance(instr.imm2),                    \
+                               uint64_t(instr.imm) + frame[instr.a].n32,       \
+                               frame[instr.b]);                                \
+    return;
+
+void Runtime::execute_register_instruction(const RegInstr &instr,
+                                           Value *frame) {
+  switch (instr.op) {
+  case OpCode::Unreachable:
+    raise_trap(UNREACHABLE);
+  case OpCode::Move:
+    frame[instr.dst] = frame[instr.a];
+    return;
+  case OpCode::Select:
+    frame[instr.dst] = frame[instr.c].n32 != 0 ? frame[instr.a] : frame[instr.b];
+    return;
+  case OpCode::GlobalGet:
+    frame[instr.dst] = globals[instr.imm].value.v;
+    return;
+  case OpCode::GlobalSet:
+    globals[instr.imm].value.v = frame[instr.a];
+    return;
+  case OpCode::MemorySize:
+    frame[instr.dst].n32 = memory_instance(instr.imm2).pages();
+    return;
+  case OpCode::MemoryGrow:
+    frame[instr.dst].n32 = memory_grow(instr.imm2, frame[instr.a].n32);
+    return;
+  case OpCode::MemoryFill:
+    memory_fill(instr.imm, frame[instr.a].n32, frame[instr.b],
+                frame[instr.c].n32);
+    return;
+  case OpCode::MemoryCopy:
+    memory_copy(instr.imm, instr.imm2, frame[instr.a].n32, frame[instr.b].n32,
+                frame[instr.c].n32);
+    return;
+  case OpCode::MemoryInit:
+    memory_init(instr.imm, instr.imm2, frame[instr.a].n32, frame[instr.b].n32,
+                frame[instr.c].n32);
+    return;
+  case OpCode::DataDrop:
+    data_drop(instr.imm);
+    return;
+  case OpCode::TableInit:
+    table_init(instr.imm, instr.imm2, frame[instr.a].n32, frame[instr.b].n32,
+               frame[instr.c].n32);
+    return;
+  case OpCode::ElemDrop:
+    elem_drop(instr.imm);
+    return;
+  case OpCode::TableCopy:
+    table_copy(instr.imm, instr.imm2, frame[instr.a].n32, frame[instr.b].n32,
+               frame[instr.c].n32);
+    return;
+  MEMORY_ACCESSES(SINGLE_LOAD, SINGLE_STORE)
+  NUMERIC_INSTRUCTIONS(SINGLE_UNOP, SINGLE_BINOP)
+  default:
+    assert(false && "todo: implement new opcode emulation");
   }
 }
 
-void Runtime::execute_block(const std::vector<Instr> &block) {
-  std::vector<Immediate> params;
-  std::vector<Immediate> locals;
-  execute_block(block, params, locals);
+#undef SINGLE_UNOP
+#undef SINGLE_BINOP
+#undef SINGLE_LOAD
+#undef SINGLE_STORE
+
+void jit_call(JitContext *context, uint32_t function_index, Value *args_end) {
+  Runtime &runtime = *context->runtime;
+  runtime.sp = args_end;
+  runtime.execute_function(function_index);
+}
+
+void jit_call_indirect(JitContext *context, uint32_t table_index,
+                       Value *args_end, uint32_t type_index) {
+  Runtime &runtime = *context->runtime;
+  const TableEntry &entry = runtime.table_entry(table_index, type_index);
+  runtime.sp = args_end;
+  if (entry.registers != nullptr) {
+    runtime.execute_compiled(*entry.registers, entry.jit);
+  } else {
+    runtime.execute_function(entry.function_index);
+  }
+}
+
+void jit_execute(JitContext *context, const RegInstr *instr, Value *frame) {
+  context->runtime->execute_register_instruction(*instr, frame);
+}
+
+void jit_trap(Trap trap) { raise_trap(trap); }
+
+Immediate Runtime::evaluate_constant_expr(const std::vector<Instr> &expr) {
+  // Constant expressions consist of a single const or global.get
+  // https://webassembly.github.io/spec/core/valid/instructions.html#constant-expressions
+  assert(expr.size() == 1 && "todo: unsupported constant expression");
+  const Instr &instr = expr[0];
+
+  if (instr.op == OpCode::I32Const || instr.op == OpCode::F32Const ||
+      instr.op == OpCode::I64Const || instr.op == OpCode::F64Const) {
+    return instr.value;
+  } else if (instr.op == OpCode::GlobalGet) {
+    uint32_t index = instr.imm;
+    assert(index < globals.size() && "invalid globals access");
+    return globals[index].value;
+  }
+
+  assert(false && "invalid constant expression");
+  return Immediate{};
 }
 
 
@@ -1159,19 +1496,23 @@ void Runtime::execute_import(int function_index) {
 
   /* TODO: do fancy lookeup, but currently only support fd_write */
 
-  Immediate nwritten = pop_stack();
-  Immediate iovs_len = pop_stack();
-  Immediate iovs_ptr = pop_stack();
-  Immediate fd = pop_stack();
+  Value nwritten = pop_stack();
+  Value iovs_len = pop_stack();
+  Value iovs_ptr = pop_stack();
+  Value fd = pop_stack();
 
   uint32_t written = 0;
 
-  for(int i = 0; i < iovs_len.v.n32; i++) {
-    Immediate base_addr = read_memory(0, iovs_ptr.v.n32 + i*8, ImmediateRepr::I32);
-    Immediate len = read_memory(0, iovs_ptr.v.n32 + i*8 + 4, ImmediateRepr::I32);
+  for(int i = 0; i < iovs_len.n32; i++) {
+    Immediate base_addr = read_memory(0, iovs_ptr.n32 + i*8, ImmediateRepr::I32);
+    Immediate len = read_memory(0, iovs_ptr.n32 + i*8 + 4, ImmediateRepr::I32);
 
+    // Checked up front, the string would leak if the copy faulted
+    if (uint64_t(base_addr.v.n32) + len.v.n32 > memory.size()) {
+      raise_trap(MEMORY_OUT_OF_BOUNDS);
+    }
     std::string chunk(&this->memory[base_addr.v.n32], &this->memory[base_addr.v.n32 + len.v.n32]);
-    if(fd.v.n32 == 1) {
+    if(fd.n32 == 1) {
       std::cout << chunk << std::endl;
     } else {
       std::cerr << chunk << std::endl;
@@ -1182,11 +1523,10 @@ void Runtime::execute_import(int function_index) {
   Immediate written_result;
   written_result.t = ImmediateRepr::I32;
   written_result.v .n32= written;
-  write_memory(0, nwritten.v.n32,  written_result);
+  write_memory(0, nwritten.n32,  written_result);
 
-  Immediate success;
-  success.t = ImmediateRepr::I32;
-  success.v.n32 = 0;
+  Value success;
+  success.n32 = 0;
   push_stack(success);
 }
 
@@ -1198,37 +1538,100 @@ void Runtime::execute_function(int function_index) {
     function_index -= wasm.imports.size();
   }
 
+  Interpreter tier = interpreter;
+  FunctionProfile *profile = nullptr;
+  if (tier == TIERED) {
+    profile = &profiles[function_index];
+    profile->calls++;
+    if (profile->tier == STACK_INTERPRETER &&
+        profile->calls + profile->back_edges >= tier_up_threshold) {
+      tier_up(function_index);
+    }
+    tier = profile->tier;
+  }
+
+  if (tier != STACK_INTERPRETER) {
+    // Already translated by the constructor unless the module is lazy, or by
+    // tier_up. This saves synchronising on every call.
+    bool translated = interpreter == TIERED || !wasm.lazy_code;
+    const RegisterCode &code = translated
+                                   ? wasm.register_codes[function_index]
+                                   : wasm.register_code(function_index);
+    const JitFunction *jit = nullptr;
+    if (tier == JIT_COMPILER) {
+      jit = translated ? &wasm.jit_functions[function_index]
+                       : &wasm.jit_function(function_index);
+    }
+    execute_compiled(code, jit);
+    return;
+  }
+
   // Again, assumes all indices are valid...
-  const Code &block = wasm.codes[function_index];
+  const Code &block = wasm.function_code(function_index);
+  if (profile != nullptr && profile->loop_back_edges.empty()) {
+    profile->loop_back_edges.resize(block.loops.size());
+  }
 
-  typeidx function_signature_index = wasm.function_section[function_index];
+  execute_code(block, profile);
+}
 
-  // important for stack information
-  const FunctionType &signature = wasm.type_section[function_signature_index];
+void Runtime::execute_compiled(const RegisterCode &code,
+                               const JitFunction *jit) {
+  // The arguments become the first locals, as for the stack interpreter
+  Value *frame = this->sp - code.num_params;
+  check_stack(frame + code.frame_size);
 
-  /* Pop Stack based on signature params */
-  std::vector<Immediate> params(signature.params.size());
-  // Go in reverse, first popped is actually last param!
-  // how did i get this far without noticing problems in the first 65 tests...
-  for (int i = signature.params.size() - 1; i >= 0; i--) {
-    params[i] = this->pop_stack();
+  std::memset(this->sp, 0, code.num_locals * sizeof(Value));
+  std::copy(code.constants.begin(), code.constants.end(),
+            frame + code.constants_slot);
+  this->sp = frame + code.frame_size;
+
+  if (jit == nullptr || jit->entry == nullptr) {
+    execute_registers(code, frame);
+    return;
   }
 
-  /* Prepare Locals */
-  std::vector<Immediate> locals;
-  for (auto &local : block.locals) {
-    for (int j = 0; j < local.count; j++) {
-      Immediate l;
-      l.t = local.type;
-      l.v.n64 = 0;
-      locals.push_back(l);
-    }
+  jit->entry(&jit_context, frame);
+  this->sp = frame + code.num_results;
+}
+
+void Runtime::execute_code(const Code &code, FunctionProfile *profile) {
+  // The arguments stay where the caller pushed them and become the first
+  // locals of the frame. The declared locals follow them, zero initialised.
+  Value *locals = this->sp - code.num_params;
+  check_stack(this->sp + code.num_locals + SCRATCH_SLOTS + code.max_height);
+
+  std::memset(this->sp, 0, code.num_locals * sizeof(Value));
+  this->sp += code.num_locals;
+
+  execute_block(code, locals, profile);
+}
+
+const TableEntry &Runtime::table_entry(uint32_t table_index,
+                                       uint32_t type_index) {
+  if (table_index >= this->function_table.size()) {
+    raise_trap(UNDEFINED_ELEMENT);
   }
+  const TableEntry &entry = this->function_table[table_index];
+  if (entry.type_id != wasm.type_ids[type_index]) {
+    raise_trap(entry.type_id == NULL_ENTRY ? UNINITIALIZED_ELEMENT
+                                           : INDIRECT_CALL_TYPE_MISMATCH);
+  }
+  return entry;
+}
 
-  execute_block(block.expr, params, locals);
+void Runtime::check_stack(const Value *frame_end) {
+  char native_frame;
+  if (frame_end > this->stack.get() + STACK_SLOTS ||
+      reinterpret_cast<uintptr_t>(&native_frame) < native_stack_limit) {
+    raise_trap(CALL_STACK_EXHAUSTED);
+  }
 }
 
-void Runtime::run(std::string &function) {
+Trap Runtime::run(std::string &function) {
+  if (instantiation_trap != NO_TRAP) {
+    return instantiation_trap;
+  }
 
   // Lookup function in exports by string,
   // a HashMap could be more efficient as a loop, but this depends on how many
@@ -1248,5 +1651,17 @@ void Runtime::run(std::string &function) {
   // assumes wasm is well structured with indices, otherwise might crash
   // Code c contains the assembly of the requested function to run
   int function_index = this->wasm.exports[export_index].idx;
+
+  Value *stack_base = sp;
+  char native_frame;
+  native_stack_limit =
+      reinterpret_cast<uintptr_t>(&native_frame) - NATIVE_STACK_SIZE;
+  TrapBoundary boundary(memories);
+  if (WINTERP_SETJMP(boundary.env) != 0) {
+    // Whatever the trapped function left on the stack is dropped
+    sp = stack_base;
+    return boundary.trap;
+  }
   this->execute_function(function_index);
+  return NO_TRAP;
 }
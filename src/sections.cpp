@@ -1,9 +1,19 @@
+#include "branches.hpp"
+#include "fusion.hpp"
 #include "instructions.hpp"
+#include "jit.hpp"
 #include "leb128.hpp"
+#include "registers.hpp"
 #include "sections.hpp"
+#include "simplify.hpp"
+#include "trap.hpp"
+#include "validator.hpp"
 #include <cassert>
 #include <iostream>
-#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
 
 bool is_valid_heap_type(uint8_t type) {
   return
@@ -46,7 +56,7 @@ const char *section_name(uint8_t section) {
   }
 }
 
-ImmediateRepr WasmFile::read_valtype(const uint8_t* &ptr, const uint8_t* end) {
+ImmediateRepr WasmFile::read_valtype(const uint8_t* &ptr, const uint8_t* end) const {
     uint32_t valtype = uleb128_decode<uint32_t>(ptr, end);
 
     if (valtype != 0x7C && valtype != 0x7D && valtype != 0x7E &&
@@ -59,7 +69,7 @@ ImmediateRepr WasmFile::read_valtype(const uint8_t* &ptr, const uint8_t* end) {
   return static_cast<ImmediateRepr>(valtype);
 }
 
-void WasmFile::parse_type_section(const std::vector<uint8_t> &data) {
+void WasmFile::parse_type_section(ByteView data) {
   const uint8_t *ptr = &data[0];
   const uint8_t *end = data.data() + data.size();
   const int num_types = uleb128_decode<uint32_t>(ptr, end);
@@ -100,21 +110,30 @@ void WasmFile::parse_type_section(const std::vector<uint8_t> &data) {
 
     this->type_section[i] = f;
   }
+
+  // Interns the types, quadratic in their number but modules declare few
+  this->type_ids.resize(num_types);
+  for (int i = 0; i < num_types; i++) {
+    const FunctionType &type = this->type_section[i];
+    int j = 0;
+    while (type.params != this->type_section[j].params ||
+           type.return_value != this->type_section[j].return_value) {
+      j++;
+    }
+    this->type_ids[i] = j;
+  }
 }
 
-void WasmFile::parse_functions(const std::vector<uint8_t> &data) {
+void WasmFile::parse_functions(ByteView data) {
   const uint8_t *ptr = &data[0];
   const uint8_t *end = data.data() + data.size();
   const int num_functions = uleb128_decode<uint32_t>(ptr, end);
 
   this->function_section.resize(num_functions);
-
-  for (int i = 0; i < num_functions; i++) {
-    this->function_section[i] = uleb128_decode<uint32_t>(ptr, end);
-  }
+  uleb128_decode_u32s(ptr, end, function_section.data(), num_functions);
 }
 
-void WasmFile::parse_memory(const std::vector<uint8_t> &data) {
+void WasmFile::parse_memory(ByteView data) {
   const uint8_t *ptr = &data[0];
   const uint8_t *end = data.data() + data.size();
   const int num_memories = uleb128_decode<uint32_t>(ptr, end);
@@ -135,7 +154,7 @@ void WasmFile::parse_memory(const std::vector<uint8_t> &data) {
 }
 
 
-void WasmFile::parse_global(const std::vector<uint8_t> &data) {
+void WasmFile::parse_global(ByteView data) {
   const uint8_t *ptr = &data[0];
   const uint8_t *end = data.data() + data.size();
   const int num_globals = uleb128_decode<uint32_t>(ptr, end);
@@ -153,7 +172,7 @@ void WasmFile::parse_global(const std::vector<uint8_t> &data) {
   }
 }
 
-void WasmFile::parse_exports(const std::vector<uint8_t> &data) {
+void WasmFile::parse_exports(ByteView data) {
   const uint8_t *ptr = &data[0];
   const uint8_t *end = data.data() + data.size();
   const int num_exports = uleb128_decode<uint32_t>(ptr, end);
@@ -174,33 +193,185 @@ void WasmFile::parse_exports(const std::vector<uint8_t> &data) {
   }
 }
 
-void WasmFile::parse_code(const std::vector<uint8_t> &data) {
+// Gives the loads and stores of memories other than 0 their indexed OpCodes
+static void index_memory_accesses(Code &code) {
+  for (Instr &instr : code.expr) {
+    if (instr.imm == 0) {
+      continue;
+    }
+    switch (instr.op) {
+#define INDEXED_ACCESS_CASE(name)                                              \
+  case OpCode::name:                                                           \
+    instr.op = OpCode::name##Indexed;                                          \
+    break;
+      MEMORY_ACCESSES(INDEXED_ACCESS_CASE, INDEXED_ACCESS_CASE)
+#undef INDEXED_ACCESS_CASE
+    default:
+      break;
+    }
+  }
+}
+
+bool WasmFile::parse_function_body(uint32_t index,
+                                   ValidationError &error) const {
+  const ByteView body = codes[index].body;
+  const uint8_t *ptr = body.begin();
+  const uint8_t *end = body.end();
+  uint32_t locals = uleb128_decode<uint32_t>(ptr, end);
+
+  // Summed up in 64 bits, such that huge counts can not wrap around
+  auto too_many_locals = [&](uint64_t num_locals) {
+    if (num_locals <= MAX_LOCALS) {
+      return false;
+    }
+    error.message = "too many locals";
+    error.function = imports.size() + index;
+    error.pc = 0;
+    return true;
+  };
+  // Every declaration takes at least two bytes
+  if (locals > body.size() / 2) {
+    too_many_locals(UINT64_MAX);
+    return false;
+  }
+
+  Code c;
+  c.body = body;
+  c.locals.resize(locals);
+
+  uint64_t num_locals = 0;
+  for(uint32_t j = 0; j < locals; j++) {
+    c.locals[j].count = uleb128_decode<uint32_t>(ptr, end);
+    c.locals[j].type = read_valtype(ptr, end);
+    num_locals += c.locals[j].count;
+    if (too_many_locals(num_locals)) {
+      return false;
+    }
+  }
+  c.num_locals = num_locals;
+
+  read_expr(ptr, end, c.expr, c.br_tables);
+
+  if (!validate_function(*this, index, c, error)) {
+    return false;
+  }
+
+  c.decoded_size = c.expr.size();
+  if (simplify) {
+    simplify_code(c);
+  }
+
+  const FunctionType &signature = type_section[function_section[index]];
+  c.num_params = signature.params.size();
+  resolve_branches(*this, signature, c);
+  index_memory_accesses(c);
+  if (superinstructions) {
+    fuse_instructions(c);
+  }
+
+  // Bodies are never modified after loading, drop the unused capacity
+  c.expr.shrink_to_fit();
+  c.br_tables.shrink_to_fit();
+
+  this->codes[index] = std::move(c);
+  return true;
+}
+
+// Below this many bytes of code per thread, starting a thread costs more
+// than decoding the bodies
+const size_t MIN_CODE_BYTES_PER_THREAD = 64 * 1024;
+
+// Number of bodies a thread decodes at once, before taking the next ones
+const uint32_t BODIES_PER_CHUNK = 16;
+
+void WasmFile::parse_code(ByteView data) {
   const uint8_t *ptr = &data[0];
   const uint8_t *end = data.data() + data.size();
-  const int num_functions = uleb128_decode<uint32_t>(ptr, end);
+  const uint32_t num_functions = uleb128_decode<uint32_t>(ptr, end);
   this->codes.resize(num_functions);
 
-  for(int i = 0; i < num_functions; i++) {
+  // Every body is prefixed by its size, hence all bodies can be located
+  // without decoding them. They are then independent of each other.
+  for(uint32_t i = 0; i < num_functions; i++) {
     uint32_t func_body_size = uleb128_decode<uint32_t>(ptr, end);
-    uint32_t locals = uleb128_decode<uint32_t>(ptr, end);
+    assert(func_body_size <= end - ptr && "function body out of bounds");
+    this->codes[i].body = ByteView(ptr, func_body_size);
+    ptr += func_body_size;
+  }
 
-    Code c;
-    c.locals.resize(locals);
+  // Only translated once a function runs in the register interpreter or is
+  // compiled
+  this->register_codes.resize(num_functions);
+  this->register_translated.reset(new std::once_flag[num_functions]);
+  this->jit_functions.resize(num_functions);
+  this->jit_compiled.reset(new std::once_flag[num_functions]);
+
+  if (lazy_code) {
+    // Decoded by function_code once a function is used
+    this->code_decoded.reset(new std::once_flag[num_functions]);
+    return;
+  }
 
-    for(int j = 0; j < locals; j++) {
-      c.locals[j].count = uleb128_decode<uint32_t>(ptr, end);
-      c.locals[j].type = read_valtype(ptr, end);
+  unsigned threads = parse_threads;
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min<size_t>(threads,
+                               data.size() / MIN_CODE_BYTES_PER_THREAD + 1);
+  }
+  threads = std::min<size_t>(threads, (size_t(num_functions) +
+                                       BODIES_PER_CHUNK - 1) / BODIES_PER_CHUNK);
+
+  if (threads <= 1) {
+    for(uint32_t i = 0; i < num_functions; i++) {
+      if (!parse_function_body(i, validation_error)) {
+        return;
+      }
     }
+    return;
+  }
+
+  // Every body is written to its own slot in codes, hence the result does
+  // not depend on which thread decodes which body.
+  // Of several invalid bodies, the first one is reported like when decoding
+  // serially.
+  std::atomic<uint32_t> next_chunk(0);
+  std::mutex error_mutex;
+  uint32_t first_invalid = UINT32_MAX;
+  auto worker = [&]() {
+    ValidationError error;
+    while (true) {
+      uint32_t first = next_chunk.fetch_add(BODIES_PER_CHUNK);
+      if (first >= num_functions) {
+        return;
+      }
 
-    read_expr(ptr, end, c.expr);
+      uint32_t last = std::min<uint32_t>(first + BODIES_PER_CHUNK, num_functions);
+      for (uint32_t i = first; i < last; i++) {
+        if (!parse_function_body(i, error)) {
+          std::lock_guard<std::mutex> lock(error_mutex);
+          if (i < first_invalid) {
+            first_invalid = i;
+            validation_error = error;
+          }
+        }
+      }
+    }
+  };
 
-    this->codes[i] = c;
+  // The calling thread decodes as well
+  std::vector<std::thread> pool;
+  for (unsigned t = 1; t < threads; t++) {
+    pool.emplace_back(worker);
   }
+  worker();
 
+  for (std::thread &thread : pool) {
+    thread.join();
+  }
 }
 
 
-void WasmFile::parse_table(const std::vector<uint8_t> &data) {
+void WasmFile::parse_table(ByteView data) {
   const uint8_t *ptr = &data[0];
   const uint8_t *end = data.data() + data.size();
   const int num_tables = uleb128_decode<uint32_t>(ptr, end);
@@ -225,7 +396,7 @@ void WasmFile::parse_table(const std::vector<uint8_t> &data) {
 }
 
 
-void WasmFile::parse_elems(const std::vector<uint8_t> &data) {
+void WasmFile::parse_elems(ByteView data) {
   const uint8_t *ptr = &data[0];
   const uint8_t *end = data.data() + data.size();
   const int num_elem_segments = uleb128_decode<uint32_t>(ptr, end);
@@ -233,23 +404,29 @@ void WasmFile::parse_elems(const std::vector<uint8_t> &data) {
 
   for (int i = 0; i < num_elem_segments; i++) {
 
-    uint8_t flag = read_byte(ptr, end);
-    assert(flag == 0x00 && "todo: currently only supporting elems with flag 0x00");
-    
     Element elem;
-    read_expr(ptr, end, elem.expr);
+    elem.flag = read_byte(ptr, end);
+    if (elem.flag == ELEM_ACTIVE) {
+      read_expr(ptr, end, elem.expr);
+    } else if (elem.flag == ELEM_PASSIVE || elem.flag == ELEM_DECLARATIVE) {
+      uint8_t elemkind = read_byte(ptr, end);
+      assert(elemkind == 0x00 && "only funcref element segments exist");
+      (void)elemkind;
+    } else {
+      assert(false && "todo: currently only supporting elems with flag 0, 1 "
+                      "and 3");
+    }
 
     const int num_elems = uleb128_decode<uint32_t>(ptr, end);
-    for(int j = 0; j < num_elems; j++) {
-      elem.function_indices.push_back(uleb128_decode<uint32_t>(ptr, end));
-    }
+    elem.function_indices.resize(num_elems);
+    uleb128_decode_u32s(ptr, end, elem.function_indices.data(), num_elems);
 
     this->elems[i] = elem;
     
   }
 }
 
-void WasmFile::parse_data(const std::vector<uint8_t> &data) {
+void WasmFile::parse_data(ByteView data) {
   const uint8_t *ptr = &data[0];
   const uint8_t *end = data.data() + data.size();
   const int num_data_segments = uleb128_decode<uint32_t>(ptr, end);
@@ -258,22 +435,26 @@ void WasmFile::parse_data(const std::vector<uint8_t> &data) {
   for (int i = 0; i < num_data_segments; i++) {
     DataSegment data;
     data.flag = uleb128_decode<uint32_t>(ptr, end);
-    if(data.flag == 0) {
+    data.memidx = 0;
+    if(data.flag == DATA_ACTIVE) {
       read_expr(ptr, end, data.expr);
-      uint32_t num_bytes = uleb128_decode<uint32_t>(ptr, end);
-      for(int j = 0; j < num_bytes; j++) {
-        data.bytes.push_back(read_byte(ptr, end));
-      }
-    } else {
+    } else if (data.flag == DATA_ACTIVE_MEMORY) {
+      data.memidx = uleb128_decode<uint32_t>(ptr, end);
+      read_expr(ptr, end, data.expr);
+    } else if (data.flag != DATA_PASSIVE) {
       assert(false && "todo: read in other data format.");
     }
+    uint32_t num_bytes = uleb128_decode<uint32_t>(ptr, end);
+    assert(num_bytes <= end - ptr && "data segment out of bounds");
+    data.bytes = ByteView(ptr, num_bytes);
+    ptr += num_bytes;
 
     this->data[i] = data;
   }
 
 }
 
-void WasmFile::parse_imports(const std::vector<uint8_t> &data) {
+void WasmFile::parse_imports(ByteView data) {
   const uint8_t *ptr = &data[0];
   const uint8_t *end = data.data() + data.size();
   const int num_imports = uleb128_decode<uint32_t>(ptr, end);
@@ -298,41 +479,132 @@ void WasmFile::parse_imports(const std::vector<uint8_t> &data) {
 }
 
 
+const Code &WasmFile::function_code(uint32_t code_index) const {
+  if (code_decoded) {
+    // Whichever caller comes first decodes the body, all others wait for it
+    // and then see the complete Code
+    std::call_once(code_decoded[code_index], [this, code_index]() {
+      ValidationError error;
+      if (!parse_function_body(code_index, error)) {
+        codes[code_index].error = error;
+      }
+    });
+    // Function bodies of lazy modules are only validated when they are used,
+    // the caller is running one and hence inside a TrapBoundary
+    if (!codes[code_index].error.message.empty()) {
+      raise_trap(INVALID_FUNCTION);
+    }
+  }
+  return codes[code_index];
+}
+
+const RegisterCode &WasmFile::register_code(uint32_t code_index) const {
+  if (code_decoded) {
+    // Invalid bodies trap here, not while translating them, which must not
+    // leave the call_once below with a longjmp
+    function_code(code_index);
+  }
+  std::call_once(register_translated[code_index], [this, code_index]() {
+    translate_registers(*this, code_index, register_codes[code_index]);
+  });
+  return register_codes[code_index];
+}
+
+const JitFunction &WasmFile::jit_function(uint32_t code_index) const {
+  if (code_decoded) {
+    function_code(code_index);
+  }
+  std::call_once(jit_compiled[code_index], [this, code_index]() {
+    compile_function(register_code(code_index), jit_functions[code_index]);
+  });
+  return jit_functions[code_index];
+}
+
+const FunctionType &WasmFile::function_type(uint32_t function_index) const {
+  // Imported functions come first in the function index space
+  if (function_index < imports.size()) {
+    return type_section[imports[function_index].signature_index];
+  }
+  return type_section[function_section[function_index - imports.size()]];
+}
+
+uint32_t WasmFile::function_type_id(uint32_t function_index) const {
+  if (function_index < imports.size()) {
+    return type_ids[imports[function_index].signature_index];
+  }
+  return type_ids[function_section[function_index - imports.size()]];
+}
+
+void WasmFile::parse_data_count(ByteView data) {
+  const uint8_t *ptr = data.begin();
+  const uint8_t *end = data.end();
+  this->data_count = uleb128_decode<uint32_t>(ptr, end);
+  this->has_data_count = true;
+}
+
+void WasmFile::parse_custom(ByteView data) {
+  const uint8_t *ptr = data.begin();
+  const uint8_t *end = data.end();
+
+  CustomSection custom;
+  const uint32_t name_length = uleb128_decode<uint32_t>(ptr, end);
+  assert(name_length <= end - ptr && "custom section name out of bounds");
+  custom.name = std::string(ptr, ptr + name_length);
+  ptr += name_length;
+  custom.bytes = ByteView(ptr, end - ptr);
+
+  this->custom_sections.push_back(custom);
+}
+
 int WasmFile::read(const char* file_name) {
-  
-  std::ifstream file(file_name, std::ios::binary);
+  file = MappedFile::open(file_name);
 
   if (!file) {
     std::cerr << "unable to open " << file_name << std::endl;
     return 1;
   }
 
-  std::vector<uint8_t> header(8); // Read Magic and Version
-  file.read((char *)header.data(), header.size());
-  if (file.gcount() != 8) {
-    std::cerr << file_name << "corruped file" << std::endl;
+  return parse(file->data(), file->size());
+}
+
+int WasmFile::read_from_memory(const uint8_t *bytes, size_t size) {
+  file = nullptr;
+  return parse(bytes, size);
+}
+
+int WasmFile::parse(const uint8_t *bytes, size_t size) {
+  const uint8_t *ptr = bytes;
+  const uint8_t *end = bytes + size;
+
+  // Magic and Version
+  if (size < 8) {
+    std::cerr << "corrupted file" << std::endl;
     return 1;
   }
 
   const unsigned char expected_magic[4] = {0x00, 0x61, 0x73, 0x6D};
-  if (!std::equal(header.begin(), header.begin() + 4, expected_magic)) {
+  if (!std::equal(ptr, ptr + 4, expected_magic)) {
     std::cerr << "is not a valid WebAssembly binary file" << std::endl;
     return 1;
   }
+  ptr += 8;
 
   // Section information based on
   // https://webassembly.github.io/spec/core/binary/modules.html
 
-  uint8_t section_id;
-  uint32_t section_size;
+  while (ptr != end) {
+    uint8_t section_id = read_byte(ptr, end);
+    uint32_t section_size = uleb128_decode<uint32_t>(ptr, end);
 
-  do {
-    file.read((char *)&section_id, sizeof(section_id));
-    section_size = file_uleb128_u32t(file);
+    if (section_size > end - ptr) {
+      std::cerr << "corrupted " << section_name(section_id) << " section"
+                << std::endl;
+      return 1;
+    }
 
-    // assumes code files are not larger that working memory...
-    std::vector<uint8_t> section_data(section_size);
-    file.read((char *)section_data.data(), section_size);
+    // Sections are parsed directly from the module's bytes
+    ByteView section_data(ptr, section_size);
+    ptr += section_size;
 
     // TODO: lookup table? only more ergonomic...
     if (section_id == TYPE_SECTION) {
@@ -352,16 +624,35 @@ int WasmFile::read(const char* file_name) {
     } else if(section_id == ELEMENT_SECTION) {
       parse_elems(section_data);
     } else if(section_id == DATA_COUNT_SECTION) {
-      // TODO: Good for validation
+      parse_data_count(section_data);
     } else if(section_id == DATA_SECTION) {
        parse_data(section_data); 
     } else if(section_id == IMPORT_SECTION) {
        parse_imports(section_data); 
+    } else if(section_id == CUSTOM_SECTION) {
+       parse_custom(section_data);
     }else {
       assert(false && "todo");
     }
 
-  } while (file.peek() != EOF);
+    if (!validation_error.message.empty()) {
+      break;
+    }
+  }
+
+  if (validation_error.message.empty()) {
+    validate_module(*this, validation_error);
+  }
+
+  if (!validation_error.message.empty()) {
+    std::cerr << "invalid module: " << validation_error.message;
+    if (validation_error.function != NO_FUNCTION) {
+      std::cerr << " (function " << validation_error.function
+                << ", instruction " << validation_error.pc << ")";
+    }
+    std::cerr << std::endl;
+    return 1;
+  }
 
   return 0;
 }
@@ -0,0 +1,247 @@
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "instructions.hpp"
+#include "numeric.hpp"
+#include "sections.hpp"
+#include "simplify.hpp"
+#include "validator.hpp"
+
+const uint32_t NO_SKIP = UINT32_MAX;
+
+static bool is_const(OpCode op) {
+  return op == OpCode::I32Const || op == OpCode::I64Const ||
+         op == OpCode::F32Const || op == OpCode::F64Const;
+}
+
+static OpCode const_opcode(ImmediateRepr type) {
+  switch (type) {
+  case ImmediateRepr::I64:
+    return OpCode::I64Const;
+  case ImmediateRepr::F32:
+    return OpCode::F32Const;
+  case ImmediateRepr::F64:
+    return OpCode::F64Const;
+  default:
+    return OpCode::I32Const;
+  }
+}
+
+// Whether the instruction traps for some operands, it is never folded
+static bool may_trap(OpCode op) {
+  return (op >= OpCode::I32DivS && op <= OpCode::I32RemU) ||
+         (op >= OpCode::I64DivS && op <= OpCode::I64RemU) ||
+         (op >= OpCode::I32TruncSF32 && op <= OpCode::I32TruncUF64) ||
+         (op >= OpCode::I64TruncSF32 && op <= OpCode::I64TruncUF64);
+}
+
+// Computes a numeric instruction like the interpreters, b is ignored by unops.
+// Returns false for instructions without a handler.
+static bool evaluate(OpCode op, Value a, Value b, Value &result) {
+  switch (op) {
+#define EVALUATE_UNOP(name, handler)                                           \
+  case OpCode::name:                                                           \
+    result = handler<OpCode::name>(a);                                         \
+    return true;
+#define EVALUATE_BINOP(name, handler)                                          \
+  case OpCode::name:                                                           \
+    result = handler<OpCode::name>(a, b);                                      \
+    return true;
+    NUMERIC_INSTRUCTIONS(EVALUATE_UNOP, EVALUATE_BINOP)
+#undef EVALUATE_UNOP
+#undef EVALUATE_BINOP
+  default:
+    return false;
+  }
+}
+
+// Replaces the numeric instruction at the end of result by a constant, if
+// all of its operands are constants
+static void fold(std::vector<Instr> &result) {
+  OpCode op = result.back().op;
+  NumericType type;
+  if (may_trap(op) || !numeric_type(op, type)) {
+    return;
+  }
+
+  uint32_t operands = type.b == ImmediateRepr::None ? 1 : 2;
+  if (result.size() < operands + 1) {
+    return;
+  }
+  const Instr *first = &result[result.size() - 1 - operands];
+  for (uint32_t i = 0; i < operands; i++) {
+    if (!is_const(first[i].op)) {
+      return;
+    }
+  }
+
+  Value value;
+  if (!evaluate(op, first[0].value.v, first[operands - 1].value.v, value)) {
+    return;
+  }
+  // 32 bit results leave the upper half undefined
+  if (type.result == ImmediateRepr::I32 || type.result == ImmediateRepr::F32) {
+    value.n64 = value.n32;
+  }
+
+  Instr constant{};
+  constant.op = const_opcode(type.result);
+  constant.value.t = type.result;
+  constant.value.v = value;
+  result.resize(result.size() - 1 - operands);
+  result.push_back(constant);
+}
+
+// Index of the else or end closing the block containing pc, or expr.size()
+// for the function body. Else is only returned if at_else is set.
+static uint32_t block_end(const std::vector<Instr> &expr, uint32_t pc,
+                          bool at_else) {
+  uint32_t depth = 0;
+  for (; pc < expr.size(); pc++) {
+    switch (expr[pc].op) {
+    case OpCode::Block:
+    case OpCode::Loop:
+    case OpCode::If:
+      depth++;
+      break;
+    case OpCode::Else:
+      if (depth == 0 && at_else) {
+        return pc;
+      }
+      break;
+    case OpCode::End:
+      if (depth == 0) {
+        return pc;
+      }
+      depth--;
+      break;
+    default:
+      break;
+    }
+  }
+  return pc;
+}
+
+static bool contains_loop(const std::vector<Instr> &expr, uint32_t from,
+                          uint32_t to) {
+  return std::any_of(expr.begin() + from, expr.begin() + to,
+                     [](const Instr &instr) { return instr.op == OpCode::Loop; });
+}
+
+static bool ends_block(OpCode op) {
+  return op == OpCode::Br || op == OpCode::BrTable || op == OpCode::Return ||
+         op == OpCode::Unreachable;
+}
+
+void simplify_code(Code &code) {
+  const std::vector<Instr> &expr = code.expr;
+  std::vector<Instr> result;
+  result.reserve(expr.size());
+
+  // The else of an if which became a block continues at its end, as the
+  // instructions in between are never executed
+  std::vector<uint32_t> skip(expr.size(), NO_SKIP);
+
+  auto constant_condition = [&]() {
+    return !result.empty() && result.back().op == OpCode::I32Const;
+  };
+
+  uint32_t pc = 0;
+  while (pc < expr.size()) {
+    if (skip[pc] != NO_SKIP) {
+      pc = skip[pc];
+      continue;
+    }
+    Instr instr = expr[pc];
+
+    switch (instr.op) {
+    case OpCode::BrIf:
+      if (constant_condition()) {
+        bool taken = result.back().value.v.n32 != 0;
+        result.pop_back();
+        if (!taken) {
+          pc++;
+          continue;
+        }
+        instr.op = OpCode::Br;
+      }
+      break;
+    case OpCode::BrTable:
+      if (constant_condition()) {
+        uint32_t index = std::min(result.back().value.v.n32, instr.imm);
+        result.pop_back();
+        uint32_t depth = code.br_tables[instr.target.pc + index].pc;
+        instr = Instr{};
+        instr.op = OpCode::Br;
+        instr.imm = depth;
+      }
+      break;
+    case OpCode::If: {
+      if (!constant_condition()) {
+        break;
+      }
+      bool taken = result.back().value.v.n32 != 0;
+      uint32_t middle = block_end(expr, pc + 1, true);
+      bool has_else = middle < expr.size() && expr[middle].op == OpCode::Else;
+      uint32_t end = has_else ? block_end(expr, middle + 1, false) : middle;
+      if (taken ? contains_loop(expr, middle, end)
+                : contains_loop(expr, pc + 1, middle)) {
+        break;
+      }
+
+      // Becomes a block of the branch which is taken, keeping the label
+      result.pop_back();
+      instr.op = OpCode::Block;
+      result.push_back(instr);
+      if (taken) {
+        if (has_else) {
+          skip[middle] = end;
+        }
+        pc++;
+      } else {
+        pc = has_else ? middle + 1 : middle;
+      }
+      continue;
+    }
+    case OpCode::Drop:
+      if (!result.empty() && (is_const(result.back().op) ||
+                              result.back().op == OpCode::LocalGet ||
+                              result.back().op == OpCode::GlobalGet)) {
+        result.pop_back();
+        pc++;
+        continue;
+      }
+      break;
+    default:
+      break;
+    }
+
+    result.push_back(instr);
+    pc++;
+
+    if (ends_block(instr.op)) {
+      uint32_t end = block_end(expr, pc, true);
+      if (!contains_loop(expr, pc, end)) {
+        pc = end;
+      }
+    } else {
+      fold(result);
+    }
+  }
+
+  // Only the labels of the remaining br_tables are kept
+  std::vector<BranchTarget> br_tables;
+  for (Instr &instr : result) {
+    if (instr.op == OpCode::BrTable) {
+      uint32_t first = br_tables.size();
+      br_tables.insert(br_tables.end(), code.br_tables.begin() + instr.target.pc,
+                       code.br_tables.begin() + instr.target.pc + instr.imm +
+                           1);
+      instr.target.pc = first;
+    }
+  }
+
+  code.expr = std::move(result);
+  code.br_tables = std::move(br_tables);
+}
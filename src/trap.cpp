@@ -0,0 +1,115 @@
+#include <cstdlib>
+#include <iostream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <csignal>
+#include <signal.h>
+#define WINTERP_FAULT_HANDLER 1
+#else
+#define WINTERP_FAULT_HANDLER 0
+#endif
+
+#include "trap.hpp"
+
+const char *trap_message(Trap trap) {
+  switch (trap) {
+  case NO_TRAP:
+    return "no trap";
+  case UNREACHABLE:
+    return "unreachable";
+  case MEMORY_OUT_OF_BOUNDS:
+    return "out of bounds memory access";
+  case INTEGER_DIVIDE_BY_ZERO:
+    return "integer divide by zero";
+  case INTEGER_OVERFLOW:
+    return "integer overflow";
+  case INVALID_CONVERSION_TO_INTEGER:
+    return "invalid conversion to integer";
+  case UNDEFINED_ELEMENT:
+    return "undefined element";
+  case UNINITIALIZED_ELEMENT:
+    return "uninitialized element";
+  case INDIRECT_CALL_TYPE_MISMATCH:
+    return "indirect call type mismatch";
+  case TABLE_OUT_OF_BOUNDS:
+    return "out of bounds table access";
+  case CALL_STACK_EXHAUSTED:
+    return "call stack exhausted";
+  case INVALID_FUNCTION:
+    return "invalid function body";
+  case OUT_OF_MEMORY:
+    return "out of memory";
+  }
+  return "unknown trap";
+}
+
+// Innermost boundary of the thread, read by the fault handler
+static thread_local TrapBoundary *current_boundary = nullptr;
+
+#if WINTERP_FAULT_HANDLER
+// Handlers before ours, which get the faults outside of linear memories
+static struct sigaction previous_segv;
+static struct sigaction previous_bus;
+
+static void handle_fault(int signal, siginfo_t *info, void *context) {
+  TrapBoundary *boundary = current_boundary;
+  if (boundary != nullptr) {
+    for (const LinearMemory *memory : boundary->memories) {
+      if (memory->reserves(info->si_addr)) {
+        boundary->trap = MEMORY_OUT_OF_BOUNDS;
+        siglongjmp(boundary->env, 1);
+      }
+    }
+  }
+
+  const struct sigaction &previous =
+      signal == SIGSEGV ? previous_segv : previous_bus;
+  if (previous.sa_flags & SA_SIGINFO) {
+    previous.sa_sigaction(signal, info, context);
+  } else if (previous.sa_handler != SIG_DFL &&
+             previous.sa_handler != SIG_IGN) {
+    previous.sa_handler(signal);
+  } else {
+    // Returning runs the faulting instruction again, which now terminates
+    // the process as usual
+    std::signal(signal, SIG_DFL);
+  }
+}
+
+static bool install_fault_handler() {
+  struct sigaction action = {};
+  action.sa_sigaction = handle_fault;
+  // Not blocking the signal while handling it leaves the signal mask intact
+  // when jumping out of the handler
+  action.sa_flags = SA_SIGINFO | SA_NODEFER;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGSEGV, &action, &previous_segv);
+  sigaction(SIGBUS, &action, &previous_bus);
+  return true;
+}
+#endif
+
+TrapBoundary::TrapBoundary(const std::vector<LinearMemory *> &memories)
+    : memories(memories), outer(current_boundary) {
+#if WINTERP_FAULT_HANDLER
+  static bool installed = install_fault_handler();
+  (void)installed;
+#endif
+  current_boundary = this;
+}
+
+TrapBoundary::~TrapBoundary() { current_boundary = outer; }
+
+void raise_trap(Trap trap) {
+  TrapBoundary *boundary = current_boundary;
+  if (boundary == nullptr) {
+    std::cerr << "trap: " << trap_message(trap) << std::endl;
+    std::abort();
+  }
+  boundary->trap = trap;
+#if WINTERP_FAULT_HANDLER
+  siglongjmp(boundary->env, 1);
+#else
+  std::longjmp(boundary->env, 1);
+#endif
+}
@@ -0,0 +1,708 @@
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "instructions.hpp"
+#include "linear_memory.hpp"
+#include "sections.hpp"
+#include "validator.hpp"
+
+// Type of an operand in unreachable code, which matches every type
+const ImmediateRepr UNKNOWN = ImmediateRepr::Uninitialised;
+
+static bool is_value_type(ImmediateRepr type) {
+  return type == ImmediateRepr::I32 || type == ImmediateRepr::I64 ||
+         type == ImmediateRepr::F32 || type == ImmediateRepr::F64;
+}
+
+static const char *type_name(ImmediateRepr type) {
+  switch (type) {
+  case ImmediateRepr::I32:
+    return "i32";
+  case ImmediateRepr::I64:
+    return "i64";
+  case ImmediateRepr::F32:
+    return "f32";
+  case ImmediateRepr::F64:
+    return "f64";
+  case ImmediateRepr::None:
+    return "nothing";
+  default:
+    return "unknown";
+  }
+}
+
+bool numeric_type(OpCode op, NumericType &type) {
+  const ImmediateRepr i32 = ImmediateRepr::I32, i64 = ImmediateRepr::I64,
+                      f32 = ImmediateRepr::F32, f64 = ImmediateRepr::F64,
+                      none = ImmediateRepr::None;
+
+  if (op == OpCode::I32eqz) {
+    type = {i32, none, i32};
+  } else if (op >= 0x46 && op <= 0x4F) {
+    type = {i32, i32, i32};
+  } else if (op == OpCode::I64eqz) {
+    type = {i64, none, i32};
+  } else if (op >= 0x51 && op <= 0x5A) {
+    type = {i64, i64, i32};
+  } else if (op >= 0x5B && op <= 0x60) {
+    type = {f32, f32, i32};
+  } else if (op >= 0x61 && op <= 0x66) {
+    type = {f64, f64, i32};
+  } else if (op >= 0x67 && op <= 0x69) {
+    type = {i32, none, i32};
+  } else if (op >= 0x6A && op <= 0x78) {
+    type = {i32, i32, i32};
+  } else if (op >= 0x79 && op <= 0x7B) {
+    type = {i64, none, i64};
+  } else if (op >= 0x7C && op <= 0x8A) {
+    type = {i64, i64, i64};
+  } else if (op >= 0x8B && op <= 0x91) {
+    type = {f32, none, f32};
+  } else if (op >= 0x92 && op <= 0x98) {
+    type = {f32, f32, f32};
+  } else if (op >= 0x99 && op <= 0x9F) {
+    type = {f64, none, f64};
+  } else if (op >= 0xA0 && op <= 0xA6) {
+    type = {f64, f64, f64};
+  } else if (op >= 0xA7 && op <= 0xBF) {
+    // Conversions, in the order of their opcodes
+    static const NumericType conversions[] = {
+        {i64, none, i32}, {f32, none, i32}, {f32, none, i32},
+        {f64, none, i32}, {f64, none, i32}, {i32, none, i64},
+        {i32, none, i64}, {f32, none, i64}, {f32, none, i64},
+        {f64, none, i64}, {f64, none, i64}, {i32, none, f32},
+        {i32, none, f32}, {i64, none, f32}, {i64, none, f32},
+        {f64, none, f32}, {i32, none, f64}, {i32, none, f64},
+        {i64, none, f64}, {i64, none, f64}, {f32, none, f64},
+        {f32, none, i32}, {f64, none, i64}, {i32, none, f32},
+        {i64, none, f64}};
+    type = conversions[op - 0xA7];
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Type of the value accessed by a load or store
+static ImmediateRepr memory_type(OpCode op) {
+  switch (op) {
+  case OpCode::I64Load:
+  case OpCode::I64Load8S:
+  case OpCode::I64Load8U:
+  case OpCode::I64Load16S:
+  case OpCode::I64Load16U:
+  case OpCode::I64Load32S:
+  case OpCode::I64Load32U:
+  case OpCode::I64Store:
+  case OpCode::I64Store8:
+  case OpCode::I64Store16:
+  case OpCode::I64Store32:
+    return ImmediateRepr::I64;
+  case OpCode::F32Load:
+  case OpCode::F32Store:
+    return ImmediateRepr::F32;
+  case OpCode::F64Load:
+  case OpCode::F64Store:
+    return ImmediateRepr::F64;
+  default:
+    return ImmediateRepr::I32;
+  }
+}
+
+// Number of functions in the function index space
+static uint32_t num_functions(const WasmFile &wasm) {
+  return wasm.imports.size() + wasm.function_section.size();
+}
+
+// A block, loop, if or the function body itself, which has been entered but
+// whose end has not been reached yet
+struct ControlFrame {
+  OpCode op;
+  ImmediateRepr result; // None if the label produces no value
+  uint32_t height;      // Operand stack height when entering the label
+  // Remaining instructions until the end (or else) can never be executed.
+  // The operand stack is polymorphic in this case.
+  bool unreachable;
+};
+
+// Simulates the types on the operand stack of a single function body
+// https://webassembly.github.io/spec/core/appendix/algorithm.html
+class BodyValidator {
+public:
+  BodyValidator(const WasmFile &wasm, uint32_t code_index, const Code &code,
+                ValidationError &error)
+      : wasm(wasm), code(code), error(error), pc(0) {
+    function = wasm.imports.size() + code_index;
+    signature = &wasm.type_section[wasm.function_section[code_index]];
+  }
+
+  bool run() {
+    locals = signature->params;
+    for (const Local &local : code.locals) {
+      if (!is_value_type(local.type)) {
+        return fail("unsupported type of local");
+      }
+      locals.insert(locals.end(), local.count, local.type);
+    }
+
+    frames.push_back({OpCode::Block, signature->return_value, 0, false});
+
+    for (pc = 0; pc < code.expr.size(); pc++) {
+      if (!instruction(code.expr[pc])) {
+        return false;
+      }
+    }
+
+    // The final end of the body is not part of expr
+    if (frames.size() != 1) {
+      return fail("missing end of a block");
+    }
+    return end_frame();
+  }
+
+private:
+  const WasmFile &wasm;
+  const Code &code;
+  ValidationError &error;
+  uint32_t function;
+  const FunctionType *signature;
+  uint32_t pc;
+
+  std::vector<ImmediateRepr> locals;
+  std::vector<ImmediateRepr> stack;
+  std::vector<ControlFrame> frames;
+
+  bool fail(const std::string &message) {
+    error.message = message;
+    error.function = function;
+    error.pc = pc;
+    return false;
+  }
+
+  void push(ImmediateRepr type) {
+    if (type != ImmediateRepr::None) {
+      stack.push_back(type);
+    }
+  }
+
+  // Pops a value of type expected, or of any type if expected is UNKNOWN.
+  // The popped type is stored in actual.
+  bool pop(ImmediateRepr expected, ImmediateRepr &actual) {
+    const ControlFrame &frame = frames.back();
+    if (stack.size() == frame.height) {
+      if (frame.unreachable) {
+        actual = expected;
+        return true;
+      }
+      return fail(std::string("operand stack underflow, expected ") +
+                  type_name(expected));
+    }
+
+    actual = stack.back();
+    stack.pop_back();
+    if (expected != UNKNOWN && actual != UNKNOWN && actual != expected) {
+      return fail(std::string("type mismatch, expected ") +
+                  type_name(expected) + " but got " + type_name(actual));
+    }
+    return true;
+  }
+
+  bool pop(ImmediateRepr expected) {
+    if (expected == ImmediateRepr::None) {
+      return true;
+    }
+    ImmediateRepr actual;
+    return pop(expected, actual);
+  }
+
+  void set_unreachable() {
+    stack.resize(frames.back().height);
+    frames.back().unreachable = true;
+  }
+
+  // Type of the values carried over by a branch to the label at depth
+  bool label_type(uint32_t depth, ImmediateRepr &type) {
+    if (depth >= frames.size()) {
+      return fail("invalid label depth " + std::to_string(depth));
+    }
+    const ControlFrame &frame = frames[frames.size() - 1 - depth];
+    // Branching to a loop continues with its first instruction
+    type = frame.op == OpCode::Loop ? ImmediateRepr::None : frame.result;
+    return true;
+  }
+
+  // Checks that exactly the results of the innermost frame are left
+  bool end_frame() {
+    const ControlFrame &frame = frames.back();
+    if (!pop(frame.result)) {
+      return false;
+    }
+    if (stack.size() != frame.height) {
+      return fail("values remaining on the stack at the end of a block");
+    }
+    return true;
+  }
+
+  bool block_type(const Instr &instr, ImmediateRepr &type) {
+    if (instr.imm == 0x40) {
+      type = ImmediateRepr::None;
+      return true;
+    }
+    type = static_cast<ImmediateRepr>(instr.imm);
+    if (!is_value_type(type)) {
+      return fail("unsupported block type");
+    }
+    return true;
+  }
+
+  bool memory_index(uint32_t index) {
+    if (index >= wasm.memory.size()) {
+      return fail("invalid memory index " + std::to_string(index));
+    }
+    return true;
+  }
+
+  bool data_index(uint32_t index) {
+    if (!wasm.has_data_count) {
+      return fail("data segment used without a data count section");
+    }
+    if (index >= wasm.data_count) {
+      return fail("invalid data segment index " + std::to_string(index));
+    }
+    return true;
+  }
+
+  bool table_index(uint32_t index) {
+    if (index >= wasm.tables.size()) {
+      return fail("invalid table index " + std::to_string(index));
+    }
+    return true;
+  }
+
+  bool elem_index(uint32_t index) {
+    if (index >= wasm.elems.size()) {
+      return fail("invalid element segment index " + std::to_string(index));
+    }
+    return true;
+  }
+
+  bool call(const FunctionType &type) {
+    for (size_t i = type.params.size(); i > 0; i--) {
+      if (!pop(type.params[i - 1])) {
+        return false;
+      }
+    }
+    push(type.return_value);
+    return true;
+  }
+
+  bool instruction(const Instr &instr) {
+    ImmediateRepr type, other;
+
+    switch (instr.op) {
+    case OpCode::Nop:
+      return true;
+    case OpCode::Unreachable:
+      set_unreachable();
+      return true;
+    case OpCode::Block:
+    case OpCode::Loop:
+    case OpCode::If:
+      if (!block_type(instr, type)) {
+        return false;
+      }
+      if (instr.op == OpCode::If && !pop(ImmediateRepr::I32)) {
+        return false;
+      }
+      frames.push_back(
+          {instr.op, type, static_cast<uint32_t>(stack.size()), false});
+      return true;
+    case OpCode::Else:
+      if (frames.size() == 1 || frames.back().op != OpCode::If) {
+        return fail("else without matching if");
+      }
+      if (!end_frame()) {
+        return false;
+      }
+      frames.back().op = OpCode::Else;
+      frames.back().unreachable = false;
+      return true;
+    case OpCode::End: {
+      if (frames.size() == 1) {
+        return fail("end without matching block");
+      }
+      if (!end_frame()) {
+        return false;
+      }
+      ControlFrame frame = frames.back();
+      if (frame.op == OpCode::If && frame.result != ImmediateRepr::None) {
+        return fail("if without else must not produce a value");
+      }
+      frames.pop_back();
+      push(frame.result);
+      return true;
+    }
+    case OpCode::Br:
+      if (!label_type(instr.imm, type) || !pop(type)) {
+        return false;
+      }
+      set_unreachable();
+      return true;
+    case OpCode::BrIf:
+      if (!pop(ImmediateRepr::I32) || !label_type(instr.imm, type) ||
+          !pop(type)) {
+        return false;
+      }
+      push(type);
+      return true;
+    case OpCode::BrTable: {
+      if (!pop(ImmediateRepr::I32)) {
+        return false;
+      }
+      // All labels carry the same values as the default, which is last.
+      // Until resolve_branches runs, pc holds the label depth.
+      const BranchTarget *labels = &code.br_tables[instr.target.pc];
+      if (!label_type(labels[instr.imm].pc, type)) {
+        return false;
+      }
+      for (uint32_t i = 0; i < instr.imm; i++) {
+        if (!label_type(labels[i].pc, other)) {
+          return false;
+        }
+        if (other != type) {
+          return fail("br_table labels carry different types");
+        }
+      }
+      if (!pop(type)) {
+        return false;
+      }
+      set_unreachable();
+      return true;
+    }
+    case OpCode::Return:
+      if (!pop(signature->return_value)) {
+        return false;
+      }
+      set_unreachable();
+      return true;
+    case OpCode::Call:
+      if (instr.imm >= num_functions(wasm)) {
+        return fail("invalid function index " + std::to_string(instr.imm));
+      }
+      return call(wasm.function_type(instr.imm));
+    case OpCode::CallIndirect:
+      if (instr.imm >= wasm.type_section.size()) {
+        return fail("invalid type index " + std::to_string(instr.imm));
+      }
+      if (!table_index(instr.imm2) || !pop(ImmediateRepr::I32)) {
+        return false;
+      }
+      return call(wasm.type_section[instr.imm]);
+    case OpCode::Drop:
+      return pop(UNKNOWN, type);
+    case OpCode::Select:
+      if (!pop(ImmediateRepr::I32) || !pop(UNKNOWN, type) ||
+          !pop(type, other)) {
+        return false;
+      }
+      push(type != UNKNOWN ? type : other);
+      return true;
+    case OpCode::LocalGet:
+    case OpCode::LocalSet:
+    case OpCode::LocalTee:
+      if (instr.imm >= locals.size()) {
+        return fail("invalid local index " + std::to_string(instr.imm));
+      }
+      type = locals[instr.imm];
+      if (instr.op == OpCode::LocalGet) {
+        push(type);
+        return true;
+      }
+      if (!pop(type)) {
+        return false;
+      }
+      if (instr.op == OpCode::LocalTee) {
+        push(type);
+      }
+      return true;
+    case OpCode::GlobalGet:
+    case OpCode::GlobalSet:
+      if (instr.imm >= wasm.globals.size()) {
+        return fail("invalid global index " + std::to_string(instr.imm));
+      }
+      type = wasm.globals[instr.imm].valtype;
+      if (instr.op == OpCode::GlobalGet) {
+        push(type);
+        return true;
+      }
+      if (!wasm.globals[instr.imm].mutability) {
+        return fail("global " + std::to_string(instr.imm) + " is immutable");
+      }
+      return pop(type);
+    case OpCode::I32Const:
+    case OpCode::I64Const:
+    case OpCode::F32Const:
+    case OpCode::F64Const:
+      push(instr.value.t);
+      return true;
+    case OpCode::MemorySize:
+      if (!memory_index(instr.imm)) {
+        return false;
+      }
+      push(ImmediateRepr::I32);
+      return true;
+    case OpCode::MemoryGrow:
+      if (!memory_index(instr.imm) || !pop(ImmediateRepr::I32)) {
+        return false;
+      }
+      push(ImmediateRepr::I32);
+      return true;
+    case OpCode::MemoryInit:
+      if (!data_index(instr.imm) || !memory_index(instr.imm2)) {
+        return false;
+      }
+      return pop(ImmediateRepr::I32) && pop(ImmediateRepr::I32) &&
+             pop(ImmediateRepr::I32);
+    case OpCode::DataDrop:
+      return data_index(instr.imm);
+    case OpCode::MemoryCopy:
+      if (!memory_index(instr.imm) || !memory_index(instr.imm2)) {
+        return false;
+      }
+      return pop(ImmediateRepr::I32) && pop(ImmediateRepr::I32) &&
+             pop(ImmediateRepr::I32);
+    case OpCode::MemoryFill:
+      if (!memory_index(instr.imm)) {
+        return false;
+      }
+      return pop(ImmediateRepr::I32) && pop(ImmediateRepr::I32) &&
+             pop(ImmediateRepr::I32);
+    case OpCode::TableInit:
+      if (!elem_index(instr.imm) || !table_index(instr.imm2)) {
+        return false;
+      }
+      return pop(ImmediateRepr::I32) && pop(ImmediateRepr::I32) &&
+             pop(ImmediateRepr::I32);
+    case OpCode::ElemDrop:
+      return elem_index(instr.imm);
+    case OpCode::TableCopy:
+      if (!table_index(instr.imm) || !table_index(instr.imm2)) {
+        return false;
+      }
+      return pop(ImmediateRepr::I32) && pop(ImmediateRepr::I32) &&
+             pop(ImmediateRepr::I32);
+    default:
+      break;
+    }
+
+    if (instr.op >= 0x28 && instr.op <= 0x35) {
+      // Loads, imm is the memory index
+      if (!memory_index(instr.imm) || !pop(ImmediateRepr::I32)) {
+        return false;
+      }
+      push(memory_type(instr.op));
+      return true;
+    }
+
+    if (instr.op >= 0x36 && instr.op <= 0x3E) {
+      // Stores
+      return memory_index(instr.imm) && pop(memory_type(instr.op)) &&
+             pop(ImmediateRepr::I32);
+    }
+
+    NumericType numeric;
+    if (numeric_type(instr.op, numeric)) {
+      if (!pop(numeric.b) || !pop(numeric.a)) {
+        return false;
+      }
+      push(numeric.result);
+      return true;
+    }
+
+    char opcode[8];
+    std::snprintf(opcode, sizeof(opcode), "%x", instr.op);
+    return fail(std::string("unsupported instruction 0x") + opcode);
+  }
+};
+
+bool validate_function(const WasmFile &wasm, uint32_t code_index,
+                       const Code &code, ValidationError &error) {
+  BodyValidator validator(wasm, code_index, code, error);
+  return validator.run();
+}
+
+static bool fail(ValidationError &error, const std::string &message) {
+  error.message = message;
+  error.function = NO_FUNCTION;
+  error.pc = 0;
+  return false;
+}
+
+// Constant expressions are a single const or global.get of an earlier,
+// immutable global, producing a value of type
+static bool validate_constant_expr(const WasmFile &wasm,
+                                   const std::vector<Instr> &expr,
+                                   ImmediateRepr type, uint32_t num_globals,
+                                   const std::string &what,
+                                   ValidationError &error) {
+  if (expr.size() != 1) {
+    return fail(error, what + " is not a constant expression");
+  }
+
+  const Instr &instr = expr[0];
+  ImmediateRepr actual;
+  if (instr.op >= OpCode::I32Const && instr.op <= OpCode::F64Const) {
+    actual = instr.value.t;
+  } else if (instr.op == OpCode::GlobalGet) {
+    if (instr.imm >= num_globals) {
+      return fail(error, what + " uses invalid global " +
+                             std::to_string(instr.imm));
+    }
+    if (wasm.globals[instr.imm].mutability) {
+      return fail(error, what + " uses mutable global " +
+                             std::to_string(instr.imm));
+    }
+    actual = wasm.globals[instr.imm].valtype;
+  } else {
+    return fail(error, what + " is not a constant expression");
+  }
+
+  if (actual != type) {
+    return fail(error, what + " has type " + type_name(actual) +
+                           ", expected " + type_name(type));
+  }
+  return true;
+}
+
+bool validate_module(const WasmFile &wasm, ValidationError &error) {
+  for (size_t i = 0; i < wasm.type_section.size(); i++) {
+    const FunctionType &type = wasm.type_section[i];
+    for (ImmediateRepr param : type.params) {
+      if (!is_value_type(param)) {
+        return fail(error, "unsupported parameter type in type " +
+                               std::to_string(i));
+      }
+    }
+    if (type.return_value != ImmediateRepr::None &&
+        !is_value_type(type.return_value)) {
+      return fail(error,
+                  "unsupported result type in type " + std::to_string(i));
+    }
+  }
+
+  for (size_t i = 0; i < wasm.imports.size(); i++) {
+    // The function index space assumes all imports are functions
+    if (wasm.imports[i].kind != 0x00) {
+      return fail(error, "import " + std::to_string(i) +
+                             " is not a function, which is unsupported");
+    }
+    if (wasm.imports[i].signature_index >= wasm.type_section.size()) {
+      return fail(error,
+                  "import " + std::to_string(i) + " has an invalid type");
+    }
+  }
+
+  for (size_t i = 0; i < wasm.function_section.size(); i++) {
+    if (wasm.function_section[i] >= wasm.type_section.size()) {
+      return fail(error, "function " +
+                             std::to_string(wasm.imports.size() + i) +
+                             " has an invalid type");
+    }
+  }
+
+  if (wasm.function_section.size() != wasm.codes.size()) {
+    return fail(error, "function and code section differ in length");
+  }
+
+  for (size_t i = 0; i < wasm.memory.size(); i++) {
+    const Memory &memory = wasm.memory[i];
+    bool has_maximum = memory.flag & MEMORY_HAS_MAXIMUM;
+    if (memory.n > MAX_MEMORY_PAGES ||
+        (has_maximum &&
+         (memory.maximum > MAX_MEMORY_PAGES || memory.maximum < memory.n))) {
+      return fail(error,
+                  "memory " + std::to_string(i) + " has invalid limits");
+    }
+  }
+
+  for (size_t i = 0; i < wasm.globals.size(); i++) {
+    const Global &global = wasm.globals[i];
+    if (!validate_constant_expr(wasm, global.expr, global.valtype, i,
+                                "initializer of global " + std::to_string(i),
+                                error)) {
+      return false;
+    }
+  }
+
+  for (size_t i = 0; i < wasm.exports.size(); i++) {
+    const Export &e = wasm.exports[i];
+    size_t count = 0;
+    switch (e.kind) {
+    case ExportKind::func:
+      count = num_functions(wasm);
+      break;
+    case ExportKind::table:
+      count = wasm.tables.size();
+      break;
+    case ExportKind::mem:
+      count = wasm.memory.size();
+      break;
+    case ExportKind::global:
+      count = wasm.globals.size();
+      break;
+    default:
+      return fail(error, "export " + e.name + " has an unsupported kind");
+    }
+    if (e.idx >= count) {
+      return fail(error, "export " + e.name + " has an invalid index");
+    }
+  }
+
+  for (size_t i = 0; i < wasm.elems.size(); i++) {
+    const Element &elem = wasm.elems[i];
+    // Passive and declarative segments are not placed into a table
+    if (elem.flag == ELEM_ACTIVE) {
+      if (wasm.tables.empty()) {
+        return fail(error, "element segment without a table");
+      }
+      if (!validate_constant_expr(wasm, elem.expr, ImmediateRepr::I32,
+                                  wasm.globals.size(),
+                                  "offset of element segment " +
+                                      std::to_string(i),
+                                  error)) {
+        return false;
+      }
+    }
+    for (uint32_t function : elem.function_indices) {
+      if (function >= num_functions(wasm)) {
+        return fail(error, "element segment " + std::to_string(i) +
+                               " has an invalid function index");
+      }
+    }
+  }
+
+  if (wasm.has_data_count && wasm.data_count != wasm.data.size()) {
+    return fail(error, "data count and data section differ in length");
+  }
+
+  for (size_t i = 0; i < wasm.data.size(); i++) {
+    const DataSegment &segment = wasm.data[i];
+    if (segment.flag == DATA_PASSIVE) {
+      continue;
+    }
+    if (segment.memidx >= wasm.memory.size()) {
+      return fail(error, "data segment " + std::to_string(i) +
+                             " has an invalid memory index");
+    }
+    if (!validate_constant_expr(wasm, segment.expr, ImmediateRepr::I32,
+                                wasm.globals.size(),
+                                "offset of data segment " + std::to_string(i),
+                                error)) {
+      return false;
+    }
+  }
+
+  return true;
+}
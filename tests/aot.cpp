@@ -0,0 +1,142 @@
+#include <cstdint>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "aot.hpp"
+#include "aot_runtime.hpp"
+#include "runtime.hpp"
+#include "sections.hpp"
+#include "test_interpreter.hpp"
+#include "wasm_builder.hpp"
+
+// Created by the test binaries translated ahead of time, see CMakeLists.txt
+extern "C" AotModule *aot_create_01_test();
+extern "C" AotModule *aot_create_02_test_prio1();
+extern "C" AotModule *aot_create_03_test_prio2();
+extern "C" AotModule *aot_create_04_test_prio3();
+extern "C" AotModule *aot_create_05_test_complex();
+extern "C" AotModule *aot_create_07_test_bulk_memory();
+extern "C" AotModule *aot_create_09_print_hello();
+// And by tests/aot_modules.cpp
+extern "C" AotModule *aot_create_aot_table();
+extern "C" AotModule *aot_create_aot_memory();
+extern "C" AotModule *aot_create_aot_unbounded_memory();
+
+// Runs every exported function without parameters by the interpreter and by
+// the generated code, and expects the same memory afterwards. This covers
+// everything the tests of the test binaries check.
+static void expect_same_results(const char *file, AotCreate create) {
+  WasmFile wasm;
+  ASSERT_EQ(wasm.read(file), 0);
+
+  int functions = 0;
+  for (const Export &e : wasm.exports) {
+    if (e.kind != ExportKind::func ||
+        !wasm.function_type(e.idx).params.empty()) {
+      continue;
+    }
+    SCOPED_TRACE(e.name);
+    std::string function = e.name;
+
+    Runtime runtime(wasm, test_interpreter());
+    runtime.run(function);
+    std::unique_ptr<AotModule> module(create());
+    module->run(function);
+
+    for (uint32_t offset = 0; offset < MEMORY_PAGE_SIZE; offset += 8) {
+      uint64_t expected =
+          runtime.read_memory(0, offset, ImmediateRepr::I64).v.n64;
+      uint64_t actual = module->read_memory(0, offset, ImmediateRepr::I64).v.n64;
+      ASSERT_EQ(actual, expected) << "at offset " << offset;
+    }
+    functions++;
+  }
+  EXPECT_GT(functions, 0);
+}
+
+TEST(Aot, SameResultsAs01) {
+  expect_same_results("test_binaries/01_test.wasm", aot_create_01_test);
+}
+
+TEST(Aot, SameResultsAs02) {
+  expect_same_results("test_binaries/02_test_prio1.wasm",
+                      aot_create_02_test_prio1);
+}
+
+TEST(Aot, SameResultsAs03) {
+  expect_same_results("test_binaries/03_test_prio2.wasm",
+                      aot_create_03_test_prio2);
+}
+
+TEST(Aot, SameResultsAs04) {
+  expect_same_results("test_binaries/04_test_prio3.wasm",
+                      aot_create_04_test_prio3);
+}
+
+TEST(Aot, SameResultsAs05) {
+  expect_same_results("test_binaries/05_test_complex.wasm",
+                      aot_create_05_test_complex);
+}
+
+TEST(Aot, SameResultsAs07) {
+  expect_same_results("test_binaries/07_test_bulk_memory.wasm",
+                      aot_create_07_test_bulk_memory);
+}
+
+TEST(Aot, SameResultsAs09) {
+  expect_same_results("test_binaries/09_print_hello.wasm",
+                      aot_create_09_print_hello);
+}
+
+TEST(Aot, TrapsOnUninitializedElements) {
+  std::unique_ptr<AotModule> module(aot_create_aot_table());
+  std::string function = "call_first";
+  module->run(function);
+  EXPECT_EQ(module->read_memory(0, 0, ImmediateRepr::I32).v.n32, 7u);
+
+  // The entry must not be taken for function 0, which has the same type
+  function = "call_empty";
+  EXPECT_DEATH(module->run(function), "uninitialized element");
+}
+
+// Result of running grow_<delta> on a new instance of the module of create
+static uint32_t grow(AotCreate create, uint32_t delta) {
+  std::unique_ptr<AotModule> module(create());
+  std::string function = "grow_" + std::to_string(delta);
+  module->run(function);
+  return module->read_memory(0, 0, ImmediateRepr::I32).v.n32;
+}
+
+TEST(Aot, GrowsMemoryWithinItsLimits) {
+  // At most 2 pages
+  EXPECT_EQ(grow(aot_create_aot_memory, 1), 1u);
+  EXPECT_EQ(grow(aot_create_aot_memory, 2), UINT32_MAX);
+  EXPECT_EQ(grow(aot_create_aot_memory, 0xFFFFFFFF), UINT32_MAX);
+  // At most 65536 pages, without wrapping around
+  EXPECT_EQ(grow(aot_create_aot_unbounded_memory, 65536), UINT32_MAX);
+  EXPECT_EQ(grow(aot_create_aot_unbounded_memory, 0xFFFFFFFF), UINT32_MAX);
+}
+
+TEST(Aot, RejectsMultipleMemories) {
+  WasmBuilder builder;
+  builder.add_memory(1);
+  Bytes bytes = builder.build();
+  WasmFile wasm;
+  ASSERT_EQ(wasm.read_from_memory(bytes.data(), bytes.size()), 0);
+
+  std::ostringstream out;
+  EXPECT_EQ(translate_module(wasm, "create", out), 1);
+}
+
+// As Test01._test_store, with the module built as a shared library
+TEST(Aot, LoadsSharedLibrary) {
+  std::unique_ptr<AotModule> module = aot_load(WINTERP_AOT_LIBRARY);
+  ASSERT_NE(module, nullptr);
+
+  std::string function = "_test_store";
+  module->run(function);
+  EXPECT_EQ(module->read_memory(0, 0, ImmediateRepr::I32).v.n32, 42u);
+}
@@ -0,0 +1,70 @@
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "wasm_builder.hpp"
+
+// Modules of tests/aot.cpp which the test binaries lack, written at build time
+// and translated like them, see CMakeLists.txt.
+// Usage: winterp_aot_modules <name> <output.wasm>
+
+// A table of a function returning 7 and an uninitialized entry behind it.
+// call_first and call_empty store the result of calling the entries at
+// address 0.
+static WasmBuilder table_module() {
+  WasmBuilder builder;
+  builder.add_type({}, {});
+  uint32_t result_type = builder.add_type({}, {0x7F});
+  uint32_t seven = builder.add_function(result_type, {}, i32_const(7));
+  builder.set_table({seven}, 2);
+  const char *names[] = {"call_first", "call_empty"};
+  for (int32_t i = 0; i < 2; i++) {
+    builder.add_export(
+        names[i],
+        builder.add_function(0, {},
+                             concat({i32_const(0), i32_const(i),
+                                     op_u(0x11, result_type), Bytes{0x00},
+                                     mem_op(0x36, 2, 0)})));
+  }
+  return builder;
+}
+
+// Memory 0 of a page and the given maximum. grow_<n> stores the result of
+// growing it by n pages at address 0.
+static WasmBuilder memory_module(int64_t maximum) {
+  WasmBuilder builder;
+  builder.add_type({}, {});
+  builder.memory_maximum = maximum;
+  for (uint32_t delta : {1u, 2u, 65536u, 0xFFFFFFFFu}) {
+    builder.add_export(
+        "grow_" + std::to_string(delta),
+        builder.add_function(0, {},
+                             concat({i32_const(0), i32_const(delta),
+                                     Bytes{0x40, 0x00}, mem_op(0x36, 2, 0)})));
+  }
+  return builder;
+}
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    std::cerr << "usage: " << argv[0] << " <name> <output.wasm>" << std::endl;
+    return 1;
+  }
+
+  WasmBuilder builder;
+  if (std::strcmp(argv[1], "aot_table") == 0) {
+    builder = table_module();
+  } else if (std::strcmp(argv[1], "aot_memory") == 0) {
+    builder = memory_module(2);
+  } else if (std::strcmp(argv[1], "aot_unbounded_memory") == 0) {
+    builder = memory_module(-1);
+  } else {
+    std::cerr << "unknown module " << argv[1] << std::endl;
+    return 1;
+  }
+  if (!builder.write(argv[2])) {
+    std::cerr << "unable to write " << argv[2] << std::endl;
+    return 1;
+  }
+  return 0;
+}
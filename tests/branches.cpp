@@ -0,0 +1,126 @@
+#include <gtest/gtest.h>
+
+#include "branches.hpp"
+#include "instructions.hpp"
+#include "sections.hpp"
+
+static Instr instr(OpCode op, uint32_t imm = 0) {
+  Instr instr{};
+  instr.op = op;
+  instr.imm = imm;
+  return instr;
+}
+
+static FunctionType void_type() {
+  FunctionType type;
+  type.return_value = ImmediateRepr::None;
+  return type;
+}
+
+TEST(Branches, LoopOverIfElse) {
+  // loop
+  //   i32.const 1
+  //   if
+  //     nop
+  //   else
+  //     nop
+  //   end
+  //   i32.const 1
+  //   br_if 0
+  // end
+  WasmFile wasm;
+  Code code;
+  code.expr = {instr(OpCode::Loop, 0x40), instr(OpCode::I32Const, 1),
+               instr(OpCode::If, 0x40),   instr(OpCode::Nop),
+               instr(OpCode::Else),       instr(OpCode::Nop),
+               instr(OpCode::End),        instr(OpCode::I32Const, 1),
+               instr(OpCode::BrIf, 0),    instr(OpCode::End)};
+
+  resolve_branches(wasm, void_type(), code);
+
+  // if jumps behind the else, else jumps behind the end
+  EXPECT_EQ(code.expr[2].target.pc, 5);
+  EXPECT_EQ(code.expr[4].target.pc, 7);
+  // br_if jumps to the first instruction of the loop
+  EXPECT_EQ(code.expr[8].target.pc, 1);
+  EXPECT_EQ(code.expr[8].target.arity, 0);
+}
+
+TEST(Branches, BlockResultHeight) {
+  // i32.const 7
+  // block (result i32)
+  //   i32.const 1
+  //   i32.const 2
+  //   br 0
+  // end
+  // drop
+  // drop
+  WasmFile wasm;
+  Code code;
+  code.expr = {instr(OpCode::I32Const, 7), instr(OpCode::Block, 0x7F),
+               instr(OpCode::I32Const, 1), instr(OpCode::I32Const, 2),
+               instr(OpCode::Br, 0),       instr(OpCode::End),
+               instr(OpCode::Drop),        instr(OpCode::Drop)};
+
+  resolve_branches(wasm, void_type(), code);
+
+  // The block starts with one value on the stack and keeps one result
+  EXPECT_EQ(code.expr[4].target.pc, 6);
+  EXPECT_EQ(code.expr[4].target.height, 1);
+  EXPECT_EQ(code.expr[4].target.arity, 1);
+  // Both constants inside of the block are on top of the 7
+  EXPECT_EQ(code.max_height, 3);
+}
+
+TEST(Branches, BrTableAndReturn) {
+  // block
+  //   block
+  //     i32.const 0
+  //     br_table 0 1 2
+  //   end
+  //   return
+  // end
+  WasmFile wasm;
+  Code code;
+  // Two labels and the default, their depths are stored in br_tables
+  Instr table = instr(OpCode::BrTable, 2);
+  table.target.pc = 0;
+  code.br_tables = {{0, 0, 0}, {1, 0, 0}, {2, 0, 0}};
+  code.expr = {instr(OpCode::Block, 0x40), instr(OpCode::Block, 0x40),
+               instr(OpCode::I32Const, 0), table,
+               instr(OpCode::End),         instr(OpCode::Return),
+               instr(OpCode::End)};
+
+  resolve_branches(wasm, void_type(), code);
+
+  ASSERT_EQ(code.br_tables.size(), 3);
+  EXPECT_EQ(code.br_tables[code.expr[3].target.pc + 0].pc, 5);
+  EXPECT_EQ(code.br_tables[code.expr[3].target.pc + 1].pc, 7);
+  // The function body is the outermost label
+  EXPECT_EQ(code.br_tables[code.expr[3].target.pc + 2].pc, 7);
+  EXPECT_EQ(code.expr[5].target.pc, 7);
+}
+
+TEST(Branches, ParseBrTableIntoSideArray) {
+  // block
+  //   i32.const 1
+  //   br_table 0 1 0
+  // end
+  const uint8_t bytes[] = {0x02, 0x40, 0x41, 0x01, 0x0E, 0x02,
+                           0x00, 0x01, 0x00, 0x0B, 0x0B};
+  const uint8_t *ptr = bytes;
+  Code code;
+  read_expr(ptr, bytes + sizeof(bytes), code.expr, code.br_tables);
+
+  ASSERT_EQ(code.expr.size(), 4);
+  EXPECT_EQ(code.expr[1].value.v.n32, 1);
+  EXPECT_EQ(code.expr[2].imm, 2);
+  ASSERT_EQ(code.br_tables.size(), 3);
+  EXPECT_EQ(code.br_tables[1].pc, 1);
+
+  resolve_branches(WasmFile(), void_type(), code);
+
+  EXPECT_EQ(code.br_tables[0].pc, 4);
+  EXPECT_EQ(code.br_tables[1].pc, 4);
+  EXPECT_EQ(code.br_tables[2].pc, 4);
+}
@@ -0,0 +1,233 @@
+#include <cstdint>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "runtime.hpp"
+#include "sections.hpp"
+#include "test_interpreter.hpp"
+#include "trap.hpp"
+#include "wasm_builder.hpp"
+
+// The bulk memory and table instructions, with their operands as constants
+static Bytes memory_fill(int32_t dst, int32_t value, int32_t n) {
+  return concat({i32_const(dst), i32_const(value), i32_const(n),
+                 misc_op(11, {0})});
+}
+
+static Bytes memory_copy(int32_t dst, int32_t src, int32_t n) {
+  return concat({i32_const(dst), i32_const(src), i32_const(n),
+                 misc_op(10, {0, 0})});
+}
+
+static Bytes memory_init(uint32_t segment, int32_t dst, int32_t src,
+                         int32_t n) {
+  return concat({i32_const(dst), i32_const(src), i32_const(n),
+                 misc_op(8, {segment, 0})});
+}
+
+static Bytes table_init(uint32_t segment, int32_t dst, int32_t src,
+                        int32_t n, uint32_t table = 0) {
+  return concat({i32_const(dst), i32_const(src), i32_const(n),
+                 misc_op(12, {segment, table})});
+}
+
+static Bytes table_copy(int32_t dst, int32_t src, int32_t n,
+                        uint32_t dst_table = 0, uint32_t src_table = 0) {
+  return concat({i32_const(dst), i32_const(src), i32_const(n),
+                 misc_op(14, {dst_table, src_table})});
+}
+
+class BulkMemory : public ::testing::Test {
+protected:
+  // The module refers to its bytes
+  Bytes bytes;
+  WasmFile wasm;
+
+  void read(WasmBuilder &builder) {
+    bytes = builder.build();
+    ASSERT_EQ(wasm.read_from_memory(bytes.data(), bytes.size()), 0)
+        << wasm.validation_error.message;
+  }
+
+  static void add(WasmBuilder &builder, const char *name, const Bytes &body) {
+    builder.add_export(name, builder.add_function(0, {}, body));
+  }
+
+  static Trap run(Runtime &runtime, const char *function) {
+    std::string func = function;
+    return runtime.run(func);
+  }
+
+  // The bytes at [address, address + 8) as a string of hex digits
+  static std::string memory(Runtime &runtime, uint32_t address) {
+    std::string out;
+    for (uint32_t i = 0; i < 8; i++) {
+      uint32_t byte =
+          runtime.read_memory(0, address + i, ImmediateRepr::Byte).v.n32;
+      out += "0123456789abcdef"[byte >> 4];
+      out += "0123456789abcdef"[byte & 0xF];
+    }
+    return out;
+  }
+};
+
+TEST_F(BulkMemory, CopiesOverlappingRanges) {
+  WasmBuilder builder;
+  builder.add_type({}, {});
+  builder.add_data(0, {1, 2, 3, 4, 5, 6, 7, 8});
+  builder.add_data(16, {1, 2, 3, 4, 5, 6, 7, 8});
+  add(builder, "forward", memory_copy(0, 2, 6));
+  add(builder, "backward", memory_copy(18, 16, 6));
+  read(builder);
+
+  Runtime runtime(wasm, test_interpreter());
+  EXPECT_EQ(run(runtime, "forward"), NO_TRAP);
+  EXPECT_EQ(memory(runtime, 0), "0304050607080708");
+  EXPECT_EQ(run(runtime, "backward"), NO_TRAP);
+  EXPECT_EQ(memory(runtime, 16), "0102010203040506");
+}
+
+TEST_F(BulkMemory, FillsRange) {
+  WasmBuilder builder;
+  builder.add_type({}, {});
+  // Only the lowest byte of the value counts
+  add(builder, "fill", memory_fill(2, 0x1AB, 4));
+  add(builder, "at_end", memory_fill(MEMORY_PAGE_SIZE, 1, 0));
+  read(builder);
+
+  Runtime runtime(wasm, test_interpreter());
+  EXPECT_EQ(run(runtime, "fill"), NO_TRAP);
+  EXPECT_EQ(memory(runtime, 0), "0000abababab0000");
+  EXPECT_EQ(run(runtime, "at_end"), NO_TRAP);
+}
+
+TEST_F(BulkMemory, OutOfBoundsWritesNothing) {
+  WasmBuilder builder;
+  builder.add_type({}, {});
+  builder.add_data(MEMORY_PAGE_SIZE - 8, {1, 2, 3, 4, 5, 6, 7, 8});
+  const int32_t last = MEMORY_PAGE_SIZE - 8;
+  add(builder, "fill", memory_fill(last + 4, 0, 5));
+  add(builder, "fill_behind", memory_fill(MEMORY_PAGE_SIZE + 1, 0, 0));
+  add(builder, "copy_to", memory_copy(last + 1, 0, 8));
+  add(builder, "copy_from", memory_copy(last, last + 1, 8));
+  // Sums which wrap around in 32 bits
+  add(builder, "fill_wraps", memory_fill(last, 0, -last));
+  add(builder, "copy_wraps", memory_copy(-1, last, 2));
+  read(builder);
+
+  Runtime runtime(wasm, test_interpreter());
+  for (const char *function : {"fill", "fill_behind", "copy_to", "copy_from",
+                               "fill_wraps", "copy_wraps"}) {
+    EXPECT_EQ(run(runtime, function), MEMORY_OUT_OF_BOUNDS) << function;
+    EXPECT_EQ(memory(runtime, last), "0102030405060708") << function;
+  }
+}
+
+TEST_F(BulkMemory, InitsFromDataSegments) {
+  WasmBuilder builder;
+  builder.add_type({}, {});
+  uint32_t passive = builder.add_passive_data({1, 2, 3, 4});
+  uint32_t active = builder.add_data(8, {5, 6});
+  add(builder, "init", memory_init(passive, 1, 1, 3));
+  add(builder, "init_active", memory_init(active, 5, 0, 2));
+  add(builder, "overrun", memory_init(passive, 0, 2, 3));
+  add(builder, "behind_memory", memory_init(passive, MEMORY_PAGE_SIZE - 1, 0, 2));
+  add(builder, "drop", misc_op(9, {passive}));
+  add(builder, "init_empty", memory_init(passive, 0, 0, 0));
+  read(builder);
+
+  Runtime runtime(wasm, test_interpreter());
+  EXPECT_EQ(run(runtime, "init"), NO_TRAP);
+  EXPECT_EQ(run(runtime, "init_active"), NO_TRAP);
+  EXPECT_EQ(memory(runtime, 0), "0002030400050600");
+  EXPECT_EQ(run(runtime, "overrun"), MEMORY_OUT_OF_BOUNDS);
+  EXPECT_EQ(run(runtime, "behind_memory"), MEMORY_OUT_OF_BOUNDS);
+  EXPECT_EQ(memory(runtime, 0), "0002030400050600");
+
+  // Only copying no bytes is left after dropping the segment
+  EXPECT_EQ(run(runtime, "drop"), NO_TRAP);
+  EXPECT_EQ(run(runtime, "init"), MEMORY_OUT_OF_BOUNDS);
+  EXPECT_EQ(run(runtime, "init_empty"), NO_TRAP);
+  EXPECT_EQ(run(runtime, "drop"), NO_TRAP);
+}
+
+TEST_F(BulkMemory, TableInitAndCopy) {
+  // Functions returning 0 to 2, a passive segment of them and the table
+  // [0, 1] with two uninitialized entries behind it
+  WasmBuilder builder;
+  builder.add_type({}, {});
+  uint32_t result_type = builder.add_type({}, {0x7F});
+  std::vector<uint32_t> functions;
+  for (int32_t i = 0; i < 3; i++) {
+    functions.push_back(builder.add_function(result_type, {}, i32_const(i)));
+  }
+  uint32_t passive = builder.add_passive_elem(functions);
+  uint32_t active = passive + 1;
+  builder.set_table({functions[0], functions[1]}, 4);
+
+  // Stores the results of calling the entries at address 0
+  Bytes body;
+  for (int32_t i = 0; i < 4; i++) {
+    put_bytes(body, concat({i32_const(i), i32_const(i), op_u(0x11, result_type),
+                            Bytes{0x00}, mem_op(0x3A, 0, 0)}));
+  }
+  add(builder, "call", body);
+  add(builder, "init", table_init(passive, 2, 1, 2));
+  add(builder, "copy_forward", table_copy(0, 1, 3));
+  add(builder, "copy_backward", table_copy(1, 0, 3));
+  add(builder, "init_behind_table", table_init(passive, 3, 0, 2));
+  add(builder, "init_behind_segment", table_init(passive, 0, 2, 2));
+  add(builder, "copy_behind_table", table_copy(2, 0, 3));
+  add(builder, "copy_wraps", table_copy(0, -1, 2));
+  add(builder, "drop", misc_op(13, {passive}));
+  add(builder, "init_active", table_init(active, 0, 0, 1));
+  add(builder, "init_empty", table_init(active, 4, 0, 0));
+  read(builder);
+
+  Runtime runtime(wasm, test_interpreter());
+  EXPECT_EQ(run(runtime, "call"), UNINITIALIZED_ELEMENT);
+  EXPECT_EQ(run(runtime, "init"), NO_TRAP);
+  EXPECT_EQ(run(runtime, "call"), NO_TRAP);
+  EXPECT_EQ(memory(runtime, 0), "0001010200000000");
+  EXPECT_EQ(run(runtime, "copy_forward"), NO_TRAP);
+  EXPECT_EQ(run(runtime, "call"), NO_TRAP);
+  EXPECT_EQ(memory(runtime, 0), "0101020200000000");
+  EXPECT_EQ(run(runtime, "copy_backward"), NO_TRAP);
+  EXPECT_EQ(run(runtime, "call"), NO_TRAP);
+  EXPECT_EQ(memory(runtime, 0), "0101010200000000");
+
+  for (const char *function : {"init_behind_table", "init_behind_segment",
+                               "copy_behind_table", "copy_wraps"}) {
+    EXPECT_EQ(run(runtime, function), TABLE_OUT_OF_BOUNDS) << function;
+    EXPECT_EQ(run(runtime, "call"), NO_TRAP);
+    EXPECT_EQ(memory(runtime, 0), "0101010200000000") << function;
+  }
+
+  // Active segments are dropped once they filled the table
+  EXPECT_EQ(run(runtime, "init_active"), TABLE_OUT_OF_BOUNDS);
+  EXPECT_EQ(run(runtime, "init_empty"), NO_TRAP);
+  EXPECT_EQ(run(runtime, "drop"), NO_TRAP);
+  EXPECT_EQ(run(runtime, "init"), TABLE_OUT_OF_BOUNDS);
+}
+
+TEST_F(BulkMemory, TablesOtherThanTheFunctionTableTrap) {
+  // Only table 0 is instantiated, so even empty ranges of table 1 trap
+  WasmBuilder builder;
+  builder.add_type({}, {});
+  uint32_t function = builder.add_function(0, {}, {});
+  uint32_t passive = builder.add_passive_elem({function});
+  builder.set_table({function});
+  uint32_t table = builder.add_table(1);
+  add(builder, "init", table_init(passive, 0, 0, 0, table));
+  add(builder, "copy_to", table_copy(0, 0, 0, table, 0));
+  add(builder, "copy_from", table_copy(0, 0, 0, 0, table));
+  add(builder, "copy", table_copy(0, 0, 1));
+  read(builder);
+
+  Runtime runtime(wasm, test_interpreter());
+  for (const char *function : {"init", "copy_to", "copy_from"}) {
+    EXPECT_EQ(run(runtime, function), TABLE_OUT_OF_BOUNDS) << function;
+  }
+  EXPECT_EQ(run(runtime, "copy"), NO_TRAP);
+}
@@ -0,0 +1,121 @@
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "runtime.hpp"
+#include "sections.hpp"
+#include "test_interpreter.hpp"
+#include "wasm_builder.hpp"
+
+// Counts all allocations of the test executable, such that a test can check
+// that a piece of code does not allocate at all
+static std::atomic<size_t> allocations(0);
+
+void *operator new(size_t size) {
+  allocations++;
+  void *ptr = std::malloc(size ? size : 1);
+  if (!ptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+// Kept out of line, GCC warns with -Wmismatched-new-delete when it sees the
+// std::free of a pointer from a new expression after inlining the delete
+[[gnu::noinline]] static void release(void *ptr) { std::free(ptr); }
+
+void operator delete(void *ptr) noexcept { release(ptr); }
+void operator delete(void *ptr, size_t) noexcept { release(ptr); }
+
+// sum(n) = n + sum(n - 1), with a local holding n - 1 across the call
+static Bytes recursive_sum_module() {
+  WasmBuilder builder;
+  uint32_t sum_type = builder.add_type({0x7F}, {0x7F});
+  uint32_t entry_type = builder.add_type({}, {});
+
+  uint32_t sum = builder.add_function(
+      sum_type, {{1, 0x7F}, {1, 0x7E}},
+      concat({op_u(0x20, 0), op(0x45), op_u(0x04, 0x7F), i32_const(0),
+              op(0x05), op_u(0x20, 0), i32_const(1), op(0x6b),
+              op_u(0x22, 1), op_u(0x10, 0), op_u(0x20, 1), op(0x6a),
+              i32_const(1), op(0x6a), op(0x0b)}));
+  uint32_t entry = builder.add_function(
+      entry_type, {},
+      concat({i32_const(0), i32_const(1000), op_u(0x10, sum),
+              mem_op(0x36, 2, 0)}));
+  builder.add_export("sum", entry);
+  return builder.build();
+}
+
+TEST(Calls, DeepRecursion) {
+  Bytes bytes = recursive_sum_module();
+  WasmFile wasm;
+  ASSERT_EQ(wasm.read_from_memory(bytes.data(), bytes.size()), 0);
+
+  std::string func = "sum";
+  Runtime runtime(wasm, test_interpreter());
+  runtime.run(func);
+  EXPECT_EQ(runtime.read_memory(0, 0, ImmediateRepr::I32).v.n32,
+            1000 * 1001 / 2);
+}
+
+TEST(Calls, CallsDoNotAllocate) {
+  Bytes bytes = recursive_sum_module();
+  WasmFile wasm;
+  ASSERT_EQ(wasm.read_from_memory(bytes.data(), bytes.size()), 0);
+
+  std::string func = "sum";
+  Runtime runtime(wasm, test_interpreter());
+  size_t before = allocations.load();
+  runtime.run(func);
+  EXPECT_EQ(allocations.load(), before);
+}
+
+// Calls the functions of a table through call_indirect, whose type is an
+// identical copy of the type they are declared with
+static Bytes indirect_calls_module() {
+  WasmBuilder builder;
+  uint32_t type = builder.add_type({0x7F}, {0x7F});
+  uint32_t entry_type = builder.add_type({}, {});
+  uint32_t copy = builder.add_type({0x7F}, {0x7F});
+  builder.add_type({0x7E}, {0x7F});
+
+  uint32_t add = builder.add_function(
+      type, {}, concat({op_u(0x20, 0), i32_const(10), op(0x6a)}));
+  uint32_t mul = builder.add_function(
+      type, {}, concat({op_u(0x20, 0), i32_const(3), op(0x6c)}));
+  builder.set_table({add, mul});
+
+  // mul(add(5)) stored at address 0
+  uint32_t entry = builder.add_function(
+      entry_type, {},
+      concat({i32_const(0), i32_const(5), i32_const(0), op_u(0x11, copy),
+              Bytes{0x00}, i32_const(1), op_u(0x11, copy), Bytes{0x00},
+              mem_op(0x36, 2, 0)}));
+  builder.add_export("f", entry);
+  return builder.build();
+}
+
+TEST(Calls, IndirectCallsCompareCanonicalTypes) {
+  Bytes bytes = indirect_calls_module();
+
+  for (bool lazy : {false, true}) {
+    WasmFile wasm;
+    wasm.lazy_code = lazy;
+    ASSERT_EQ(wasm.read_from_memory(bytes.data(), bytes.size()), 0);
+    std::vector<uint32_t> expected_ids = {0, 1, 0, 3};
+    EXPECT_EQ(wasm.type_ids, expected_ids);
+    EXPECT_EQ(wasm.function_type_id(1), 0u);
+
+    std::string func = "f";
+    Runtime runtime(wasm, test_interpreter());
+    runtime.run(func);
+    EXPECT_EQ(runtime.read_memory(0, 0, ImmediateRepr::I32).v.n32, 45u)
+        << "lazy " << lazy;
+  }
+}
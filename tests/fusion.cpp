@@ -0,0 +1,152 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "runtime.hpp"
+#include "sections.hpp"
+#include "single_function.hpp"
+#include "wasm_builder.hpp"
+
+TEST(Fusion, FusesSequences) {
+  Bytes body = concat({
+      op_u(0x20, 0), op_u(0x20, 1), op(0x6a), // local.get local.get i32.add
+      op_u(0x20, 0), i32_const(5), op(0x6b),  // local.get i32.const i32.sub
+      i32_const(3), op(0x6c),                 // i32.const i32.mul
+      op_u(0x20, 2), op(0x73),                // local.get i32.xor
+      op_u(0x21, 0), op_u(0x20, 1),           // local.set local.get
+      op(0x45), op_u(0x04, 0x40), op(0x0b),   // i32.eqz if end
+      i32_const(8), i32_const(9), mem_op(0x36, 2, 4), // i32.const i32.store
+      op(0x1a),
+  });
+  Bytes bytes = single_function(body);
+  WasmFile wasm;
+  read_function(wasm, bytes);
+
+  std::vector<OpCode> expected = {
+      OpCode::I32AddLL, OpCode::I32SubLC,    OpCode::I32MulC,
+      OpCode::I32xorL,  OpCode::LocalSetGet, OpCode::IfI32eqz,
+      OpCode::I32Const, OpCode::I32StoreC,   OpCode::Drop,
+      OpCode::Return};
+  EXPECT_EQ(ops(wasm.codes[0]), expected);
+
+  const std::vector<Instr> &expr = wasm.codes[0].expr;
+  EXPECT_EQ(expr[1].imm, 0u);
+  EXPECT_EQ(expr[1].imm2, 5u);
+  EXPECT_EQ(expr[2].imm, 3u);
+  EXPECT_EQ(expr[4].imm, 0u);
+  EXPECT_EQ(expr[4].imm2, 1u);
+  // The if continues behind its end, which is removed, when the condition is
+  // false
+  EXPECT_EQ(expr[5].target.pc, 6u);
+  EXPECT_EQ(expr[7].imm, 9u);
+  EXPECT_EQ(expr[7].imm2, 4u);
+}
+
+TEST(Fusion, RemovesBlocksAndEnds) {
+  // block block local.get br_table 0 1 end nop end loop end
+  Bytes body = concat({op_u(0x02, 0x40), op_u(0x02, 0x40), op_u(0x20, 0),
+                       Bytes{0x0e, 0x01, 0x00, 0x01}, op(0x0b), op(0x01),
+                       op(0x0b), op_u(0x03, 0x40), op(0x0b)});
+  Bytes bytes = single_function(body);
+  WasmFile wasm;
+  read_function(wasm, bytes);
+
+  std::vector<OpCode> expected = {OpCode::LocalGet, OpCode::BrTable,
+                                  OpCode::Loop, OpCode::Return};
+  EXPECT_EQ(ops(wasm.codes[0]), expected);
+
+  // Both labels continue at the loop, whose first instruction is the return
+  const Code &code = wasm.codes[0];
+  ASSERT_EQ(code.br_tables.size(), 2u);
+  EXPECT_EQ(code.br_tables[0].pc, 2u);
+  EXPECT_EQ(code.br_tables[1].pc, 2u);
+  ASSERT_EQ(code.loops.size(), 1u);
+  EXPECT_EQ(code.loops[0], 3u);
+}
+
+TEST(Fusion, CanBeDisabled) {
+  Bytes body = concat({op_u(0x20, 0), op_u(0x20, 1), op(0x6a), op(0x1a)});
+  Bytes bytes = single_function(body);
+  WasmFile wasm;
+  wasm.superinstructions = false;
+  read_function(wasm, bytes);
+
+  std::vector<OpCode> expected = {OpCode::LocalGet, OpCode::LocalGet,
+                                  OpCode::I32Add, OpCode::Drop,
+                                  OpCode::Return};
+  EXPECT_EQ(ops(wasm.codes[0]), expected);
+}
+
+// Loops over i in [0, 100) with branches in between fused instructions and
+// stores the accumulated result at address 0
+static Bytes loop_body() {
+  const uint32_t i = 0, acc = 1, t = 2;
+  return concat({
+      op_u(0x03, 0x40), // loop
+      // acc = acc + ((i * 3) ^ (i >> 1))
+      op_u(0x20, acc), op_u(0x20, i), i32_const(3), op(0x6c), op_u(0x20, i),
+      i32_const(1), op(0x76), op(0x73), op(0x6a), op_u(0x21, acc),
+      // if ((i & 1) == 0) acc = acc - 7
+      op_u(0x20, i), i32_const(1), op(0x71), op(0x45), op_u(0x04, 0x40),
+      op_u(0x20, acc), i32_const(7), op(0x6b), op_u(0x21, acc), op(0x0b),
+      // switch (i & 3) { case 0: acc += 1000; case 1: acc += 100; }
+      op_u(0x02, 0x40), op_u(0x02, 0x40), op_u(0x02, 0x40), op_u(0x20, i),
+      i32_const(3), op(0x71), Bytes{0x0e, 0x02, 0x00, 0x01, 0x02}, op(0x0b),
+      op_u(0x20, acc), i32_const(1000), op(0x6a), op_u(0x21, acc), op(0x0b),
+      op_u(0x20, acc), i32_const(100), op(0x6a), op_u(0x21, acc), op(0x0b),
+      // if (i > 50) t = t + 1
+      op_u(0x20, i), i32_const(50), op(0x4a), op_u(0x04, 0x40),
+      op_u(0x20, t), i32_const(1), op(0x6a), op_u(0x21, t), op(0x0b),
+      // while (++i < 100)
+      op_u(0x20, i), i32_const(1), op(0x6a), op_u(0x22, i), i32_const(100),
+      op(0x49), op_u(0x0d, 0),
+      op(0x0b),
+      i32_const(0), op_u(0x20, acc), op_u(0x20, t), op(0x6a),
+      mem_op(0x36, 2, 0),
+  });
+}
+
+static uint32_t expected_loop_result() {
+  uint32_t acc = 0, t = 0;
+  for (uint32_t i = 0; i < 100; i++) {
+    acc = acc + ((i * 3) ^ (i >> 1));
+    if ((i & 1) == 0) {
+      acc = acc - 7;
+    }
+    switch (i & 3) {
+    case 0:
+      acc += 1000;
+      // fall through
+    case 1:
+      acc += 100;
+    }
+    if (i > 50) {
+      t = t + 1;
+    }
+  }
+  return acc + t;
+}
+
+TEST(Fusion, SameResultAsUnfused) {
+  Bytes bytes = single_function(loop_body());
+  std::string func = "f";
+
+  WasmFile plain;
+  plain.superinstructions = false;
+  read_function(plain, bytes);
+  Runtime plain_runtime(plain);
+  plain_runtime.run(func);
+  EXPECT_EQ(plain_runtime.read_memory(0, 0, ImmediateRepr::I32).v.n32,
+            expected_loop_result());
+
+  WasmFile fused;
+  read_function(fused, bytes);
+  Runtime fused_runtime(fused);
+  fused_runtime.run(func);
+  EXPECT_EQ(fused_runtime.read_memory(0, 0, ImmediateRepr::I32).v.n32,
+            expected_loop_result());
+
+  EXPECT_LT(fused.codes[0].expr.size(), plain.codes[0].expr.size());
+}
@@ -0,0 +1,128 @@
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "jit.hpp"
+#include "runtime.hpp"
+#include "sections.hpp"
+#include "wasm_builder.hpp"
+
+// Returns the permissions of the mapping containing address, as listed in
+// /proc/self/maps, or an empty string
+static std::string permissions(const void *address) {
+  uintptr_t target = reinterpret_cast<uintptr_t>(address);
+  std::ifstream maps("/proc/self/maps");
+  std::string line;
+  while (std::getline(maps, line)) {
+    std::istringstream fields(line);
+    std::string range, perms;
+    fields >> range >> perms;
+    size_t dash = range.find('-');
+    uintptr_t start = std::stoull(range.substr(0, dash), nullptr, 16);
+    uintptr_t end = std::stoull(range.substr(dash + 1), nullptr, 16);
+    if (start <= target && target < end) {
+      return perms;
+    }
+  }
+  return "";
+}
+
+static uint32_t run(const WasmFile &wasm, Interpreter interpreter) {
+  std::string func = "f";
+  Runtime runtime(wasm, interpreter);
+  runtime.run(func);
+  return runtime.read_memory(0, 0, ImmediateRepr::I32).v.n32;
+}
+
+// (i32) -> i32 function with i32 locals, exported as "g", called by "f"
+// with argument and stored at address 0
+static Bytes call_module(uint32_t argument, uint32_t locals,
+                         const Bytes &body) {
+  WasmBuilder builder;
+  uint32_t type = builder.add_type({0x7F}, {0x7F});
+  uint32_t entry_type = builder.add_type({}, {});
+  uint32_t g = builder.add_function(type, {{locals, 0x7F}}, body);
+  uint32_t f = builder.add_function(
+      entry_type, {},
+      concat({i32_const(0), i32_const(argument), op_u(0x10, g),
+              mem_op(0x36, 2, 0)}));
+  builder.add_export("f", f);
+  return builder.build();
+}
+
+TEST(Jit, CodeIsExecutableButNotWritable) {
+  if (!jit_supported()) {
+    GTEST_SKIP() << "no JIT compiler for this platform";
+  }
+  Bytes bytes = call_module(1, 0, concat({op_u(0x20, 0)}));
+  WasmFile wasm;
+  ASSERT_EQ(wasm.read_from_memory(bytes.data(), bytes.size()), 0);
+
+  const JitFunction &function = wasm.jit_function(0);
+  ASSERT_NE(function.entry, nullptr);
+  EXPECT_EQ(permissions(function.code).substr(0, 3), "r-x");
+  EXPECT_EQ(run(wasm, JIT_COMPILER), 1u);
+}
+
+TEST(Jit, BrTable) {
+  // switch (n) { case 0: 10; case 1: 20; case 2: 30; default: 40 }
+  Bytes body = concat({
+      op_u(0x02, 0x7F), op_u(0x02, 0x7F), op_u(0x02, 0x7F), op_u(0x02, 0x7F),
+      i32_const(10), op_u(0x20, 0), Bytes{0x0e, 0x03, 0x00, 0x01, 0x02, 0x03},
+      op(0x0b), i32_const(10), op(0x6a), op(0x0b), i32_const(10), op(0x6a),
+      op(0x0b), i32_const(10), op(0x6a), op(0x0b),
+  });
+  uint32_t expected[] = {40, 30, 20, 10, 10, 10};
+  for (uint32_t n = 0; n < 6; n++) {
+    Bytes bytes = call_module(n, 0, body);
+    WasmFile wasm;
+    ASSERT_EQ(wasm.read_from_memory(bytes.data(), bytes.size()), 0);
+    EXPECT_EQ(run(wasm, STACK_INTERPRETER), expected[n]) << n;
+    EXPECT_EQ(run(wasm, JIT_COMPILER), expected[n]) << n;
+  }
+}
+
+TEST(Jit, AccessesGrownMemory) {
+  // Stores n behind the first page after growing the memory, then loads it
+  // with an offset
+  Bytes body = concat({
+      i32_const(1), op(0x40), op(0x00), op(0x1a), // memory.grow 1, drop
+      i32_const(70000), op_u(0x20, 0), mem_op(0x36, 2, 0),
+      i32_const(69000), mem_op(0x28, 2, 1000),
+  });
+  Bytes bytes = call_module(1234, 0, body);
+  WasmFile wasm;
+  ASSERT_EQ(wasm.read_from_memory(bytes.data(), bytes.size()), 0);
+  EXPECT_EQ(run(wasm, JIT_COMPILER), 1234u);
+}
+
+TEST(Jit, IntegerArithmetic) {
+  // Mixes all natively compiled i32 and i64 operations of n
+  const uint32_t n = 0, l = 1;
+  Bytes body = concat({
+      op_u(0x20, n), i32_const(7), op(0x6c), i32_const(3), op(0x6b),
+      op_u(0x20, n), i32_const(5), op(0x74), op(0x73), i32_const(2), op(0x75),
+      op_u(0x20, n), op(0x76), i32_const(12345), op(0x71), i32_const(3),
+      op(0x77), i32_const(1), op(0x78), i32_const(99), op(0x72),
+      op_u(0x21, l),
+      // i64: ((l as i64) * 3 - 1) << 33 >> 31, then wrapped
+      op_u(0x20, l), op(0xAD), i64_const(3), op(0x7E), i64_const(1), op(0x7D),
+      i64_const(33), op(0x86), i64_const(31), op(0x88), op(0xA7),
+      // plus all comparisons of l and n
+      op_u(0x20, l), op_u(0x20, n), op(0x48), op(0x6a),
+      op_u(0x20, l), op_u(0x20, n), op(0x4b), op(0x6a),
+      op_u(0x20, l), op_u(0x20, n), op(0x4c), op(0x6a),
+      op_u(0x20, l), op_u(0x20, n), op(0x4f), op(0x6a),
+      op_u(0x20, n), op(0x45), op(0x6a),
+  });
+  for (uint32_t argument : {0u, 1u, 17u, 0x80000001u, 0xFFFFFFFFu}) {
+    Bytes bytes = call_module(argument, 1, body);
+    WasmFile wasm;
+    ASSERT_EQ(wasm.read_from_memory(bytes.data(), bytes.size()), 0);
+    EXPECT_EQ(run(wasm, JIT_COMPILER), run(wasm, STACK_INTERPRETER))
+        << argument;
+  }
+}
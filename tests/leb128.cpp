@@ -56,3 +56,68 @@ TEST(LEB128, DecodingNegativeSigned) {
   int32_t result = leb128_decode<int32_t>(ptr, end);
   EXPECT_EQ(result, -42);
 }
+
+TEST(LEB128, DecodingUnsignedMaxValues) {
+  std::vector<uint8_t> data = {0xFF, 0xFF, 0xFF, 0xFF, 0x0F, 0xFF, 0xFF,
+                               0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x01};
+  const uint8_t *ptr = &data[0];
+  const uint8_t *end = data.data() + data.size();
+
+  EXPECT_EQ(uleb128_decode<uint32_t>(ptr, end), 0xFFFFFFFF);
+  EXPECT_EQ(uleb128_decode<uint64_t>(ptr, end), 0xFFFFFFFFFFFFFFFF);
+  EXPECT_EQ(ptr, end);
+}
+
+TEST(LEB128, DecodingSignedSingleByteRange) {
+  std::vector<uint8_t> data = {0x3F, 0x40, 0x7F, 0x00};
+  const uint8_t *ptr = &data[0];
+  const uint8_t *end = data.data() + data.size();
+
+  EXPECT_EQ(leb128_decode<int32_t>(ptr, end), 63);
+  EXPECT_EQ(leb128_decode<int32_t>(ptr, end), -64);
+  EXPECT_EQ(leb128_decode<int64_t>(ptr, end), -1);
+  EXPECT_EQ(leb128_decode<int64_t>(ptr, end), 0);
+}
+
+TEST(LEB128, DecodingSignedMinValues) {
+  std::vector<uint8_t> data = {0x80, 0x80, 0x80, 0x80, 0x78, 0x80, 0x80,
+                               0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x7F};
+  const uint8_t *ptr = &data[0];
+  const uint8_t *end = data.data() + data.size();
+
+  EXPECT_EQ(leb128_decode<int32_t>(ptr, end), INT32_MIN);
+  EXPECT_EQ(leb128_decode<int64_t>(ptr, end), INT64_MIN);
+  EXPECT_EQ(ptr, end);
+}
+
+TEST(LEB128, BulkDecodingMatchesSingleValues) {
+  // Runs of single byte values mixed with longer ones, ending close to the
+  // end of the buffer such that the word wise reads have to stop in time
+  std::vector<uint32_t> values;
+  for (uint32_t i = 0; i < 300; i++) {
+    if (i % 37 == 0) {
+      values.push_back(0xFFFFFFFF - i);
+    } else if (i % 11 == 0) {
+      values.push_back(i * 1000);
+    } else {
+      values.push_back(i % 128);
+    }
+  }
+
+  std::vector<uint8_t> data;
+  for (uint32_t value : values) {
+    do {
+      uint8_t block = value & 0x7F;
+      value >>= 7;
+      data.push_back(value != 0 ? block | 0x80 : block);
+    } while (value != 0);
+  }
+
+  const uint8_t *ptr = &data[0];
+  const uint8_t *end = data.data() + data.size();
+  std::vector<uint32_t> result(values.size());
+  uleb128_decode_u32s(ptr, end, result.data(), result.size());
+
+  EXPECT_EQ(result, values);
+  EXPECT_EQ(ptr, end);
+}
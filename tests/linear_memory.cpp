@@ -0,0 +1,104 @@
+#include <cstdint>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "linear_memory.hpp"
+#include "runtime.hpp"
+#include "sections.hpp"
+#include "test_interpreter.hpp"
+#include "wasm_builder.hpp"
+
+TEST(LinearMemory, GrowKeepsContents) {
+  LinearMemory memory;
+  memory.reset(1);
+  ASSERT_EQ(memory.size(), static_cast<size_t>(MEMORY_PAGE_SIZE));
+  memory[100] = 42;
+  const uint8_t *data = memory.data();
+
+  ASSERT_TRUE(memory.grow(3));
+  EXPECT_EQ(memory.pages(), 4u);
+  EXPECT_EQ(memory[100], 42);
+  EXPECT_EQ(memory[4 * MEMORY_PAGE_SIZE - 1], 0);
+  // Only a reserved memory stays in place
+  if (memory.reserved()) {
+    EXPECT_EQ(memory.data(), data);
+  }
+}
+
+TEST(LinearMemory, ResetZeroes) {
+  LinearMemory memory;
+  memory.reset(2);
+  memory[0] = 1;
+  memory[2 * MEMORY_PAGE_SIZE - 1] = 2;
+
+  memory.reset(2);
+  EXPECT_EQ(memory[0], 0);
+  EXPECT_EQ(memory[2 * MEMORY_PAGE_SIZE - 1], 0);
+
+  memory.reset(1);
+  ASSERT_TRUE(memory.grow(1));
+  EXPECT_EQ(memory[2 * MEMORY_PAGE_SIZE - 1], 0);
+}
+
+TEST(LinearMemory, GrowsUpToFourGiB) {
+  LinearMemory memory;
+  memory.reset(1);
+  EXPECT_FALSE(memory.grow(MAX_MEMORY_PAGES));
+  EXPECT_EQ(memory.pages(), 1u);
+
+  // Committing without touching the pages uses no memory, but a vector would
+  // allocate all of it
+  if (!memory.reserved()) {
+    GTEST_SKIP() << "address space not reserved";
+  }
+  ASSERT_TRUE(memory.grow(MAX_MEMORY_PAGES - 1));
+  EXPECT_EQ(memory.size(), uint64_t(MAX_MEMORY_PAGES) * MEMORY_PAGE_SIZE);
+  memory[memory.size() - 1] = 7;
+  EXPECT_EQ(memory[memory.size() - 1], 7);
+  EXPECT_FALSE(memory.grow(1));
+}
+
+TEST(LinearMemory, ResetFailsAboveFourGiB) {
+  LinearMemory memory;
+  ASSERT_TRUE(memory.reset(2));
+  EXPECT_FALSE(memory.reset(MAX_MEMORY_PAGES + 1));
+  EXPECT_EQ(memory.size(), 0u);
+  ASSERT_TRUE(memory.reset(1));
+  EXPECT_EQ(memory[0], 0);
+}
+
+TEST(LinearMemoryDeathTest, AccessBehindSizeFaults) {
+  LinearMemory memory;
+  memory.reset(1);
+  if (!memory.reserved()) {
+    GTEST_SKIP() << "address space not reserved";
+  }
+  // Behind the memory and far into the guard region
+  volatile uint8_t *data = memory.data();
+  EXPECT_DEATH(data[MEMORY_PAGE_SIZE] = 1, "");
+  EXPECT_DEATH(data[(uint64_t(1) << 33)] = 1, "");
+}
+
+TEST(LinearMemory, MemoryGrowFailsBeyondLimit) {
+  // Stores memory.grow(65536), memory.grow(1) and memory.size at 0, 4 and 8
+  WasmBuilder builder;
+  uint32_t type = builder.add_type({}, {});
+  uint32_t f = builder.add_function(
+      type, {},
+      concat({i32_const(0), i32_const(MAX_MEMORY_PAGES), op_u(0x40, 0x00),
+              mem_op(0x36, 2, 0), i32_const(4), i32_const(1),
+              op_u(0x40, 0x00), mem_op(0x36, 2, 0), i32_const(8),
+              op_u(0x3F, 0x00), mem_op(0x36, 2, 0)}));
+  builder.add_export("f", f);
+  Bytes bytes = builder.build();
+  WasmFile wasm;
+  ASSERT_EQ(wasm.read_from_memory(bytes.data(), bytes.size()), 0);
+
+  std::string func = "f";
+  Runtime runtime(wasm, test_interpreter());
+  runtime.run(func);
+  EXPECT_EQ(runtime.read_memory(0, 0, ImmediateRepr::I32).v.n32, UINT32_MAX);
+  EXPECT_EQ(runtime.read_memory(0, 4, ImmediateRepr::I32).v.n32, 1u);
+  EXPECT_EQ(runtime.read_memory(0, 8, ImmediateRepr::I32).v.n32, 2u);
+}
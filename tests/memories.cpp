@@ -0,0 +1,175 @@
+#include <cstdint>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "runtime.hpp"
+#include "sections.hpp"
+#include "test_interpreter.hpp"
+#include "trap.hpp"
+#include "wasm_builder.hpp"
+
+// Stores memory.size of memory at address 0 of memory 0
+static Bytes store_size(uint32_t memory) {
+  return concat({i32_const(0), op_u(0x3F, memory), mem_op(0x36, 2, 0)});
+}
+
+// Stores memory.grow of memory by delta at address 0 of memory 0
+static Bytes store_grow(uint32_t memory, int32_t delta) {
+  return concat({i32_const(0), i32_const(delta), op_u(0x40, memory),
+                 mem_op(0x36, 2, 0)});
+}
+
+class Memories : public ::testing::Test {
+protected:
+  // The module refers to its bytes
+  Bytes bytes;
+  WasmFile wasm;
+
+  void read(WasmBuilder &builder) {
+    bytes = builder.build();
+    ASSERT_EQ(wasm.read_from_memory(bytes.data(), bytes.size()), 0)
+        << wasm.validation_error.message;
+  }
+
+  static void add(WasmBuilder &builder, const char *name, const Bytes &body) {
+    builder.add_export(name, builder.add_function(0, {}, body));
+  }
+
+  // Runs function and returns the value at address 0 of memory 0
+  static uint32_t run(Runtime &runtime, const char *function,
+                      Trap trap = NO_TRAP) {
+    std::string func = function;
+    EXPECT_EQ(runtime.run(func), trap) << function;
+    return runtime.read_memory(0, 0, ImmediateRepr::I32).v.n32;
+  }
+};
+
+TEST_F(Memories, SizedFromLimits) {
+  WasmBuilder builder;
+  builder.add_type({}, {});
+  builder.memory_pages = 3;
+  uint32_t second = builder.add_memory(0);
+  add(builder, "size", store_size(0));
+  add(builder, "second_size", store_size(second));
+  read(builder);
+
+  Runtime runtime(wasm, test_interpreter());
+  EXPECT_EQ(run(runtime, "size"), 3u);
+  EXPECT_EQ(run(runtime, "second_size"), 0u);
+}
+
+TEST_F(Memories, AccessesAddressTheirMemory) {
+  // Memory 1 has a single page, memory 0 two of them
+  WasmBuilder builder;
+  builder.add_type({}, {});
+  builder.memory_pages = 2;
+  uint32_t second = builder.add_memory(1);
+  add(builder, "store",
+      concat({i32_const(8), i32_const(5), mem_op_at(0x36, second, 2, 0),
+              i32_const(4), i32_const(8), mem_op_at(0x28, second, 2, 0),
+              mem_op(0x36, 2, 0)}));
+  add(builder, "behind_second",
+      concat({i32_const(MEMORY_PAGE_SIZE), i32_const(1),
+              mem_op_at(0x3A, second, 0, 0)}));
+  add(builder, "behind_first",
+      concat({i32_const(MEMORY_PAGE_SIZE), i32_const(1), mem_op(0x3A, 0, 0)}));
+  read(builder);
+
+  Runtime runtime(wasm, test_interpreter());
+  run(runtime, "store");
+  EXPECT_EQ(runtime.read_memory(0, 4, ImmediateRepr::I32).v.n32, 5u);
+  EXPECT_EQ(runtime.read_memory(0, 8, ImmediateRepr::I32).v.n32, 0u);
+  EXPECT_EQ(runtime.read_memory(second, 8, ImmediateRepr::I32).v.n32, 5u);
+
+  run(runtime, "behind_second", MEMORY_OUT_OF_BOUNDS);
+  run(runtime, "behind_first");
+  EXPECT_EQ(runtime.read_memory(0, MEMORY_PAGE_SIZE, ImmediateRepr::Byte).v.n32,
+            1u);
+}
+
+TEST_F(Memories, GrowStopsAtMaximum) {
+  WasmBuilder builder;
+  builder.add_type({}, {});
+  uint32_t second = builder.add_memory(1, 2);
+  add(builder, "grow", store_grow(second, 1));
+  add(builder, "store",
+      concat({i32_const(2 * MEMORY_PAGE_SIZE - 4), i32_const(7),
+              mem_op_at(0x36, second, 2, 0)}));
+  read(builder);
+
+  Runtime runtime(wasm, test_interpreter());
+  EXPECT_EQ(run(runtime, "grow"), 1u);
+  EXPECT_EQ(run(runtime, "grow"), UINT32_MAX);
+  run(runtime, "store");
+  EXPECT_EQ(runtime
+                .read_memory(second, 2 * MEMORY_PAGE_SIZE - 4,
+                             ImmediateRepr::I32)
+                .v.n32,
+            7u);
+}
+
+TEST_F(Memories, BulkInstructionsAcrossMemories) {
+  WasmBuilder builder;
+  builder.add_type({}, {});
+  uint32_t second = builder.add_memory(1);
+  // Fills [16, 24) of memory 1 and copies [20, 28) of it to 4 in memory 0
+  add(builder, "fill_and_copy",
+      concat({i32_const(16), i32_const(9), i32_const(8),
+              misc_op(11, {second}), i32_const(4), i32_const(20),
+              i32_const(8), misc_op(10, {0, second})}));
+  add(builder, "copy_behind_second",
+      concat({i32_const(0), i32_const(MEMORY_PAGE_SIZE - 4), i32_const(8),
+              misc_op(10, {0, second})}));
+  read(builder);
+
+  Runtime runtime(wasm, test_interpreter());
+  run(runtime, "fill_and_copy");
+  EXPECT_EQ(runtime.read_memory(0, 4, ImmediateRepr::I32).v.n32, 0x09090909u);
+  EXPECT_EQ(runtime.read_memory(0, 8, ImmediateRepr::I32).v.n32, 0u);
+  EXPECT_EQ(runtime.read_memory(second, 12, ImmediateRepr::I32).v.n32, 0u);
+  EXPECT_EQ(runtime.read_memory(second, 16, ImmediateRepr::I32).v.n32,
+            0x09090909u);
+  run(runtime, "copy_behind_second", MEMORY_OUT_OF_BOUNDS);
+}
+
+TEST_F(Memories, ResetLeavesOtherMemoriesAlone) {
+  WasmBuilder builder;
+  builder.add_type({}, {});
+  uint32_t scratch = builder.add_memory(1);
+  add(builder, "use",
+      concat({store_grow(scratch, 2), i32_const(4), i32_const(3),
+              mem_op_at(0x36, scratch, 2, 0), i32_const(4), i32_const(6),
+              mem_op(0x36, 2, 0)}));
+  add(builder, "size", store_size(scratch));
+  read(builder);
+
+  Runtime runtime(wasm, test_interpreter());
+  EXPECT_EQ(run(runtime, "use"), 1u);
+  EXPECT_EQ(run(runtime, "size"), 3u);
+  EXPECT_TRUE(runtime.reset_memory(scratch));
+  EXPECT_EQ(runtime.read_memory(scratch, 4, ImmediateRepr::I32).v.n32, 0u);
+  EXPECT_EQ(runtime.read_memory(0, 4, ImmediateRepr::I32).v.n32, 6u);
+  EXPECT_EQ(run(runtime, "size"), 1u);
+
+  // Memory 0 resets the same way
+  EXPECT_TRUE(runtime.reset_memory(0));
+  EXPECT_EQ(runtime.read_memory(0, 4, ImmediateRepr::I32).v.n32, 0u);
+  EXPECT_EQ(run(runtime, "use"), 1u);
+  EXPECT_EQ(runtime.read_memory(scratch, 4, ImmediateRepr::I32).v.n32, 3u);
+}
+
+TEST_F(Memories, OutOfBoundsDataFailsInstantiation) {
+  WasmBuilder builder;
+  builder.add_type({}, {});
+  builder.add_data(0, {1});
+  builder.add_data(MEMORY_PAGE_SIZE - 2, {1, 2, 3, 4});
+  add(builder, "store", store_size(0));
+  read(builder);
+
+  Runtime runtime(wasm, test_interpreter());
+  EXPECT_EQ(runtime.instantiation_trap, MEMORY_OUT_OF_BOUNDS);
+  // Nothing runs afterwards, segments before the failing one are copied
+  run(runtime, "store", MEMORY_OUT_OF_BOUNDS);
+  EXPECT_EQ(runtime.read_memory(0, 0, ImmediateRepr::Byte).v.n32, 1u);
+}
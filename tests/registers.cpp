@@ -0,0 +1,133 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "registers.hpp"
+#include "runtime.hpp"
+#include "sections.hpp"
+#include "single_function.hpp"
+#include "wasm_builder.hpp"
+
+TEST(Registers, OperandsAreSlots) {
+  Bytes body = concat({
+      op_u(0x20, 0), op_u(0x20, 1), op(0x6a), op_u(0x21, 2), // l2 = l0 + l1
+      op_u(0x20, 2), i32_const(5), op(0x6b),                 // l2 - 5
+      i32_const(5), op(0x6c), op_u(0x21, 0),                 // l0 = _ * 5
+  });
+  Bytes bytes = single_function(body);
+  WasmFile wasm;
+  read_function(wasm, bytes);
+
+  const RegisterCode &code = wasm.register_code(0);
+  std::vector<OpCode> expected = {OpCode::I32Add, OpCode::I32Sub,
+                                  OpCode::I32Mul, OpCode::Return};
+  EXPECT_EQ(ops(code), expected);
+
+  // Both uses of 5 share a constant, placed behind the locals
+  ASSERT_EQ(code.constants.size(), 1u);
+  EXPECT_EQ(code.constants[0].n32, 5u);
+  EXPECT_EQ(code.constants_slot, 3u);
+
+  // Results of local.set are written to the local directly
+  EXPECT_EQ(code.instrs[0].dst, 2u);
+  EXPECT_EQ(code.instrs[0].a, 0u);
+  EXPECT_EQ(code.instrs[0].b, 1u);
+  EXPECT_EQ(code.instrs[1].a, 2u);
+  EXPECT_EQ(code.instrs[1].b, 3u);
+  EXPECT_EQ(code.instrs[2].a, code.instrs[1].dst);
+  EXPECT_EQ(code.instrs[2].b, 3u);
+  EXPECT_EQ(code.instrs[2].dst, 0u);
+}
+
+// Exercises calls, block results, br_if carrying a value, select and a swap
+// of two locals, which must not read a local after it has been overwritten
+static Bytes mixed_module() {
+  const uint32_t i = 0, acc = 1, x = 2, y = 3;
+  WasmBuilder builder;
+  uint32_t add3_type = builder.add_type({0x7F, 0x7F, 0x7F}, {0x7F});
+  uint32_t entry_type = builder.add_type({}, {});
+  uint32_t add3 = builder.add_function(
+      add3_type, {},
+      concat({op_u(0x20, 0), op_u(0x20, 1), op(0x6a), op_u(0x20, 2),
+              op(0x6a)}));
+  uint32_t entry = builder.add_function(
+      entry_type, {{4, 0x7F}},
+      concat({
+          i32_const(3), op_u(0x21, x), i32_const(5), op_u(0x21, y),
+          // swap x and y through the operand stack
+          op_u(0x20, x), op_u(0x20, y), op_u(0x21, x), op_u(0x21, y),
+          i32_const(0), // address of the store below
+          op_u(0x02, 0x7F), // block (result i32)
+          op_u(0x03, 0x40), // loop
+          // acc = add3(acc, i, select(1, 2, i & 1))
+          op_u(0x20, acc), op_u(0x20, i), i32_const(1), i32_const(2),
+          op_u(0x20, i), i32_const(1), op(0x71), op(0x1b),
+          op_u(0x10, add3), op_u(0x21, acc),
+          // while (++i < 10)
+          op_u(0x20, i), i32_const(1), op(0x6a), op_u(0x22, i), i32_const(10),
+          op(0x48), op_u(0x0d, 0),
+          op(0x0b),
+          // acc leaves the block if it is greater than 50, otherwise 7 does
+          op_u(0x20, acc), op_u(0x20, acc), i32_const(50), op(0x4b),
+          op_u(0x0d, 0), op(0x1a), i32_const(7),
+          op(0x0b),
+          i32_const(100), op(0x6c), op_u(0x20, x), i32_const(10), op(0x6c),
+          op(0x6a), op_u(0x20, y), op(0x6a),
+          mem_op(0x36, 2, 0),
+      }));
+  builder.add_export("f", entry);
+  return builder.build();
+}
+
+static uint32_t expected_mixed_result() {
+  uint32_t acc = 0;
+  for (uint32_t i = 0; i < 10; i++) {
+    acc = acc + i + ((i & 1) ? 1 : 2);
+  }
+  uint32_t result = acc > 50 ? acc : 7;
+  return result * 100 + 5 * 10 + 3;
+}
+
+TEST(Registers, SameResultAsStack) {
+  Bytes bytes = mixed_module();
+  std::string func = "f";
+
+  WasmFile wasm;
+  ASSERT_EQ(wasm.read_from_memory(bytes.data(), bytes.size()), 0)
+      << wasm.validation_error.message;
+
+  for (Interpreter interpreter : {STACK_INTERPRETER, REGISTER_INTERPRETER}) {
+    Runtime runtime(wasm, interpreter);
+    runtime.run(func);
+    EXPECT_EQ(runtime.read_memory(0, 0, ImmediateRepr::I32).v.n32,
+              expected_mixed_result());
+  }
+}
+
+TEST(Registers, FewerInstructionsThanStack) {
+  Bytes bytes = mixed_module();
+  WasmFile wasm;
+  wasm.superinstructions = false;
+  ASSERT_EQ(wasm.read_from_memory(bytes.data(), bytes.size()), 0);
+
+  for (uint32_t i = 0; i < wasm.codes.size(); i++) {
+    EXPECT_LT(wasm.register_code(i).instrs.size(), wasm.codes[i].expr.size());
+  }
+}
+
+TEST(Registers, TranslatedOnFirstCallOfLazyModules) {
+  Bytes bytes = mixed_module();
+  WasmFile wasm;
+  wasm.lazy_code = true;
+  ASSERT_EQ(wasm.read_from_memory(bytes.data(), bytes.size()), 0);
+  EXPECT_TRUE(wasm.register_codes[1].instrs.empty());
+
+  std::string func = "f";
+  Runtime runtime(wasm, REGISTER_INTERPRETER);
+  runtime.run(func);
+  EXPECT_EQ(runtime.read_memory(0, 0, ImmediateRepr::I32).v.n32,
+            expected_mixed_result());
+  EXPECT_FALSE(wasm.register_codes[1].instrs.empty());
+}
@@ -0,0 +1,265 @@
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "runtime.hpp"
+#include "sections.hpp"
+#include "trap.hpp"
+#include "wasm_builder.hpp"
+
+static std::vector<uint8_t> read_bytes(const char *path) {
+  std::ifstream file(path, std::ios::binary);
+  return std::vector<uint8_t>(std::istreambuf_iterator<char>(file),
+                              std::istreambuf_iterator<char>());
+}
+
+TEST(Sections, ReadFromMemoryMatchesRead) {
+  const char *path = "test_binaries/03_test_prio2.wasm";
+  std::vector<uint8_t> bytes = read_bytes(path);
+  ASSERT_FALSE(bytes.empty());
+
+  WasmFile from_file;
+  ASSERT_EQ(from_file.read(path), 0);
+  WasmFile from_memory;
+  ASSERT_EQ(from_memory.read_from_memory(bytes.data(), bytes.size()), 0);
+
+  ASSERT_EQ(from_file.codes.size(), from_memory.codes.size());
+  for (size_t i = 0; i < from_file.codes.size(); i++) {
+    EXPECT_EQ(from_file.codes[i].expr.size(), from_memory.codes[i].expr.size());
+  }
+
+  ASSERT_EQ(from_file.data.size(), from_memory.data.size());
+  for (size_t i = 0; i < from_file.data.size(); i++) {
+    const ByteView &a = from_file.data[i].bytes;
+    const ByteView &b = from_memory.data[i].bytes;
+    ASSERT_EQ(a.size(), b.size());
+    EXPECT_TRUE(std::equal(a.begin(), a.end(), b.begin()));
+  }
+}
+
+TEST(Sections, DataSegmentsReferenceModuleBytes) {
+  std::vector<uint8_t> bytes =
+      read_bytes("test_binaries/07_test_bulk_memory.wasm");
+  WasmFile wasm;
+  ASSERT_EQ(wasm.read_from_memory(bytes.data(), bytes.size()), 0);
+
+  ASSERT_FALSE(wasm.data.empty());
+  for (const DataSegment &segment : wasm.data) {
+    EXPECT_GE(segment.bytes.begin(), bytes.data());
+    EXPECT_LE(segment.bytes.end(), bytes.data() + bytes.size());
+  }
+}
+
+TEST(Sections, CustomSection) {
+  // Empty module with a custom section "name" holding 3 bytes
+  std::vector<uint8_t> bytes = {0x00, 0x61, 0x73, 0x6D, 0x01, 0x00, 0x00,
+                                0x00, 0x00, 0x08, 0x04, 'n',  'a',  'm',
+                                'e',  0x01, 0x02, 0x03};
+  WasmFile wasm;
+  ASSERT_EQ(wasm.read_from_memory(bytes.data(), bytes.size()), 0);
+
+  ASSERT_EQ(wasm.custom_sections.size(), 1);
+  EXPECT_EQ(wasm.custom_sections[0].name, "name");
+  EXPECT_EQ(wasm.custom_sections[0].bytes.size(), 3);
+  EXPECT_EQ(wasm.custom_sections[0].bytes.data(), bytes.data() + 15);
+}
+
+TEST(Sections, TruncatedSection) {
+  // Type section claiming more bytes than the module has
+  std::vector<uint8_t> bytes = {0x00, 0x61, 0x73, 0x6D, 0x01, 0x00,
+                                0x00, 0x00, 0x01, 0x10, 0x00};
+  WasmFile wasm;
+  EXPECT_EQ(wasm.read_from_memory(bytes.data(), bytes.size()), 1);
+}
+
+TEST(Sections, MissingFile) {
+  WasmFile wasm;
+  EXPECT_EQ(wasm.read("test_binaries/does_not_exist.wasm"), 1);
+}
+
+static void expect_same_codes(const WasmFile &serial, const WasmFile &parallel) {
+  ASSERT_EQ(serial.codes.size(), parallel.codes.size());
+  for (size_t i = 0; i < serial.codes.size(); i++) {
+    const Code &a = serial.codes[i];
+    const Code &b = parallel.codes[i];
+
+    ASSERT_EQ(a.locals.size(), b.locals.size()) << "function " << i;
+    for (size_t j = 0; j < a.locals.size(); j++) {
+      EXPECT_EQ(a.locals[j].count, b.locals[j].count);
+      EXPECT_EQ(a.locals[j].type, b.locals[j].type);
+    }
+
+    ASSERT_EQ(a.br_tables.size(), b.br_tables.size()) << "function " << i;
+    for (size_t j = 0; j < a.br_tables.size(); j++) {
+      EXPECT_EQ(a.br_tables[j].pc, b.br_tables[j].pc);
+      EXPECT_EQ(a.br_tables[j].height, b.br_tables[j].height);
+      EXPECT_EQ(a.br_tables[j].arity, b.br_tables[j].arity);
+    }
+
+    // Compared member wise, since unused bytes of the union are undefined
+    ASSERT_EQ(a.expr.size(), b.expr.size()) << "function " << i;
+    for (size_t pc = 0; pc < a.expr.size(); pc++) {
+      const Instr &x = a.expr[pc];
+      const Instr &y = b.expr[pc];
+      ASSERT_EQ(x.op, y.op) << "function " << i << " pc " << pc;
+      EXPECT_EQ(x.imm, y.imm);
+      if (x.op >= OpCode::I32Const && x.op <= OpCode::F64Const) {
+        EXPECT_EQ(x.value.t, y.value.t);
+        EXPECT_EQ(x.value.v.n64, y.value.v.n64);
+      } else {
+        EXPECT_EQ(x.target.pc, y.target.pc);
+        EXPECT_EQ(x.target.height, y.target.height);
+        EXPECT_EQ(x.target.arity, y.target.arity);
+      }
+    }
+  }
+}
+
+TEST(Sections, ParallelCodeMatchesSerial) {
+  const char *paths[] = {
+      "test_binaries/01_test.wasm",       "test_binaries/02_test_prio1.wasm",
+      "test_binaries/03_test_prio2.wasm", "test_binaries/04_test_prio3.wasm",
+      "test_binaries/05_test_complex.wasm",
+      "test_binaries/07_test_bulk_memory.wasm"};
+
+  for (const char *path : paths) {
+    WasmFile serial;
+    serial.parse_threads = 1;
+    ASSERT_EQ(serial.read(path), 0) << path;
+
+    WasmFile parallel;
+    parallel.parse_threads = 4;
+    ASSERT_EQ(parallel.read(path), 0) << path;
+
+    expect_same_codes(serial, parallel);
+  }
+}
+
+TEST(Sections, ParallelCodeMatchesSerialManyFunctions) {
+  // Bodies of varying size with locals, nested blocks and a br_table, such
+  // that every part of Code differs between neighbouring functions
+  WasmBuilder builder;
+  uint32_t type = builder.add_type({0x7F}, {0x7F});
+  for (uint32_t i = 0; i < 3000; i++) {
+    Bytes body;
+    for (uint32_t j = 0; j < i % 13; j++) {
+      body = concat({body, op_u(0x20, 0), i64_const(int64_t(i) << j),
+                     op(0xA7), op(0x6a), op_u(0x21, 0)});
+    }
+    Bytes br_table = {0x0E, 0x02, 0x00, 0x01, static_cast<uint8_t>(i % 3)};
+    body = concat({body, op_u(0x02, 0x40), op_u(0x02, 0x40),
+                   op_u(0x02, 0x40), op_u(0x20, 0), br_table, op(0x0b),
+                   op(0x0b), op(0x0b), op_u(0x20, 0)});
+    builder.add_function(type, {{i % 4, 0x7F}, {1, 0x7E}}, body);
+  }
+  Bytes bytes = builder.build();
+
+  WasmFile serial;
+  serial.parse_threads = 1;
+  ASSERT_EQ(serial.read_from_memory(bytes.data(), bytes.size()), 0);
+
+  for (unsigned threads : {0u, 2u, 3u, 8u}) {
+    WasmFile parallel;
+    parallel.parse_threads = threads;
+    ASSERT_EQ(parallel.read_from_memory(bytes.data(), bytes.size()), 0);
+    expect_same_codes(serial, parallel);
+  }
+}
+
+static size_t decoded_functions(const WasmFile &wasm) {
+  size_t decoded = 0;
+  for (const Code &code : wasm.codes) {
+    decoded += !code.expr.empty();
+  }
+  return decoded;
+}
+
+TEST(Sections, LazyCodeDecodesOnFirstCall) {
+  const char *path = "test_binaries/05_test_complex.wasm";
+  WasmFile lazy;
+  lazy.lazy_code = true;
+  ASSERT_EQ(lazy.read(path), 0);
+  ASSERT_FALSE(lazy.codes.empty());
+  EXPECT_EQ(decoded_functions(lazy), 0);
+
+  std::string func = "nested_blocks";
+  Runtime runtime(lazy);
+  runtime.run(func);
+  EXPECT_EQ(runtime.read_memory(0, 0, ImmediateRepr::I32).v.n32, 42);
+
+  size_t decoded = decoded_functions(lazy);
+  EXPECT_GT(decoded, 0);
+  EXPECT_LT(decoded, lazy.codes.size());
+
+  // Decoding the remaining functions gives the same result as eager decoding
+  for (uint32_t i = 0; i < lazy.codes.size(); i++) {
+    lazy.function_code(i);
+  }
+  WasmFile eager;
+  ASSERT_EQ(eager.read(path), 0);
+  expect_same_codes(eager, lazy);
+}
+
+TEST(Sections, LazyCodeSharedBetweenThreads) {
+  WasmFile lazy;
+  lazy.lazy_code = true;
+  ASSERT_EQ(lazy.read("test_binaries/05_test_complex.wasm"), 0);
+
+  // Every thread runs its own Runtime, all of them decode the same functions
+  // at the same time
+  const char *functions[] = {"multi_call", "recursive_5", "br_table_nested_0",
+                             "loop_with_blocks"};
+  const uint32_t expected[] = {30, 120, 400, 5};
+  std::vector<uint32_t> results(8 * 4);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; t++) {
+    threads.emplace_back([&, t]() {
+      for (int f = 0; f < 4; f++) {
+        std::string func = functions[f];
+        Runtime runtime(lazy);
+        runtime.run(func);
+        results[t * 4 + f] = runtime.read_memory(0, 0, ImmediateRepr::I32).v.n32;
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  for (int t = 0; t < 8; t++) {
+    for (int f = 0; f < 4; f++) {
+      EXPECT_EQ(results[t * 4 + f], expected[f]) << functions[f];
+    }
+  }
+}
+
+TEST(Sections, LazyCodeTrapsOnInvalidBody) {
+  // i32.add without operands, only noticed once "invalid" is called
+  WasmBuilder builder;
+  uint32_t type = builder.add_type({}, {});
+  builder.add_export("valid", builder.add_function(type, {}, {}));
+  builder.add_export("invalid", builder.add_function(type, {}, op(0x6a)));
+  Bytes bytes = builder.build();
+
+  for (Interpreter interpreter :
+       {STACK_INTERPRETER, REGISTER_INTERPRETER, JIT_COMPILER, TIERED}) {
+    WasmFile lazy;
+    lazy.lazy_code = true;
+    ASSERT_EQ(lazy.read_from_memory(bytes.data(), bytes.size()), 0);
+
+    Runtime runtime(lazy, interpreter);
+    std::string valid = "valid";
+    std::string invalid = "invalid";
+    EXPECT_EQ(runtime.run(valid), NO_TRAP) << interpreter;
+    // Calling it again traps the same way
+    EXPECT_EQ(runtime.run(invalid), INVALID_FUNCTION) << interpreter;
+    EXPECT_EQ(runtime.run(invalid), INVALID_FUNCTION) << interpreter;
+    EXPECT_EQ(lazy.codes[1].error.function, 1u);
+    EXPECT_FALSE(lazy.codes[1].error.message.empty());
+  }
+}
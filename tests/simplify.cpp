@@ -0,0 +1,196 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "runtime.hpp"
+#include "sections.hpp"
+#include "single_function.hpp"
+#include "test_interpreter.hpp"
+#include "wasm_builder.hpp"
+
+TEST(Simplify, FoldsConstants) {
+  // local0 = (2 + 3) * 4, local1 = i32.wrap(-1 >> 60), 1 / 0 is kept
+  Bytes body = concat({
+      i32_const(2), i32_const(3), op(0x6a), i32_const(4), op(0x6c),
+      op_u(0x21, 0), i64_const(-1), i64_const(60), op(0x88), op(0xA7),
+      op_u(0x21, 1), i32_const(1), i32_const(0), op(0x6d), op_u(0x21, 2),
+  });
+  Bytes bytes = single_function(body);
+  WasmFile wasm;
+  // Without superinstructions, such that only simplify_code changes the body
+  wasm.superinstructions = false;
+  read_function(wasm, bytes);
+
+  std::vector<OpCode> expected = {
+      OpCode::I32Const, OpCode::LocalSet, OpCode::I32Const,
+      OpCode::LocalSet, OpCode::I32Const, OpCode::I32Const,
+      OpCode::I32DivS,  OpCode::LocalSet, OpCode::Return};
+  EXPECT_EQ(ops(wasm.codes[0]), expected);
+
+  const std::vector<Instr> &expr = wasm.codes[0].expr;
+  EXPECT_EQ(expr[0].value.v.n32, 20u);
+  EXPECT_EQ(expr[2].value.v.n32, 15u);
+  EXPECT_EQ(wasm.codes[0].decoded_size, 15u);
+}
+
+TEST(Simplify, RemovesConstantBranches) {
+  Bytes body = concat({
+      op_u(0x02, 0x40), i32_const(0), op_u(0x0d, 0), // never taken
+      op_u(0x20, 0), op(0x1a),                       // local.get drop
+      i32_const(1), op_u(0x0d, 0),                   // always taken
+      op_u(0x20, 0), op_u(0x21, 1), op(0x0b),        // unreachable
+      i32_const(0), op_u(0x04, 0x40), op_u(0x20, 0), op_u(0x21, 1), op(0x05),
+      op_u(0x20, 1), op_u(0x21, 2), op(0x0b), // only the else is executed
+      op_u(0x02, 0x40), i32_const(7), Bytes{0x0e, 0x01, 0x00, 0x00},
+      op(0x0b), // br_table to its default
+  });
+  Bytes bytes = single_function(body);
+  WasmFile wasm;
+  wasm.superinstructions = false;
+  read_function(wasm, bytes);
+
+  std::vector<OpCode> expected = {
+      OpCode::Block,    OpCode::Br,       OpCode::End,   OpCode::Block,
+      OpCode::LocalGet, OpCode::LocalSet, OpCode::End,   OpCode::Block,
+      OpCode::Br,       OpCode::End,      OpCode::Return};
+  EXPECT_EQ(ops(wasm.codes[0]), expected);
+  EXPECT_TRUE(wasm.codes[0].br_tables.empty());
+
+  const std::vector<Instr> &expr = wasm.codes[0].expr;
+  EXPECT_EQ(expr[4].imm, 1u);
+  EXPECT_EQ(expr[5].imm, 2u);
+  EXPECT_EQ(expr[1].target.pc, 3u);
+  EXPECT_EQ(expr[8].target.pc, 10u);
+}
+
+TEST(Simplify, KeepsUnreachableLoops) {
+  // The loop stays such that loops are numbered like in the register code
+  Bytes body = concat({op_u(0x02, 0x40), op_u(0x0c, 0), op_u(0x03, 0x40),
+                       op(0x0b), op(0x0b), op_u(0x03, 0x40), op(0x0b)});
+  Bytes bytes = single_function(body);
+  WasmFile wasm;
+  wasm.superinstructions = false;
+  read_function(wasm, bytes);
+
+  std::vector<OpCode> expected = {OpCode::Block, OpCode::Br,  OpCode::Loop,
+                                  OpCode::End,   OpCode::End, OpCode::Loop,
+                                  OpCode::End,   OpCode::Return};
+  EXPECT_EQ(ops(wasm.codes[0]), expected);
+  EXPECT_EQ(wasm.codes[0].loops.size(), 2u);
+}
+
+TEST(Simplify, CanBeDisabled) {
+  Bytes body = concat({i32_const(2), i32_const(3), op(0x6a), op(0x1a)});
+  Bytes bytes = single_function(body);
+  WasmFile wasm;
+  wasm.superinstructions = false;
+  wasm.simplify = false;
+  read_function(wasm, bytes);
+
+  std::vector<OpCode> expected = {OpCode::I32Const, OpCode::I32Const,
+                                  OpCode::I32Add, OpCode::Drop,
+                                  OpCode::Return};
+  EXPECT_EQ(ops(wasm.codes[0]), expected);
+}
+
+TEST(Simplify, SameResultAsUnsimplified) {
+  // Stores 170 at address 0
+  Bytes body = concat({
+      i32_const(0),
+      i32_const(6), i32_const(7), op(0x6c),                   // 42
+      f64_const(2.5), f64_const(4), op(0xA2), op(0xAA), op(0x6a), // + 10
+      i32_const(1), op_u(0x04, 0x7F), i32_const(100), op(0x05), // + 100
+      i32_const(200), op(0x0b), op(0x6a),
+      op_u(0x02, 0x7F), i32_const(3), i32_const(0), op_u(0x0d, 0), // + 3
+      i32_const(1), op_u(0x0d, 0), op(0x1a), i32_const(9), op(0x0b),
+      op(0x6a),
+      i64_const(-1), i64_const(60), op(0x88), op(0xA7), op(0x6a), // + 15
+      mem_op(0x36, 2, 0),
+  });
+  Bytes bytes = single_function(body);
+  std::string func = "f";
+
+  WasmFile plain;
+  plain.superinstructions = false;
+  plain.simplify = false;
+  read_function(plain, bytes);
+  Runtime plain_runtime(plain, test_interpreter());
+  plain_runtime.run(func);
+  EXPECT_EQ(plain_runtime.read_memory(0, 0, ImmediateRepr::I32).v.n32, 170u);
+
+  WasmFile simplified;
+  simplified.superinstructions = false;
+  read_function(simplified, bytes);
+  Runtime simplified_runtime(simplified, test_interpreter());
+  simplified_runtime.run(func);
+  EXPECT_EQ(simplified_runtime.read_memory(0, 0, ImmediateRepr::I32).v.n32,
+            170u);
+
+  std::vector<OpCode> expected = {
+      OpCode::I32Const, OpCode::I32Const, OpCode::F64Const, OpCode::I32TruncSF64,
+      OpCode::I32Add,   OpCode::Block,    OpCode::I32Const, OpCode::End,
+      OpCode::I32Add,   OpCode::Block,    OpCode::I32Const, OpCode::Br,
+      OpCode::End,      OpCode::I32Add,   OpCode::I32Const, OpCode::I32Add,
+      OpCode::I32Store, OpCode::Return};
+  EXPECT_EQ(ops(simplified.codes[0]), expected);
+  EXPECT_EQ(simplified.codes[0].decoded_size, 32u);
+}
+
+TEST(Simplify, FoldsLikeTheSpecification) {
+  // Comparisons and shifts which are easy to get wrong, with their results
+  struct Case {
+    const char *name;
+    Bytes operation;
+    bool is_i64;
+    uint64_t expected;
+  };
+  const Case cases[] = {
+      {"i64.lt_u", concat({i64_const(1), i64_const(-1), op(0x54)}), false, 1},
+      {"i64.lt_u reversed", concat({i64_const(-1), i64_const(1), op(0x54)}),
+       false, 0},
+      {"i64.shr_s", concat({i64_const(-256), i64_const(4), op(0x87)}), true,
+       static_cast<uint64_t>(-16)},
+      {"i64.shr_s by 68", concat({i64_const(-256), i64_const(68), op(0x87)}),
+       true, static_cast<uint64_t>(-16)},
+      {"i64.shl by 64", concat({i64_const(3), i64_const(64), op(0x86)}), true,
+       3},
+      {"i64.shr_u by 65", concat({i64_const(-1), i64_const(65), op(0x88)}),
+       true, UINT64_MAX >> 1},
+      {"i64.rotl by 0", concat({i64_const(5), i64_const(0), op(0x89)}), true,
+       5},
+      {"i32.shl by 33", concat({i32_const(1), i32_const(33), op(0x74)}), false,
+       2},
+      {"i32.shr_s by -1", concat({i32_const(INT32_MIN), i32_const(-1),
+                                  op(0x75)}),
+       false, UINT32_MAX},
+      {"i32.rotr by 32", concat({i32_const(5), i32_const(32), op(0x78)}),
+       false, 5},
+  };
+
+  std::string func = "f";
+  for (const Case &c : cases) {
+    // Stores the result at address 0
+    Bytes body = concat({i32_const(0), c.operation,
+                         c.is_i64 ? mem_op(0x37, 3, 0) : mem_op(0x36, 2, 0)});
+    Bytes bytes = single_function(body);
+    ImmediateRepr repr = c.is_i64 ? ImmediateRepr::I64 : ImmediateRepr::I32;
+
+    for (bool simplify : {false, true}) {
+      WasmFile wasm;
+      wasm.superinstructions = false;
+      wasm.simplify = simplify;
+      read_function(wasm, bytes);
+      if (simplify) {
+        EXPECT_EQ(wasm.codes[0].expr.size(), 4u) << c.name;
+      }
+
+      Runtime runtime(wasm, test_interpreter());
+      runtime.run(func);
+      Immediate result = runtime.read_memory(0, 0, repr);
+      EXPECT_EQ(c.is_i64 ? result.v.n64 : result.v.n32, c.expected)
+          << c.name << (simplify ? " simplified" : "");
+    }
+  }
+}
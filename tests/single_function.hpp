@@ -0,0 +1,49 @@
+#ifndef SINGLE_FUNCTION_HPP
+#define SINGLE_FUNCTION_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "registers.hpp"
+#include "sections.hpp"
+#include "wasm_builder.hpp"
+
+// Modules of a single exported function f without params and three i32
+// locals, for the tests of what decoding makes of one body
+
+inline Bytes single_function(const Bytes &body) {
+  WasmBuilder builder;
+  uint32_t type = builder.add_type({}, {});
+  uint32_t f = builder.add_function(type, {{3, 0x7F}}, body);
+  builder.add_export("f", f);
+  return builder.build();
+}
+
+// Reads a module of single_function into wasm, with the options already set
+// on it
+inline void read_function(WasmFile &wasm, const Bytes &bytes) {
+  ASSERT_EQ(wasm.read_from_memory(bytes.data(), bytes.size()), 0)
+      << wasm.validation_error.message;
+  ASSERT_EQ(wasm.codes.size(), 1u);
+}
+
+// The OpCodes of a decoded or translated body
+inline std::vector<OpCode> ops(const Code &code) {
+  std::vector<OpCode> result;
+  for (const Instr &instr : code.expr) {
+    result.push_back(instr.op);
+  }
+  return result;
+}
+
+inline std::vector<OpCode> ops(const RegisterCode &code) {
+  std::vector<OpCode> result;
+  for (const RegInstr &instr : code.instrs) {
+    result.push_back(instr.op);
+  }
+  return result;
+}
+
+#endif // SINGLE_FUNCTION_HPP
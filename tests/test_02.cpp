@@ -3,6 +3,7 @@
 #include "instructions.hpp"
 #include "runtime.hpp"
 #include "sections.hpp"
+#include "test_interpreter.hpp"
 
 class Test02 : public ::testing::Test {
 protected:
@@ -21,9 +22,9 @@ WasmFile Test02::wasm;
   TEST_F(Test02, func_name) {                                                  \
     std::string func = #func_name;                                             \
                                                                                \
-    Runtime runtime(wasm);                                                     \
+    Runtime runtime(wasm, test_interpreter());                                 \
     runtime.run(func);                                                         \
-    Immediate result = runtime.read_memory(2, 0, ImmediateRepr::I32);          \
+    Immediate result = runtime.read_memory(0, 0, ImmediateRepr::I32);          \
                                                                                \
     EXPECT_EQ(result.v.n32, expected_value);                                   \
     EXPECT_EQ(static_cast<int32_t>(result.v.n32), expected_value);             \
@@ -33,9 +34,9 @@ WasmFile Test02::wasm;
   TEST_F(Test02, func_name) {                                                  \
     std::string func = #func_name;                                             \
                                                                                \
-    Runtime runtime(wasm);                                                     \
+    Runtime runtime(wasm, test_interpreter());                                 \
     runtime.run(func);                                                         \
-    Immediate result = runtime.read_memory(2, 0, ImmediateRepr::F32);          \
+    Immediate result = runtime.read_memory(0, 0, ImmediateRepr::F32);          \
                                                                                \
     EXPECT_EQ(result.v.p32, expected_value);                                   \
   }
@@ -44,9 +45,9 @@ WasmFile Test02::wasm;
   TEST_F(Test02, func_name) {                                                  \
     std::string func = #func_name;                                             \
                                                                                \
-    Runtime runtime(wasm);                                                     \
+    Runtime runtime(wasm, test_interpreter());                                 \
     runtime.run(func);                                                         \
-    Immediate result = runtime.read_memory(2, 0, ImmediateRepr::F64);          \
+    Immediate result = runtime.read_memory(0, 0, ImmediateRepr::F64);          \
                                                                                \
     EXPECT_EQ(result.v.p64, expected_value);                                   \
   }
@@ -3,6 +3,7 @@
 #include "instructions.hpp"
 #include "runtime.hpp"
 #include "sections.hpp"
+#include "test_interpreter.hpp"
 
 class Test03 : public ::testing::Test {
 protected:
@@ -23,9 +24,9 @@ WasmFile Test03::wasm;
   TEST_F(Test03, func_name) {                                                  \
     std::string func = #func_name;                                             \
                                                                                \
-    Runtime runtime(wasm);                                                     \
+    Runtime runtime(wasm, test_interpreter());                                 \
     runtime.run(func);                                                         \
-    Immediate result = runtime.read_memory(2, offset, ImmediateRepr::I32);          \
+    Immediate result = runtime.read_memory(0, offset, ImmediateRepr::I32);          \
                                                                                \
     EXPECT_EQ(static_cast<int32_t>(result.v.n32), expected_value);                                   \
   }
@@ -34,9 +35,9 @@ WasmFile Test03::wasm;
   TEST_F(Test03, func_name) {                                                  \
     std::string func = #func_name;                                             \
                                                                                \
-    Runtime runtime(wasm);                                                     \
+    Runtime runtime(wasm, test_interpreter());                                 \
     runtime.run(func);                                                         \
-    Immediate result = runtime.read_memory(2, offset, ImmediateRepr::F32);          \
+    Immediate result = runtime.read_memory(0, offset, ImmediateRepr::F32);          \
                                                                                \
     EXPECT_EQ(result.v.p32, expected_value);                                   \
   }
@@ -92,15 +93,15 @@ WASM_TEST(_test_i64_call_function, 200, 42);
 WASM_TEST(_test_i64_large_mul, 200, static_cast<int32_t>(1000000L * 1000L));
 WASM_TEST(_test_i64_bit_pattern, 200, 0xFFFFFFFF);
 
-/* TODO: IMPLEMENT TRAPPING */
- // WASM_TEST(_test_trap_safe_div, 0);
-// WASM_TEST(_test_trap_divisor_zero, 0);
-// WASM_TEST(_test_trap_check_div_zero, 0);
-// WASM_TEST(_test_trap_check_mem_valid, 0);
-// WASM_TEST(_test_trap_check_mem_invalid, 0);
-// WASM_TEST(_test_trap_check_overflow, 0);
-// WASM_TEST(_test_trap_check_rem_zero, 0);
-// WASM_TEST(_test_trap_check_i64_div_zero, 0);
+// These check their operands first, they store -1 or 0 instead of trapping
+WASM_TEST(_test_trap_safe_div, 200, 5);
+WASM_TEST(_test_trap_divisor_zero, 200, 0);
+WASM_TEST(_test_trap_check_div_zero, 200, -1);
+WASM_TEST(_test_trap_check_mem_valid, 200, 1);
+WASM_TEST(_test_trap_check_mem_invalid, 200, 0);
+WASM_TEST(_test_trap_check_overflow, 200, 1);
+WASM_TEST(_test_trap_check_rem_zero, 200, -1);
+WASM_TEST(_test_trap_check_i64_div_zero, 200, -1);
 
 WASM_TEST(_test_combined_data_i64, 200, 84);
 WASM_TEST(_test_combined_indirect_i64, 200, 30);
@@ -4,6 +4,7 @@
 #include "instructions.hpp"
 #include "runtime.hpp"
 #include "sections.hpp"
+#include "test_interpreter.hpp"
 
 class Test04 : public ::testing::Test {
 protected:
@@ -22,9 +23,9 @@ WasmFile Test04::wasm;
   TEST_F(Test04, func_name) {                                                  \
     std::string func = #func_name;                                             \
                                                                                \
-    Runtime runtime(wasm);                                                     \
+    Runtime runtime(wasm, test_interpreter());                                 \
     runtime.run(func);                                                         \
-    Immediate result = runtime.read_memory(2, 0, ImmediateRepr::I32);          \
+    Immediate result = runtime.read_memory(0, 0, ImmediateRepr::I32);          \
                                                                                \
     EXPECT_EQ(static_cast<int32_t>(result.v.n32), expected_value);                                   \
   }
@@ -33,9 +34,9 @@ WasmFile Test04::wasm;
   TEST_F(Test04, func_name) {                                                  \
     std::string func = #func_name;                                             \
                                                                                \
-    Runtime runtime(wasm);                                                     \
+    Runtime runtime(wasm, test_interpreter());                                 \
     runtime.run(func);                                                         \
-    Immediate result = runtime.read_memory(2, 0, ImmediateRepr::F32);          \
+    Immediate result = runtime.read_memory(0, 0, ImmediateRepr::F32);          \
                                                                                \
     EXPECT_EQ(result.v.p32, expected_value);                                   \
   }
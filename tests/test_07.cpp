@@ -3,6 +3,7 @@
 #include "instructions.hpp"
 #include "runtime.hpp"
 #include "sections.hpp"
+#include "test_interpreter.hpp"
 
 class Test07 : public ::testing::Test {
 protected:
@@ -21,9 +22,9 @@ WasmFile Test07::wasm;
   TEST_F(Test07, func_name) {                                                  \
     std::string func = #func_name;                                             \
                                                                                \
-    Runtime runtime(wasm);                                                     \
+    Runtime runtime(wasm, test_interpreter());                                 \
     runtime.run(func);                                                         \
-    Immediate result = runtime.read_memory(2, 0, ImmediateRepr::I32);          \
+    Immediate result = runtime.read_memory(0, 0, ImmediateRepr::I32);          \
                                                                                \
     EXPECT_EQ(static_cast<int32_t>(result.v.n32), expected_value);             \
   }
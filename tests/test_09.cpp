@@ -3,6 +3,7 @@
 
 #include "runtime.hpp"
 #include "sections.hpp"
+#include "test_interpreter.hpp"
 
 class Test09 : public ::testing::Test {
 protected:
@@ -20,9 +21,9 @@ WasmFile Test09::wasm;
 TEST_F(Test09, hello_world) {
   std::string func = "_start";
 
-  Runtime runtime(wasm);
+  Runtime runtime(wasm, test_interpreter());
   runtime.run(func);
-  Immediate nwritten = runtime.read_memory(2, 20, ImmediateRepr::I32);
+  Immediate nwritten = runtime.read_memory(0, 20, ImmediateRepr::I32);
   // Written 'Hello World!\n', which has 14 chars (with \0)
   EXPECT_EQ(nwritten.v.n32, 14);
 }
@@ -0,0 +1,23 @@
+#ifndef TEST_INTERPRETER_HPP
+#define TEST_INTERPRETER_HPP
+
+#include <cstdlib>
+#include <cstring>
+
+#include "runtime.hpp"
+
+// The interpreter the tests run their modules with. ctest runs every test
+// once per interpreter, selected by the environment variable
+// WINTERP_TEST_INTERPRETER, see CMakeLists.txt.
+inline Interpreter test_interpreter() {
+  const char *name = std::getenv("WINTERP_TEST_INTERPRETER");
+  if (name != nullptr && std::strcmp(name, "registers") == 0) {
+    return REGISTER_INTERPRETER;
+  }
+  if (name != nullptr && std::strcmp(name, "jit") == 0) {
+    return JIT_COMPILER;
+  }
+  return STACK_INTERPRETER;
+}
+
+#endif // TEST_INTERPRETER_HPP
@@ -0,0 +1,243 @@
+#include <cstdint>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "jit.hpp"
+#include "runtime.hpp"
+#include "sections.hpp"
+#include "wasm_builder.hpp"
+
+// (i32) -> i32 function of the module built by entry_module, exported as "f"
+// together with the entry calling it
+struct EntryModule {
+  Bytes bytes;
+  uint32_t function;
+};
+
+// f calls the function with argument and stores its result at address 0
+static EntryModule entry_module(uint32_t argument, uint32_t locals,
+                                const Bytes &body) {
+  WasmBuilder builder;
+  uint32_t type = builder.add_type({0x7F}, {0x7F});
+  uint32_t entry_type = builder.add_type({}, {});
+  uint32_t function = builder.add_function(type, {{locals, 0x7F}}, body);
+  uint32_t f = builder.add_function(
+      entry_type, {},
+      concat({i32_const(0), i32_const(argument), op_u(0x10, function),
+              mem_op(0x36, 2, 0)}));
+  builder.add_export("f", f);
+  return EntryModule{builder.build(), function};
+}
+
+// sum(n) = n + (n - 1) + ... + 1 with a loop, which branches back n times
+static EntryModule sum_module(uint32_t n) {
+  return entry_module(
+      n, 1,
+      concat({op_u(0x02, 0x40), op_u(0x03, 0x40), op_u(0x20, 0), op(0x45),
+              op_u(0x0d, 1), op_u(0x20, 1), op_u(0x20, 0), op(0x6a),
+              op_u(0x21, 1), op_u(0x20, 0), i32_const(1), op(0x6b),
+              op_u(0x21, 0), op_u(0x0c, 0), op(0x0b), op(0x0b),
+              op_u(0x20, 1)}));
+}
+
+// n + sum(n) + 3, with a loop running three times and a loop running n times
+// while n is on the operand stack
+static EntryModule two_loops_module(uint32_t n) {
+  return entry_module(
+      n, 2,
+      concat({op_u(0x20, 0),
+              // do local2++ while local2 < 3
+              op_u(0x03, 0x40), op_u(0x20, 2), i32_const(1), op(0x6a),
+              op_u(0x22, 2), i32_const(3), op(0x49), op_u(0x0d, 0), op(0x0b),
+              // do local1 += n while --n != 0
+              op_u(0x03, 0x40), op_u(0x20, 1), op_u(0x20, 0), op(0x6a),
+              op_u(0x21, 1), op_u(0x20, 0), i32_const(1), op(0x6b),
+              op_u(0x22, 0), op_u(0x0d, 0), op(0x0b),
+              op_u(0x20, 1), op(0x6a), op_u(0x20, 2), op(0x6a)}));
+}
+
+// fib(n) = n < 2 ? n : fib(n - 1) + fib(n - 2)
+static EntryModule fib_module(uint32_t n) {
+  return entry_module(
+      n, 0,
+      concat({op_u(0x20, 0), i32_const(2), op(0x48), op_u(0x04, 0x7F),
+              op_u(0x20, 0), op(0x05), op_u(0x20, 0), i32_const(1), op(0x6b),
+              op_u(0x10, 0), op_u(0x20, 0), i32_const(2), op(0x6b),
+              op_u(0x10, 0), op(0x6a), op(0x0b)}));
+}
+
+static uint32_t run(Runtime &runtime) {
+  std::string func = "f";
+  runtime.run(func);
+  return runtime.read_memory(0, 0, ImmediateRepr::I32).v.n32;
+}
+
+static Interpreter expected_tier(Interpreter optimized_tier) {
+  if (optimized_tier == JIT_COMPILER && !jit_supported()) {
+    return REGISTER_INTERPRETER;
+  }
+  return optimized_tier;
+}
+
+TEST(Tiered, CountsCallsAndBackEdges) {
+  EntryModule module = sum_module(10);
+  WasmFile wasm;
+  ASSERT_EQ(wasm.read_from_memory(module.bytes.data(), module.bytes.size()),
+            0);
+
+  Runtime runtime(wasm, TIERED);
+  runtime.tier_up_threshold = UINT64_MAX;
+  for (int i = 0; i < 3; i++) {
+    EXPECT_EQ(run(runtime), 55u);
+  }
+
+  const FunctionProfile &profile = runtime.profile(module.function);
+  EXPECT_EQ(profile.calls, 3u);
+  EXPECT_EQ(profile.back_edges, 30u);
+  ASSERT_EQ(profile.loop_back_edges.size(), 1u);
+  EXPECT_EQ(profile.loop_back_edges[0], 30u);
+  EXPECT_EQ(profile.tier, STACK_INTERPRETER);
+  EXPECT_TRUE(runtime.tier_ups.empty());
+}
+
+TEST(Tiered, PromotesHotFunctionsOnly) {
+  EntryModule module = sum_module(10);
+  WasmFile wasm;
+  ASSERT_EQ(wasm.read_from_memory(module.bytes.data(), module.bytes.size()),
+            0);
+
+  for (Interpreter tier : {REGISTER_INTERPRETER, JIT_COMPILER}) {
+    Runtime runtime(wasm, TIERED);
+    runtime.tier_up_threshold = 25;
+    runtime.optimized_tier = tier;
+    runtime.on_stack_replacement = false;
+    for (int i = 0; i < 5; i++) {
+      EXPECT_EQ(run(runtime), 55u) << i;
+    }
+
+    // Reaches the threshold on its fourth call, after 30 back edges. The
+    // back edges of later calls are not counted.
+    ASSERT_EQ(runtime.tier_ups.size(), 1u);
+    const TierUp &tier_up = runtime.tier_ups[0];
+    EXPECT_EQ(tier_up.function_index, module.function);
+    EXPECT_EQ(tier_up.calls, 4u);
+    EXPECT_EQ(tier_up.back_edges, 30u);
+    EXPECT_EQ(tier_up.tier, expected_tier(tier));
+
+    const FunctionProfile &profile = runtime.profile(module.function);
+    EXPECT_EQ(profile.calls, 5u);
+    EXPECT_EQ(profile.back_edges, 30u);
+    EXPECT_EQ(profile.tier, expected_tier(tier));
+
+    // The entry is called too rarely
+    EXPECT_EQ(runtime.profile(module.function + 1).tier, STACK_INTERPRETER);
+  }
+}
+
+TEST(Tiered, MixesTiersInRecursion) {
+  EntryModule module = fib_module(20);
+  WasmFile wasm;
+  ASSERT_EQ(wasm.read_from_memory(module.bytes.data(), module.bytes.size()),
+            0);
+
+  for (Interpreter tier : {REGISTER_INTERPRETER, JIT_COMPILER}) {
+    Runtime runtime(wasm, TIERED);
+    runtime.tier_up_threshold = 100;
+    runtime.optimized_tier = tier;
+    EXPECT_EQ(run(runtime), 6765u);
+
+    // Promoted while its callers still run in the stack interpreter
+    ASSERT_EQ(runtime.tier_ups.size(), 1u);
+    EXPECT_EQ(runtime.tier_ups[0].calls, 100u);
+    EXPECT_EQ(runtime.profile(module.function).calls, 21891u);
+  }
+}
+
+TEST(Tiered, EntersHotLoop) {
+  EntryModule module = two_loops_module(1000);
+  WasmFile wasm;
+  ASSERT_EQ(wasm.read_from_memory(module.bytes.data(), module.bytes.size()),
+            0);
+
+  for (Interpreter tier : {REGISTER_INTERPRETER, JIT_COMPILER}) {
+    Runtime runtime(wasm, TIERED);
+    runtime.tier_up_threshold = 50;
+    runtime.optimized_tier = tier;
+    EXPECT_EQ(run(runtime), 501503u);
+
+    // Hot after its first call, 2 back edges of the first loop and 47 of the
+    // second one
+    ASSERT_EQ(runtime.tier_ups.size(), 1u);
+    EXPECT_EQ(runtime.tier_ups[0].calls, 1u);
+    EXPECT_EQ(runtime.tier_ups[0].back_edges, 49u);
+    ASSERT_EQ(runtime.osr_entries.size(), 1u);
+    const OsrEntry &entry = runtime.osr_entries[0];
+    EXPECT_EQ(entry.function_index, module.function);
+    EXPECT_EQ(entry.loop, 1u);
+    EXPECT_EQ(entry.back_edges, 47u);
+    EXPECT_EQ(entry.tier, expected_tier(tier));
+
+    // Not counted any more
+    const FunctionProfile &profile = runtime.profile(module.function);
+    EXPECT_EQ(profile.loop_back_edges[0], 2u);
+    EXPECT_EQ(profile.loop_back_edges[1], 47u);
+  }
+}
+
+TEST(Tiered, WithoutOnStackReplacement) {
+  EntryModule module = two_loops_module(1000);
+  WasmFile wasm;
+  ASSERT_EQ(wasm.read_from_memory(module.bytes.data(), module.bytes.size()),
+            0);
+
+  Runtime runtime(wasm, TIERED);
+  runtime.tier_up_threshold = 50;
+  runtime.on_stack_replacement = false;
+  EXPECT_EQ(run(runtime), 501503u);
+  EXPECT_TRUE(runtime.tier_ups.empty());
+  EXPECT_TRUE(runtime.osr_entries.empty());
+  EXPECT_EQ(runtime.profile(module.function).loop_back_edges[1], 999u);
+}
+
+// Runs every exported function without parameters with and without on stack
+// replacement, and expects the same memory afterwards. With a threshold of 2,
+// every function called once moves to its optimized code at its first back
+// edge.
+static void expect_same_results(const char *file) {
+  WasmFile wasm;
+  ASSERT_EQ(wasm.read(file), 0);
+
+  for (const Export &e : wasm.exports) {
+    if (e.kind != ExportKind::func ||
+        !wasm.function_type(e.idx).params.empty()) {
+      continue;
+    }
+    SCOPED_TRACE(e.name);
+    std::string function = e.name;
+
+    Runtime expected(wasm, STACK_INTERPRETER);
+    expected.run(function);
+    for (Interpreter tier : {REGISTER_INTERPRETER, JIT_COMPILER}) {
+      Runtime runtime(wasm, TIERED);
+      runtime.tier_up_threshold = 2;
+      runtime.optimized_tier = tier;
+      runtime.run(function);
+
+      for (uint32_t offset = 0; offset < MEMORY_PAGE_SIZE; offset += 8) {
+        ASSERT_EQ(runtime.read_memory(0, offset, ImmediateRepr::I64).v.n64,
+                  expected.read_memory(0, offset, ImmediateRepr::I64).v.n64)
+            << "at offset " << offset;
+      }
+    }
+  }
+}
+
+TEST(Tiered, SameResultsWithOnStackReplacement) {
+  expect_same_results("test_binaries/01_test.wasm");
+  expect_same_results("test_binaries/02_test_prio1.wasm");
+  expect_same_results("test_binaries/03_test_prio2.wasm");
+  expect_same_results("test_binaries/04_test_prio3.wasm");
+  expect_same_results("test_binaries/05_test_complex.wasm");
+  expect_same_results("test_binaries/07_test_bulk_memory.wasm");
+}
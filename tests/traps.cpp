@@ -0,0 +1,303 @@
+#include <cmath>
+#include <cstdint>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "runtime.hpp"
+#include "sections.hpp"
+#include "test_interpreter.hpp"
+#include "trap.hpp"
+#include "wasm_builder.hpp"
+
+// Stores 1 at address 0 before body and 2 after it, such that the value at 0
+// tells whether body trapped
+static Bytes marked(const Bytes &body) {
+  return concat({i32_const(0), i32_const(1), mem_op(0x36, 2, 0), body,
+                 i32_const(0), i32_const(2), mem_op(0x36, 2, 0)});
+}
+
+class Traps : public ::testing::Test {
+protected:
+  // The module refers to its bytes
+  Bytes bytes;
+  WasmFile wasm;
+
+  void read(WasmBuilder &builder) {
+    bytes = builder.build();
+    ASSERT_EQ(wasm.read_from_memory(bytes.data(), bytes.size()), 0)
+        << wasm.validation_error.message;
+  }
+
+  // Runs function, expecting trap, and returns the value at address 0
+  uint32_t run(Runtime &runtime, const char *function, Trap trap) {
+    std::string func = function;
+    EXPECT_EQ(runtime.run(func), trap) << function;
+    return runtime.read_memory(0, 0, ImmediateRepr::I32).v.n32;
+  }
+};
+
+TEST_F(Traps, LoadBehindMemory) {
+  WasmBuilder builder;
+  uint32_t type = builder.add_type({}, {});
+  // The last byte is in bounds, the three behind it are not
+  uint32_t f = builder.add_function(
+      type, {},
+      marked(concat({i32_const(MEMORY_PAGE_SIZE - 1), mem_op(0x28, 2, 0),
+                     op(0x1a)})));
+  builder.add_export("load", f);
+  f = builder.add_function(
+      type, {},
+      marked(concat({i32_const(MEMORY_PAGE_SIZE - 1), mem_op(0x2D, 0, 0),
+                     op(0x1a)})));
+  builder.add_export("last_byte", f);
+  read(builder);
+
+  Runtime runtime(wasm, test_interpreter());
+  EXPECT_EQ(run(runtime, "load", MEMORY_OUT_OF_BOUNDS), 1u);
+  EXPECT_EQ(run(runtime, "last_byte", NO_TRAP), 2u);
+}
+
+TEST_F(Traps, OffsetDoesNotWrapAround) {
+  WasmBuilder builder;
+  uint32_t type = builder.add_type({}, {});
+  // Address and offset add up to 4 GiB, which is 0 in 32 bits
+  uint32_t f = builder.add_function(
+      type, {},
+      marked(concat({i32_const(-1), mem_op(0x2D, 0, 1), op(0x1a)})));
+  builder.add_export("load", f);
+  // Far into the guard region
+  f = builder.add_function(
+      type, {},
+      marked(concat(
+          {i32_const(-1), i64_const(7), mem_op(0x37, 3, UINT32_MAX)})));
+  builder.add_export("store", f);
+  read(builder);
+
+  Runtime runtime(wasm, test_interpreter());
+  EXPECT_EQ(run(runtime, "load", MEMORY_OUT_OF_BOUNDS), 1u);
+  EXPECT_EQ(run(runtime, "store", MEMORY_OUT_OF_BOUNDS), 1u);
+}
+
+TEST_F(Traps, GrownMemoryIsAccessible) {
+  WasmBuilder builder;
+  uint32_t type = builder.add_type({}, {});
+  uint32_t f = builder.add_function(
+      type, {}, marked(concat({i32_const(1), op_u(0x40, 0x00), op(0x1a)})));
+  builder.add_export("grow", f);
+  f = builder.add_function(
+      type, {},
+      marked(concat({i32_const(2 * MEMORY_PAGE_SIZE - 4), i32_const(5),
+                     mem_op(0x36, 2, 0)})));
+  builder.add_export("store", f);
+  read(builder);
+
+  Runtime runtime(wasm, test_interpreter());
+  EXPECT_EQ(run(runtime, "store", MEMORY_OUT_OF_BOUNDS), 1u);
+  EXPECT_EQ(run(runtime, "grow", NO_TRAP), 2u);
+  EXPECT_EQ(run(runtime, "store", NO_TRAP), 2u);
+  uint32_t address = 2 * MEMORY_PAGE_SIZE - 4;
+  EXPECT_EQ(runtime.read_memory(0, address, ImmediateRepr::I32).v.n32, 5u);
+}
+
+TEST_F(Traps, RunsAgainAfterTrap) {
+  // The trap happens in a callee with values of the caller on the stack
+  WasmBuilder builder;
+  uint32_t type = builder.add_type({}, {});
+  uint32_t load_type = builder.add_type({0x7F}, {0x7F});
+  uint32_t load = builder.add_function(
+      load_type, {}, concat({op_u(0x20, 0), mem_op(0x28, 2, 0)}));
+  uint32_t f = builder.add_function(
+      type, {},
+      marked(concat({i32_const(3), i32_const(4), i32_const(-4),
+                     op_u(0x10, load), op(0x6a), op(0x6a), op(0x1a)})));
+  builder.add_export("trap", f);
+  // Stores 3 + 4 + load(0) = 9 at 4
+  f = builder.add_function(
+      type, {},
+      concat({i32_const(0), i32_const(2), mem_op(0x36, 2, 0), i32_const(4),
+              i32_const(3), i32_const(4), i32_const(0), op_u(0x10, load),
+              op(0x6a), op(0x6a), mem_op(0x36, 2, 0)}));
+  builder.add_export("no_trap", f);
+  read(builder);
+
+  Runtime runtime(wasm, test_interpreter());
+  for (int i = 0; i < 3; i++) {
+    EXPECT_EQ(run(runtime, "trap", MEMORY_OUT_OF_BOUNDS), 1u);
+    EXPECT_EQ(run(runtime, "no_trap", NO_TRAP), 2u);
+    EXPECT_EQ(runtime.read_memory(0, 4, ImmediateRepr::I32).v.n32, 9u);
+  }
+}
+
+// Adds an export without params and results which runs marked(body)
+static void add_marked(WasmBuilder &builder, const std::string &name,
+                       const Bytes &body) {
+  uint32_t type = builder.add_type({}, {});
+  builder.add_export(name, builder.add_function(type, {}, marked(body)));
+}
+
+// Computes a binop of two i32 constants, storing its result at 4
+static Bytes i32_binop(int32_t a, int32_t b, uint8_t opcode) {
+  return concat({i32_const(4), i32_const(a), i32_const(b), op(opcode),
+                 mem_op(0x36, 2, 0)});
+}
+
+// Truncates an f64 constant with opcode to i32, storing the result at 4
+static Bytes i32_trunc(double value, uint8_t opcode) {
+  return concat({i32_const(4), f64_const(value), op(opcode),
+                 mem_op(0x36, 2, 0)});
+}
+
+TEST_F(Traps, Unreachable) {
+  WasmBuilder builder;
+  add_marked(builder, "unreachable", op(0x00));
+  read(builder);
+
+  Runtime runtime(wasm, test_interpreter());
+  EXPECT_EQ(run(runtime, "unreachable", UNREACHABLE), 1u);
+}
+
+TEST_F(Traps, DivideByZero) {
+  WasmBuilder builder;
+  add_marked(builder, "div_s", i32_binop(7, 0, 0x6d));
+  add_marked(builder, "div_u", i32_binop(7, 0, 0x6e));
+  add_marked(builder, "rem_s", i32_binop(7, 0, 0x6f));
+  add_marked(builder, "rem_u", i32_binop(7, 0, 0x70));
+  add_marked(builder, "i64_div_s",
+             concat({i64_const(7), i64_const(0), op(0x7f), op(0x1a)}));
+  add_marked(builder, "i64_rem_u",
+             concat({i64_const(7), i64_const(0), op(0x82), op(0x1a)}));
+  read(builder);
+
+  Runtime runtime(wasm, test_interpreter());
+  for (const char *function :
+       {"div_s", "div_u", "rem_s", "rem_u", "i64_div_s", "i64_rem_u"}) {
+    EXPECT_EQ(run(runtime, function, INTEGER_DIVIDE_BY_ZERO), 1u) << function;
+  }
+}
+
+TEST_F(Traps, SignedDivisionOverflows) {
+  WasmBuilder builder;
+  add_marked(builder, "div_s", i32_binop(INT32_MIN, -1, 0x6d));
+  add_marked(builder, "i64_div_s",
+             concat({i64_const(INT64_MIN), i64_const(-1), op(0x7f), op(0x1a)}));
+  // Only the quotient overflows, the remainder is 0
+  add_marked(builder, "rem_s", i32_binop(INT32_MIN, -1, 0x6f));
+  read(builder);
+
+  Runtime runtime(wasm, test_interpreter());
+  EXPECT_EQ(run(runtime, "div_s", INTEGER_OVERFLOW), 1u);
+  EXPECT_EQ(run(runtime, "i64_div_s", INTEGER_OVERFLOW), 1u);
+  EXPECT_EQ(run(runtime, "rem_s", NO_TRAP), 2u);
+  EXPECT_EQ(runtime.read_memory(0, 4, ImmediateRepr::I32).v.n32, 0u);
+}
+
+TEST_F(Traps, TruncationOutOfRange) {
+  WasmBuilder builder;
+  add_marked(builder, "too_large", i32_trunc(2147483648.0, 0xAA));
+  add_marked(builder, "too_small", i32_trunc(-2147483649.0, 0xAA));
+  add_marked(builder, "negative_u", i32_trunc(-1.0, 0xAB));
+  add_marked(builder, "too_large_u", i32_trunc(4294967296.0, 0xAB));
+  add_marked(builder, "infinity", i32_trunc(INFINITY, 0xAA));
+  add_marked(builder, "i64_too_large_u",
+             concat({f64_const(18446744073709551616.0), op(0xB1), op(0x1a)}));
+  read(builder);
+
+  Runtime runtime(wasm, test_interpreter());
+  for (const char *function : {"too_large", "too_small", "negative_u",
+                               "too_large_u", "infinity", "i64_too_large_u"}) {
+    EXPECT_EQ(run(runtime, function, INTEGER_OVERFLOW), 1u) << function;
+  }
+}
+
+TEST_F(Traps, TruncationWithinRange) {
+  // Rounded towards zero, each lands on a bound of the integer type
+  WasmBuilder builder;
+  add_marked(builder, "min", i32_trunc(-2147483648.9, 0xAA));
+  add_marked(builder, "max", i32_trunc(2147483647.9, 0xAA));
+  add_marked(builder, "min_u", i32_trunc(-0.9, 0xAB));
+  add_marked(builder, "max_u", i32_trunc(4294967295.9, 0xAB));
+  read(builder);
+
+  Runtime runtime(wasm, test_interpreter());
+  EXPECT_EQ(run(runtime, "min", NO_TRAP), 2u);
+  EXPECT_EQ(runtime.read_memory(0, 4, ImmediateRepr::I32).v.n32, 0x80000000u);
+  EXPECT_EQ(run(runtime, "max", NO_TRAP), 2u);
+  EXPECT_EQ(runtime.read_memory(0, 4, ImmediateRepr::I32).v.n32, 0x7FFFFFFFu);
+  EXPECT_EQ(run(runtime, "min_u", NO_TRAP), 2u);
+  EXPECT_EQ(runtime.read_memory(0, 4, ImmediateRepr::I32).v.n32, 0u);
+  EXPECT_EQ(run(runtime, "max_u", NO_TRAP), 2u);
+  EXPECT_EQ(runtime.read_memory(0, 4, ImmediateRepr::I32).v.n32, UINT32_MAX);
+}
+
+TEST_F(Traps, InvalidConversion) {
+  WasmBuilder builder;
+  add_marked(builder, "nan", i32_trunc(NAN, 0xAA));
+  add_marked(builder, "nan_u", i32_trunc(-NAN, 0xAB));
+  add_marked(builder, "i64_nan_u",
+             concat({f64_const(NAN), op(0xB1), op(0x1a)}));
+  read(builder);
+
+  Runtime runtime(wasm, test_interpreter());
+  for (const char *function : {"nan", "nan_u", "i64_nan_u"}) {
+    EXPECT_EQ(run(runtime, function, INVALID_CONVERSION_TO_INTEGER), 1u)
+        << function;
+  }
+}
+
+TEST_F(Traps, IndirectCalls) {
+  // A table of two functions ()->i32 and one uninitialized entry
+  WasmBuilder builder;
+  uint32_t result_type = builder.add_type({}, {0x7F});
+  uint32_t param_type = builder.add_type({0x7F}, {0x7F});
+  uint32_t seven = builder.add_function(result_type, {}, i32_const(7));
+  uint32_t eight = builder.add_function(result_type, {}, i32_const(8));
+  builder.set_table({seven, eight}, 3);
+
+  auto call = [&](uint32_t type, int32_t index) {
+    Bytes args = type == param_type ? i32_const(0) : Bytes{};
+    return concat({i32_const(4), args, i32_const(index), op_u(0x11, type),
+                   Bytes{0x00}, mem_op(0x36, 2, 0)});
+  };
+  add_marked(builder, "call", call(result_type, 1));
+  add_marked(builder, "undefined", call(result_type, 3));
+  add_marked(builder, "negative", call(result_type, -1));
+  add_marked(builder, "uninitialized", call(result_type, 2));
+  add_marked(builder, "mismatch", call(param_type, 0));
+  read(builder);
+
+  Runtime runtime(wasm, test_interpreter());
+  EXPECT_EQ(run(runtime, "call", NO_TRAP), 2u);
+  EXPECT_EQ(runtime.read_memory(0, 4, ImmediateRepr::I32).v.n32, 8u);
+  EXPECT_EQ(run(runtime, "undefined", UNDEFINED_ELEMENT), 1u);
+  EXPECT_EQ(run(runtime, "negative", UNDEFINED_ELEMENT), 1u);
+  EXPECT_EQ(run(runtime, "uninitialized", UNINITIALIZED_ELEMENT), 1u);
+  EXPECT_EQ(run(runtime, "mismatch", INDIRECT_CALL_TYPE_MISMATCH), 1u);
+}
+
+TEST_F(Traps, CallStackExhausted) {
+  // Recursion without end, once with a large frame which fills the operand
+  // stack first
+  WasmBuilder builder;
+  uint32_t type = builder.add_type({}, {});
+  uint32_t f = builder.add_function(type, {}, op_u(0x10, 0));
+  builder.add_export("recurse", f);
+  f = builder.add_function(type, {{MAX_LOCALS, 0x7F}}, op_u(0x10, 1));
+  builder.add_export("large_frames", f);
+  add_marked(builder, "no_trap", {});
+  read(builder);
+
+  Runtime runtime(wasm, test_interpreter());
+  for (const char *function : {"recurse", "large_frames"}) {
+    std::string func = function;
+    EXPECT_EQ(runtime.run(func), CALL_STACK_EXHAUSTED) << function;
+    EXPECT_EQ(run(runtime, "no_trap", NO_TRAP), 2u);
+  }
+}
+
+TEST(TrapMessage, NamesTrap) {
+  EXPECT_STREQ(trap_message(MEMORY_OUT_OF_BOUNDS),
+               "out of bounds memory access");
+  EXPECT_STREQ(trap_message(INTEGER_DIVIDE_BY_ZERO), "integer divide by zero");
+  EXPECT_STREQ(trap_message(CALL_STACK_EXHAUSTED), "call stack exhausted");
+}
@@ -0,0 +1,204 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "sections.hpp"
+#include "validator.hpp"
+#include "wasm_builder.hpp"
+
+static const uint8_t I32_T = 0x7F;
+static const uint8_t I64_T = 0x7E;
+
+// Reads a module with a single function of the given signature and body and
+// returns the error reported for it
+static ValidationError validate_body(const Bytes &params, const Bytes &results,
+                                     const Bytes &body) {
+  WasmBuilder builder;
+  uint32_t type = builder.add_type(params, results);
+  builder.add_function(type, {{1, I32_T}}, body);
+  Bytes bytes = builder.build();
+
+  WasmFile wasm;
+  int result = wasm.read_from_memory(bytes.data(), bytes.size());
+  EXPECT_EQ(result == 0, wasm.validation_error.message.empty());
+  return wasm.validation_error;
+}
+
+TEST(Validator, TestBinariesAreValid) {
+  const char *paths[] = {
+      "test_binaries/01_test.wasm",         "test_binaries/02_test_prio1.wasm",
+      "test_binaries/03_test_prio2.wasm",   "test_binaries/04_test_prio3.wasm",
+      "test_binaries/05_test_complex.wasm", "test_binaries/07_test_bulk_memory.wasm",
+      "test_binaries/09_print_hello.wasm",
+  };
+  for (const char *path : paths) {
+    WasmFile wasm;
+    EXPECT_EQ(wasm.read(path), 0) << path;
+    EXPECT_EQ(wasm.validation_error.message, "") << path;
+  }
+}
+
+TEST(Validator, ValidBody) {
+  // (block (result i32) (i32.const 1) (br_if 0 (local.get 0)))
+  Bytes body = concat({{0x02, I32_T}, i32_const(1), op_u(0x20, 0),
+                       op_u(0x0D, 0), op(0x0b)});
+  ValidationError error = validate_body({}, {I32_T}, body);
+  EXPECT_EQ(error.message, "");
+}
+
+TEST(Validator, TypeMismatch) {
+  Bytes body = concat({i32_const(1), i64_const(2), op(0x6a)});
+  ValidationError error = validate_body({}, {I32_T}, body);
+  EXPECT_EQ(error.message, "type mismatch, expected i32 but got i64");
+  EXPECT_EQ(error.function, 0u);
+  EXPECT_EQ(error.pc, 2u);
+}
+
+TEST(Validator, StackUnderflow) {
+  Bytes body = concat({i32_const(1), op(0x6a)});
+  ValidationError error = validate_body({}, {I32_T}, body);
+  EXPECT_EQ(error.message, "operand stack underflow, expected i32");
+  EXPECT_EQ(error.pc, 1u);
+}
+
+TEST(Validator, ValuesLeftOnStack) {
+  Bytes body = concat({i32_const(1), i32_const(2)});
+  ValidationError error = validate_body({}, {I32_T}, body);
+  EXPECT_EQ(error.message,
+            "values remaining on the stack at the end of a block");
+}
+
+TEST(Validator, UnreachableStackIsPolymorphic) {
+  // The missing operands of i32.add after unreachable are fine
+  Bytes body = concat({op(0x00), op(0x6a)});
+  ValidationError error = validate_body({}, {I32_T}, body);
+  EXPECT_EQ(error.message, "");
+}
+
+TEST(Validator, InvalidLocal) {
+  // One parameter and one declared local
+  Bytes body = concat({op_u(0x20, 2)});
+  ValidationError error = validate_body({I64_T}, {I32_T}, body);
+  EXPECT_EQ(error.message, "invalid local index 2");
+  EXPECT_EQ(error.pc, 0u);
+
+  body = concat({op_u(0x20, 0)});
+  error = validate_body({I64_T}, {I32_T}, body);
+  EXPECT_EQ(error.message, "type mismatch, expected i32 but got i64");
+}
+
+TEST(Validator, TooManyLocals) {
+  // The counts of the declarations sum up to more than 2^32
+  for (auto locals : std::vector<std::vector<std::pair<uint32_t, uint8_t>>>{
+           {{MAX_LOCALS + 1, I32_T}},
+           {{UINT32_MAX, I32_T}},
+           {{UINT32_MAX, I32_T}, {UINT32_MAX, I64_T}, {2, I32_T}}}) {
+    WasmBuilder builder;
+    uint32_t type = builder.add_type({}, {});
+    builder.add_function(type, {}, {});
+    builder.add_function(type, locals, {});
+    Bytes bytes = builder.build();
+
+    WasmFile wasm;
+    EXPECT_EQ(wasm.read_from_memory(bytes.data(), bytes.size()), 1);
+    EXPECT_EQ(wasm.validation_error.message, "too many locals");
+    EXPECT_EQ(wasm.validation_error.function, 1u);
+  }
+
+  WasmBuilder builder;
+  uint32_t type = builder.add_type({}, {});
+  builder.add_function(type, {{MAX_LOCALS - 1, I32_T}, {1, I64_T}}, {});
+  Bytes bytes = builder.build();
+  WasmFile wasm;
+  EXPECT_EQ(wasm.read_from_memory(bytes.data(), bytes.size()), 0);
+  EXPECT_EQ(wasm.codes[0].num_locals, MAX_LOCALS);
+}
+
+TEST(Validator, InvalidLabelDepth) {
+  Bytes body = concat({{0x02, 0x40}, op_u(0x0C, 2), op(0x0b)});
+  ValidationError error = validate_body({}, {}, body);
+  EXPECT_EQ(error.message, "invalid label depth 2");
+  EXPECT_EQ(error.pc, 1u);
+}
+
+TEST(Validator, InvalidCall) {
+  Bytes body = concat({op_u(0x10, 5)});
+  ValidationError error = validate_body({}, {}, body);
+  EXPECT_EQ(error.message, "invalid function index 5");
+}
+
+TEST(Validator, InvalidTableInstructions) {
+  // Without a table and element segments
+  Bytes operands = concat({i32_const(0), i32_const(0), i32_const(0)});
+  ValidationError error =
+      validate_body({}, {}, concat({operands, misc_op(12, {0, 0})}));
+  EXPECT_EQ(error.message, "invalid element segment index 0");
+  error = validate_body({}, {}, misc_op(13, {1}));
+  EXPECT_EQ(error.message, "invalid element segment index 1");
+  error = validate_body({}, {}, concat({operands, misc_op(14, {0, 0})}));
+  EXPECT_EQ(error.message, "invalid table index 0");
+}
+
+TEST(Validator, IfWithoutElse) {
+  // (if (result i32) (local.get 0) (then (i32.const 1)))
+  Bytes body = concat({op_u(0x20, 0), {0x04, I32_T}, i32_const(1), op(0x0b)});
+  ValidationError error = validate_body({}, {I32_T}, body);
+  EXPECT_EQ(error.message, "if without else must not produce a value");
+  EXPECT_EQ(error.pc, 3u);
+}
+
+TEST(Validator, BrTableLabelTypes) {
+  // The default label carries an i32, label 0 carries nothing
+  Bytes body = concat({{0x02, I32_T},
+                       {0x02, 0x40},
+                       i32_const(1),
+                       op_u(0x20, 0),
+                       {0x0E, 0x01, 0x00, 0x01},
+                       op(0x0b),
+                       i32_const(2),
+                       op(0x0b)});
+  ValidationError error = validate_body({}, {I32_T}, body);
+  EXPECT_EQ(error.message, "br_table labels carry different types");
+  EXPECT_EQ(error.pc, 4u);
+}
+
+TEST(Validator, InvalidExport) {
+  WasmBuilder builder;
+  uint32_t type = builder.add_type({}, {});
+  builder.add_function(type, {}, {});
+  builder.add_export("missing", 3);
+  Bytes bytes = builder.build();
+
+  WasmFile wasm;
+  EXPECT_EQ(wasm.read_from_memory(bytes.data(), bytes.size()), 1);
+  EXPECT_EQ(wasm.validation_error.message,
+            "export missing has an invalid index");
+  EXPECT_EQ(wasm.validation_error.function, NO_FUNCTION);
+}
+
+TEST(Validator, InvalidMemoryLimits) {
+  WasmBuilder builder;
+  builder.add_memory(2, 1);
+  Bytes bytes = builder.build();
+
+  WasmFile wasm;
+  EXPECT_EQ(wasm.read_from_memory(bytes.data(), bytes.size()), 1);
+  EXPECT_EQ(wasm.validation_error.message, "memory 1 has invalid limits");
+}
+
+TEST(Validator, FirstInvalidFunctionIsReported) {
+  WasmBuilder builder;
+  uint32_t type = builder.add_type({}, {I32_T});
+  builder.add_function(type, {}, i32_const(1));
+  for (int i = 0; i < 100; i++) {
+    builder.add_function(type, {}, i64_const(1));
+  }
+  Bytes bytes = builder.build();
+
+  WasmFile wasm;
+  wasm.parse_threads = 4;
+  EXPECT_EQ(wasm.read_from_memory(bytes.data(), bytes.size()), 1);
+  EXPECT_EQ(wasm.validation_error.function, 1u);
+}
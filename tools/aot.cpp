@@ -0,0 +1,37 @@
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+#include "aot.hpp"
+#include "sections.hpp"
+
+// Translates a module into a C++ translation unit, see aot.hpp.
+// Usage: winterp_aot <module.wasm> <output.cpp> [create]
+// create names the function returning a new instance, by default
+// winterp_aot_create.
+int main(int argc, char **argv) {
+  if (argc < 3 || argc > 4) {
+    std::cerr << "usage: " << argv[0] << " <module.wasm> <output.cpp> [create]"
+              << std::endl;
+    return 1;
+  }
+
+  WasmFile wasm;
+  if (wasm.read(argv[1]) != 0) {
+    return 1;
+  }
+
+  std::ofstream out(argv[2]);
+  if (!out) {
+    std::cerr << "unable to open " << argv[2] << std::endl;
+    return 1;
+  }
+
+  const char *create = argc == 4 ? argv[3] : "winterp_aot_create";
+  if (translate_module(wasm, create, out) != 0) {
+    out.close();
+    std::remove(argv[2]);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,39 @@
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+
+#include "sections.hpp"
+
+// Prints the number of instructions of every function as decoded and after
+// simplify_code (see simplify.hpp), followed by the totals.
+// Usage: winterp_report <module.wasm>
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    std::cerr << "usage: " << argv[0] << " <module.wasm>" << std::endl;
+    return 1;
+  }
+
+  // Superinstructions would be counted as well
+  WasmFile wasm;
+  wasm.superinstructions = false;
+  if (wasm.read(argv[1]) != 0) {
+    return 1;
+  }
+
+  uint64_t decoded = 0, simplified = 0;
+  std::printf("%-10s %12s %12s\n", "function", "decoded", "simplified");
+  for (uint32_t i = 0; i < wasm.codes.size(); i++) {
+    const Code &code = wasm.function_code(i);
+    // Without the return appended by resolve_branches
+    uint32_t size = code.expr.size() - 1;
+    std::printf("%-10u %12u %12u\n",
+                static_cast<uint32_t>(i + wasm.imports.size()),
+                code.decoded_size, size);
+    decoded += code.decoded_size;
+    simplified += size;
+  }
+  std::printf("%-10s %12llu %12llu\n", "total",
+              static_cast<unsigned long long>(decoded),
+              static_cast<unsigned long long>(simplified));
+  return 0;
+}